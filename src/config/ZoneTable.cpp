@@ -0,0 +1,107 @@
+#include "ZoneTable.h"
+#include <Preferences.h>
+
+static uint8_t pct_(uint8_t v) { return v > 100 ? 100 : v; }
+
+void ZoneTable::publish_(int idx, const Zone& z) {
+  if (idx < 0 || idx >= MAX_ZONES) return;
+  z_[idx].publish(z);
+  ver_.fetch_add(1, std::memory_order_release);
+}
+
+void ZoneTable::load() {
+  Preferences p;
+  const bool ok = p.begin(ns_, /*ro*/ true);
+  for (int i = 0; i < MAX_ZONES; ++i) {
+    Zone z;
+    if (ok) {
+      z.volumeMl = p.getUInt (key_(i, "vol").c_str(),  0);
+      z.timeMs   = p.getUInt (key_(i, "time").c_str(), 0);
+      z.fert1Pct = pct_(p.getUChar(key_(i, "f1").c_str(), 0));
+      z.fert2Pct = pct_(p.getUChar(key_(i, "f2").c_str(), 0));
+    }
+    publish_(i, z);
+  }
+  const int n = ok ? p.getInt("count", 0) : 0;
+  count_.store(n < 0 ? 0 : (n > MAX_ZONES ? MAX_ZONES : n), std::memory_order_release);
+  if (ok) p.end();
+}
+
+bool ZoneTable::save(int idx, const Zone& in) {
+  if (idx < 0 || idx >= MAX_ZONES) return false;
+  Zone z = in;
+  z.fert1Pct = pct_(z.fert1Pct);
+  z.fert2Pct = pct_(z.fert2Pct);
+
+  Preferences p;
+  if (!p.begin(ns_, false)) return false;
+  p.putUInt (key_(idx, "vol").c_str(),  z.volumeMl);
+  p.putUInt (key_(idx, "time").c_str(), z.timeMs);
+  p.putUChar(key_(idx, "f1").c_str(),   z.fert1Pct);
+  p.putUChar(key_(idx, "f2").c_str(),   z.fert2Pct);
+  if (idx + 1 > count()) {
+    p.putInt("count", idx + 1);
+    count_.store(idx + 1, std::memory_order_release);
+  }
+  p.end();
+
+  publish_(idx, z);
+  return true;
+}
+
+bool ZoneTable::erase(int idx) {
+  if (idx < 0 || idx >= MAX_ZONES) return false;
+  Preferences p;
+  if (!p.begin(ns_, false)) return false;
+  p.remove(key_(idx, "vol").c_str());
+  p.remove(key_(idx, "time").c_str());
+  p.remove(key_(idx, "f1").c_str());
+  p.remove(key_(idx, "f2").c_str());
+  p.end();
+
+  publish_(idx, Zone{});
+  return true;
+}
+
+void ZoneTable::compactAfterDelete(int deletedIdx, int newCount) {
+  if (deletedIdx < 0) return;
+  if (newCount > MAX_ZONES - 1) newCount = MAX_ZONES - 1;
+  Preferences p;
+  if (!p.begin(ns_, false)) return;
+
+  // Las entradas siguientes ya están en RAM: se copian sin releer la NVS
+  for (int k = deletedIdx; k < newCount; ++k) {
+    const Zone z = get(k + 1);
+    p.putUInt (key_(k, "vol").c_str(),  z.volumeMl);
+    p.putUInt (key_(k, "time").c_str(), z.timeMs);
+    p.putUChar(key_(k, "f1").c_str(),   z.fert1Pct);
+    p.putUChar(key_(k, "f2").c_str(),   z.fert2Pct);
+    publish_(k, z);
+  }
+
+  p.remove(key_(newCount, "vol").c_str());
+  p.remove(key_(newCount, "time").c_str());
+  p.remove(key_(newCount, "f1").c_str());
+  p.remove(key_(newCount, "f2").c_str());
+  publish_(newCount, Zone{});
+
+  p.putInt("count", newCount);
+  p.end();
+  count_.store(newCount, std::memory_order_release);
+}
+
+void ZoneTable::setCount(int n) {
+  if (n < 0) n = 0;
+  if (n > MAX_ZONES) n = MAX_ZONES;
+  if (n == count()) return;
+  Preferences p;
+  if (!p.begin(ns_, false)) return;
+  p.putInt("count", n);
+  p.end();
+  count_.store(n, std::memory_order_release);
+}
+
+ZoneTable& zoneTable() {
+  static ZoneTable t;
+  return t;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "../core/SeqLock.h"
+
+// ===================== Objetivos por zona (NVS "zones" en RAM) =====================
+// Dueño único de los ZoneParams: se cargan una vez al arrancar y desde ahí la
+// NVS sólo se toca al guardar. Claves: z{i}_vol, z{i}_time, z{i}_f1, z{i}_f2 y
+// "count" (estados con zona).
+//
+// Escritor único: la WebUI (save/remove/setCount), que persiste y publica la
+// entrada en el mismo paso. Lectores sin locks en cualquier core: AutoMode al
+// iniciar cada paso, la Home y el planificador. Cada entrada es un SeqLock
+// propio; version() sube con cada cambio publicado.
+class ZoneTable {
+public:
+  static constexpr int MAX_ZONES = 64;   // = FlowMonitor::MAX_ZONES
+
+  struct Zone {
+    uint32_t volumeMl = 0;
+    uint32_t timeMs   = 0;
+    uint8_t  fert1Pct = 0;   // 0..100
+    uint8_t  fert2Pct = 0;
+  };
+
+  explicit ZoneTable(const char* ns = "zones") : ns_(ns) {}
+
+  // Arranque (o el simulador tras escribir la NVS): relee todo
+  void load();
+
+  // Lectores: zona fuera de rango o sin guardar = ceros
+  Zone     get(int idx) const { return (idx >= 0 && idx < MAX_ZONES) ? z_[idx].read() : Zone{}; }
+  int      count()   const { return count_.load(std::memory_order_acquire); }
+  uint32_t version() const { return ver_.load(std::memory_order_acquire); }
+
+  // Escritor (WebUI): NVS + publicación. idx fuera de 0..MAX_ZONES-1 = false
+  // (la WebUI no ofrece agregar más estados que MAX_ZONES)
+  bool save(int idx, const Zone& z);
+  bool erase(int idx);
+  // Borra la zona idx corriendo las siguientes una posición (quedan newCount)
+  void compactAfterDelete(int deletedIdx, int newCount);
+  // Sólo escribe si cambió (las páginas GET no gastan flash); tope MAX_ZONES
+  void setCount(int n);
+
+private:
+  static String key_(int idx, const char* suffix) { return String("z") + String(idx) + "_" + suffix; }
+  void publish_(int idx, const Zone& z);
+
+  const char*           ns_;
+  SeqLock<Zone>         z_[MAX_ZONES];
+  std::atomic<int>      count_{0};
+  std::atomic<uint32_t> ver_{0};
+};
+
+// Tabla compartida del proyecto
+ZoneTable& zoneTable();
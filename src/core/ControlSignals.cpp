@@ -0,0 +1,39 @@
+#include "ControlSignals.h"
+
+namespace ctl {
+
+static TaskHandle_t          gTask = nullptr;
+static std::atomic<uint8_t>  gOvr{0};   // bit0 = enabled, bit1 = manual
+
+void attachControlTask(TaskHandle_t h) { gTask = h; }
+
+void notify(uint32_t bits) {
+  if (gTask) xTaskNotify(gTask, bits, eSetBits);
+}
+
+void IRAM_ATTR notifyFromIsr(uint32_t bits) {
+  if (!gTask) return;
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(gTask, bits, eSetBits, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+uint32_t wait(uint32_t timeoutMs) {
+  uint32_t bits = 0;
+  TickType_t ticks = (timeoutMs == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+  if (timeoutMs > 0 && ticks == 0) ticks = 1;   // < 1 tick redondearía a no bloquear
+  xTaskNotifyWait(0, UINT32_MAX, &bits, ticks);
+  return bits;
+}
+
+void postModeOverride(bool enabled, bool manual) {
+  gOvr.store((uint8_t)((enabled ? 1 : 0) | (manual ? 2 : 0)), std::memory_order_release);
+  notify(SIG_MODE_CFG);
+}
+
+ModeOverride modeOverride() {
+  const uint8_t v = gOvr.load(std::memory_order_acquire);
+  return ModeOverride{ (v & 1) != 0, (v & 2) != 0 };
+}
+
+} // namespace ctl
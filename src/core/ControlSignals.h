@@ -0,0 +1,41 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// ===================== Señales hacia la tarea de control =====================
+// irrigationTask duerme en xTaskNotifyWait hasta su próximo deadline; cualquier
+// otra tarea (WebUI/MQTT) o ISR (selector físico, umbral PCNT) la despierta con
+// un bit. Los bits se acumulan: varias señales antes de despertar => 1 wake.
+namespace ctl {
+
+enum : uint32_t {
+  SIG_MODE_CFG   = 1u << 0,   // override de modo cambió (WebUI /mode/set)
+  SIG_SWITCH     = 1u << 1,   // flanco del selector físico Manual/Auto (InputService)
+  SIG_FLOW       = 1u << 2,   // umbral de volumen PCNT alcanzado (ISR)
+  SIG_MANUAL_CMD = 1u << 3,   // start/stop manual desde Web
+  SIG_BUTTON     = 1u << 4,   // flanco de botón frontal (InputService)
+  SIG_PROGRAM    = 1u << 5,   // programa/calibración nuevos
+  SIG_ORDER      = 1u << 6,   // orden de riego a demanda encolada (Web/MQTT)
+  SIG_AUTO_CMD   = 1u << 7,   // comando remoto para AutoMode (MQTT stop/run_set)
+};
+
+// La tarea de control se registra al arrancar
+void attachControlTask(TaskHandle_t h);
+
+// Desde tareas
+void notify(uint32_t bits);
+// Desde ISR (IRAM)
+void IRAM_ATTR notifyFromIsr(uint32_t bits);
+
+// Bloquea la tarea de control hasta una señal o timeoutMs. Devuelve los bits.
+// Todo timeoutMs > 0 bloquea al menos un tick.
+uint32_t wait(uint32_t timeoutMs);
+
+// ---- Override de modo publicado por la WebUI (sin releer NVS en el loop) ----
+struct ModeOverride { bool enabled; bool manual; };
+void         postModeOverride(bool enabled, bool manual);   // guarda + SIG_MODE_CFG
+ModeOverride modeOverride();
+
+} // namespace ctl
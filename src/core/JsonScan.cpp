@@ -0,0 +1,155 @@
+#include "JsonScan.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace json {
+
+namespace {
+  // Cursor sobre [p, end): cada lectura deja p justo después de lo consumido
+  struct Cur {
+    const char* p;
+    const char* end;
+
+    void ws() { while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p; }
+    bool eat(char c) { ws(); if (p < end && *p == c) { ++p; return true; } return false; }
+    bool lit(const char* s) {
+      const size_t n = strlen(s);
+      if ((size_t)(end - p) < n || memcmp(p, s, n) != 0) return false;
+      p += n;
+      return true;
+    }
+
+    // Tras la comilla de apertura: hasta la de cierre (los escapes se validan al copiar)
+    bool str(const char*& s, size_t& n) {
+      s = p;
+      while (p < end) {
+        const char c = *p;
+        if (c == '"') { n = (size_t)(p - s); ++p; return true; }
+        if ((unsigned char)c < 0x20) return false;
+        p += (c == '\\') ? 2 : 1;
+      }
+      return false;
+    }
+
+    bool digit() const { return p < end && *p >= '0' && *p <= '9'; }
+    // Al menos un dígito; deja p tras el último
+    bool digits() { if (!digit()) return false; while (digit()) ++p; return true; }
+
+    // Gramática de JSON: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    // (sin ceros a la izquierda ni '.'/exponente vacíos: 01, 1., .5, 1e no pasan)
+    bool num() {
+      if (p < end && *p == '-') ++p;
+      if (p < end && *p == '0') ++p;
+      else if (!digits()) return false;
+      if (p < end && *p == '.') { ++p; if (!digits()) return false; }
+      if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-')) ++p;
+        if (!digits()) return false;
+      }
+      return true;
+    }
+
+    bool value(Value& v, uint8_t depth);
+
+    bool nested(char close, uint8_t depth) {
+      if (depth == 0) return false;
+      if (eat(close)) return true;
+      for (;;) {
+        Value v;
+        if (close == '}') {
+          const char* k; size_t kn;
+          if (!eat('"') || !str(k, kn) || !eat(':')) return false;
+        }
+        if (!value(v, depth - 1)) return false;
+        if (eat(',')) continue;
+        return eat(close);
+      }
+    }
+  };
+
+  bool Cur::value(Value& v, uint8_t depth) {
+    ws();
+    if (p >= end) return false;
+    const char c = *p;
+    v.raw = p;
+    if (c == '"')      { ++p; v.kind = Value::STRING; return str(v.raw, v.len); }
+    if (c == '{')      { ++p; v.kind = Value::NESTED; if (!nested('}', depth)) return false; }
+    else if (c == '[') { ++p; v.kind = Value::NESTED; if (!nested(']', depth)) return false; }
+    else if (lit("true"))  v.kind = Value::BOOL_TRUE;
+    else if (lit("false")) v.kind = Value::BOOL_FALSE;
+    else if (lit("null"))  v.kind = Value::NUL;
+    else if (num())        v.kind = Value::NUMBER;
+    else return false;
+    v.len = (size_t)(p - v.raw);
+    return true;
+  }
+}
+
+bool scanObject(const char* s, size_t n, FieldFn fn, void* ctx, uint8_t maxDepth) {
+  if (!s) return false;
+  Cur c{ s, s + n };
+  if (!c.eat('{')) return false;
+  if (!c.eat('}')) {
+    for (;;) {
+      const char* k; size_t kn;
+      Value v;
+      if (!c.eat('"') || !c.str(k, kn) || !c.eat(':')) return false;
+      if (!c.value(v, maxDepth)) return false;
+      if (fn) fn(ctx, k, kn, v);
+      if (c.eat(',')) continue;
+      if (c.eat('}')) break;
+      return false;
+    }
+  }
+  c.ws();
+  // Se tolera un '\0' final (payloads que lo incluyen)
+  return c.p == c.end || (c.p + 1 == c.end && *c.p == '\0');
+}
+
+bool Value::copyTo(char* dst, size_t cap) const {
+  if (!dst || cap == 0) return false;
+  dst[0] = '\0';
+  if (kind != STRING) return false;
+  size_t o = 0;
+  for (size_t i = 0; i < len; ++i) {
+    char c = raw[i];
+    if (c == '\\' && i + 1 < len) {
+      const char e = raw[++i];
+      switch (e) {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'u': c = '?'; i += (i + 4 < len) ? 4 : len - 1 - i; break;
+        default:  c = e;    break;   // \" \\ \/
+      }
+    }
+    if (o + 1 >= cap) { dst[o] = '\0'; return false; }
+    dst[o++] = c;
+  }
+  dst[o] = '\0';
+  return true;
+}
+
+double Value::number(double def) const {
+  if (kind != NUMBER && kind != STRING) return def;
+  char b[32];
+  if (len == 0 || len >= sizeof(b)) return def;
+  memcpy(b, raw, len);
+  b[len] = '\0';
+  char* e = nullptr;
+  const double d = strtod(b, &e);
+  return (e && *e == '\0') ? d : def;
+}
+
+bool Value::equals(const char* lit) const {
+  return kind == STRING && lit && strlen(lit) == len && memcmp(raw, lit, len) == 0;
+}
+
+bool keyIs(const char* key, size_t keyLen, const char* lit) {
+  return lit && strlen(lit) == keyLen && memcmp(key, lit, keyLen) == 0;
+}
+
+} // namespace json
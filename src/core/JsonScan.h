@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ===================== Escáner JSON de una pasada (sin asignar) =====================
+// Recorre un objeto JSON directamente sobre el buffer recibido (p. ej. la
+// vista de PubSubClient) y entrega cada par clave/valor del primer nivel al
+// callback; quien llama copia sólo lo que le sirve a sus structs de tamaño
+// fijo. Objetos y arrays anidados se validan y se saltan (NESTED).
+//
+// Las vistas (key/raw) apuntan al buffer de entrada: valen mientras él viva.
+namespace json {
+
+struct Value {
+  enum Kind : uint8_t { STRING, NUMBER, BOOL_TRUE, BOOL_FALSE, NUL, NESTED };
+  Kind        kind = NUL;
+  const char* raw  = nullptr;   // STRING: sin comillas, escapes sin decodificar
+  size_t      len  = 0;
+
+  // STRING -> dst (decodifica \" \\ \/ \n \t ..., \uXXXX -> '?'), siempre con '\0';
+  // false si no entró entero (queda truncado) o no es STRING
+  bool   copyTo(char* dst, size_t cap) const;
+  // NUMBER (o "123" entre comillas) -> número; def si no lo es
+  double number(double def = 0.0) const;
+  bool   boolean(bool def = false) const { return kind == BOOL_TRUE ? true : kind == BOOL_FALSE ? false : def; }
+  // Comparación exacta de un STRING sin escapes
+  bool   equals(const char* lit) const;
+};
+
+// Clave y valor de un campo del primer nivel
+using FieldFn = void (*)(void* ctx, const char* key, size_t keyLen, const Value& v);
+
+// false si el texto no es un objeto JSON bien formado (o anida más de maxDepth)
+bool scanObject(const char* s, size_t n, FieldFn fn, void* ctx, uint8_t maxDepth = 8);
+
+// Igual, con lambda/functor (sin std::function: no asigna)
+template <typename F>
+bool scanObject(const char* s, size_t n, F&& f, uint8_t maxDepth = 8) {
+  return scanObject(s, n,
+                    [](void* ctx, const char* k, size_t kl, const Value& v) { (*static_cast<F*>(ctx))(k, kl, v); },
+                    &f, maxDepth);
+}
+
+// ¿La clave (vista) es igual a lit?
+bool keyIs(const char* key, size_t keyLen, const char* lit);
+
+} // namespace json
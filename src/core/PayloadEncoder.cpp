@@ -0,0 +1,265 @@
+#include "PayloadEncoder.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace payload {
+
+static const char* const KEY_NAMES[] = {
+  "v", "seq", "event", "at",
+  "window", "name", "start", "end",
+  "state", "volume_ml", "duration_ms", "elapsed_ms",
+  "order", "id", "priority", "queue_ms", "backlog",
+  "handover", "saved_ms", "run_saved_ms",
+  "fert", "pct", "target_ms", "on_ms",
+  "err_ms", "pulses", "jitter_avg_ms", "jitter_max_ms", "saturated",
+  "kind", "line", "rate_lph", "baseline_lph",
+  "kpa", "min_kpa", "hold_ms",
+  "cmd", "status", "reason", "latency_ms", "enabled",
+  "running", "pausing", "remote_run", "step",
+  "state_elapsed_ms", "state_volume_ml", "run_volume_ml", "flow_lph",
+  "flow_alarm", "pressure_alarm", "program_enabled", "next_start",
+  "order_zone", "order_backlog", "manual",
+  "cmd_latency_ms", "cmd_latency_max_ms",
+};
+static_assert(sizeof(KEY_NAMES) / sizeof(KEY_NAMES[0]) == (size_t)Key::COUNT, "KEY_NAMES y Key desalineados");
+
+const char* keyName(Key k) {
+  return (size_t)k < (size_t)Key::COUNT ? KEY_NAMES[(size_t)k] : "";
+}
+
+// Cabecera CBOR (tipo mayor + argumento) en p; devuelve los bytes usados (<= 5)
+static size_t cborHead_(uint8_t* p, uint8_t major, uint32_t v) {
+  const uint8_t m = (uint8_t)(major << 5);
+  if (v < 24)      { p[0] = m | (uint8_t)v; return 1; }
+  if (v <= 0xFF)   { p[0] = m | 24; p[1] = (uint8_t)v; return 2; }
+  if (v <= 0xFFFF) { p[0] = m | 25; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)v; return 3; }
+  p[0] = m | 26;
+  p[1] = (uint8_t)(v >> 24); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 8); p[4] = (uint8_t)v;
+  return 5;
+}
+
+Writer::Writer(Format f, uint8_t* buf, size_t cap) : f_(f), buf_(buf), cap_(cap) {
+  if (!buf_ || cap_ < 2) { err_ = true; return; }
+  buf_[0] = 0;
+}
+
+// ------------------- Bytes -------------------
+void Writer::put_(uint8_t b) {
+  if (err_ || n_ + 1 >= cap_) { err_ = true; return; }
+  buf_[n_++] = b;
+  buf_[n_]   = 0;
+}
+
+void Writer::put_(const void* p, size_t n) {
+  if (err_ || n_ + n >= cap_) { err_ = true; return; }
+  memcpy(buf_ + n_, p, n);
+  n_ += n;
+  buf_[n_] = 0;
+}
+
+void Writer::head_(uint8_t major, uint32_t v) {
+  uint8_t h[5];
+  put_(h, cborHead_(h, major, v));
+}
+
+void Writer::jsonUint_(uint32_t v) {
+  char d[10];
+  size_t i = sizeof(d);
+  do { d[--i] = (char)('0' + v % 10); v /= 10; } while (v);
+  put_(d + i, sizeof(d) - i);
+}
+
+void Writer::jsonStr_(const char* s, size_t n) {
+  put_('"');
+  size_t run = 0;   // tramo sin escapes pendiente de copiar
+  for (size_t i = 0; i < n; ++i) {
+    const uint8_t c = (uint8_t)s[i];
+    if (c >= 0x20 && c != '"' && c != '\\') { run++; continue; }
+    put_(s + i - run, run);
+    run = 0;
+    char e[7];
+    switch (c) {
+      case '"':  put_("\\\"", 2); break;
+      case '\\': put_("\\\\", 2); break;
+      case '\n': put_("\\n", 2);  break;
+      case '\r': put_("\\r", 2);  break;
+      case '\t': put_("\\t", 2);  break;
+      default:   snprintf(e, sizeof(e), "\\u%04x", c); put_(e, 6); break;
+    }
+  }
+  put_(s + n - run, run);
+  put_('"');
+}
+
+// ------------------- Estructura -------------------
+void Writer::key_(Key k) {
+  if (depth_ == 0) {
+    if (n_) err_ = true;               // un solo valor raíz
+    return;
+  }
+  Level& l = lv_[depth_ - 1];
+  if (l.map == (k == Key::NONE)) { err_ = true; return; }   // clave en array / falta en map
+  if (f_ == Format::JSON) {
+    if (l.count) put_(',');
+    if (l.map) {
+      put_('"');
+      const char* name = keyName(k);
+      put_(name, strlen(name));
+      put_("\":", 2);
+    }
+  } else if (l.map) {
+    head_(0, (uint8_t)k);
+  }
+  l.count++;
+}
+
+void Writer::open_(Key k, bool map) {
+  key_(k);
+  if (depth_ >= MAX_DEPTH) { err_ = true; return; }
+  lv_[depth_++] = Level{ (uint16_t)n_, 0, map };
+  if (f_ == Format::JSON) put_(map ? '{' : '[');
+  else                    put_((uint8_t)(map ? 0xA0 : 0x80));   // largo a completar en close_
+}
+
+void Writer::close_(bool map) {
+  if (depth_ == 0 || lv_[depth_ - 1].map != map) { err_ = true; return; }
+  const Level l = lv_[--depth_];
+  if (f_ == Format::JSON) { put_(map ? '}' : ']'); return; }
+  if (err_) return;
+
+  const uint8_t major = map ? 5 : 4;
+  if (l.count < 24) {
+    buf_[l.hdr] = (uint8_t)((major << 5) | l.count);
+  } else if (l.count <= 0xFF) {
+    // Cabecera de 2 bytes: correr el contenido uno
+    if (n_ + 1 >= cap_) { err_ = true; return; }
+    memmove(buf_ + l.hdr + 2, buf_ + l.hdr + 1, n_ - l.hdr - 1);
+    buf_[l.hdr]     = (uint8_t)((major << 5) | 24);
+    buf_[l.hdr + 1] = (uint8_t)l.count;
+    buf_[++n_]      = 0;
+  } else {
+    err_ = true;
+  }
+}
+
+void Writer::beginEvent() {
+  beginMap();
+  u32(Key::V, SCHEMA_VERSION);
+}
+
+void Writer::beginMap(Key k)   { open_(k, true); }
+void Writer::endMap()          { close_(true); }
+void Writer::beginArray(Key k) { open_(k, false); }
+void Writer::endArray()        { close_(false); }
+
+// ------------------- Valores -------------------
+void Writer::str(Key k, const char* s) { str(k, s, s ? strlen(s) : 0); }
+
+void Writer::str(Key k, const char* s, size_t n) {
+  key_(k);
+  if (!s) { s = ""; n = 0; }
+  if (f_ == Format::JSON) { jsonStr_(s, n); return; }
+  head_(3, (uint32_t)n);
+  put_(s, n);
+}
+
+void Writer::u32(Key k, uint32_t v) {
+  key_(k);
+  if (f_ == Format::JSON) jsonUint_(v);
+  else                    head_(0, v);
+}
+
+void Writer::i32(Key k, int32_t v) {
+  key_(k);
+  const uint32_t mag = v < 0 ? (uint32_t)(-(v + 1)) : (uint32_t)v;   // CBOR: -1 - n
+  if (f_ == Format::JSON) {
+    if (v < 0) { put_('-'); jsonUint_(mag + 1); }
+    else       jsonUint_(mag);
+  } else {
+    head_(v < 0 ? 1 : 0, mag);
+  }
+}
+
+void Writer::real(Key k, float v, uint8_t decimals) {
+  key_(k);
+  if (f_ == Format::JSON) {
+    if (!isfinite(v)) { put_("null", 4); return; }
+    char b[24];
+    const int n = snprintf(b, sizeof(b), "%.*f", (int)decimals, (double)v);
+    if (n > 0 && (size_t)n < sizeof(b)) put_(b, (size_t)n);
+    else                                err_ = true;
+    return;
+  }
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  const uint8_t b[5] = { 0xFA, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits };
+  put_(b, sizeof(b));
+}
+
+void Writer::boolean(Key k, bool v) {
+  key_(k);
+  if (f_ == Format::JSON) { if (v) put_("true", 4); else put_("false", 5); }
+  else                    put_((uint8_t)(v ? 0xF5 : 0xF4));
+}
+
+void Writer::time(Key k, time_t epoch) {
+  key_(k);
+  if (f_ == Format::CBOR) {
+    if (epoch <= 0) { put_((uint8_t)0xF6); return; }   // null
+    put_((uint8_t)0xC1);                               // tag 1: epoch
+    head_(0, (uint32_t)epoch);
+    return;
+  }
+  struct tm tm;
+  char b[32];
+  if (epoch <= 0 || !localtime_r(&epoch, &tm)) { put_("\"-\"", 3); return; }
+  const size_t n = strftime(b, sizeof(b), "%Y-%m-%d %H:%M:%S", &tm);
+  put_('"');
+  put_(b, n);
+  put_('"');
+}
+
+String Writer::toString() const {
+  String s;
+  if (!ok()) return s;
+  s.reserve((unsigned)n_);
+  s.concat(reinterpret_cast<const char*>(buf_), (unsigned)n_);
+  return s;
+}
+
+// ------------------- EventOutbox -------------------
+void prependSeq(const String& in, uint32_t seq, String& out) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(in.c_str());
+  const size_t   n = in.length();
+  out = String();
+
+  if (n && p[0] == '{') {
+    char b[24];
+    const int hl = snprintf(b, sizeof(b), "{\"seq\":%lu%s", (unsigned long)seq, n > 2 ? "," : "");
+    out.reserve((unsigned)(n + hl));
+    out.concat(b, (unsigned)hl);
+    out.concat(in.c_str() + 1, (unsigned)(n - 1));
+    return;
+  }
+
+  // Map CBOR: una entrada más (clave SEQ) al frente
+  if (n && (p[0] & 0xE0) == 0xA0) {
+    uint32_t cnt  = p[0] & 0x1F;
+    size_t   skip = 1;
+    if (cnt == 24 && n > 1) { cnt = p[1]; skip = 2; }
+    if (cnt < 0xFF && (p[0] & 0x1F) <= 24) {
+      uint8_t h[12];
+      size_t  hl = cborHead_(h, 5, cnt + 1);
+      hl += cborHead_(h + hl, 0, (uint32_t)Key::SEQ);
+      hl += cborHead_(h + hl, 0, seq);
+      out.reserve((unsigned)(n + hl));
+      out.concat(reinterpret_cast<const char*>(h), (unsigned)hl);
+      out.concat(in.c_str() + skip, (unsigned)(n - skip));
+      return;
+    }
+  }
+  out = in;
+}
+
+} // namespace payload
@@ -0,0 +1,107 @@
+#pragma once
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// ===================== Codificación de eventos / telemetría (JSON o CBOR) =====================
+// Un mismo código arma el mensaje y el formato se elige por tópico: Writer
+// escribe directo en un buffer del llamador (sin String intermedios) y al final
+// se copia una sola vez al payload.
+//
+//   JSON: las claves por nombre, los instantes como "YYYY-MM-DD HH:MM:SS" local
+//         (igual que antes; se agrega "v").
+//   CBOR (RFC 8949): las claves como enteros del esquema (Key, 1 byte las
+//         primeras 24), los instantes como epoch con tag 1, reales float32.
+//
+// Versión de esquema: todo mensaje empieza con v = SCHEMA_VERSION (clave 0).
+// Los números de Key son el contrato con los consumidores: sólo se agregan
+// al final; renombrar o reutilizar uno obliga a subir SCHEMA_VERSION.
+namespace payload {
+
+enum class Format : uint8_t { JSON = 0, CBOR = 1 };
+
+static constexpr uint8_t SCHEMA_VERSION = 1;
+
+enum class Key : uint8_t {
+  V = 0, SEQ = 1, EVENT = 2, AT = 3,
+  WINDOW = 4, NAME = 5, START = 6, END = 7,
+  STATE = 8, VOLUME_ML = 9, DURATION_MS = 10, ELAPSED_MS = 11,
+  ORDER = 12, ID = 13, PRIORITY = 14, QUEUE_MS = 15, BACKLOG = 16,
+  HANDOVER = 17, SAVED_MS = 18, RUN_SAVED_MS = 19,
+  FERT = 20, PCT = 21, TARGET_MS = 22, ON_MS = 23,
+  // Desde aquí, 2 bytes en CBOR
+  ERR_MS = 24, PULSES = 25, JITTER_AVG_MS = 26, JITTER_MAX_MS = 27, SATURATED = 28,
+  KIND = 29, LINE = 30, RATE_LPH = 31, BASELINE_LPH = 32,
+  KPA = 33, MIN_KPA = 34, HOLD_MS = 35,
+  CMD = 36, STATUS = 37, REASON = 38, LATENCY_MS = 39, ENABLED = 40,
+  RUNNING = 41, PAUSING = 42, REMOTE_RUN = 43, STEP = 44,
+  STATE_ELAPSED_MS = 45, STATE_VOLUME_ML = 46, RUN_VOLUME_ML = 47, FLOW_LPH = 48,
+  FLOW_ALARM = 49, PRESSURE_ALARM = 50, PROGRAM_ENABLED = 51, NEXT_START = 52,
+  ORDER_ZONE = 53, ORDER_BACKLOG = 54, MANUAL = 55,
+  CMD_LATENCY_MS = 56, CMD_LATENCY_MAX_MS = 57,
+  COUNT,
+  NONE = 0xFF   // elemento de array (sin clave)
+};
+
+// Nombre JSON de la clave ("" si no existe)
+const char* keyName(Key k);
+
+class Writer {
+public:
+  static constexpr uint8_t MAX_DEPTH = 6;
+
+  // buf vive mientras el Writer; cap incluye el '\0' final que se deja siempre
+  Writer(Format f, uint8_t* buf, size_t cap);
+
+  // Objeto raíz con v = SCHEMA_VERSION ya escrito
+  void beginEvent();
+
+  void beginMap(Key k = Key::NONE);
+  void endMap();
+  void beginArray(Key k = Key::NONE);
+  void endArray();
+
+  void str(Key k, const char* s);
+  void str(Key k, const char* s, size_t n);
+  void str(Key k, const String& s) { str(k, s.c_str(), s.length()); }
+  void u32(Key k, uint32_t v);
+  void i32(Key k, int32_t v);
+  void real(Key k, float v, uint8_t decimals);   // JSON con 'decimals' fijos
+  void boolean(Key k, bool v);
+  void time(Key k, time_t epoch);                // <= 0 = desconocido ("-" / null)
+
+  // false si no entró (o quedó un map/array abierto)
+  bool           ok()     const { return !err_ && depth_ == 0; }
+  size_t         size()   const { return n_; }
+  const uint8_t* data()   const { return buf_; }
+  Format         format() const { return f_; }
+  // Copia al payload de MQTT (binario para CBOR)
+  String         toString() const;
+
+private:
+  struct Level { uint16_t hdr; uint16_t count; bool map; };
+
+  void key_(Key k);
+  void open_(Key k, bool map);
+  void close_(bool map);
+  void put_(uint8_t b);
+  void put_(const void* p, size_t n);
+  void head_(uint8_t major, uint32_t v);    // CBOR
+  void jsonUint_(uint32_t v);
+  void jsonStr_(const char* s, size_t n);
+
+  Format   f_;
+  uint8_t* buf_;
+  size_t   cap_;
+  size_t   n_     = 0;
+  bool     err_   = false;
+  Level    lv_[MAX_DEPTH];
+  uint8_t  depth_ = 0;
+};
+
+// "seq" como primer campo de un evento ya codificado (EventOutbox): JSON que
+// empieza con '{' o map CBOR. Otro payload se copia tal cual.
+void prependSeq(const String& in, uint32_t seq, String& out);
+
+} // namespace payload
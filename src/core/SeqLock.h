@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+// ===================== SeqLock de un escritor / N lectores =====================
+// El escritor (tarea de control) publica una copia completa de T por tick; los
+// lectores (WebUI en el otro core) la copian sin bloquear al escritor. Si la
+// copia se cruzó con una publicación (secuencia impar o distinta), el lector
+// reintenta: nunca ve un estado a medio escribir. El costo del escritor no
+// depende de cuántos lectores haya.
+//
+// Requisitos: T trivialmente copiable; un solo escritor; no usar desde ISR.
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock<T> requiere T trivialmente copiable");
+
+public:
+  // Escritor único
+  void publish(const T& v) {
+    const uint32_t s = seq_.load(std::memory_order_relaxed);
+    seq_.store(s + 1, std::memory_order_relaxed);          // impar: escribiendo
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&data_, &v, sizeof(T));
+    seq_.store(s + 2, std::memory_order_release);          // par: estable
+  }
+
+  // Lectores: copia consistente (reintenta si se cruzó con publish).
+  // versionOut (opcional): número de publicación de la copia devuelta.
+  T read(uint32_t* versionOut = nullptr) const {
+    T out;
+    for (;;) {
+      const uint32_t s1 = seq_.load(std::memory_order_acquire);
+      if (s1 & 1u) continue;
+      memcpy(&out, &data_, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint32_t s2 = seq_.load(std::memory_order_relaxed);
+      if (s1 == s2) { if (versionOut) *versionOut = s1 >> 1; return out; }
+    }
+  }
+
+  // Número de publicaciones (0 = nunca publicado)
+  uint32_t version() const { return seq_.load(std::memory_order_acquire) >> 1; }
+
+private:
+  std::atomic<uint32_t> seq_{0};
+  T                     data_{};
+};
@@ -0,0 +1,88 @@
+#include "EspPcntHal.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <soc/pcnt_struct.h>   // PCNT.int_st / int_raw / int_clr / status_unit
+
+bool EspPcntHal::configure(uint8_t unit, int pin, uint16_t filterTicks, int16_t wrapLimit) {
+  if (unit >= MAX_UNITS || pin < 0 || wrapLimit <= 0) return false;
+
+  pcnt_config_t c = {};
+  c.pulse_gpio_num = pin;
+  c.ctrl_gpio_num  = PCNT_PIN_NOT_USED;
+  c.channel        = PCNT_CHANNEL_0;
+  c.unit           = (pcnt_unit_t)unit;
+  c.pos_mode       = PCNT_COUNT_INC;   // flanco de subida
+  c.neg_mode       = PCNT_COUNT_DIS;
+  c.lctrl_mode     = PCNT_MODE_KEEP;
+  c.hctrl_mode     = PCNT_MODE_KEEP;
+  c.counter_h_lim  = wrapLimit;
+  c.counter_l_lim  = 0;
+  if (pcnt_unit_config(&c) != ESP_OK) return false;
+
+  // Pull-up externo según README: sin pulls internos
+  gpio_pullup_dis((gpio_num_t)pin);
+  gpio_pulldown_dis((gpio_num_t)pin);
+
+  const pcnt_unit_t u = (pcnt_unit_t)unit;
+  pcnt_counter_pause(u);
+  if (filterTicks > 0) {
+    pcnt_set_filter_value(u, filterTicks > 1023 ? 1023 : filterTicks);  // 10 bits
+    pcnt_filter_enable(u);
+  } else {
+    pcnt_filter_disable(u);
+  }
+  pcnt_event_enable(u, PCNT_EVT_H_LIM);
+  pcnt_counter_clear(u);
+  pcnt_intr_enable(u);
+  pcnt_counter_resume(u);
+
+  units_ |= (1u << unit);
+  return true;
+}
+
+bool EspPcntHal::attach(WrapFn onWrap, WrapFn onThreshold, void* arg) {
+  fnWrap_ = onWrap; fnThres_ = onThreshold; fnArg_ = arg;
+  if (isrH_) return true;
+  // ISR propia (no pcnt_isr_service): así contabilizamos el desborde ANTES de
+  // limpiar el flag y wrapPending() nunca pierde la ventana intermedia.
+  return pcnt_isr_register(isr_, this, ESP_INTR_FLAG_IRAM, &isrH_) == ESP_OK;
+}
+
+int16_t EspPcntHal::count(uint8_t unit) const {
+  int16_t v = 0;
+  pcnt_get_counter_value((pcnt_unit_t)unit, &v);
+  return v;
+}
+
+void EspPcntHal::setThreshold(uint8_t unit, int16_t value) {
+  const pcnt_unit_t u = (pcnt_unit_t)unit;
+  if (value <= 0) { pcnt_event_disable(u, PCNT_EVT_THRES_0); return; }
+  pcnt_set_event_value(u, PCNT_EVT_THRES_0, value);
+  pcnt_event_enable(u, PCNT_EVT_THRES_0);
+}
+
+bool EspPcntHal::wrapPending(uint8_t unit) const {
+  // interrupción sin atender Y el último evento fue H_LIM (no el umbral)
+  return (PCNT.int_raw.val & (1u << unit)) != 0 && PCNT.status_unit[unit].h_lim_lat;
+}
+
+void IRAM_ATTR EspPcntHal::isr_(void* arg) {
+  EspPcntHal* self = static_cast<EspPcntHal*>(arg);
+  const uint32_t st = PCNT.int_st.val & self->units_;
+  const uint32_t s  = self->isrSeq_.load(std::memory_order_relaxed);
+  self->isrSeq_.store(s + 1, std::memory_order_relaxed);   // impar: ver total()
+  std::atomic_thread_fence(std::memory_order_release);
+  for (uint8_t u = 0; u < MAX_UNITS; ++u) {
+    if (!(st & (1u << u))) continue;
+    if (PCNT.status_unit[u].h_lim_lat  && self->fnWrap_)  self->fnWrap_(self->fnArg_, u);
+    if (PCNT.status_unit[u].thres0_lat && self->fnThres_) self->fnThres_(self->fnArg_, u);
+  }
+  PCNT.int_clr.val = st;
+  self->isrSeq_.store(s + 2, std::memory_order_release);
+}
+
+PcntHal& defaultPcntHal() {
+  static EspPcntHal hal;
+  return hal;
+}
+#endif
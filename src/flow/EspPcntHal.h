@@ -0,0 +1,32 @@
+#pragma once
+#include "PcntHal.h"
+#include <atomic>
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <driver/pcnt.h>
+
+// PCNT del ESP32 (API legacy de IDF 4.x): un canal por unidad, sólo flancos
+// de subida, filtro de glitches por hardware, evento H_LIM para desbordes y
+// THRES_0 como umbral de despertar.
+class EspPcntHal : public PcntHal {
+public:
+  static constexpr uint8_t MAX_UNITS = 8;
+
+  bool configure(uint8_t unit, int pin, uint16_t filterTicks, int16_t wrapLimit) override;
+  bool attach(WrapFn onWrap, WrapFn onThreshold, void* arg) override;
+  void setThreshold(uint8_t unit, int16_t value) override;
+  int16_t count(uint8_t unit) const override;
+  bool wrapPending(uint8_t unit) const override;
+  uint32_t isrSeq() const override { return isrSeq_.load(std::memory_order_acquire); }
+
+private:
+  static void IRAM_ATTR isr_(void* arg);
+
+  WrapFn             fnWrap_  = nullptr;
+  WrapFn             fnThres_ = nullptr;
+  void*              fnArg_   = nullptr;
+  uint32_t           units_   = 0;        // máscara de unidades configuradas
+  pcnt_isr_handle_t  isrH_    = nullptr;
+  std::atomic<uint32_t> isrSeq_{0};
+};
+#endif
@@ -0,0 +1,171 @@
+#include "FertDoser.h"
+#include <math.h>
+
+void FertDoser::begin() {
+  if (begun_) return;
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    if (pin_[ch] < 0) continue;
+    pinMode(pin_[ch], OUTPUT);
+    write_(ch, false);
+  }
+  begun_ = true;
+}
+
+// ------------------- Corrida de dosis -------------------
+void FertDoser::start(uint32_t nowMs, uint64_t p1, uint64_t p2) {
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    if (ch_[ch].pinOn) write_(ch, false);
+    ch_[ch] = Chan{};
+    ch_[ch].nextPeriodMs = nowMs + PERIOD_MS;   // la 1ª ventana ya tiene agua medida
+  }
+  for (uint8_t i = 0; i < MAX_FEEDS; ++i) feedOn_[i] = false;
+  lastMs_   = nowMs;
+  lastP_[0] = p1;
+  lastP_[1] = p2;
+  running_  = true;
+}
+
+void FertDoser::setFeed(uint8_t slot, const Feed& f) {
+  if (slot >= MAX_FEEDS) return;
+  feed_[slot]   = f;
+  feedOn_[slot] = true;
+}
+
+void FertDoser::clearFeed(uint8_t slot) {
+  if (slot < MAX_FEEDS) feedOn_[slot] = false;
+}
+
+void FertDoser::stop() {
+  const uint32_t now = millis();
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    Chan& c = ch_[ch];
+    if (c.on) { settle_(c, now); c.on = false; }
+    if (c.pinOn) write_(ch, false);
+  }
+  for (uint8_t i = 0; i < MAX_FEEDS; ++i) feedOn_[i] = false;
+  running_ = false;
+}
+
+// ------------------- Control -------------------
+void FertDoser::tick(uint32_t nowMs, uint64_t p1, uint64_t p2) {
+  if (!running_) return;
+
+  // Agua por línea desde el último tick (pulsos crudos si no hay calibración)
+  const uint64_t p[NUM_LINES] = { p1, p2 };
+  float ml[NUM_LINES];
+  for (int l = 0; l < NUM_LINES; ++l) {
+    const float d = (float)(p[l] - lastP_[l]);
+    ml[l]     = (ppm_[l] > 0.f) ? d / ppm_[l] : d;
+    lastP_[l] = p[l];
+  }
+  const uint32_t dt = nowMs - lastMs_;
+  lastMs_ = nowMs;
+
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    Chan& c = ch_[ch];
+    float add = 0.f;
+    for (uint8_t i = 0; i < MAX_FEEDS; ++i) {
+      if (!feedOn_[i] || feed_[i].pct[ch] == 0) continue;
+      const Feed& f = feed_[i];
+      if (f.refLph > 0) {
+        const float water = (f.line < 0) ? ml[0] + ml[1] : ml[f.line];
+        add += water * (float)f.pct[ch] * 36.f / (float)f.refLph;
+      } else {
+        add += (float)dt * (float)f.pct[ch] / 100.f;
+      }
+    }
+    c.targetMs += add;
+    c.creditMs += add;
+    if (c.creditMs > (float)MAX_CREDIT_MS) { c.creditMs = (float)MAX_CREDIT_MS; c.saturated = true; }
+
+    stepChannel_(ch, nowMs);
+  }
+}
+
+void FertDoser::stepChannel_(int ch, uint32_t nowMs) {
+  Chan& c = ch_[ch];
+
+  // Fin de pulso: se descuenta lo realmente encendido (incluye el retraso)
+  if (c.on && (int32_t)(nowMs - c.offDueMs) >= 0) {
+    noteJitter_(c, nowMs - c.offDueMs);
+    settle_(c, nowMs);
+    c.on = false;
+  }
+
+  // Nueva ventana: pulso de min(crédito, ventana)
+  if ((int32_t)(nowMs - c.nextPeriodMs) >= 0) {
+    const uint32_t late = nowMs - c.nextPeriodMs;
+    noteJitter_(c, late);
+    c.nextPeriodMs = (late >= PERIOD_MS) ? nowMs + PERIOD_MS : c.nextPeriodMs + PERIOD_MS;
+
+    if (c.on) settle_(c, nowMs);
+    if (c.creditMs >= (float)MIN_PULSE_MS) {
+      const uint32_t onMs = (c.creditMs >= (float)PERIOD_MS) ? PERIOD_MS : (uint32_t)c.creditMs;
+      if (!c.on) { c.on = true; c.onSinceMs = nowMs; }
+      c.offDueMs = nowMs + onMs;
+    } else {
+      c.on = false;
+    }
+  }
+
+  // Un solo write por cambio real (100 % encadena ventanas sin soltar el relé)
+  if (c.on != c.pinOn) {
+    if (c.on) c.pulses++;
+    write_(ch, c.on);
+  }
+}
+
+void FertDoser::settle_(Chan& c, uint32_t nowMs) {
+  const uint32_t onMs = nowMs - c.onSinceMs;
+  c.deliveredMs += onMs;
+  c.creditMs    -= (float)onMs;
+  c.onSinceMs    = nowMs;
+}
+
+void FertDoser::noteJitter_(Chan& c, uint32_t lateMs) {
+  c.jitterSum += lateMs;
+  c.jitterN++;
+  if (lateMs > c.jitterMax) c.jitterMax = lateMs;
+}
+
+void FertDoser::write_(int ch, bool on) {
+  ch_[ch].pinOn = on;
+  if (pin_[ch] >= 0) digitalWrite(pin_[ch], on ? HIGH : LOW);
+}
+
+uint32_t FertDoser::msUntilNextEdge(uint32_t nowMs) const {
+  if (!running_) return UINT32_MAX;
+  uint32_t wait = UINT32_MAX;
+  auto until = [&](uint32_t deadlineMs) {
+    const int32_t d = (int32_t)(deadlineMs - nowMs);
+    const uint32_t w = d > 0 ? (uint32_t)d : 0;
+    if (w < wait) wait = w;
+  };
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    const Chan& c = ch_[ch];
+    if (c.on) until(c.offDueMs);
+    // Las ventanas sólo importan si algún aporte dosifica este canal
+    bool wanted = false;
+    for (uint8_t i = 0; i < MAX_FEEDS; ++i) wanted |= feedOn_[i] && feed_[i].pct[ch] > 0;
+    if (wanted) until(c.nextPeriodMs);
+  }
+  return wait;
+}
+
+FertDoser::Stats FertDoser::stats(int ch, uint32_t nowMs) const {
+  Stats s;
+  if (ch < 0 || ch >= NUM_CH) return s;
+  const Chan& c = ch_[ch];
+
+  for (uint8_t i = 0; i < MAX_FEEDS; ++i)
+    if (feedOn_[i] && feed_[i].pct[ch] > s.pct) s.pct = feed_[i].pct[ch];
+  s.on          = c.pinOn;
+  s.targetMs    = (uint32_t)lroundf(c.targetMs);
+  s.deliveredMs = c.deliveredMs + (c.on ? nowMs - c.onSinceMs : 0);
+  s.errorMs     = (int32_t)s.deliveredMs - (int32_t)s.targetMs;
+  s.pulses      = c.pulses;
+  s.jitterAvgMs = (uint16_t)(c.jitterN ? c.jitterSum / c.jitterN : 0);
+  s.jitterMaxMs = (uint16_t)(c.jitterMax > 65535 ? 65535 : c.jitterMax);
+  s.saturated   = c.saturated;
+  return s;
+}
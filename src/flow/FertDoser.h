@@ -0,0 +1,103 @@
+#pragma once
+#include <Arduino.h>
+
+// ===================== Fertirriego proporcional al caudal =====================
+// Dos salidas de inyección (Fert1 = TOGGLE_NEXT, Fert2 = AUX_FERT2, ambas relés
+// AH) manejadas con pulsos temporizados dentro de ventanas de PERIOD_MS.
+//
+// Cada mL de agua medido en la línea de la zona genera "crédito" de inyector:
+//   ms_on por mL = pct * 36 / refLph
+// así, al caudal de referencia el ciclo útil es exactamente pct %, y si el
+// caudal sube o baja la dosis lo sigue. Al abrir cada ventana se enciende el
+// inyector por min(crédito, PERIOD_MS); el tiempo real encendido (medido en el
+// flanco de apagado, con el retraso que haya tenido la tarea) se descuenta del
+// crédito. El error acumulado queda acotado a una ventana (salvo saturación:
+// dosis pedida > 100 % del tiempo). Sin caudal de referencia, pct es ciclo útil
+// fijo por tiempo.
+//
+// Pulsos < MIN_PULSE_MS no se dan (el relé/solenoide no los sigue): se acumulan.
+// Sólo la tarea de control lo toca; no asigna memoria.
+class FertDoser {
+public:
+  static constexpr int      NUM_CH        = 2;       // salidas de inyección
+  static constexpr int      NUM_LINES     = 2;       // caudalímetros
+  static constexpr uint8_t  MAX_FEEDS     = 2;       // = ZoneSlot::MAX_ZONES
+  static constexpr uint32_t PERIOD_MS     = 10000;
+  static constexpr uint32_t MIN_PULSE_MS  = 250;
+  static constexpr uint32_t MAX_CREDIT_MS = 2 * PERIOD_MS;
+
+  // Zona que aporta agua: su línea (-1 = suma de ambas), % por canal y caudal
+  // al que pct es ciclo útil exacto (0 = ciclo útil fijo)
+  struct Feed {
+    int8_t   line   = -1;
+    uint8_t  pct[NUM_CH] = { 0, 0 };
+    uint32_t refLph = 0;
+  };
+
+  // Métricas por canal desde el último start()
+  struct Stats {
+    uint8_t  pct         = 0;      // % pedido (máximo entre zonas)
+    bool     on          = false;
+    uint32_t targetMs    = 0;      // tiempo de inyección que correspondía al agua medida
+    uint32_t deliveredMs = 0;      // tiempo realmente encendido
+    int32_t  errorMs     = 0;      // delivered - target
+    uint32_t pulses      = 0;
+    uint16_t jitterAvgMs = 0;      // retraso medio de flancos programados
+    uint16_t jitterMaxMs = 0;
+    bool     saturated   = false;  // el caudal pidió más de 100 % de ciclo útil
+  };
+
+  FertDoser(int pinFert1, int pinFert2) : pin_{ pinFert1, pinFert2 } {}
+
+  void begin();   // idempotente: salidas en OUTPUT y apagadas
+  void setCalibration(float pulsesPerMl1, float pulsesPerMl2) { ppm_[0] = pulsesPerMl1; ppm_[1] = pulsesPerMl2; }
+
+  // Nueva corrida de dosis (paso o slot): crédito y métricas a cero
+  void start(uint32_t nowMs, uint64_t p1, uint64_t p2);
+  void setFeed(uint8_t slot, const Feed& f);
+  void clearFeed(uint8_t slot);
+  // Apaga ambas salidas y olvida zonas y crédito (fin de paso / pausa / modo)
+  void stop();
+  bool active() const { return running_; }
+
+  // Una vez por tick con los totales PCNT: acumula crédito y conmuta salidas
+  void tick(uint32_t nowMs, uint64_t p1, uint64_t p2);
+  // ms hasta el próximo flanco programado; UINT32_MAX = inactivo
+  uint32_t msUntilNextEdge(uint32_t nowMs) const;
+
+  Stats stats(int ch, uint32_t nowMs) const;
+
+private:
+  struct Chan {
+    float    creditMs    = 0.f;
+    float    targetMs    = 0.f;
+    uint32_t deliveredMs = 0;
+    bool     on          = false;   // estado lógico
+    bool     pinOn       = false;   // último nivel escrito
+    uint32_t onSinceMs   = 0;
+    uint32_t offDueMs    = 0;
+    uint32_t nextPeriodMs = 0;
+    uint32_t pulses      = 0;
+    uint32_t jitterSum   = 0;
+    uint32_t jitterN     = 0;
+    uint32_t jitterMax   = 0;
+    bool     saturated   = false;
+  };
+
+  void stepChannel_(int ch, uint32_t nowMs);
+  void settle_(Chan& c, uint32_t nowMs);
+  void write_(int ch, bool on);
+  static void noteJitter_(Chan& c, uint32_t lateMs);
+
+  const int pin_[NUM_CH];
+  float     ppm_[NUM_LINES] = { 1.0f, 1.0f };
+  bool      begun_   = false;
+  bool      running_ = false;
+
+  Feed      feed_[MAX_FEEDS];
+  bool      feedOn_[MAX_FEEDS] = { false, false };
+
+  uint32_t  lastMs_ = 0;
+  uint64_t  lastP_[NUM_LINES] = { 0, 0 };
+  Chan      ch_[NUM_CH];
+};
@@ -0,0 +1,83 @@
+#include "FlowMeterService.h"
+
+bool FlowMeterService::begin(int pinFlow1, int pinFlow2, uint32_t glitchNs) {
+  if (started_) return true;
+
+  uint32_t ticks = (glitchNs * APB_MHZ) / 1000UL;
+  if (ticks > 1023) ticks = 1023;   // registro de filtro de 10 bits
+
+  const int pins[NUM_CH] = { pinFlow1, pinFlow2 };
+  bool ok = true;
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    wraps_[ch].store(0, std::memory_order_relaxed);
+    if (pins[ch] < 0) { unit_[ch] = -1; continue; }
+    if (hal_.configure((uint8_t)ch, pins[ch], (uint16_t)ticks, WRAP_LIMIT)) unit_[ch] = (int8_t)ch;
+    else { unit_[ch] = -1; ok = false; }
+  }
+  ok = hal_.attach(&FlowMeterService::onWrap_, &FlowMeterService::onThreshold_, this) && ok;
+
+  started_ = true;
+  return ok;
+}
+
+int IRAM_ATTR FlowMeterService::chOfUnit_(uint8_t unit) const {
+  for (int ch = 0; ch < NUM_CH; ++ch) if (unit_[ch] == (int8_t)unit) return ch;
+  return -1;
+}
+
+void IRAM_ATTR FlowMeterService::onWrap_(void* arg, uint8_t unit) {
+  FlowMeterService* self = static_cast<FlowMeterService*>(arg);
+  const int ch = self->chOfUnit_(unit);
+  if (ch < 0) return;
+  self->wraps_[ch].fetch_add(1, std::memory_order_release);
+  // Umbral armado más allá de este ciclo: el desborde también despierta
+  if (self->armed_[ch].exchange(false) && self->wakeHook_) self->wakeHook_();
+}
+
+void IRAM_ATTR FlowMeterService::onThreshold_(void* arg, uint8_t unit) {
+  FlowMeterService* self = static_cast<FlowMeterService*>(arg);
+  const int ch = self->chOfUnit_(unit);
+  if (ch < 0) return;
+  if (self->armed_[ch].exchange(false) && self->wakeHook_) self->wakeHook_();
+}
+
+void FlowMeterService::armWake(int ch, uint32_t pulsesFromNow) {
+  if (ch < 0 || ch >= NUM_CH || unit_[ch] < 0) return;
+  const uint8_t u = (uint8_t)unit_[ch];
+  if (pulsesFromNow == 0) pulsesFromNow = 1;
+
+  const int32_t target = (int32_t)hal_.count(u) + (int32_t)(pulsesFromNow > (uint32_t)WRAP_LIMIT ? WRAP_LIMIT : pulsesFromNow);
+  // Si cae en el próximo ciclo, basta con el desborde (ver onWrap_)
+  hal_.setThreshold(u, target < WRAP_LIMIT ? (int16_t)target : (int16_t)0);
+  armed_[ch].store(true);
+}
+
+void FlowMeterService::disarmWake() {
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    if (unit_[ch] < 0) continue;
+    if (armed_[ch].exchange(false)) hal_.setThreshold((uint8_t)unit_[ch], 0);
+  }
+}
+
+uint64_t FlowMeterService::total(int ch) const {
+  if (ch < 0 || ch >= NUM_CH || unit_[ch] < 0) return 0;
+  const uint8_t u = (uint8_t)unit_[ch];
+
+  for (;;) {
+    // ISR en curso: el desborde puede estar contado en wraps_ y aún pendiente
+    const uint32_t s1    = hal_.isrSeq();
+    if (s1 & 1u) continue;
+    const uint32_t w1    = wraps_[ch].load(std::memory_order_acquire);
+    const bool     pend1 = hal_.wrapPending(u);  // desbordó y la ISR aún no corrió
+    const int16_t  cnt   = hal_.count(u);
+    const bool     pend2 = hal_.wrapPending(u);
+    const uint32_t w2    = wraps_[ch].load(std::memory_order_acquire);
+    const uint32_t s2    = hal_.isrSeq();
+    if (s1 != s2 || w1 != w2 || pend1 != pend2) continue;   // ISR o desborde en medio: reintentar
+    const bool pend = pend1;
+
+    uint64_t t = (uint64_t)w1 * (uint64_t)WRAP_LIMIT + (uint64_t)(cnt < 0 ? 0 : cnt);
+    if (pend) t += (uint64_t)WRAP_LIMIT;
+    return t;
+  }
+}
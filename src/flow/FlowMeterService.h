@@ -0,0 +1,60 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "PcntHal.h"
+
+// ===================== Servicio único de caudalímetros =====================
+// Cuenta los pulsos de los dos caudalímetros en unidades PCNT (sin una ISR por
+// pulso ni debounce por software). El hardware filtra glitches y sólo interrumpe
+// al desbordar (cada WRAP_LIMIT pulsos); los totales son de 64 bits y no se
+// reinician nunca: cada modo guarda su propia línea base y resta.
+//
+// Lectura sin locks: (seq ISR, wraps, pendiente, cuenta, pendiente, wraps, seq
+// ISR) y reintento si la ISR o un desborde ocurrieron en medio. Se puede llamar desde cualquier
+// core/tarea (no desde ISR).
+class FlowMeterService {
+public:
+  static constexpr int     NUM_CH     = 2;
+  static constexpr int16_t WRAP_LIMIT = 30000;
+
+  using WakeHook = void (*)();   // se llama desde ISR (debe ser IRAM)
+
+  explicit FlowMeterService(PcntHal& hal, WakeHook wakeHook = nullptr) : hal_(hal), wakeHook_(wakeHook) {}
+
+  // Idempotente: ambos modos la llaman en su begin(); sólo configura la 1ª vez.
+  // glitchNs: pulsos más cortos se descartan (máx. ~12.7 µs por hardware).
+  bool begin(int pinFlow1, int pinFlow2, uint32_t glitchNs = DEFAULT_GLITCH_NS);
+  bool started() const { return started_; }
+
+  // Total de pulsos desde el arranque (monótono)
+  uint64_t total(int ch) const;
+  void     totals(uint64_t& t1, uint64_t& t2) const { t1 = total(0); t2 = total(1); }
+
+  // ---- Despertar por volumen ----
+  // La tarea de control arma un umbral "dentro de N pulsos" por canal; al
+  // alcanzarlo (o al desbordar con el umbral armado) la ISR llama al hook.
+  // Es sólo una pista para dormir: quien despierta vuelve a medir y re-arma.
+  void setWakeHook(WakeHook fn) { wakeHook_ = fn; }
+  void armWake(int ch, uint32_t pulsesFromNow);
+  void disarmWake();
+
+  // Métrica: desbordes contabilizados por canal
+  uint32_t wraps(int ch) const { return (ch >= 0 && ch < NUM_CH) ? wraps_[ch].load(std::memory_order_relaxed) : 0; }
+
+  // Llamados por el HAL desde la ISR
+  static void IRAM_ATTR onWrap_(void* arg, uint8_t unit);
+  static void IRAM_ATTR onThreshold_(void* arg, uint8_t unit);
+
+private:
+  static constexpr uint32_t DEFAULT_GLITCH_NS = 12700;
+  static constexpr uint32_t APB_MHZ           = 80;
+
+  PcntHal&              hal_;
+  WakeHook              wakeHook_ = nullptr;
+  bool                  started_ = false;
+  int8_t                unit_[NUM_CH] = { -1, -1 };
+  std::atomic<uint32_t> wraps_[NUM_CH] {};
+  std::atomic<bool>     armed_[NUM_CH] {};
+
+  int chOfUnit_(uint8_t unit) const;
+};
@@ -0,0 +1,195 @@
+#include "FlowMonitor.h"
+#include <stdlib.h>
+
+const char* FlowMonitor::name(Anomaly a) {
+  switch (a) {
+    case Anomaly::NO_FLOW:   return "no_flow";
+    case Anomaly::HIGH_FLOW: return "high_flow";
+    case Anomaly::IDLE_FLOW: return "idle_flow";
+    default:                 return "none";
+  }
+}
+
+FlowMonitor::~FlowMonitor() {
+  for (uint16_t*& r : ring_) { free(r); r = nullptr; }
+}
+
+bool FlowMonitor::begin() {
+  bool ok = true;
+  for (uint16_t*& r : ring_) {
+    if (r) continue;
+    const size_t bytes = sizeof(uint16_t) * RING_SECONDS;
+#if defined(BOARD_HAS_PSRAM)
+    // WROVER/CAM: la historia va a PSRAM; si no arrancó, a la RAM interna
+    r = static_cast<uint16_t*>(ps_malloc(bytes));
+    if (!r) r = static_cast<uint16_t*>(malloc(bytes));
+#else
+    r = static_cast<uint16_t*>(malloc(bytes));
+#endif
+    if (!r) ok = false;
+  }
+  return ok;
+}
+
+// ------------------- Vigilancias -------------------
+void FlowMonitor::watch(uint8_t slot, int zone, int8_t line, uint32_t declaredLph, uint32_t nowMs) {
+  if (slot >= MAX_WATCH) return;
+  Watch& w = w_[slot];
+  w = Watch{};
+  w.active  = true;
+  w.zone    = zone;
+  w.line    = line;
+  w.startMs = nowMs;
+
+  // Sin nada aprendido, el caudal declarado sirve de referencia para NO_FLOW
+  if (zone >= 0 && zone < MAX_ZONES && base_[zone].learned == 0) base_[zone].lph = (float)declaredLph;
+}
+
+void FlowMonitor::unwatch(uint8_t slot, bool learn, uint32_t nowMs) {
+  if (slot >= MAX_WATCH || !w_[slot].active) return;
+  Watch& w = w_[slot];
+
+  const float mean = w.n ? w.sum / (float)w.n : 0.f;
+  if (learn && !w.flagged && w.n >= MIN_LEARN_S && mean >= FLOOR_LPH && w.zone >= 0 && w.zone < MAX_ZONES) {
+    Base& b = base_[w.zone];
+    b.lph = (b.learned == 0) ? mean : b.lph + LEARN * (mean - b.lph);
+    if (b.learned < 255) b.learned++;
+  }
+  w.active = false;
+
+  // Las válvulas recién cerradas drenan: el reposo se vigila tras la gracia
+  idleSinceMs_ = nowMs;
+  idleEwma_    = 0.f;
+  idleStreak_  = 0;
+}
+
+void FlowMonitor::setIdleWatch(bool on, uint32_t nowMs) {
+  if (on == idleOn_) return;
+  idleOn_ = on;
+  if (on) {
+    idleSinceMs_ = nowMs;
+    idleEwma_    = 0.f;
+    idleStreak_  = 0;
+    idleFlagged_ = false;
+  }
+}
+
+// ------------------- Muestreo -------------------
+uint32_t FlowMonitor::msUntilNextSample(uint32_t nowMs) const {
+  if (!synced_) return 0;
+  const uint32_t el = nowMs - lastMs_;
+  return el >= SAMPLE_MS ? 0 : SAMPLE_MS - el;
+}
+
+bool FlowMonitor::poll(uint32_t nowMs, uint64_t p1, uint64_t p2, Alarm& out) {
+  const uint32_t dt = nowMs - lastMs_;
+  if (!synced_ || dt > GAP_MS) {
+    synced_   = true;
+    lastMs_   = nowMs;
+    lastP_[0] = p1;
+    lastP_[1] = p2;
+    return false;
+  }
+  if (dt < SAMPLE_MS) return false;
+
+  // Una muestra por línea con el dt real (el tick puede llegar tarde)
+  const uint64_t p[NUM_LINES] = { p1, p2 };
+  for (int l = 0; l < NUM_LINES; ++l) {
+    const float ml  = (ppm_[l] > 0.f) ? (float)(p[l] - lastP_[l]) / ppm_[l] : (float)(p[l] - lastP_[l]);
+    const float lph = ml * 3600.f / (float)dt;
+    last_[l]  = lph >= 65535.f ? 65535 : (uint16_t)lroundf(lph);
+    lastP_[l] = p[l];
+    if (ring_[l]) ring_[l][head_] = last_[l];
+  }
+  head_ = (uint16_t)((head_ + 1) % RING_SECONDS);
+  if (count_ < RING_SECONDS) count_++;
+  lastMs_ = nowMs;
+
+  // Todas las vigilancias se actualizan; se informa la primera confirmada
+  bool any = false, vigil = false;
+  for (uint8_t s = 0; s < MAX_WATCH; ++s) {
+    if (!w_[s].active) continue;
+    vigil = true;
+    Alarm a;
+    if (evalWatch_(s, nowMs, a) && !any) { out = a; any = true; }
+  }
+  if (!vigil && idleOn_) {
+    Alarm a;
+    if (evalIdle_(nowMs, a) && !any) { out = a; any = true; }
+  }
+  return any;
+}
+
+bool FlowMonitor::evalWatch_(uint8_t slot, uint32_t nowMs, Alarm& out) {
+  Watch& w = w_[slot];
+  const float rate = (float)rateLph(w.line);
+  w.ewma = w.primed ? w.ewma + ALPHA * (rate - w.ewma) : rate;
+  w.primed = true;
+
+  if (nowMs - w.startMs < SETTLE_MS || w.flagged) return false;
+  w.n++;
+  w.sum += rate;
+
+  const Base* b   = (w.zone >= 0 && w.zone < MAX_ZONES) ? &base_[w.zone] : nullptr;
+  const float ref = b ? b->lph : 0.f;
+
+  // Sin referencia (ni declarada ni aprendida) no se juzga: puede no haber caudalímetro
+  Anomaly kind = Anomaly::NONE;
+  if (ref >= FLOOR_LPH && (w.ewma < FLOOR_LPH || w.ewma < ref * LOW_FRAC)) kind = Anomaly::NO_FLOW;
+  else if (b && b->learned > 0 && w.ewma > ref * HIGH_FRAC + FLOOR_LPH) kind = Anomaly::HIGH_FLOW;
+
+  if (kind == Anomaly::NONE) { w.streak = 0; return false; }
+  if (++w.streak < CONFIRM_S) return false;
+
+  w.flagged       = true;
+  out.kind        = kind;
+  out.slot        = (int8_t)slot;
+  out.zone        = w.zone;
+  out.line        = w.line;
+  out.rateLph     = (uint32_t)lroundf(w.ewma);
+  out.baselineLph = (uint32_t)lroundf(ref);
+  return true;
+}
+
+bool FlowMonitor::evalIdle_(uint32_t nowMs, Alarm& out) {
+  const float rate = (float)rateLph(-1);
+  idleEwma_ += ALPHA * (rate - idleEwma_);
+  if (nowMs - idleSinceMs_ < IDLE_GRACE_MS) return false;
+
+  if (idleEwma_ < FLOOR_LPH) { idleStreak_ = 0; idleFlagged_ = false; return false; }
+  if (idleFlagged_ || ++idleStreak_ < CONFIRM_S) return false;
+
+  idleFlagged_    = true;
+  out.kind        = Anomaly::IDLE_FLOW;
+  out.slot        = -1;
+  out.zone        = -1;
+  out.line        = -1;
+  out.rateLph     = (uint32_t)lroundf(idleEwma_);
+  out.baselineLph = 0;
+  return true;
+}
+
+// ------------------- Lecturas -------------------
+uint32_t FlowMonitor::rateLph(int line) const {
+  if (line >= 0 && line < NUM_LINES) return last_[line];
+  return (uint32_t)last_[0] + last_[1];
+}
+
+uint32_t FlowMonitor::baselineLph(int zone) const {
+  return (zone >= 0 && zone < MAX_ZONES) ? (uint32_t)lroundf(base_[zone].lph) : 0;
+}
+
+size_t FlowMonitor::recent(int line, uint16_t* out, size_t n) const {
+  if (!out || n == 0) return 0;
+  const int l0 = (line < 0) ? 0 : line;
+  if (l0 >= NUM_LINES || !ring_[l0] || (line < 0 && !ring_[1])) return 0;
+  if (n > count_) n = count_;
+
+  size_t pos = (head_ + RING_SECONDS - n) % RING_SECONDS;
+  for (size_t i = 0; i < n; ++i) {
+    const uint32_t v = (line < 0) ? (uint32_t)ring_[0][pos] + ring_[1][pos] : ring_[l0][pos];
+    out[i] = v > 65535 ? 65535 : (uint16_t)v;
+    pos = (pos + 1) % RING_SECONDS;
+  }
+  return n;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+
+// ===================== Vigilancia de caudal por segundo (fugas / sin caudal) =====================
+// Cada segundo convierte el delta de pulsos de cada línea en L/h y lo guarda en
+// un anillo fijo por línea (en PSRAM si la placa la tiene). Sobre esas muestras
+// corre un detector incremental por zona vigilada:
+//   - EWMA de la tasa (ALPHA), evaluada tras SETTLE_MS (transición + llenado).
+//   - Línea base por zona (StepSpec::idx) aprendida de los pasos limpios; hasta
+//     aprenderla se usa el flowLph declarado sólo para "sin caudal"; una zona
+//     sin ninguna referencia no se juzga (instalación sin caudalímetro).
+//   - NO_FLOW  : EWMA < LOW_FRAC de la base (o < FLOOR_LPH)  -> válvula trabada / corte.
+//   - HIGH_FLOW: EWMA > HIGH_FRAC de la base aprendida       -> lateral roto / fuga.
+//   - IDLE_FLOW: caudal con todo cerrado (tras IDLE_GRACE_MS) -> fuga aguas arriba.
+// Una anomalía se confirma con CONFIRM_S muestras seguidas y se informa una sola
+// vez por vigilancia. Sin asignaciones fuera de begin(); O(1) por muestra.
+class FlowMonitor {
+public:
+  static constexpr int      NUM_LINES     = 2;      // = FlowMeterService::NUM_CH
+  static constexpr uint8_t  MAX_WATCH     = 2;      // = ZoneSlot::MAX_ZONES
+  static constexpr uint16_t MAX_ZONES     = 64;     // líneas base (por StepSpec::idx)
+  static constexpr uint16_t RING_SECONDS  = 900;    // 15 min de historia por línea
+  static constexpr uint32_t SAMPLE_MS     = 1000;
+  static constexpr uint32_t GAP_MS        = 5000;   // hueco mayor (p.ej. en MANUAL): se resincroniza
+  static constexpr uint32_t SETTLE_MS     = 20000;
+  static constexpr uint32_t IDLE_GRACE_MS = 30000;  // drenado tras cerrar válvulas
+  static constexpr uint8_t  CONFIRM_S     = 5;
+  static constexpr uint16_t MIN_LEARN_S   = 30;     // muestras estables para aprender
+  static constexpr float    ALPHA         = 0.3f;
+  static constexpr float    LEARN         = 0.25f;  // peso de un paso limpio en la base
+  static constexpr float    LOW_FRAC      = 0.25f;
+  static constexpr float    HIGH_FRAC     = 1.5f;
+  static constexpr float    FLOOR_LPH     = 20.f;   // por debajo es "cero"
+
+  enum class Anomaly : uint8_t { NONE, NO_FLOW, HIGH_FLOW, IDLE_FLOW };
+  static const char* name(Anomaly a);
+
+  struct Alarm {
+    Anomaly  kind        = Anomaly::NONE;
+    int8_t   slot        = -1;   // vigilancia (0..MAX_WATCH-1); -1 = reposo
+    int      zone        = -1;   // StepSpec::idx
+    int8_t   line        = -1;   // -1 = suma de ambas
+    uint32_t rateLph     = 0;    // EWMA al confirmar
+    uint32_t baselineLph = 0;    // 0 = sin base
+  };
+
+  ~FlowMonitor();
+
+  // Reserva los anillos (idempotente). false = sin memoria: sigue detectando
+  // con la EWMA, sólo sin historia.
+  bool begin();
+  void setCalibration(float pulsesPerMl1, float pulsesPerMl2) { ppm_[0] = pulsesPerMl1; ppm_[1] = pulsesPerMl2; }
+
+  // Vigilar una zona abierta en 'slot'. line: caudalímetro propio o -1 (suma).
+  void watch(uint8_t slot, int zone, int8_t line, uint32_t declaredLph, uint32_t nowMs);
+  // Fin de la zona; learn: paso completo y limpio -> actualiza su línea base
+  void unwatch(uint8_t slot, bool learn, uint32_t nowMs);
+  void unwatchAll(uint32_t nowMs) { for (uint8_t s = 0; s < MAX_WATCH; ++s) unwatch(s, false, nowMs); }
+  bool watching(uint8_t slot) const { return slot < MAX_WATCH && w_[slot].active; }
+  bool flagged(uint8_t slot)  const { return slot < MAX_WATCH && w_[slot].flagged; }
+
+  // Vigilar caudal en reposo (sólo cuando las válvulas están cerradas por programa)
+  void setIdleWatch(bool on, uint32_t nowMs);
+
+  // Una vez por tick con los totales PCNT: agrega la muestra vencida (si la hay)
+  // y evalúa. true = anomalía recién confirmada en 'out'.
+  bool poll(uint32_t nowMs, uint64_t p1, uint64_t p2, Alarm& out);
+  uint32_t msUntilNextSample(uint32_t nowMs) const;
+  // Tras un hueco sin poll() (otro modo): la próxima llamada sólo toma referencia
+  void resync() { synced_ = false; }
+
+  // Lecturas (tarea de control)
+  uint32_t rateLph(int line) const;                 // última muestra; line -1 = suma
+  uint32_t ewmaLph(uint8_t slot) const { return slot < MAX_WATCH ? (uint32_t)lroundf(w_[slot].ewma) : 0; }
+  uint32_t baselineLph(int zone) const;
+  // Copia las últimas n muestras (L/h, la más antigua primero); devuelve cuántas
+  size_t   recent(int line, uint16_t* out, size_t n) const;
+
+private:
+  struct Watch {
+    bool     active  = false;
+    bool     flagged = false;
+    bool     primed  = false;   // EWMA con al menos una muestra
+    int      zone    = -1;
+    int8_t   line    = -1;
+    uint32_t startMs = 0;
+    float    ewma    = 0.f;
+    uint8_t  streak  = 0;
+    uint32_t n       = 0;      // muestras tras SETTLE_MS (para aprender)
+    float    sum     = 0.f;
+  };
+  struct Base {
+    float   lph     = 0.f;
+    uint8_t learned = 0;       // pasos limpios aprendidos (satura)
+  };
+
+  bool evalWatch_(uint8_t slot, uint32_t nowMs, Alarm& out);
+  bool evalIdle_(uint32_t nowMs, Alarm& out);
+
+  uint16_t* ring_[NUM_LINES] = { nullptr, nullptr };
+  uint16_t  head_   = 0;       // próxima posición a escribir
+  uint16_t  count_  = 0;
+  uint16_t  last_[NUM_LINES] = { 0, 0 };
+
+  float     ppm_[NUM_LINES] = { 1.0f, 1.0f };
+  bool      synced_ = false;
+  uint32_t  lastMs_ = 0;
+  uint64_t  lastP_[NUM_LINES] = { 0, 0 };
+
+  Watch     w_[MAX_WATCH];
+  Base      base_[MAX_ZONES];
+
+  bool      idleOn_     = false;
+  uint32_t  idleSinceMs_ = 0;
+  float     idleEwma_   = 0.f;
+  uint8_t   idleStreak_ = 0;
+  bool      idleFlagged_ = false;
+};
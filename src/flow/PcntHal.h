@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+
+// ===================== Costura HAL del contador de pulsos =====================
+// FlowMeterService sólo habla con esta interfaz. En el ESP32 la implementa
+// EspPcntHal (periférico PCNT); en host se puede sustituir por una versión que
+// inyecte pulsos/desbordes para probar la lógica de conteo sin hardware.
+class PcntHal {
+public:
+  // Callback de desborde/umbral: se llama desde la ISR (debe ser IRAM en el ESP32)
+  // ANTES de reconocer la interrupción, para que wrapPending() sea coherente.
+  using WrapFn = void (*)(void* arg, uint8_t unit);
+
+  virtual ~PcntHal() {}
+
+  // Configura 'unit' contando flancos de subida en 'pin', con filtro de
+  // glitches (en ticks APB) y auto-reinicio a 0 al llegar a wrapLimit.
+  virtual bool configure(uint8_t unit, int pin, uint16_t filterTicks, int16_t wrapLimit) = 0;
+
+  // Instala los manejadores de desborde y de umbral (una vez para todas las unidades)
+  virtual bool attach(WrapFn onWrap, WrapFn onThreshold, void* arg) = 0;
+
+  // Umbral de despertar: interrumpe cuando la cuenta llega a 'value'
+  // (0 < value < wrapLimit). value <= 0 lo desactiva.
+  virtual void setThreshold(uint8_t unit, int16_t value) = 0;
+
+  // Cuenta actual del hardware (0..wrapLimit-1)
+  virtual int16_t count(uint8_t unit) const = 0;
+
+  // true si el hardware ya desbordó pero la ISR aún no lo contabilizó
+  virtual bool wrapPending(uint8_t unit) const = 0;
+
+  // Secuencia de la ISR: impar mientras corre (callbacks -> reconocer), par
+  // fuera. Entre el callback de desborde y el reconocimiento, el desborde ya
+  // está contabilizado y wrapPending() sigue en true: el lector reintenta.
+  virtual uint32_t isrSeq() const = 0;
+};
+
+// Implementación por defecto de la plataforma (EspPcntHal en el ESP32)
+PcntHal& defaultPcntHal();
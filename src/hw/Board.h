@@ -0,0 +1,113 @@
+#pragma once
+#include <Arduino.h>
+
+// ===================== Descripción de placa (compile-time) =====================
+// ÚNICA fuente de verdad del cableado. Todo lo demás (RP::, PinMap, máscaras de
+// registro, tabla de roles de la WebUI) se deriva de aquí en compilación, así los
+// modos, main y la WebUI no pueden divergir.
+//
+// La placa se elige por env de PlatformIO (build_flags en platformio.ini):
+//   -D RIEGO_BOARD_WROVER | -D RIEGO_BOARD_WROOM | -D RIEGO_BOARD_CAM
+// Sin flag => WROVER (placa de referencia del README).
+
+enum class BoardId : uint8_t { WROVER, WROOM, CAM };
+
+#if defined(RIEGO_BOARD_CAM)
+  static constexpr BoardId BOARD_ID = BoardId::CAM;
+#elif defined(RIEGO_BOARD_WROOM)
+  static constexpr BoardId BOARD_ID = BoardId::WROOM;
+#else
+  static constexpr BoardId BOARD_ID = BoardId::WROVER;
+#endif
+
+// ---------- Cableado del tablero de riego (orden y niveles EXACTOS al README) ----------
+struct RiegoWiring {
+  // Pines de control del banco
+  static constexpr int PIN_ALWAYS_ON    = 33;  // Master banco (AH)
+  static constexpr int PIN_ALWAYS_ON_12 = 12;  // Válvula principal (AH)
+
+  // Salidas auxiliares
+  static constexpr int PIN_TOGGLE_NEXT  = 25;  // Fertilizante 1 (AH)
+  static constexpr int PIN_TOGGLE_PREV  = 14;  // Alarma (AH)
+  static constexpr int PIN_AUX_FERT2    = 32;  // Fertilizante 2 (AH)
+
+  // Caudalímetros / sensores (pull-up externo)
+  static constexpr int PIN_FLOW_1  = 34;
+  static constexpr int PIN_FLOW_2  = 35;
+  static constexpr int PIN_FLOW_VP = 36;
+  static constexpr int PIN_FLOW_VN = 39;
+
+  // Selector físico Manual/Auto: HIGH = MANUAL, LOW = AUTO
+  static constexpr int PIN_SWITCH_MANUAL = 19;
+
+  // Botones frontales (pull-down -> activo HIGH al presionar)
+  static constexpr int PIN_NEXT = 13;  // Stop (NC en README)
+  static constexpr int PIN_PREV = 4;   // Botón verde (NO)
+
+  // MAIN (negativa: LOW = ON)
+  static constexpr int  MAIN_PINS[]       = { 0, 2, 5, 15, 16, 17, 1, 3, 18, 21, 22, 23 };
+  static constexpr bool MAIN_ACTIVE_LOW[] = { 1, 1, 1,  1,  1,  1, 1, 1,  1,  1,  1,  1 };
+
+  // SEC (positiva: HIGH = ON)
+  static constexpr int  SEC_PINS[]        = { 26, 27 };
+  static constexpr bool SEC_ACTIVE_LOW[]  = { 0, 0 };
+};
+
+// Una especialización por placa. Hoy las tres comparten el tablero; si alguna
+// cambia, se especializa aquí (p.ej. ESP32-CAM con menos GPIO libres).
+template<BoardId B> struct BoardDesc;
+template<> struct BoardDesc<BoardId::WROVER> : RiegoWiring {};
+template<> struct BoardDesc<BoardId::WROOM>  : RiegoWiring {};
+template<> struct BoardDesc<BoardId::CAM>    : RiegoWiring {};
+
+using Board = BoardDesc<BOARD_ID>;
+
+// ---------- Validaciones en compilación ----------
+namespace board_detail {
+  template<size_t N> constexpr int countOf(const int (&)[N]) { return (int)N; }
+
+  constexpr bool isFlashPin(int p) { return p >= 6 && p <= 11; }
+
+  // Todos los pines usados por el proyecto, en el orden de la tabla GPIO de la WebUI
+  constexpr int NUM_MAINS = countOf(Board::MAIN_PINS);
+  constexpr int NUM_SECS  = countOf(Board::SEC_PINS);
+  constexpr int NUM_EXTRA = 12;
+  constexpr int NUM_USED  = NUM_MAINS + NUM_SECS + NUM_EXTRA;
+
+  struct PinList { int pin[NUM_USED]; };
+
+  constexpr PinList usedPins() {
+    PinList l{};
+    int k = 0;
+    for (int i=0;i<NUM_MAINS;i++) l.pin[k++] = Board::MAIN_PINS[i];
+    for (int j=0;j<NUM_SECS;j++)  l.pin[k++] = Board::SEC_PINS[j];
+    const int extras[NUM_EXTRA] = {
+      Board::PIN_ALWAYS_ON, Board::PIN_ALWAYS_ON_12, Board::PIN_TOGGLE_NEXT, Board::PIN_TOGGLE_PREV,
+      Board::PIN_AUX_FERT2, Board::PIN_FLOW_1, Board::PIN_FLOW_2, Board::PIN_FLOW_VP, Board::PIN_FLOW_VN,
+      Board::PIN_SWITCH_MANUAL, Board::PIN_NEXT, Board::PIN_PREV
+    };
+    for (int e=0;e<NUM_EXTRA;e++) l.pin[k++] = extras[e];
+    return l;
+  }
+
+  constexpr bool pinsUniqueAndValid() {
+    const PinList l = usedPins();
+    for (int a=0;a<NUM_USED;a++) {
+      const int p = l.pin[a];
+      if (p < 0) continue;
+      if (p >= 40 || isFlashPin(p)) return false;
+      for (int b=a+1;b<NUM_USED;b++) if (l.pin[b] == p) return false;
+    }
+    return true;
+  }
+
+  constexpr bool sameLen(size_t a, size_t b) { return a == b; }
+}
+
+static_assert(board_detail::NUM_MAINS <= 16, "applyMask usa uint16_t para MAIN");
+static_assert(board_detail::NUM_SECS  <= 16, "applyMask usa uint16_t para SEC");
+static_assert(board_detail::sameLen(sizeof(Board::MAIN_PINS)/sizeof(int), sizeof(Board::MAIN_ACTIVE_LOW)/sizeof(bool)),
+              "MAIN_PINS y MAIN_ACTIVE_LOW deben tener el mismo largo");
+static_assert(board_detail::sameLen(sizeof(Board::SEC_PINS)/sizeof(int), sizeof(Board::SEC_ACTIVE_LOW)/sizeof(bool)),
+              "SEC_PINS y SEC_ACTIVE_LOW deben tener el mismo largo");
+static_assert(board_detail::pinsUniqueAndValid(), "Pin repetido, fuera de rango o del flash (6..11) en Board.h");
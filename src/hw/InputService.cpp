@@ -0,0 +1,120 @@
+#include "InputService.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+  #include <esp_timer.h>
+  #include <soc/gpio_reg.h>   // GPIO_IN_REG / GPIO_IN1_REG
+#endif
+
+InputService::InputService(const Spec* specs, uint8_t n, WakeHook wake)
+: specs_(specs), n_(n > MAX_INPUTS ? MAX_INPUTS : n), wake_(wake) {}
+
+#if defined(ARDUINO_ARCH_ESP32)
+static void scanTimer_(void* arg) {
+  static_cast<InputService*>(arg)->scanNow(millis());
+}
+#endif
+
+bool InputService::begin() {
+  if (begun_) return true;
+  for (uint8_t i = 0; i < n_; ++i) {
+    const Spec& s = specs_[i];
+    if (s.pin < 0) continue;
+    pinMode(s.pin, s.mode);
+    hi_[i]  = s.pin >= 32;
+    bit_[i] = 1u << (s.pin & 31);
+  }
+
+  // Estado inicial = lo que hay ahora (el selector arranca donde esté)
+  state_ = sampleRaw_();
+  c0_ = c1_ = c2_ = 0;
+  stable_.store(state_, std::memory_order_release);
+  begun_ = true;
+
+#if defined(ARDUINO_ARCH_ESP32)
+  esp_timer_create_args_t args = {};
+  args.callback        = scanTimer_;
+  args.arg             = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name            = "inputs";
+  esp_timer_handle_t h = nullptr;
+  if (esp_timer_create(&args, &h) != ESP_OK) return false;
+  return esp_timer_start_periodic(h, SCAN_MS * 1000ULL) == ESP_OK;
+#else
+  return true;
+#endif
+}
+
+uint32_t InputService::sampleRaw_() const {
+#if defined(ARDUINO_ARCH_ESP32)
+  const uint32_t in0 = REG_READ(GPIO_IN_REG);
+  const uint32_t in1 = REG_READ(GPIO_IN1_REG);
+#endif
+  uint32_t raw = 0;
+  for (uint8_t i = 0; i < n_; ++i) {
+    if (specs_[i].pin < 0) continue;
+#if defined(ARDUINO_ARCH_ESP32)
+    const bool high = ((hi_[i] ? in1 : in0) & bit_[i]) != 0;
+#else
+    const bool high = digitalRead(specs_[i].pin) == HIGH;
+#endif
+    if (high == specs_[i].activeHigh) raw |= 1u << i;
+  }
+  return raw;
+}
+
+void InputService::scan(uint32_t raw, uint32_t nowMs) {
+  // Contador vertical de 3 bits: +1 donde la muestra difiere del estado,
+  // 0 donde coincide; al dar la vuelta (8 seguidas) la entrada cambia
+  const uint32_t delta = raw ^ state_;
+  c2_ = (c2_ ^ (c1_ & c0_)) & delta;
+  c1_ = (c1_ ^ c0_) & delta;
+  c0_ = ~c0_ & delta;
+  const uint32_t toggled = delta & ~(c0_ | c1_ | c2_);
+
+  pending_ = 0;
+  if (toggled) {
+    state_ ^= toggled;
+    stable_.store(state_, std::memory_order_release);
+  }
+
+  for (uint8_t i = 0; i < n_; ++i) {
+    const uint32_t b = 1u << i;
+    if (toggled & b) {
+      const bool on = (state_ & b) != 0;
+      push_(i, on ? Kind::PRESS : Kind::RELEASE, nowMs);
+      heldScans_[i] = 0;
+      longMask_    &= ~b;
+    }
+    // Pulsación larga: se cuenta en muestras (misma base de tiempo que el debounce)
+    if ((state_ & b) && specs_[i].longPressMs && !(longMask_ & b)) {
+      if (++heldScans_[i] * SCAN_MS >= specs_[i].longPressMs) {
+        longMask_ |= b;
+        push_(i, Kind::LONG, nowMs);
+      }
+    }
+  }
+
+  if (pending_ && wake_) wake_(pending_);
+}
+
+void InputService::push_(uint8_t input, Kind kind, uint32_t nowMs) {
+  const uint8_t h = head_.load(std::memory_order_relaxed);
+  const uint8_t next = (uint8_t)((h + 1) & (QUEUE_LEN - 1));
+  if (next == tail_.load(std::memory_order_acquire)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  q_[h].input = input;
+  q_[h].kind  = kind;
+  q_[h].atMs  = nowMs;
+  head_.store(next, std::memory_order_release);
+  pending_ |= 1u << input;
+}
+
+bool InputService::pop(Event& out) {
+  const uint8_t t = tail_.load(std::memory_order_relaxed);
+  if (t == head_.load(std::memory_order_acquire)) return false;
+  out = q_[t];
+  tail_.store((uint8_t)((t + 1) & (QUEUE_LEN - 1)), std::memory_order_release);
+  return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+
+// ===================== Entradas digitales: muestreo fijo + debounce vertical =====================
+// Un solo muestreo periódico (cada SCAN_MS, esp_timer) lee TODAS las entradas de
+// una vez (GPIO_IN/GPIO_IN1) y las filtra en paralelo con un contador vertical
+// de 3 bits: cada entrada es un bit de tres palabras, y un cambio sólo se acepta
+// tras STABLE_SCANS muestras seguidas distintas del estado actual. La latencia
+// de un flanco es entonces fija: STABLE_SCANS * SCAN_MS.
+//
+// Los flancos aceptados (y la pulsación larga) van a una cola SPSC sin locks:
+// productor = el timer, consumidor = irrigationTask (modesPollCommands). El
+// hook de despertar avisa a la tarea de control cuando hay eventos.
+//
+// Nadie más hace pinMode sobre estas entradas: begin() las configura una vez.
+class InputService {
+public:
+  static constexpr uint8_t  MAX_INPUTS   = 8;
+  static constexpr uint32_t SCAN_MS      = 10;
+  static constexpr uint8_t  STABLE_SCANS = 8;    // 3 bits de contador -> 80 ms
+  static constexpr uint8_t  QUEUE_LEN    = 16;   // potencia de 2
+
+  // Una entrada: pin, pull y pulsación larga (0 = sin evento LONG)
+  struct Spec {
+    int      pin;
+    uint8_t  mode;           // INPUT / INPUT_PULLUP / INPUT_PULLDOWN
+    bool     activeHigh;
+    uint32_t longPressMs;
+  };
+
+  enum class Kind : uint8_t { PRESS, RELEASE, LONG };
+  struct Event {
+    uint8_t  input = 0;      // índice en la tabla de Spec
+    Kind     kind  = Kind::PRESS;
+    uint32_t atMs  = 0;
+  };
+
+  // Desde el contexto del timer (no ISR): máscara de entradas con eventos nuevos
+  using WakeHook = void (*)(uint32_t inputsMask);
+
+  InputService(const Spec* specs, uint8_t n, WakeHook wake = nullptr);
+
+  // Configura los pines, toma el estado inicial (sin eventos) y arranca el
+  // timer. Idempotente.
+  bool begin();
+
+  // Un muestreo: lo llama el timer; en host, el simulador cada SCAN_MS
+  void scanNow(uint32_t nowMs) { scan(sampleRaw_(), nowMs); }
+  // Núcleo puro: raw = bit i activo (ya con la polaridad aplicada)
+  void scan(uint32_t raw, uint32_t nowMs);
+
+  // Consumidor único
+  bool pop(Event& out);
+
+  // Estado filtrado (cualquier core)
+  bool     active(uint8_t input) const { return (stable_.load(std::memory_order_acquire) >> input) & 1u; }
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  uint32_t sampleRaw_() const;
+  void     push_(uint8_t input, Kind kind, uint32_t nowMs);
+
+  const Spec* specs_;
+  const uint8_t n_;
+  WakeHook    wake_;
+  bool        begun_ = false;
+
+  // Máscaras de registro por entrada (banco 0: GPIO 0..31, banco 1: 32..39)
+  uint32_t    bit_[MAX_INPUTS]  = {};
+  bool        hi_[MAX_INPUTS]   = {};
+
+  // Contador vertical: bit i de (c2_,c1_,c0_) = muestras distintas seguidas de la entrada i
+  uint32_t    state_ = 0, c0_ = 0, c1_ = 0, c2_ = 0;
+  uint32_t    heldScans_[MAX_INPUTS] = {};   // muestras activas seguidas (pulsación larga)
+  uint32_t    longMask_ = 0;                 // LONG ya emitido en esta pulsación
+  std::atomic<uint32_t> stable_{0};
+
+  Event                 q_[QUEUE_LEN];
+  std::atomic<uint8_t>  head_{0};   // escribe el productor
+  std::atomic<uint8_t>  tail_{0};   // escribe el consumidor
+  std::atomic<uint32_t> dropped_{0};
+  uint32_t              pending_ = 0;   // entradas con eventos en este scan (para el hook)
+};
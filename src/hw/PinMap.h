@@ -19,3 +19,32 @@ struct PinMap {
   int pinToggleNext;     // salida auxiliar (NEXT long press)
   int pinTogglePrev;     // salida auxiliar (PREV long press)
 };
+
+// Máscaras de registro derivadas de un PinMap (espacio de 64 pines:
+// bits 0..31 -> GPIO_OUT, bits 32..39 -> GPIO_OUT1). constexpr: con un PinMap
+// constexpr (ver Board.h) se calculan en compilación.
+struct RelayMasks {
+  uint64_t mainsScope  = 0;   // todos los pines MAIN
+  uint64_t secsScope   = 0;   // todos los pines SEC
+  uint64_t alwaysBit   = 0;
+  uint64_t always12Bit = 0;
+  uint64_t activeLow   = 0;   // pines cuya lógica ON es LOW
+};
+
+constexpr uint64_t pinBit64(int pin) { return (pin >= 0 && pin < 64) ? (1ULL << pin) : 0; }
+
+constexpr RelayMasks relayMasksOf(const PinMap& m) {
+  RelayMasks r{};
+  for (int i=0;i<m.numMains;i++) {
+    r.mainsScope |= pinBit64(m.mainPins[i]);
+    if (m.mainActiveLow[i]) r.activeLow |= pinBit64(m.mainPins[i]);
+  }
+  for (int j=0;j<m.numSecs;j++) {
+    r.secsScope |= pinBit64(m.secPins[j]);
+    if (m.secActiveLow[j]) r.activeLow |= pinBit64(m.secPins[j]);
+  }
+  // always/always12 son activo-alto
+  r.alwaysBit   = pinBit64(m.pinAlwaysOn);
+  r.always12Bit = pinBit64(m.pinAlwaysOn12);
+  return r;
+}
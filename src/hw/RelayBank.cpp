@@ -1,2 +1,26 @@
 #include "RelayBank.h"
-// Todo en header (simple). Archivo para mantener estructura SOLID.
+
+#include <soc/gpio_reg.h>   // GPIO_OUT(1)_W1TS/W1TC_REG (host: native/hal)
+
+void RelayBank::commit_(uint64_t scope, uint64_t onBits) const {
+  // Nivel HIGH = ON en activo-alto, OFF en activo-bajo
+  const uint64_t high = (onBits ^ k_.activeLow) & scope;
+  const uint64_t low  = scope & ~high;
+
+  const uint32_t set0 = (uint32_t)high, clr0 = (uint32_t)low;
+  const uint32_t set1 = (uint32_t)(high >> 32), clr1 = (uint32_t)(low >> 32);
+  if (set0) REG_WRITE(GPIO_OUT_W1TS_REG,  set0);
+  if (clr0) REG_WRITE(GPIO_OUT_W1TC_REG,  clr0);
+  if (set1) REG_WRITE(GPIO_OUT1_W1TS_REG, set1);
+  if (clr1) REG_WRITE(GPIO_OUT1_W1TC_REG, clr1);
+}
+
+void RelayBank::applyMask(uint16_t mainsMask, uint16_t secsMask, bool always, bool always12) {
+  uint64_t on = 0;
+  for (int i=0;i<m_.numMains;i++) if (mainsMask & (1u<<i)) on |= pinBit64(m_.mainPins[i]);
+  for (int j=0;j<m_.numSecs;j++)  if (secsMask  & (1u<<j)) on |= pinBit64(m_.secPins[j]);
+  if (always)   on |= k_.alwaysBit;
+  if (always12) on |= k_.always12Bit;
+
+  commit_(k_.mainsScope | k_.secsScope | k_.alwaysBit | k_.always12Bit, on);
+}
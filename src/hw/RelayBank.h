@@ -3,9 +3,23 @@
 
 class RelayBank {
 public:
-  explicit RelayBank(const PinMap& map) : m_(map) {}
+  explicit RelayBank(const PinMap& map) : m_(map), k_(relayMasksOf(map)) {}
+  // Con máscaras ya calculadas en compilación (Board.h: RP::RELAY_MASKS)
+  RelayBank(const PinMap& map, const RelayMasks& masks) : m_(map), k_(masks) {}
 
-  void begin() {
+  int numMains() const { return m_.numMains; }
+  int numSecs()  const { return m_.numSecs; }
+
+  // safeBootMs > 0: primero deja las salidas de relés en INPUT_PULLUP ese tiempo
+  // (evita pulsos espurios al arrancar) y luego las configura como OUTPUT.
+  void begin(unsigned long safeBootMs = 0) {
+    if (safeBootMs > 0) {
+      for (int i=0;i<m_.numMains;i++) pinMode(m_.mainPins[i], INPUT_PULLUP);
+      for (int j=0;j<m_.numSecs;j++)  pinMode(m_.secPins[j],  INPUT_PULLUP);
+      if (m_.pinAlwaysOn   >= 0) pinMode(m_.pinAlwaysOn,   INPUT_PULLUP);
+      if (m_.pinAlwaysOn12 >= 0) pinMode(m_.pinAlwaysOn12, INPUT_PULLUP);
+      delay(safeBootMs);
+    }
     if (m_.pinAlwaysOn >= 0)       pinMode(m_.pinAlwaysOn, OUTPUT);
     if (m_.pinAlwaysOn12 >= 0)     pinMode(m_.pinAlwaysOn12, OUTPUT);
     if (m_.pinToggleNext >= 0)     pinMode(m_.pinToggleNext, OUTPUT);
@@ -20,12 +34,8 @@ public:
     setTogglePrev(false);
   }
 
-  void allMainsOff() {
-    for (int i=0;i<m_.numMains;i++) digitalWrite(m_.mainPins[i], m_.mainActiveLow[i] ? HIGH : LOW);
-  }
-  void allSecsOff() {
-    for (int j=0;j<m_.numSecs;j++) digitalWrite(m_.secPins[j], m_.secActiveLow[j] ? HIGH : LOW);
-  }
+  void allMainsOff() { commit_(k_.mainsScope, 0); }
+  void allSecsOff()  { commit_(k_.secsScope,  0); }
 
   void setAlways(bool on)    { if (m_.pinAlwaysOn   >=0) digitalWrite(m_.pinAlwaysOn,   on ? HIGH : LOW); }
   void setAlways12(bool on)  { if (m_.pinAlwaysOn12 >=0) digitalWrite(m_.pinAlwaysOn12, on ? HIGH : LOW); }
@@ -34,31 +44,30 @@ public:
 
   // Aplica un “patrón” de MAIN: directo = solo 'm' encendida; complementario = todas menos 'm'
   void applyMainsPattern(int m, bool direct) {
-    for (int i=0;i<m_.numMains;i++) {
-      bool turnOn = direct ? (i == m) : (i != m);
-      digitalWrite(m_.mainPins[i],
-        m_.mainActiveLow[i]
-          ? (turnOn ? LOW  : HIGH)
-          : (turnOn ? HIGH : LOW));
-    }
+    const uint64_t bm = mainBit_(m);
+    commit_(k_.mainsScope, direct ? bm : (k_.mainsScope & ~bm));
   }
 
   // Enciende un main específico DIRECTO (solo ese), helper
-  void setMainDirect(int m) {
-    for (int i=0;i<m_.numMains;i++) {
-      bool turnOn = (i==m);
-      digitalWrite(m_.mainPins[i],
-        m_.mainActiveLow[i] ? (turnOn?LOW:HIGH) : (turnOn?HIGH:LOW));
-    }
-  }
+  void setMainDirect(int m) { commit_(k_.mainsScope, mainBit_(m)); }
 
   // Enciende un sec específico
   void setSec(int idx, bool on) {
     if (idx < 0 || idx >= m_.numSecs) return;
-    digitalWrite(m_.secPins[idx],
-      m_.secActiveLow[idx] ? (on?LOW:HIGH) : (on?HIGH:LOW));
+    const uint64_t b = pinBit64(m_.secPins[idx]);
+    commit_(b, on ? b : 0);
   }
 
+  // Aplica el patrón COMPLETO (mains + secs + always/always12) de una sola vez:
+  // a lo sumo un W1TS + un W1TC por banco GPIO, sin combinaciones intermedias.
+  void applyMask(uint16_t mainsMask, uint16_t secsMask, bool always, bool always12);
+
 private:
-  const PinMap& m_;
+  uint64_t mainBit_(int m) const { return (m >= 0 && m < m_.numMains) ? pinBit64(m_.mainPins[m]) : 0; }
+
+  // Escribe 'onBits' dentro de 'scope' respetando ActiveLow (ON -> LOW si AL)
+  void commit_(uint64_t scope, uint64_t onBits) const;
+
+  const PinMap&    m_;
+  const RelayMasks k_;   // máscaras de registro derivadas del PinMap
 };
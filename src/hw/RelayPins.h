@@ -1,42 +1,133 @@
 #pragma once
 #include <Arduino.h>
+#include "Board.h"
+#include "PinMap.h"
 
+// Vista del proyecto sobre la placa seleccionada (Board.h). Nada de esto se
+// edita a mano: todo se deriva en compilación de Board.
 namespace RP {
 
 // ========================== Pines de control del banco ==========================
-static constexpr int PIN_ALWAYS_ON    = 33;  // Master banco (AH)
-static constexpr int PIN_ALWAYS_ON_12 = 12;  // Válvula principal (AH)
+static constexpr int PIN_ALWAYS_ON    = Board::PIN_ALWAYS_ON;
+static constexpr int PIN_ALWAYS_ON_12 = Board::PIN_ALWAYS_ON_12;
 
-// Salidas auxiliares (según README)
-static constexpr int PIN_TOGGLE_NEXT  = 25;  // Fertilizante 1 (AH)
-static constexpr int PIN_TOGGLE_PREV  = 14;  // Alarma (AH)
-static constexpr int PIN_AUX_FERT2    = 32;  // Fertilizante 2 (AH)
+// Salidas auxiliares
+static constexpr int PIN_TOGGLE_NEXT  = Board::PIN_TOGGLE_NEXT;  // Fertilizante 1
+static constexpr int PIN_TOGGLE_PREV  = Board::PIN_TOGGLE_PREV;  // Alarma
+static constexpr int PIN_AUX_FERT2    = Board::PIN_AUX_FERT2;    // Fertilizante 2
 
 // ========================== Pines de caudalímetros / sensores ==================
-static constexpr int PIN_FLOW_1  = 34; // Pull-up externo
-static constexpr int PIN_FLOW_2  = 35; // Pull-up externo
-static constexpr int PIN_FLOW_VP = 36; // Pull-up externo
-static constexpr int PIN_FLOW_VN = 39; // Pull-up externo
+static constexpr int PIN_FLOW_1  = Board::PIN_FLOW_1;
+static constexpr int PIN_FLOW_2  = Board::PIN_FLOW_2;
+static constexpr int PIN_FLOW_VP = Board::PIN_FLOW_VP;
+static constexpr int PIN_FLOW_VN = Board::PIN_FLOW_VN;
 
 // ========================== Selector físico Manual/Auto ========================
 // HIGH = MANUAL, LOW = AUTO
-static constexpr int PIN_SWITCH_MANUAL = 19;
+static constexpr int PIN_SWITCH_MANUAL = Board::PIN_SWITCH_MANUAL;
 
 // ========================== Banco de relés: MAIN y SEC =========================
-// Orden y niveles exactamente como el README
-// MAIN (negativa: LOW = ON)
-static const int  MAIN_PINS[]       = { 0, 2, 5, 15, 16, 17, 1, 3, 18, 21, 22, 23 };
-static const bool MAIN_ACTIVE_LOW[] = { 1, 1, 1,  1,  1,  1, 1, 1,  1,  1,  1,  1 };
-static const int  NUM_MAINS         = sizeof(MAIN_PINS)/sizeof(MAIN_PINS[0]);
+static constexpr const int*  MAIN_PINS       = Board::MAIN_PINS;
+static constexpr const bool* MAIN_ACTIVE_LOW = Board::MAIN_ACTIVE_LOW;
+static constexpr int         NUM_MAINS       = board_detail::NUM_MAINS;
 
-// SEC (positiva: HIGH = ON) -> {26,27}
-static const int  SEC_PINS[]        = { 26, 27 };
-static const bool SEC_ACTIVE_LOW[]  = { 0, 0 };
-static const int  NUM_SECS          = sizeof(SEC_PINS)/sizeof(SEC_PINS[0]);
+static constexpr const int*  SEC_PINS        = Board::SEC_PINS;
+static constexpr const bool* SEC_ACTIVE_LOW  = Board::SEC_ACTIVE_LOW;
+static constexpr int         NUM_SECS        = board_detail::NUM_SECS;
 
 // ========================== Botones frontales ==========================
-// README: pulsadores usan pull-down -> activo HIGH al presionar
-static constexpr int PIN_NEXT = 13;  // Stop (NC en README); cableado con pull-down -> leer HIGH si presionado
-static constexpr int PIN_PREV = 4;   // Botón verde (NO); pull-down -> leer HIGH si presionado
+static constexpr int PIN_NEXT = Board::PIN_NEXT;
+static constexpr int PIN_PREV = Board::PIN_PREV;
+
+// ========================== Derivados en compilación ==========================
+// PinMap único compartido por ambos modos (un solo objeto en todo el binario)
+inline constexpr PinMap PIN_MAP = {
+  MAIN_PINS, MAIN_ACTIVE_LOW, NUM_MAINS,
+  SEC_PINS,  SEC_ACTIVE_LOW,  NUM_SECS,
+  PIN_ALWAYS_ON, PIN_ALWAYS_ON_12,
+  PIN_TOGGLE_NEXT, PIN_TOGGLE_PREV
+};
+
+// Máscaras W1TS/W1TC listas para RelayBank
+inline constexpr RelayMasks RELAY_MASKS = relayMasksOf(PIN_MAP);
+
+// ---------- Tabla de roles por GPIO (O(1), para la WebUI) ----------
+enum class Role : uint8_t {
+  NONE, MAIN, SEC, ALWAYS_ON, ALWAYS_ON_12, TOGGLE_NEXT, TOGGLE_PREV, AUX_FERT2,
+  FLOW_1, FLOW_2, FLOW_VP, FLOW_VN, SWITCH_MANUAL, BTN_NEXT, BTN_PREV
+};
+
+struct PinRole {
+  Role   role      = Role::NONE;
+  int8_t idx       = -1;     // índice dentro de MAIN/SEC
+  bool   hasAL     = false;  // sólo MAIN/SEC tienen polaridad configurada
+  bool   activeLow = false;
+  bool   output    = false;
+};
+
+static constexpr int NUM_GPIO = 40;
+struct RoleTable { PinRole at[NUM_GPIO]; };
+
+constexpr RoleTable makeRoleTable() {
+  RoleTable t{};
+  auto put = [&t](int pin, Role r, bool out) {
+    if (pin < 0 || pin >= NUM_GPIO) return;
+    t.at[pin].role = r; t.at[pin].output = out;
+  };
+  for (int i=0;i<NUM_MAINS;i++) {
+    const int p = MAIN_PINS[i];
+    put(p, Role::MAIN, true);
+    t.at[p].idx = (int8_t)i; t.at[p].hasAL = true; t.at[p].activeLow = MAIN_ACTIVE_LOW[i];
+  }
+  for (int j=0;j<NUM_SECS;j++) {
+    const int p = SEC_PINS[j];
+    put(p, Role::SEC, true);
+    t.at[p].idx = (int8_t)j; t.at[p].hasAL = true; t.at[p].activeLow = SEC_ACTIVE_LOW[j];
+  }
+  put(PIN_ALWAYS_ON,     Role::ALWAYS_ON,     true);
+  put(PIN_ALWAYS_ON_12,  Role::ALWAYS_ON_12,  true);
+  put(PIN_TOGGLE_NEXT,   Role::TOGGLE_NEXT,   true);
+  put(PIN_TOGGLE_PREV,   Role::TOGGLE_PREV,   true);
+  put(PIN_AUX_FERT2,     Role::AUX_FERT2,     true);
+  put(PIN_FLOW_1,        Role::FLOW_1,        false);
+  put(PIN_FLOW_2,        Role::FLOW_2,        false);
+  put(PIN_FLOW_VP,       Role::FLOW_VP,       false);
+  put(PIN_FLOW_VN,       Role::FLOW_VN,       false);
+  put(PIN_SWITCH_MANUAL, Role::SWITCH_MANUAL, false);
+  put(PIN_NEXT,          Role::BTN_NEXT,      false);
+  put(PIN_PREV,          Role::BTN_PREV,      false);
+  return t;
+}
+
+inline constexpr RoleTable ROLES = makeRoleTable();
+
+inline constexpr PinRole NO_ROLE{};
+constexpr const PinRole& roleOf(int pin) {
+  return (pin >= 0 && pin < NUM_GPIO) ? ROLES.at[pin] : NO_ROLE;
+}
+
+inline const char* roleName(Role r) {
+  switch (r) {
+    case Role::MAIN:          return "MAIN";
+    case Role::SEC:           return "SEC";
+    case Role::ALWAYS_ON:     return "ALWAYS_ON";
+    case Role::ALWAYS_ON_12:  return "ALWAYS_ON_12";
+    case Role::TOGGLE_NEXT:   return "TOGGLE_NEXT";
+    case Role::TOGGLE_PREV:   return "TOGGLE_PREV";
+    case Role::AUX_FERT2:     return "AUX_FERT2";
+    case Role::FLOW_1:        return "FLOW_1";
+    case Role::FLOW_2:        return "FLOW_2";
+    case Role::FLOW_VP:       return "FLOW_VP";
+    case Role::FLOW_VN:       return "FLOW_VN";
+    case Role::SWITCH_MANUAL: return "SWITCH_MANUAL";
+    case Role::BTN_NEXT:      return "BTN_NEXT";
+    case Role::BTN_PREV:      return "BTN_PREV";
+    default:                  return "-";
+  }
+}
+
+// Lista ordenada de pines del proyecto (MAIN, SEC, control/aux) para la tabla GPIO
+inline constexpr board_detail::PinList USED_PINS = board_detail::usedPins();
+static constexpr int NUM_USED_PINS = board_detail::NUM_USED;
 
 } // namespace RP
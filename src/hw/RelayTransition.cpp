@@ -0,0 +1,99 @@
+#include "RelayTransition.h"
+
+void RelayTransition::start(int idx, uint32_t nowMs, Latch latch) {
+  idx_          = idx;
+  useMask_      = false;
+  latch_        = latch;
+
+  // Etapa 0: apaga todo (inmediato, un solo commit)
+  bank_.applyMask(0, 0, false, false);
+
+  stage_        = Stage::OFF;
+  stageStartMs_ = nowMs;
+  waitMs_       = (uint32_t)stepMs_;
+}
+
+void RelayTransition::startMask(uint16_t mainsMask, uint16_t secsMask, uint32_t nowMs, Latch latch) {
+  start(-1, nowMs, latch);
+  useMask_ = true;
+  mains_   = mainsMask;
+  secs_    = secsMask;
+}
+
+void RelayTransition::handover(uint16_t fromMains, uint16_t fromSecs,
+                               uint16_t toMains,   uint16_t toSecs,
+                               uint32_t overlapMs, uint32_t nowMs) {
+  idx_     = -1;
+  useMask_ = true;
+  mains_   = toMains;
+  secs_    = toSecs;
+
+  // Ambas zonas abiertas en un solo commit (la bomba no ve el cierre)
+  bank_.applyMask(fromMains | toMains, fromSecs | toSecs, true, true);
+
+  stage_        = Stage::OVERLAP;
+  stageStartMs_ = nowMs;
+  waitMs_       = overlapMs;
+}
+
+bool RelayTransition::tick(uint32_t nowMs) {
+  if (stage_ == Stage::IDLE) return false;
+  if ((uint32_t)(nowMs - stageStartMs_) < waitMs_) return true;
+
+  switch (stage_) {
+    case Stage::OFF:
+      // Estado OFF: la transición termina tras la espera de apagado
+      if (useMask_ ? (mains_ == 0 && secs_ == 0)
+                   : (idx_ < 0 || idx_ >= bank_.numMains() * 2)) { stage_ = Stage::IDLE; return false; }
+      bank_.setAlways(true);
+      bank_.setAlways12(true);
+      stage_ = Stage::BANK;
+      break;
+
+    case Stage::BANK:
+      applyMains_();
+      stage_ = Stage::MAIN;
+      break;
+
+    case Stage::MAIN:
+      applySecs_();
+      stage_ = Stage::SEC;
+      break;
+
+    case Stage::OVERLAP:
+      // Fin del solape: cierra la zona saliente
+      bank_.applyMask(mains_, secs_, true, true);
+      stage_ = Stage::IDLE;
+      return false;
+
+    case Stage::SEC:
+      if (latch_ & LATCH_NEXT) bank_.setToggleNext(true);
+      if (latch_ & LATCH_PREV) bank_.setTogglePrev(true);
+      stage_ = Stage::IDLE;
+      return false;
+
+    default:
+      stage_ = Stage::IDLE;
+      return false;
+  }
+
+  stageStartMs_ = nowMs;
+  waitMs_       = (uint32_t)stepMs_;
+  return true;
+}
+
+void RelayTransition::applyMains_() {
+  if (useMask_) { bank_.applyMask(mains_, 0, true, true); return; }
+  const int  m      = idx_ / 2;
+  const bool direct = ((idx_ & 1) == 0);
+  if (direct) bank_.setMainDirect(m);
+  else        bank_.applyMainsPattern(m, false);
+}
+
+void RelayTransition::applySecs_() {
+  if (useMask_) { bank_.applyMask(mains_, secs_, true, true); return; }
+  // direct => S1=ON, S0=OFF ; alterno => S0=ON, S1=OFF
+  const bool direct = ((idx_ & 1) == 0);
+  bank_.setSec(0, !direct);
+  bank_.setSec(1,  direct);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <Arduino.h>
+#include "RelayBank.h"
+
+// Secuenciador NO bloqueante de la transición suave entre estados de relés.
+// Reemplaza los cuatro delay(stepMs) de smoothTransition: cada etapa se aplica y
+// se espera stepMs (por timestamp) antes de la siguiente. tick() avanza como
+// máximo una etapa por llamada, así el bucle de control nunca se congela.
+//
+// Etapas:  OFF (todo apagado) -> BANK (always/always12) -> MAIN (patrón) -> SEC -> IDLE
+// idx = main*2 + (direct ? 0 : 1); idx >= numMains*2 => sólo apagar (estado OFF).
+//
+// Relevo sin corte (handover): OVERLAP (zona saliente + entrante abiertas, bancos
+// y bomba siguen ON) -> sólo la entrante -> IDLE. Sin OFF ni esperas de etapa.
+class RelayTransition {
+public:
+  RelayTransition(RelayBank& bank, unsigned long stepMs) : bank_(bank), stepMs_(stepMs) {}
+
+  // Salidas auxiliares que se encienden al terminar la transición
+  enum Latch : uint8_t {
+    LATCH_NONE = 0,
+    LATCH_NEXT = 1 << 0,   // TOGGLE_NEXT (Fert1); con FertDoser lo maneja el dosificador
+    LATCH_PREV = 1 << 1,   // TOGGLE_PREV
+    LATCH_BOTH = LATCH_NEXT | LATCH_PREV   // comportamiento histórico de AutoMode
+  };
+
+  // Arranca una transición hacia idx. Si había otra en curso, se reemplaza.
+  void start(int idx, uint32_t nowMs, Latch latch);
+
+  // Igual que start() pero hacia un patrón arbitrario de relés (varias zonas
+  // a la vez, modo concurrente). Máscaras vacías => sólo apagar.
+  void startMask(uint16_t mainsMask, uint16_t secsMask, uint32_t nowMs, Latch latch);
+
+  // Make-before-break: abre 'to' sin cerrar 'from' y, tras overlapMs, deja
+  // sólo 'to'. Los bancos (always/always12) y los toggles no se tocan.
+  void handover(uint16_t fromMains, uint16_t fromSecs,
+                uint16_t toMains,   uint16_t toSecs,
+                uint32_t overlapMs, uint32_t nowMs);
+
+  // Avanza una etapa si venció su espera. Devuelve true mientras siga en curso.
+  bool tick(uint32_t nowMs);
+
+  // Aborta sin tocar salidas (quien llama decide el estado eléctrico).
+  void cancel() { stage_ = Stage::IDLE; }
+
+  bool busy()   const { return stage_ != Stage::IDLE; }
+  int  target() const { return idx_; }
+
+  // Instante (millis) en que vence la etapa actual; sólo válido si busy().
+  uint32_t deadlineMs() const { return stageStartMs_ + waitMs_; }
+
+private:
+  enum class Stage : uint8_t { IDLE, OFF, BANK, MAIN, SEC, OVERLAP };
+
+  void applyMains_();
+  void applySecs_();
+
+  RelayBank&          bank_;
+  const unsigned long stepMs_;
+
+  Stage    stage_        = Stage::IDLE;
+  int      idx_          = -1;
+  bool     useMask_      = false;   // destino por máscaras (startMask)
+  uint16_t mains_        = 0;
+  uint16_t secs_         = 0;
+  Latch    latch_        = LATCH_NONE;
+  uint32_t stageStartMs_ = 0;
+  uint32_t waitMs_       = 0;       // espera de la etapa actual (stepMs_ u overlap)
+};
@@ -3,19 +3,29 @@
 #include <WebServer.h>
 #include <ESPmDNS.h>
 #include <Preferences.h>
+#include <LittleFS.h>
 #include <time.h>
+#include <freertos/semphr.h>
 
 #include "WiFiManagerESP32.h"
 
 #include "config/MqttConfig.h"
 #include "config/MqttConfigStore.h"
+#include "config/ZoneTable.h"
 #include "mqtt/MqttChat.h"
+#include "mqtt/EventOutbox.h"
+#include "mqtt/CommandChannel.h"
 
 #include "web/WebUI.h"
 
 #include "modes/modes.h"                // resetFullMode/runFullMode/resetBlinkMode/runBlinkMode
 #include "schedule/IrrigationSchedule.h"
+#include "schedule/IrrigationConfigCodec.h" // blob binario de la config de riego
+#include "schedule/SchedulePlanner.h"   // dry-run de 7 días (/sched/plan)
+#include "schedule/WindowIndex.h"
 #include "state/RelayState.h"           // catálogo de estados (RelayState)
+#include "hw/RelayPins.h"               // pines derivados de hw/Board.h
+#include "core/ControlSignals.h"        // notificaciones hacia irrigationTask
 
 // =================== CONFIG BÁSICA ===================
 #ifndef SERIAL_BAUD
@@ -24,10 +34,16 @@
 #ifndef SERIAL_CLI_TIMEOUT_MS
 #define SERIAL_CLI_TIMEOUT_MS 10UL
 #endif
+// Codificación por tópico (core/PayloadEncoder.h): 0 = JSON, 1 = CBOR
+#ifndef RIEGO_EVENT_FORMAT
+#define RIEGO_EVENT_FORMAT 0              // eventos de riego (RIEGO_TOPIC)
+#endif
+#ifndef RIEGO_REPLY_FORMAT
+#define RIEGO_REPLY_FORMAT 0              // respuestas del canal de comandos
+#endif
 
-// Selector de modo MANUAL/AUTO por hardware
-static constexpr int PIN_SWITCH_MANUAL  = 19;   // LOW=AUTO, HIGH=MANUAL
-static constexpr uint32_t MODE_DEBOUNCE_MS = 120;
+// Selector de modo MANUAL/AUTO por hardware: RP::PIN_SWITCH_MANUAL (LOW=AUTO, HIGH=MANUAL).
+// Lo muestrea y filtra hw/InputService (modesSwitchManual()).
 
 // =================== “Serial nulo” para WiFiManager ===================
 class NullStream : public Stream {
@@ -46,19 +62,25 @@ WiFiManagerESP32 wifi;
 MqttConfig       cfg;
 MqttConfigStore  cfgStore("mqtt");
 MqttChat         chat(cfg.host.c_str(), cfg.port, cfg.user.c_str(), cfg.pass.c_str(), cfg.topic.c_str());
+EventOutbox      eventOutbox("/outbox");   // eventos de riego en flash hasta su ack
+CommandChannel   cmdChannel;               // riego/<clientId>/cmd -> .../reply
 WebUI*           webui = nullptr;
 
 static TaskHandle_t gIrrigationTask = nullptr;
+static TaskHandle_t gPersistTask    = nullptr;
 
 // Config de riego (persistente)
 static Preferences irrPrefs;
 static IrrigationConfig gIrrCfg;   // tz, program (starts + sets[0].steps), flowCal
+// gIrrCfg lo edita la WebUI (loop); persistTask lo copia bajo este mutex
+static SemaphoreHandle_t gIrrCfgMutex = nullptr;
+static constexpr uint32_t PERSIST_COALESCE_MS = 300;   // agrupa ráfagas de ediciones
 
 // ===== Catálogo de ESTADOS (persistente) =====
 static Preferences statesPrefs;
 static std::vector<RelayState> gStates;       // Estados visibles/editables en /states
-static constexpr int HW_NUM_MAINS = 12;       // Ajusta si tu HW cambia
-static constexpr int HW_NUM_SECS  = 2;
+static constexpr int HW_NUM_MAINS = RP::NUM_MAINS;   // derivado de hw/Board.h
+static constexpr int HW_NUM_SECS  = RP::NUM_SECS;
 
 // ===== Override de modo (persistente, usado por /mode en WebUI) =====
 static const char* NS_MODE = "mode";
@@ -110,56 +132,52 @@ static bool tryAutoConnectFromPrefs() {
 }
 
 // =================== HELPERS: Persistencia (Irrigation) ===================
-static bool saveIrrConfig(const IrrigationConfig& c) {
-  if (!irrPrefs.begin("irr", false)) return false;
+// Todo el IrrigationConfig va en un único blob "cfg" (schedule/IrrigationConfigCodec.h):
+// una escritura/lectura de flash, con versión y CRC.
+static constexpr const char* IRR_BLOB_KEY = "cfg";
+
+// Escribe el blob y lo relee: sólo cuenta como guardado si vuelve idéntico.
+// Se llama con irrPrefs ya abierto.
+static bool writeIrrBlob_(const std::vector<uint8_t>& blob) {
+  if (irrPrefs.putBytes(IRR_BLOB_KEY, blob.data(), blob.size()) != blob.size()) return false;
+  if (irrPrefs.getBytesLength(IRR_BLOB_KEY) != blob.size()) return false;
+  std::vector<uint8_t> back(blob.size());
+  return irrPrefs.getBytes(IRR_BLOB_KEY, back.data(), back.size()) == blob.size() && back == blob;
+}
 
-  irrPrefs.putString("tz", c.tz);
-  irrPrefs.putFloat("cal1", c.flowCal.pulsesPerMl1);
-  irrPrefs.putFloat("cal2", c.flowCal.pulsesPerMl2);
-
-  irrPrefs.putUChar("prog_en", c.program.enabled ? 1 : 0);
-
-  // Guardar STARTS
-  irrPrefs.putUChar("st_cnt", (uint8_t)min<size_t>(c.program.starts.size(), 30));
-  for (size_t i=0; i<min<size_t>(c.program.starts.size(), 30); ++i) {
-    const auto& st = c.program.starts[i];
-    irrPrefs.putUChar((String("st")+i+"_h").c_str(), st.hour);
-    irrPrefs.putUChar((String("st")+i+"_m").c_str(), st.minute);
-    irrPrefs.putUChar((String("st")+i+"_dw").c_str(), st.dowMask);
-    irrPrefs.putUChar((String("st")+i+"_set").c_str(), st.stepSetIndex);
-    irrPrefs.putUChar((String("st")+i+"_en").c_str(), st.enabled ? 1 : 0);
-    irrPrefs.putFloat((String("st")+i+"_ts").c_str(), st.timeScale);
-    irrPrefs.putFloat((String("st")+i+"_vs").c_str(), st.volumeScale);
-  }
+static bool saveIrrConfig(const IrrigationConfig& c) {
+  std::vector<uint8_t> blob;
+  irrcfg::encode(c, blob);
 
-  // Guardar sólo el StepSet 0
-  uint8_t setCnt = (uint8_t)max<size_t>(1, c.program.sets.size());
-  irrPrefs.putUChar("set_cnt", setCnt);
+  if (!irrPrefs.begin("irr", false)) return false;
+  const bool ok = writeIrrBlob_(blob);
+  irrPrefs.end();
+  return ok;
+}
 
-  if (c.program.sets.empty()) {
-    StepSet s; s.name = "Default"; s.pauseMsBetweenSteps = 10000;
-    irrPrefs.putString("set0_name", s.name);
-    irrPrefs.putUInt  ("set0_pause", s.pauseMsBetweenSteps);
-    irrPrefs.putUChar ("p_cnt", 0);
-  } else {
-    const StepSet& s0 = c.program.sets[0];
-    irrPrefs.putString("set0_name", s0.name);
-    irrPrefs.putUInt  ("set0_pause", s0.pauseMsBetweenSteps);
-
-    irrPrefs.putUChar("p_cnt", (uint8_t)min<size_t>(s0.steps.size(), 40));
-    for (size_t i=0; i<min<size_t>(s0.steps.size(), 40); ++i) {
-      irrPrefs.putInt ((String("p")+i+"_idx").c_str(), s0.steps[i].idx);
-      irrPrefs.putUInt((String("p")+i+"_dur").c_str(), s0.steps[i].maxDurationMs);
-      irrPrefs.putUInt((String("p")+i+"_ml").c_str(),  s0.steps[i].targetMl);
-    }
-  }
+// Formato anterior (una clave NVS por campo, sólo sets[0]); sólo para migrar.
+// Todo con irrPrefs ya abierto.
+static bool hasIrrLegacyKeys_() {
+  return irrPrefs.isKey("prog_en") || irrPrefs.isKey("st_cnt") || irrPrefs.isKey("p_cnt");
+}
 
-  irrPrefs.end();
-  return true;
+// Borra las claves viejas una a una (hasta los topes de aquel formato: 30
+// inicios, 40 pasos). Las que marcan config legacy van al final: si se corta
+// la luz a mitad, el próximo arranque (ya con blob) termina la limpieza.
+static void removeIrrLegacyKeys_() {
+  static const char* const ST_KEYS[] = { "_h", "_m", "_dw", "_set", "_en", "_ts", "_vs" };
+  static const char* const P_KEYS[]  = { "_idx", "_dur", "_ml" };
+  static const char* const KEYS[]    = { "tz", "cal1", "cal2", "set_cnt", "set0_name", "set0_pause",
+                                         "prog_en", "st_cnt", "p_cnt" };
+  for (int i = 0; i < 30; ++i)
+    for (const char* k : ST_KEYS) irrPrefs.remove((String("st") + i + k).c_str());
+  for (int i = 0; i < 40; ++i)
+    for (const char* k : P_KEYS) irrPrefs.remove((String("p") + i + k).c_str());
+  for (const char* k : KEYS) irrPrefs.remove(k);
 }
 
-static bool loadIrrConfig(IrrigationConfig& out) {
-  if (!irrPrefs.begin("irr", true)) return false;
+static bool loadIrrConfigLegacy_(IrrigationConfig& out) {
+  if (!hasIrrLegacyKeys_()) return false;
 
   out.tz = irrPrefs.getString("tz", "America/Bogota");
   out.flowCal.pulsesPerMl1 = irrPrefs.getFloat("cal1", 4.5f);
@@ -199,7 +217,42 @@ static bool loadIrrConfig(IrrigationConfig& out) {
     s0.steps.push_back(stp);
   }
   out.program.sets.push_back(s0);
+  return true;
+}
+
+static bool loadIrrConfig(IrrigationConfig& out) {
+  if (!irrPrefs.begin("irr", false)) return false;
+
+  // 1) Blob actual
+  const size_t n = irrPrefs.getBytesLength(IRR_BLOB_KEY);
+  if (n > 0) {
+    std::vector<uint8_t> blob(n);
+    const bool ok = irrPrefs.getBytes(IRR_BLOB_KEY, blob.data(), n) == n &&
+                    irrcfg::decode(blob.data(), n, out);
+    if (ok) {
+      if (hasIrrLegacyKeys_()) removeIrrLegacyKeys_();   // migración interrumpida
+      irrPrefs.end();
+      return true;
+    }
+    Serial.println(F("[IRR] Blob de config inválido (CRC/versión)"));
+    if (!hasIrrLegacyKeys_()) { irrPrefs.end(); return false; }
+    out = IrrigationConfig();   // decode a medias: se reintenta desde las claves viejas
+  }
+
+  // 2) Migración desde las claves por campo: primero el blob (releído), y
+  //    sólo entonces se borran las claves viejas. Si la escritura falla se
+  //    corre con la config legacy y se reintenta en el próximo arranque.
+  if (!loadIrrConfigLegacy_(out)) { irrPrefs.end(); return false; }
 
+  std::vector<uint8_t> blob;
+  irrcfg::encode(out, blob);
+  if (writeIrrBlob_(blob)) {
+    removeIrrLegacyKeys_();
+    Serial.println(F("[IRR] Config migrada a blob binario"));
+  } else {
+    irrPrefs.remove(IRR_BLOB_KEY);   // sin blob a medias que tape las claves viejas
+    Serial.println(F("[IRR] No se pudo escribir el blob; se usa la config legacy"));
+  }
   irrPrefs.end();
   return true;
 }
@@ -238,6 +291,7 @@ static bool loadRelayStates(std::vector<RelayState>& out) {
     rs.alwaysOn12 = statesPrefs.getUChar ((String("s")+i+"_a12").c_str(),    0) != 0;
     rs.mainsMask  = statesPrefs.getUShort((String("s")+i+"_mm").c_str(), 0);
     rs.secsMask   = statesPrefs.getUShort((String("s")+i+"_sm").c_str(), 0);
+    rs.flowLph    = statesPrefs.getUShort((String("s")+i+"_lph").c_str(), 0);
     out.push_back(rs);
   }
   statesPrefs.end();
@@ -255,6 +309,7 @@ static bool saveRelayStates(const std::vector<RelayState>& v) {
     statesPrefs.putUChar ((String("s")+i+"_a12").c_str(),    rs.alwaysOn12 ? 1 : 0);
     statesPrefs.putUShort((String("s")+i+"_mm").c_str(), rs.mainsMask);
     statesPrefs.putUShort((String("s")+i+"_sm").c_str(), rs.secsMask);
+    statesPrefs.putUShort((String("s")+i+"_lph").c_str(), rs.flowLph);
   }
   statesPrefs.end();
   return true;
@@ -307,6 +362,19 @@ static int relayStateToStepIdx(const RelayState& rs) {
   bool direct = secIsDirect(rs.secsMask);
   return m*2 + (direct ? 0 : 1);
 }
+// Copia la hidráulica de cada zona (RelayState i -> paso i del Set 0) para el
+// empaquetado concurrente de AutoMode
+static void syncStepHydraulics(IrrigationConfig& c) {
+  if (c.program.sets.empty()) return;
+  std::vector<StepSpec>& steps = c.program.sets[0].steps;
+  for (size_t i = 0; i < steps.size(); ++i) {
+    const bool have = i < gStates.size();
+    steps[i].mainsMask = have ? gStates[i].mainsMask : 0;
+    steps[i].secsMask  = have ? gStates[i].secsMask  : 0;
+    steps[i].flowLph   = have ? gStates[i].flowLph   : 0;
+  }
+}
+
 static void ensureStepsCoverAllStates() {
   if (gIrrCfg.program.sets.empty()) {
     StepSet s; s.name = "Default"; s.pauseMsBetweenSteps = 10000;
@@ -314,28 +382,100 @@ static void ensureStepsCoverAllStates() {
   }
   StepSet& s0 = gIrrCfg.program.sets[0];
 
-  // Si ya coincide el tamaño, no tocamos para no pisar ajustes finos
-  if (s0.steps.size() == gStates.size()) return;
+  // Si ya coincide el tamaño, no tocamos los pasos (sólo su hidráulica) para no pisar ajustes finos
+  if (s0.steps.size() == gStates.size()) {
+    syncStepHydraulics(gIrrCfg);
+    modesSetProgram(gIrrCfg.program, gIrrCfg.flowCal);
+    return;
+  }
 
   s0.steps.clear();
   s0.steps.reserve(gStates.size());
   for (size_t i = 0; i < gStates.size(); ++i) {
     StepSpec sp;
     sp.idx           = relayStateToStepIdx(gStates[i]);
-    sp.maxDurationMs = 0; // objetivos reales vendrán por NVS "zones"
+    sp.maxDurationMs = 0; // objetivos reales vendrán de ZoneTable (NVS "zones")
     sp.targetMl      = 0;
     s0.steps.push_back(sp);
   }
+  syncStepHydraulics(gIrrCfg);
 
   // Persistir y reinyectar al motor sin reiniciar
   saveIrrConfig(gIrrCfg);
   modesSetProgram(gIrrCfg.program, gIrrCfg.flowCal);
 }
 
+// Edición de gIrrCfg desde la WebUI: bajo el mutex que comparte con persistTask
+template <typename F>
+static void editIrrConfig(F&& fn) {
+  xSemaphoreTake(gIrrCfgMutex, portMAX_DELAY);
+  fn(gIrrCfg);
+  xSemaphoreGive(gIrrCfgMutex);
+}
+
+// Escritura NVS fuera del hilo web: copia bajo mutex y guarda sin bloquear a nadie
+static void persistTask(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    vTaskDelay(pdMS_TO_TICKS(PERSIST_COALESCE_MS));
+    ulTaskNotifyTake(pdTRUE, 0);        // las ediciones de la ráfaga van en esta escritura
+
+    IrrigationConfig snap;
+    xSemaphoreTake(gIrrCfgMutex, portMAX_DELAY);
+    snap = gIrrCfg;
+    xSemaphoreGive(gIrrCfgMutex);
+
+    if (!saveIrrConfig(snap)) Serial.println(F("[IRR] Error guardando config en NVS"));
+  }
+}
+
+// Cambio de programa: recarga en caliente (AutoMode lo adopta entre pasos)
+// y persistencia asíncrona. La petición web vuelve sin esperar a la NVS.
 static void applyAndSave() {
-  saveIrrConfig(gIrrCfg);
-  delay(50);
-  ESP.restart();
+  editIrrConfig([](IrrigationConfig& c){ syncStepHydraulics(c); });
+  modesSetProgram(gIrrCfg.program, gIrrCfg.flowCal);
+  if (gPersistTask) xTaskNotifyGive(gPersistTask);
+  else              saveIrrConfig(gIrrCfg);
+}
+
+// =================== Planificador en seco ===================
+// Corre en loop() (mismo hilo que edita gIrrCfg): sin mutex. Objetivos por
+// zona desde ZoneTable (ZoneParams en RAM), origen = hora local actual.
+static String planJson(size_t maxEvents) {
+  const ProgramSpec& prog = gIrrCfg.program;
+  size_t nZones = 0;
+  for (const StepSet& s : prog.sets) if (s.steps.size() > nZones) nZones = s.steps.size();
+
+  std::vector<plan::ZoneTarget> zones(nZones);
+  for (size_t i = 0; i < nZones; ++i) {
+    const ZoneTable::Zone z = zoneTable().get((int)i);
+    zones[i].volumeMl = z.volumeMl;
+    zones[i].timeMs   = z.timeMs;
+  }
+
+  // Caudal aprendido por AutoMode (SeqLock): hasta tener base, el declarado
+  const AutoMode::FlowBaselines learned = getAutoFlowBaselines();
+
+  plan::Params pp;
+  pp.prog           = &prog;
+  pp.windows        = &windowIndex().snapshot();   // loop() es quien la construye
+  pp.zones          = zones.data();
+  pp.nZones         = zones.size();
+  pp.learnedLph     = learned.lph;
+  pp.nLearned       = FlowMonitor::MAX_ZONES;
+  pp.flowCalibrated = gIrrCfg.flowCal.pulsesPerMl1 > 0.f || gIrrCfg.flowCal.pulsesPerMl2 > 0.f;
+  pp.stepDelayMs    = modesAutoStepDelayMs();
+  pp.maxEvents      = maxEvents;
+
+  // Sin NTP: origen lunes 00:00 (el plan sigue siendo útil como forma de la semana)
+  time_t now = time(nullptr);
+  struct tm tm;
+  if (now >= 1600000000 && localtime_r(&now, &tm)) {
+    pp.startDow     = (uint8_t)WindowIndex::dowOf(tm);
+    pp.startMsOfDay = ((uint32_t)tm.tm_hour * 3600UL + tm.tm_min * 60UL + tm.tm_sec) * 1000UL;
+  }
+
+  return plan::toJson(plan::simulate(pp), pp);
 }
 
 // =================== Override de modo: helpers ===================
@@ -350,55 +490,54 @@ static void loadModeOverride(bool& outOvr, bool& outManual) {
 }
 
 // =================== TASK RIEGO ===================
+// Duerme en una notificación hasta el próximo deadline del modo activo (o una
+// señal: selector físico, botones, umbral PCNT, cambios desde la WebUI). El tope
+// CONTROL_MAX_SLEEP_MS mantiene fresca la telemetría publicada.
+static constexpr uint32_t CONTROL_MAX_SLEEP_MS = 1000;
+static constexpr uint32_t CONTROL_MIN_SLEEP_MS = 1;
+
 static void irrigationTask(void* /*pv*/) {
-  pinMode(PIN_SWITCH_MANUAL, INPUT_PULLDOWN);
+  ctl::attachControlTask(xTaskGetCurrentTaskHandle());
 
-  // Lee override inicial
-  loadModeOverride(gOvrEnabled, gOvrManual);
+  // Selector y botones: muestreo fijo con debounce; sus flancos llegan como
+  // SIG_SWITCH / SIG_BUTTON
+  modesBeginInputs();
 
-  bool rawHW      = (digitalRead(PIN_SWITCH_MANUAL) == HIGH);
-  bool debHW      = rawHW;               // estado debounced del switch
-  uint32_t lastCh = millis();
+  // Override vigente (cargado de NVS en setup; luego lo publica la WebUI)
+  ctl::ModeOverride ovr = ctl::modeOverride();
+  gOvrEnabled = ovr.enabled;
+  gOvrManual  = ovr.manual;
 
   // Estado de operación actual
-  bool manual = gOvrEnabled ? gOvrManual : debHW;
+  bool manual = gOvrEnabled ? gOvrManual : modesSwitchManual();
   if (manual) resetFullMode(); else resetBlinkMode();
 
-  uint32_t lastModeCheck = millis();
-
   for (;;) {
-    uint32_t now = millis();
-
-    // Debounce del switch físico (sólo si no hay override)
-    bool newRaw = (digitalRead(PIN_SWITCH_MANUAL) == HIGH);
-    if (newRaw != rawHW) { rawHW = newRaw; lastCh = now; }
-    if (!gOvrEnabled && (now - lastCh) > MODE_DEBOUNCE_MS) {
-      if (debHW != rawHW) debHW = rawHW;
-    }
-
-    // Refrescar override desde NVS cada ~500 ms
-    if (now - lastModeCheck > 500) {
-      lastModeCheck = now;
-      bool ovr, man;
-      loadModeOverride(ovr, man);
-      if (ovr != gOvrEnabled || man != gOvrManual) {
-        gOvrEnabled = ovr;
-        gOvrManual  = man;
-      }
-    }
+    // Override publicado por la WebUI (sin abrir NVS)
+    ovr = ctl::modeOverride();
+    gOvrEnabled = ovr.enabled;
+    gOvrManual  = ovr.manual;
 
     // Decide modo deseado (override tiene prioridad)
-    bool desiredManual = gOvrEnabled ? gOvrManual : debHW;
+    bool desiredManual = gOvrEnabled ? gOvrManual : modesSwitchManual();
     if (desiredManual != manual) {
       manual = desiredManual;
       if (manual) resetFullMode(); else resetBlinkMode();
     }
 
+    // Botones y órdenes manuales desde la Web (start/stop)
+    modesPollCommands(manual);
+
     // Ejecuta modo actual
     if (manual) runFullMode();
     else        runBlinkMode();
 
-    vTaskDelay(1);
+    // Próximo despertar. Siempre se bloquea al menos un tick: con taskYIELD()
+    // un deadline vencido dejaría a IDLE0 sin correr (watchdog de core 0).
+    uint32_t waitMs = modesNextWakeMs(manual);
+    if (waitMs > CONTROL_MAX_SLEEP_MS) waitMs = CONTROL_MAX_SLEEP_MS;
+    if (waitMs < CONTROL_MIN_SLEEP_MS) waitMs = CONTROL_MIN_SLEEP_MS;
+    ctl::wait(waitMs);
   }
 }
 
@@ -419,9 +558,14 @@ void setup() {
   Serial.begin(SERIAL_BAUD);
   delay(50);
 
+  gIrrCfgMutex = xSemaphoreCreateMutex();
+
   // Cargar config MQTT
   cfgStore.load(cfg);
 
+  // Objetivos por zona: única lectura de NVS "zones" (antes de irrigationTask)
+  zoneTable().load();
+
   // Cargar config de riego (o defaults si no hay)
   if (!loadIrrConfig(gIrrCfg)) {
     ensureIrrDefaults(gIrrCfg);
@@ -454,14 +598,24 @@ void setup() {
   chat.setAuth(cfg.user, cfg.pass);
   chat.setTopic(cfg.topic);
   chat.setSubTopic(cfg.subTopic);
+  // Outbox persistente (partición "spiffs" en LittleFS; se formatea si no monta)
+  if (LittleFS.begin(true) && eventOutbox.begin(LittleFS)) chat.attachOutbox(&eventOutbox);
+  else Serial.println(F("[outbox] LittleFS no disponible: eventos sin persistencia"));
   chat.begin();
+  if (!cmdChannel.begin(chat, "riego", (payload::Format)RIEGO_REPLY_FORMAT)) Serial.println(F("[cmd] canal de comandos MQTT no disponible"));
+  cmdChannel.attachProgramEnable([](bool en){
+    editIrrConfig([&](IrrigationConfig& c){ c.program.enabled = en; });
+    applyAndSave();
+  });
 
   // ===== NUEVO: cableado de publicación de eventos de riego =====
+  // Pasan por el outbox en flash: sobreviven a caídas de Wi-Fi/broker y reinicios
   modesSetEventPublisher(
     [&](const String& topic, const String& payload){
-      (void)chat.publishTo(topic, payload);
+      (void)chat.publishDurable(topic, payload);
     },
-    String(RIEGO_TOPIC)
+    String(RIEGO_TOPIC),
+    (payload::Format)RIEGO_EVENT_FORMAT
   );
 
   // ===== NUEVO: resolver nombre de estado (por índice de paso dentro del set) =====
@@ -477,16 +631,20 @@ void setup() {
   webui = &ui;
   webui->begin();
   webui->attachMqttSink();
+  webui->attachCommandChannel(&cmdChannel);
 
   // API de Programación para WebUI (/sched)
   webui->attachScheduleAPI(
     [](){ return gIrrCfg.program.enabled; },
-    [](bool en){ gIrrCfg.program.enabled = en; applyAndSave(); },
+    [](bool en){ editIrrConfig([&](IrrigationConfig& c){ c.program.enabled = en; }); applyAndSave(); },
     [](){ return gIrrCfg.program.starts; },
-    [](const StartSpec& st){ gIrrCfg.program.starts.push_back(st); applyAndSave(); return true; },
+    [](const StartSpec& st){
+      editIrrConfig([&](IrrigationConfig& c){ c.program.starts.push_back(st); });
+      applyAndSave(); return true;
+    },
     [](unsigned int idx){
       if (idx >= gIrrCfg.program.starts.size()) return false;
-      gIrrCfg.program.starts.erase(gIrrCfg.program.starts.begin()+idx);
+      editIrrConfig([&](IrrigationConfig& c){ c.program.starts.erase(c.program.starts.begin()+idx); });
       applyAndSave(); return true;
     },
     [](){
@@ -494,26 +652,52 @@ void setup() {
       return gIrrCfg.program.sets[0].steps;
     },
     [](const std::vector<StepSpec>& v){
-      if (gIrrCfg.program.sets.empty()) {
-        StepSet s; s.name="Default"; s.pauseMsBetweenSteps=10000;
-        gIrrCfg.program.sets.push_back(s);
-      }
-      gIrrCfg.program.sets[0].steps = v;
+      editIrrConfig([&](IrrigationConfig& c){
+        if (c.program.sets.empty()) {
+          StepSet s; s.name="Default"; s.pauseMsBetweenSteps=10000;
+          c.program.sets.push_back(s);
+        }
+        c.program.sets[0].steps = v;
+      });
       applyAndSave(); return true;
     },
     [](){ return nowString(); },
     [](const std::vector<StartSpec>& v){
-      gIrrCfg.program.starts = v;
+      editIrrConfig([&](IrrigationConfig& c){ c.program.starts = v; });
+      applyAndSave(); return true;
+    }
+  );
+
+  // API de hidráulica (/riego): riego concurrente y relevo entre zonas
+  webui->attachHydraulicsAPI(
+    [](){
+      WebUI::Hydraulics h;
+      h.concurrent      = gIrrCfg.program.concurrent;
+      h.pumpCapacityLph = gIrrCfg.program.pumpCapacityLph;
+      h.handoverMs      = gIrrCfg.program.handoverMs;
+      return h;
+    },
+    [](const WebUI::Hydraulics& h){
+      editIrrConfig([&](IrrigationConfig& c){
+        c.program.concurrent      = h.concurrent;
+        c.program.pumpCapacityLph = h.pumpCapacityLph;
+        c.program.handoverMs      = h.handoverMs;
+      });
       applyAndSave(); return true;
     }
   );
 
+  // Dry-run del programa vivo (/sched/plan y MQTT "plan")
+  webui->attachPlanAPI(planJson);
+
   // API de ESTADOS (/states)
   webui->attachStateAPI(
     [](){ return gStates; },
     [](const std::vector<RelayState>& v){
       gStates = v;
-      return saveRelayStates(gStates);
+      const bool ok = saveRelayStates(gStates);
+      applyAndSave();   // hidráulica de zonas -> programa vivo
+      return ok;
     },
     [](){ return std::make_pair(HW_NUM_MAINS, HW_NUM_SECS); },
     [](int idx, bool isMain){
@@ -528,13 +712,24 @@ void setup() {
   // Intenta conectar STA a la red marcada como automática
   (void)tryAutoConnectFromPrefs();
 
+  // Override de modo persistido -> estado compartido con irrigationTask
+  loadModeOverride(gOvrEnabled, gOvrManual);
+  ctl::postModeOverride(gOvrEnabled, gOvrManual);
+
+  // Persistencia asíncrona de la config de riego (core 1, baja prioridad)
+  xTaskCreatePinnedToCore(persistTask, "persistTask", 4096, nullptr, 1, &gPersistTask, 1);
+
+  // Presión / nivel por ADC continuo (su propia tarea en core 1)
+  modesBeginSensors();
+
   // Task de riego (core 0, prioridad baja)
   xTaskCreatePinnedToCore(irrigationTask, "irrigationTask", 6144, nullptr, 1, &gIrrigationTask, 0);
 }
 
 void loop() {
   wifi.service();                      // Wi-Fi Manager (CLI)
-  if (wifi.isConnected()) chat.loop(); // MQTT si hay Wi-Fi
+  chat.loop();                         // MQTT recibido -> handlers (la red va en mqttTask)
+  cmdChannel.loop();                   // comandos remotos -> modos, y sus respuestas
   if (webui) webui->loop();            // HTTP
 
   // Reintento suave de Wi-Fi cada 10 s si está caído
@@ -2,13 +2,8 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <math.h>
-#include <Preferences.h>   // NVS ventanas / zonas
-
-// ====== estáticos ISR ======
-volatile unsigned long AutoMode::pulse1_ = 0;
-volatile unsigned long AutoMode::pulse2_ = 0;
-volatile unsigned long AutoMode::lastMicros1_ = 0;
-volatile unsigned long AutoMode::lastMicros2_ = 0;
+#include "../schedule/WindowIndex.h"
+#include "../config/ZoneTable.h"
 
 // --- Registro del último inicio por ventana (evitar doble disparo) ---
 namespace {
@@ -22,39 +17,38 @@ AutoMode::AutoMode(RelayBank& bank,
                    unsigned long stateDurationMs,
                    unsigned long offDurationMs,
                    unsigned long stepDelayMs,
+                   FlowMeterService& flow,
                    int pinFlow1, int pinFlow2)
 : bank_(bank),
   customStates_(customStates), numStates_(numStates),
   stateDurMs_(stateDurationMs), offDurationMs_(offDurationMs),
   stepDelayMs_(stepDelayMs),
-  pinFlow1_(pinFlow1), pinFlow2_(pinFlow2)
+  pinFlow1_(pinFlow1), pinFlow2_(pinFlow2),
+  flow_(flow),
+  trans_(bank, stepDelayMs)
 {}
 
 // ------------------- setters nuevos -------------------
-void AutoMode::setEventPublisher(EventPublisher pub, const String& topic) {
+void AutoMode::setEventPublisher(EventPublisher pub, const String& topic, payload::Format fmt) {
   publisher_ = pub;
+  pubFormat_ = fmt;
   if (topic.length()) pubTopic_ = topic;
 }
 void AutoMode::setStateNameResolver(StateNameResolver res) {
   nameRes_ = res;
 }
 
-// ------------------- ISR caudal -------------------
-void IRAM_ATTR AutoMode::isrFlow1Thunk() {
-  unsigned long now = micros();
-  if (now - lastMicros1_ >= DEBOUNCE_US) { pulse1_++; lastMicros1_ = now; }
-}
-void IRAM_ATTR AutoMode::isrFlow2Thunk() {
-  unsigned long now = micros();
-  if (now - lastMicros2_ >= DEBOUNCE_US) { pulse2_++; lastMicros2_ = now; }
-}
-
 // ------------------- ciclo de vida -------------------
 void AutoMode::begin() {
   bank_.begin();
-  // Pull-up externo según README -> INPUT (sin PULLUP interno)
-  if (pinFlow1_ >= 0) { pinMode(pinFlow1_, INPUT); attachInterrupt(digitalPinToInterrupt(pinFlow1_), isrFlow1Thunk, RISING); }
-  if (pinFlow2_ >= 0) { pinMode(pinFlow2_, INPUT); attachInterrupt(digitalPinToInterrupt(pinFlow2_), isrFlow2Thunk, RISING); }
+  // Caudal por PCNT compartido con MANUAL (idempotente, sin attach/detach)
+  flow_.begin(pinFlow1_, pinFlow2_);
+  uint64_t p1, p2;
+  flow_.totals(p1, p2);
+  blinkLastTotal_ = p1 + p2;
+  flowMon_.begin();
+  flowMon_.resync();
+  if (doser_) doser_->begin();
 
   phaseStart_ = stateStart_ = millis();
   // Si no hay programa configurado, arranca con la transición inicial legacy.
@@ -77,7 +71,10 @@ void AutoMode::reset() {
   // Programado
   phase_        = Phase::IDLE;
   stepIdx_      = 0;
+  slots_.clear();
+  for (ZoneRun& z : zones_) z.active = false;
   stepStartMs_  = 0;
+  stepClockPending_ = false;
   pauseStartMs_ = 0;
   stepStartP1_  = 0;
   stepStartP2_  = 0;
@@ -95,42 +92,358 @@ void AutoMode::reset() {
   effDurMs_ = 0;
   effVolMl_ = 0;
 
+  orderActive_   = false;   // las órdenes en cola esperan a la próxima vuelta a AUTO
+  resume_        = Resume{};
+  deferredStart_ = -1;
+
+  flowMon_.unwatchAll(millis());
+  flowAlarm_     = false;
+  pressureAlarm_ = false;
+  lowActive_     = false;
+  if (doser_) doser_->stop();
+
   allOff_();
+  publishTelemetry_();
 }
 
 void AutoMode::run() {
-  if (!initialized_) { begin(); return; }
+  if (!initialized_) { begin(); publishTelemetry_(); return; }
+
+  // Avanza la transición de relés en curso (una etapa por tick, sin bloquear);
+  // al quedar quieta arranca el reloj del paso que la pidió
+  trans_.tick(millis());
+  if (stepClockPending_ && !trans_.busy()) startStepClock_(millis());
+
+  // Órdenes a demanda: no esperan franja ni programa habilitado
+  pollOrders_(millis());
 
   // Si hay programa asignado, usarlo. Si no, comportamiento legacy.
-  if (prog_ && prog_->enabled && (!prog_->sets.empty() || !prog_->starts.empty())) {
+  if (scheduled_()) {
     runScheduled();
+    pollFlowMonitor_(millis());
+    pollPressure_(millis());
+    if (doser_) {
+      uint64_t p1, p2;
+      flow_.totals(p1, p2);
+      doser_->tick(millis(), p1, p2);
+    }
   } else {
     // Legacy "blink"
     handlePhaseLogic();
   }
+
+  armFlowWake_();
+
+  // Un snapshot por tick para los lectores del otro core
+  publishTelemetry_();
+}
+
+// ------------------- Vigilancia de caudal (1 s) -------------------
+void AutoMode::pollFlowMonitor_(uint32_t nowMs) {
+  // Con las válvulas cerradas por programa, cualquier caudal es fuga
+  flowMon_.setIdleWatch(phase_ == Phase::IDLE || phase_ == Phase::PAUSE, nowMs);
+
+  uint64_t p1, p2;
+  flow_.totals(p1, p2);
+  FlowMonitor::Alarm a;
+  if (!flowMon_.poll(nowMs, p1, p2, a)) return;
+
+  flowAlarm_ = true;
+  bank_.setTogglePrev(true);
+  publishFlowAlarm_(a);
+
+  // Cortar sólo lo anómalo: la zona del slot o el paso secuencial
+  if (phase_ != Phase::RUN_STEP || a.slot < 0) return;
+  if (!slots_.empty()) {
+    ZoneRun& z = zones_[a.slot];
+    if (z.active) { z.cut = true; runSlot_(); }
+  } else {
+    finishStep_();
+  }
+}
+
+// ------------------- Baja presión (sensors/SensorService.h) -------------------
+void AutoMode::pollPressure_(uint32_t nowMs) {
+  // Sólo se juzga regando, con los relés quietos y la línea ya llena
+  float kpa = 0.f;
+  const bool judge = sensors_ && lowKpa_ > 0.f && phase_ == Phase::RUN_STEP && !trans_.busy() &&
+                     (uint32_t)(nowMs - stepStartMs_) >= FlowMonitor::SETTLE_MS &&
+                     sensors_->latest(SensorService::Kind::PRESSURE, kpa, nowMs);
+  if (!judge || kpa >= lowKpa_) { lowActive_ = false; return; }
+  if (!lowActive_) { lowActive_ = true; lowSinceMs_ = nowMs; }
+  if ((uint32_t)(nowMs - lowSinceMs_) < lowHoldMs_) return;
+
+  lowActive_     = false;
+  pressureAlarm_ = true;
+  bank_.setTogglePrev(true);
+  publishPressureLow_(kpa);
+
+  // La presión es de toda la línea: se corta todo lo abierto. Un paso sin
+  // presión no alimenta las líneas base de caudal.
+  if (!slots_.empty()) {
+    for (uint8_t i = 0; i < ZoneSlot::MAX_ZONES; ++i) {
+      if (!zones_[i].active) continue;
+      flowMon_.unwatch(i, /*learn*/ false, nowMs);
+      zones_[i].cut = true;
+    }
+    runSlot_();
+  } else {
+    flowMon_.unwatch(0, /*learn*/ false, nowMs);
+    finishStep_();
+  }
+}
+
+// ------------------- Deadlines (irrigationTask duerme hasta aquí) -------------------
+uint32_t AutoMode::stepDurTargetMs_() const {
+  if (effDurMs_ > 0) return effDurMs_;
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) return 0;
+  const StepSet& set = prog_->sets[curSetIdx_];
+  if (stepIdx_ >= set.steps.size()) return 0;
+  const StepSpec& sp = set.steps[stepIdx_];
+  return sp.maxDurationMs ? (uint32_t)lroundf((float)sp.maxDurationMs * timeScale_) : 0;
+}
+
+uint32_t AutoMode::stepVolTargetMl_() const {
+  if (effVolMl_ > 0) return effVolMl_;
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) return 0;
+  const StepSet& set = prog_->sets[curSetIdx_];
+  if (stepIdx_ >= set.steps.size()) return 0;
+  const StepSpec& sp = set.steps[stepIdx_];
+  return sp.targetMl ? (uint32_t)lroundf((float)sp.targetMl * volScale_) : 0;
+}
+
+void AutoMode::armFlowWake_() {
+  if (stepClockPending_) { flow_.disarmWake(); return; }
+  if (phase_ == Phase::RUN_STEP && !slots_.empty()) { armSlotWake_(); return; }
+  const uint32_t target = (phase_ == Phase::RUN_STEP) ? stepVolTargetMl_() : 0;
+  if (target == 0 || (cal_.pulsesPerMl1 <= 0.f && cal_.pulsesPerMl2 <= 0.f)) { flow_.disarmWake(); return; }
+
+  uint64_t p1, p2;
+  flow_.totals(p1, p2);
+  const uint32_t ml = volumeMlFromPulses_((uint32_t)(p1 - stepStartP1_), (uint32_t)(p2 - stepStartP2_));
+  if (ml >= target) { flow_.disarmWake(); return; }
+
+  // ml1 + ml2 >= R implica que algún canal aportó >= R/2: armando cada canal a
+  // R/2 nunca se duerme más allá del objetivo (cada despertar re-arma).
+  const float half = (float)(target - ml) * 0.5f;
+  if (cal_.pulsesPerMl1 > 0.f) flow_.armWake(0, (uint32_t)ceilf(half * cal_.pulsesPerMl1));
+  if (cal_.pulsesPerMl2 > 0.f) flow_.armWake(1, (uint32_t)ceilf(half * cal_.pulsesPerMl2));
+}
+
+uint32_t AutoMode::msUntilNextDeadline(uint32_t nowMs) const {
+  uint32_t wait = UINT32_MAX;
+  auto until = [&](uint32_t deadlineMs) {
+    const int32_t d = (int32_t)(deadlineMs - nowMs);
+    const uint32_t w = d > 0 ? (uint32_t)d : 0;
+    if (w < wait) wait = w;
+  };
+
+  if (!initialized_) return 0;
+  if (trans_.busy()) until(trans_.deadlineMs());
+
+  // Orden en cola y punto libre para arrancarla: ya
+  if (orders_ && !orderActive_ && orders_->backlog() > 0 &&
+      (phase_ == Phase::IDLE || (phase_ == Phase::PAUSE && slots_.empty() && !holdForReload_))) {
+    return 0;
+  }
+
+  if (scheduled_()) {
+    if (phase_ == Phase::RUN_STEP && stepClockPending_) {
+      // Sin reloj aún: el próximo deadline es la etapa de la transición
+    } else if (phase_ == Phase::RUN_STEP && !slots_.empty()) {
+      for (const ZoneRun& z : zones_) if (z.active && z.durMs > 0) until(z.startMs + z.durMs);
+    } else if (phase_ == Phase::RUN_STEP) {
+      const uint32_t dur = stepDurTargetMs_();
+      if (dur > 0) until(stepStartMs_ + dur);
+    } else if (phase_ == Phase::PAUSE) {
+      if (curSetIdx_ >= 0 && (size_t)curSetIdx_ < prog_->sets.size()) {
+        const StepSet& set = prog_->sets[curSetIdx_];
+        const uint32_t pauseMs = set.pauseMsBetweenSteps ? (uint32_t)lroundf((float)set.pauseMsBetweenSteps * timeScale_) : 0;
+        until(pauseStartMs_ + pauseMs);
+      } else {
+        wait = 0;
+      }
+    }
+    // Regando: muestra de caudal de 1 s para el detector (flow/FlowMonitor.h)
+    if (phase_ == Phase::RUN_STEP) until(nowMs + flowMon_.msUntilNextSample(nowMs));
+    // Presión baja sostenida: corte al cumplirse la espera
+    if (lowActive_) until(lowSinceMs_ + lowHoldMs_);
+    // Flancos de los pulsos de fertilizante
+    if (doser_) {
+      const uint32_t d = doser_->msUntilNextEdge(nowMs);
+      if (d < wait) wait = d;
+    }
+    // Inicios/franjas tienen resolución de minuto: despertar al cambiar de minuto
+    time_t t = time(nullptr);
+    if (t > 100000) {
+      struct tm lt;
+      localtime_r(&t, &lt);
+      until(nowMs + (uint32_t)(60 - lt.tm_sec) * 1000UL);
+    }
+  } else if (customStates_ && numStates_ > 0) {
+    // Legacy blink
+    if (activePhase_) until(stateStart_ + stateDurMs_);
+    else              until(phaseStart_ + offDurationMs_);
+  }
+  return wait;
+}
+
+// ------------------- Órdenes a demanda -------------------
+bool AutoMode::scheduled_() const {
+  if (orderActive_ || remoteRun_) return true;
+  return prog_ && prog_->enabled && (!prog_->sets.empty() || !prog_->starts.empty());
+}
+
+void AutoMode::pollOrders_(uint32_t nowMs) {
+  if (!orders_ || orderActive_) return;
+  // Punto libre: reposo o pausa de una corrida secuencial (sin recarga pendiente)
+  const bool idle  = phase_ == Phase::IDLE;
+  const bool pause = phase_ == Phase::PAUSE && slots_.empty() && !holdForReload_;
+  if (!idle && !pause) return;
+
+  OrderQueue::Order o;
+  while (orders_->pop(o)) {
+    if (startOrder_(o, nowMs)) return;
+  }
+}
+
+bool AutoMode::startOrder_(const OrderQueue::Order& o, uint32_t nowMs) {
+  // La zona es un paso del Set 0 (uno por RelayState, ver main)
+  if (!prog_ || prog_->sets.empty() || o.zone < 0 || (size_t)o.zone >= prog_->sets[0].steps.size()) {
+    ordersRejected_++;
+    orders_->report(o.id, OrderQueue::Outcome::REJECTED, nowMs, nowMs - o.queuedMs);
+    return false;
+  }
+
+  // Objetivos como effectiveTargets_ (escala 1): sin ninguno alcanzable no arranca
+  const StepSpec&       sp = prog_->sets[0].steps[o.zone];
+  const ZoneTable::Zone z  = zoneTable().get(o.zone);
+  const uint32_t dur = o.durationMs ? o.durationMs : (z.timeMs   ? z.timeMs   : sp.maxDurationMs);
+  const uint32_t vol = o.volumeMl   ? o.volumeMl   : (z.volumeMl ? z.volumeMl : sp.targetMl);
+  const bool calibrated = cal_.pulsesPerMl1 > 0.f || cal_.pulsesPerMl2 > 0.f;
+  if (dur == 0 && (vol == 0 || !calibrated)) {
+    ordersRejected_++;
+    orders_->report(o.id, OrderQueue::Outcome::REJECTED, nowMs, nowMs - o.queuedMs);
+    return false;
+  }
+
+  // Corrida en pausa: se retoma al terminar la orden
+  resume_ = Resume{};
+  if (phase_ == Phase::PAUSE) {
+    resume_.valid       = true;
+    resume_.startIdx    = curStartIdx_;
+    resume_.setIdx      = curSetIdx_;
+    resume_.stepIdx     = stepIdx_;
+    resume_.timeScale   = timeScale_;
+    resume_.volScale    = volScale_;
+    resume_.runVolumeMl = runVolumeMl_;
+  } else {
+    flowAlarm_     = false;   // como cualquier inicio desde reposo
+    pressureAlarm_ = false;
+  }
+
+  orderActive_  = true;
+  order_        = o;
+  orderQueueMs_ = nowMs - o.queuedMs;
+  if (orderQueueMs_ > orderQueueMaxMs_) orderQueueMaxMs_ = orderQueueMs_;
+
+  curStartIdx_ = -1;
+  curSetIdx_   = 0;
+  timeScale_   = 1.0f;
+  volScale_    = 1.0f;
+  stepIdx_     = (size_t)o.zone;
+  runVolumeMl_ = 0;
+  phase_       = Phase::RUN_STEP;
+  beginStep_(stepIdx_);
+  orders_->report(o.id, OrderQueue::Outcome::STARTED, nowMs, orderQueueMs_);
+  return true;
 }
 
-// ------------------- compat órdenes -------------------
-void AutoMode::enqueueOrder(const IrrigationOrder& ord) {
-  queue_.push_back(ord);
+void AutoMode::endOrder_() {
+  orderActive_ = false;
+  ordersDone_++;
+
+  if (resume_.valid) {
+    // Vuelve a la pausa de la corrida interrumpida (completa: la línea se despresuriza igual)
+    allOff_();
+    if (doser_) doser_->stop();
+    bank_.setToggleNext(false); bank_.setTogglePrev(alarm_());
+    curStartIdx_  = resume_.startIdx;
+    curSetIdx_    = resume_.setIdx;
+    stepIdx_      = resume_.stepIdx;
+    timeScale_    = resume_.timeScale;
+    volScale_     = resume_.volScale;
+    runVolumeMl_  = resume_.runVolumeMl;
+    effDurMs_     = 0;
+    effVolMl_     = 0;
+    resume_       = Resume{};
+    pauseStartMs_ = millis();
+    phase_        = Phase::PAUSE;
+    return;
+  }
+
+  // Desde reposo: un inicio programado que cayó durante la orden arranca ahora
+  const int deferred = deferredStart_;
+  stopProgram();
+  if (deferred >= 0) startProgramForStart((size_t)deferred);
 }
 
 // ------------------- Programación: seteo -------------------
 void AutoMode::setSchedule(const ProgramSpec* prog, const FlowCalibration* cal) {
   prog_ = prog;
   if (cal) cal_ = *cal;
+  flowMon_.setCalibration(cal_.pulsesPerMl1, cal_.pulsesPerMl2);
+  if (doser_) doser_->setCalibration(cal_.pulsesPerMl1, cal_.pulsesPerMl2);
+  flowMon_.unwatchAll(millis());
+  startIndex_.build(prog_);
+  nextStartValid_ = false;
+  flow_.disarmWake();
   allOff_();
   phase_ = Phase::IDLE;
   stepIdx_ = 0;
+  stepClockPending_ = false;
+  slots_.clear();
+  for (ZoneRun& z : zones_) z.active = false;
   runVolumeMl_ = 0;
   curStartIdx_ = -1;
   curSetIdx_   = -1;
+  remoteRun_   = false;
   effDurMs_ = 0;
   effVolMl_ = 0;
 }
 
+void AutoMode::reloadSchedule(const ProgramSpec* prog, const FlowCalibration* cal) {
+  holdForReload_ = false;
+
+  // Primer programa (sale del blink legacy) o sin programa: recarga completa
+  if (!prog_ || !prog) {
+    setSchedule(prog, cal);
+    return;
+  }
+
+  // En reposo las salidas ya están apagadas: no se tocan (puede estar en MANUAL)
+  prog_ = prog;
+  if (cal) cal_ = *cal;
+  flowMon_.setCalibration(cal_.pulsesPerMl1, cal_.pulsesPerMl2);
+  if (doser_) doser_->setCalibration(cal_.pulsesPerMl1, cal_.pulsesPerMl2);
+  startIndex_.build(prog_);
+  nextStartValid_ = false;
+
+  if (phase_ != Phase::PAUSE) return;
+
+  // Pausa entre pasos: la corrida sigue con el programa nuevo, salvo que se
+  // haya deshabilitado (salvo corrida remota) o su set desaparecido (si sólo se
+  // acortó, la pausa lo detecta)
+  if (curStartIdx_ >= (int)prog_->starts.size()) curStartIdx_ = -1;
+  if ((!prog_->enabled && !remoteRun_) || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) stopProgram();
+}
+
 // ------------------- Telemetría -------------------
-AutoMode::Tele AutoMode::telemetry() const {
+void AutoMode::publishTelemetry_() {
+  tele_.publish(buildTelemetry_(millis()));
+}
+
+AutoMode::Tele AutoMode::buildTelemetry_(uint32_t nowMs) {
   Tele t;
 
   time_t nowEpoch = time(nullptr);
@@ -138,20 +451,42 @@ AutoMode::Tele AutoMode::telemetry() const {
   t.pausing    = (phase_ == Phase::PAUSE);
   t.running    = (phase_ == Phase::RUN_STEP || t.pausing);
 
-  // Pulsos globales
-  noInterrupts();
-  t.pulses1 = pulse1_;
-  t.pulses2 = pulse2_;
-  interrupts();
+  // Pulsos globales (PCNT, truncados a 32 bits para la UI)
+  t.pulses1 = (uint32_t)flow_.total(0);
+  t.pulses2 = (uint32_t)flow_.total(1);
 
   t.programEnabled = (prog_ && prog_->enabled);
-  t.nextStartEpoch = computeNextStartEpoch_();
+  t.flowAlarm      = flowAlarm_;
+  t.flowLph        = flowMon_.rateLph(-1);
+  if (doser_) for (int ch = 0; ch < FertDoser::NUM_CH; ++ch) t.fert[ch] = doser_->stats(ch, nowMs);
+  t.pressureAlarm  = pressureAlarm_;
+  t.orderZone       = orderActive_ ? order_.zone : -1;
+  t.orderBacklog    = orders_ ? orders_->backlog() : 0;
+  t.ordersDone      = ordersDone_;
+  t.ordersRejected  = ordersRejected_;
+  t.ordersDropped   = orders_ ? orders_->dropped() : 0;
+  t.orderQueueMs    = orderQueueMs_;
+  t.orderQueueMaxMs = orderQueueMaxMs_;
+  t.remoteRun       = remoteRun_;
+  if (sensors_) {
+    const SensorService::Snapshot s = sensors_->snapshot();
+    for (int ch = 0; ch < SensorService::NUM_CH; ++ch) t.analog[ch] = s.ch[ch];
+  }
+
+  // Próximo inicio: se recalcula como mucho 1 vez por segundo
+  if (!nextStartValid_ || (uint32_t)(nowMs - nextStartComputedMs_) >= 1000UL) {
+    nextStartEpoch_      = computeNextStartEpoch_();
+    nextStartComputedMs_ = nowMs;
+    nextStartValid_      = true;
+  }
+  t.nextStartEpoch = nextStartEpoch_;
 
   if (prog_ && t.running) {
     const StepSpec* sp = nullptr;
+    const size_t    curStep = currentStep_();
     if (curSetIdx_ >= 0 && (size_t)curSetIdx_ < prog_->sets.size()) {
       const StepSet& set = prog_->sets[curSetIdx_];
-      if (stepIdx_ < set.steps.size()) sp = &set.steps[stepIdx_];
+      if (curStep < set.steps.size()) sp = &set.steps[curStep];
     }
     // fallback si no hay sets -> incompatible, pero no debería pasar si t.running
     if (!sp) {
@@ -160,8 +495,8 @@ AutoMode::Tele AutoMode::telemetry() const {
     }
 
     const int idx = sp->idx;
-    t.stepIndex  = (int)stepIdx_;
-    t.stateIndex = (int)stepIdx_;
+    t.stepIndex  = (int)curStep;
+    t.stateIndex = (int)curStep;
     t.mainIndex  = idx / 2;
     t.direct     = ((idx & 1) == 0);
 
@@ -172,12 +507,11 @@ AutoMode::Tele AutoMode::telemetry() const {
 
     t.stateDurationMs = effDurMs_ ? effDurMs_ : durScaled;
     t.stateTargetMl   = effVolMl_ ? effVolMl_ : volScaled;
-    t.stateElapsedMs  = millis() - stepStartMs_;
+    t.stateElapsedMs  = stepClockPending_ ? 0 : nowMs - stepStartMs_;
 
     // volumen del paso (delta)
-    noInterrupts();
-    unsigned long p1 = pulse1_, p2 = pulse2_;
-    interrupts();
+    uint64_t p1, p2;
+    flow_.totals(p1, p2);
     uint32_t d1 = (uint32_t)(p1 - stepStartP1_);
     uint32_t d2 = (uint32_t)(p2 - stepStartP2_);
     t.stateVolumeMl = volumeMlFromPulses_(d1, d2);
@@ -190,7 +524,7 @@ AutoMode::Tele AutoMode::telemetry() const {
     t.stateIndex = stateIndex_;
     t.mainIndex  = idx / 2;
     t.direct     = ((idx & 1) == 0);
-    t.stateElapsedMs  = millis() - stateStart_;
+    t.stateElapsedMs  = nowMs - stateStart_;
     t.stateDurationMs = stateDurMs_;
     t.stateTargetMl   = 0;
     t.stateVolumeMl   = 0;
@@ -204,42 +538,13 @@ AutoMode::Tele AutoMode::telemetry() const {
 
 // ------------------- helpers comunes -------------------
 void AutoMode::smoothTransition(int idx) {
-  // Apaga todo
-  bank_.allMainsOff(); bank_.allSecsOff();
-  bank_.setAlways(false); bank_.setAlways12(false);
-  delay(stepDelayMs_);
-
-  // Enciende bancos
-  bank_.setAlways(true);
-  bank_.setAlways12(true);
-  delay(stepDelayMs_);
-
-  const int  m      = idx / 2;
-  const bool direct = ((idx & 1) == 0);
-
-  if (direct) {
-    bank_.setMainDirect(m);
-    delay(stepDelayMs_);
-    bank_.setSec(0, false);
-    bank_.setSec(1, true);
-    delay(stepDelayMs_);
-  } else {
-    bank_.applyMainsPattern(m, false);
-    delay(stepDelayMs_);
-    bank_.setSec(0, true);
-    bank_.setSec(1, false);
-    delay(stepDelayMs_);
-  }
-
-  bank_.setToggleNext(true);
-  bank_.setTogglePrev(true);
+  // OFF -> bancos -> main -> sec (+toggles), una etapa cada stepDelayMs_ desde run()
+  trans_.start(idx, millis(), doser_ ? RelayTransition::LATCH_PREV : RelayTransition::LATCH_BOTH);
 }
 
 void AutoMode::allOff_() {
-  bank_.allMainsOff();
-  bank_.allSecsOff();
-  bank_.setAlways(false);
-  bank_.setAlways12(false);
+  trans_.cancel();
+  bank_.applyMask(0, 0, false, false);
 }
 
 bool AutoMode::waitForValidIP(uint32_t timeoutMs) const {
@@ -260,12 +565,12 @@ void AutoMode::handlePhaseLogic() {
   unsigned long now = millis();
 
   if (activePhase_) {
-    // acumula pulsos recientes
-    noInterrupts();
-    unsigned long p_tot = pulse1_ + pulse2_;
-    pulse1_ = pulse2_ = 0;
-    interrupts();
-    pulseCount_ += p_tot;
+    // acumula pulsos recientes (delta contra la última lectura)
+    uint64_t p1, p2;
+    flow_.totals(p1, p2);
+    const uint64_t p_tot = p1 + p2;
+    pulseCount_ += (unsigned long)(p_tot - blinkLastTotal_);
+    blinkLastTotal_ = p_tot;
 
     if ((now - stateStart_ >= stateDurMs_) || (pulseCount_ >= 1000UL)) {
       stateIndex_++;
@@ -298,42 +603,25 @@ bool AutoMode::timeNow(struct tm& out) const {
   return true;
 }
 
-bool AutoMode::todayMatches(uint8_t dowMask, int wday) const {
-  // tm_wday: 0=Dom..6=Sab ; máscara: bit0=Lun..bit6=Dom
-  int dowBit = -1;
-  switch (wday) {
-    case 1: dowBit = 0; break; // Lun
-    case 2: dowBit = 1; break; // Mar
-    case 3: dowBit = 2; break; // Mie
-    case 4: dowBit = 3; break; // Jue
-    case 5: dowBit = 4; break; // Vie
-    case 6: dowBit = 5; break; // Sab
-    case 0: dowBit = 6; break; // Dom
-  }
-  if (dowBit < 0) return false;
-  return (dowMask & (1 << dowBit)) != 0;
-}
-
 int AutoMode::shouldStartNow(const struct tm& nowTm) {
-  if (!prog_ || !prog_->enabled || prog_->starts.empty()) return -1;
+  if (!prog_ || !prog_->enabled || startIndex_.empty()) return -1;
 
   int yday = nowTm.tm_yday;
   int minuteOfDay = nowTm.tm_hour * 60 + nowTm.tm_min;
 
+  // O(1): nada que hacer en este minuto
+  const int mow = StartIndex::minuteOfWeek(nowTm);
+  if (!startIndex_.hasStartAt(mow)) return -1;
+
   // Evitar doble disparo en el mismo minuto
   if (lastStartYDay_ == yday && lastStartMin_ == minuteOfDay) return -1;
 
-  for (size_t i=0;i<prog_->starts.size();++i) {
-    const StartSpec& st = prog_->starts[i];
-    if (!st.enabled) continue;
-    if (!todayMatches(st.dowMask, nowTm.tm_wday)) continue;
-    if (st.hour == (uint8_t)nowTm.tm_hour && st.minute == (uint8_t)nowTm.tm_min) {
-      lastStartYDay_ = yday;
-      lastStartMin_  = minuteOfDay;
-      return (int)i;
-    }
+  const int i = startIndex_.startAt(mow);
+  if (i >= 0) {
+    lastStartYDay_ = yday;
+    lastStartMin_  = minuteOfDay;
   }
-  return -1;
+  return i;
 }
 
 void AutoMode::startProgramForStart(size_t startIdx) {
@@ -360,24 +648,81 @@ void AutoMode::startProgramForStart(size_t startIdx) {
   stepIdx_  = 0;
   runVolumeMl_ = 0;
 
-  noInterrupts();
-  stepStartP1_ = pulse1_;
-  stepStartP2_ = pulse2_;
-  interrupts();
+  flow_.totals(stepStartP1_, stepStartP2_);
 
   effDurMs_ = 0;
   effVolMl_ = 0;
 
-  beginStep_(stepIdx_);
+  beginRun_();
+}
+
+// ------------------- Control remoto -------------------
+bool AutoMode::runSetNow(size_t setIdx, float timeScale, float volScale) {
+  if (!initialized_ || phase_ != Phase::IDLE || orderActive_) return false;
+  if (!prog_ || setIdx >= prog_->sets.size() || prog_->sets[setIdx].steps.empty()) return false;
+
+  curStartIdx_ = -1;
+  curSetIdx_   = (int)setIdx;
+  timeScale_   = timeScale > 0.f ? timeScale : 1.0f;
+  volScale_    = volScale  > 0.f ? volScale  : 1.0f;
+  remoteRun_   = true;
+
+  phase_       = Phase::RUN_STEP;
+  stepIdx_     = 0;
+  runVolumeMl_ = 0;
+  flow_.totals(stepStartP1_, stepStartP2_);
+  effDurMs_ = 0;
+  effVolMl_ = 0;
+
+  beginRun_();
+  publishTelemetry_();
+  return true;
+}
+
+bool AutoMode::stopNow() {
+  if (phase_ != Phase::RUN_STEP && phase_ != Phase::PAUSE) return false;
+  abortRun_();
+  publishTelemetry_();
+  return true;
+}
+
+void AutoMode::abortRun_() {
+  if (phase_ == Phase::RUN_STEP && !slots_.empty()) {
+    for (ZoneRun& z : zones_) if (z.active) finishZone_(z);
+  } else if (phase_ == Phase::RUN_STEP) {
+    // Medidas reales hasta este instante
+    uint64_t p1, p2;
+    flow_.totals(p1, p2);
+
+    uint32_t d1 = (uint32_t)(p1 - stepStartP1_);
+    uint32_t d2 = (uint32_t)(p2 - stepStartP2_);
+    uint32_t volReal = volumeMlFromPulses_(d1, d2);
+    uint32_t durReal = msSince(stepStartMs_);
+
+    // Publicar el cierre
+    publishStateEnd_(stepIdx_, durReal, volReal);
+  }
+  if (orderActive_) ordersDone_++;
+
+  stopProgram();   // apaga y resetea fase
 }
 
 void AutoMode::stopProgram() {
   allOff_();
-  bank_.setToggleNext(false); bank_.setTogglePrev(false);
+  flowMon_.unwatchAll(millis());
+  if (doser_) doser_->stop();
+  bank_.setToggleNext(false); bank_.setTogglePrev(alarm_());
   phase_ = Phase::IDLE;
   stepIdx_ = 0;
+  stepClockPending_ = false;
+  slots_.clear();
+  for (ZoneRun& z : zones_) z.active = false;
   curStartIdx_ = -1;
   curSetIdx_   = -1;
+  remoteRun_   = false;
+  orderActive_   = false;
+  resume_        = Resume{};
+  deferredStart_ = -1;
 
   haveCurWindow_       = false;
   curWindowStartEpoch_ = 0;
@@ -388,42 +733,127 @@ void AutoMode::stopProgram() {
   effVolMl_ = 0;
 }
 
-void AutoMode::beginStep_(size_t idx) {
+void AutoMode::beginStep_(size_t idx, const StepSpec* handoverFrom) {
   if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) { stopProgram(); return; }
   const StepSet& set = prog_->sets[curSetIdx_];
   if (idx >= set.steps.size()) { stopProgram(); return; }
 
-  smoothTransition(set.steps[idx].idx);
+  // ====== Objetivos efectivos (NVS zonas) ======
+  effectiveTargets_(idx, effDurMs_, effVolMl_);
+
+  // La transición avanza en run(); el paso (tiempo/volumen) se mide desde que
+  // termina (startStepClock_). Hasta entonces, valores provisionales. En un
+  // relevo también: durante el solape corre el agua de la zona saliente, que
+  // no es de este paso.
   stepStartMs_ = millis();
+  flow_.totals(stepStartP1_, stepStartP2_);
+  stepSavedMs_ = 0;
+  handoverIn_  = handoverFrom != nullptr;
+  if (handoverFrom) {
+    const StepSpec& to = set.steps[idx];
+    trans_.handover(handoverFrom->mainsMask, handoverFrom->secsMask,
+                    to.mainsMask, to.secsMask, prog_->handoverMs, millis());
+  } else {
+    // Con la hidráulica de la zona (RelayState) se actúa por máscaras, igual
+    // que el relevo y el modo concurrente: la misma zona abre los mismos relés
+    // en los tres. Sin ella, por idx (main*2 + alterno).
+    const StepSpec& sp = set.steps[idx];
+    if (sp.mainsMask) trans_.startMask(sp.mainsMask, sp.secsMask, millis(),
+                                       doser_ ? RelayTransition::LATCH_PREV : RelayTransition::LATCH_BOTH);
+    else              smoothTransition(sp.idx);
+    if (doser_) doser_->stop();   // sin agua todavía
+  }
+  stepClockPending_ = true;
 
-  noInterrupts();
-  stepStartP1_ = pulse1_;
-  stepStartP2_ = pulse2_;
-  interrupts();
+  // ====== PUBLICACIÓN: inicio de estado con objetivos efectivos ======
+  publishStateStart_(idx, effDurMs_, effVolMl_);
+}
+
+void AutoMode::startStepClock_(uint32_t nowMs) {
+  stepClockPending_ = false;
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) return;
+  const StepSet& set = prog_->sets[curSetIdx_];
+
+  // Agua de la transición (en un relevo, ambas zonas abiertas): cuenta para
+  // el run pero no para ningún paso
+  uint64_t p1, p2;
+  flow_.totals(p1, p2);
+  runVolumeMl_ += volumeMlFromPulses_((uint32_t)(p1 - stepStartP1_), (uint32_t)(p2 - stepStartP2_));
+
+  // Relevo: lo ahorrado frente al corte clásico, medido (transición con corte
+  // de este equipo + la pausa que se saltó - lo que tardó el relevo)
+  const uint32_t transMs = nowMs - stepStartMs_;
+  if (handoverIn_) {
+    const uint32_t cutMs = cutTransMs_ + handoverPauseMs_;
+    stepSavedMs_      = cutMs > transMs ? cutMs - transMs : 0;
+    handoverSavedMs_ += stepSavedMs_;
+    handoverIn_       = false;
+  } else if (slots_.empty()) {
+    cutTransMs_ = transMs;
+  }
+
+  stepStartMs_ = nowMs;
+  stepStartP1_ = p1;
+  stepStartP2_ = p2;
+  if (doser_) doser_->start(nowMs, stepStartP1_, stepStartP2_);
+
+  uint32_t durMs, volMl;
+  uint8_t  fert[FertDoser::NUM_CH] = { 0, 0 };
+  if (slots_.empty()) {
+    if (stepIdx_ >= set.steps.size()) return;
+    const StepSpec& sp = set.steps[stepIdx_];
+    flowMon_.watch(0, sp.idx, -1, sp.flowLph, nowMs);
+    effectiveTargets_(stepIdx_, durMs, volMl, fert);
+    feedDoser_(0, sp, -1, fert);
+    return;
+  }
+
+  for (uint8_t i = 0; i < ZoneSlot::MAX_ZONES; ++i) {
+    ZoneRun& z = zones_[i];
+    if (!z.active) continue;
+    const StepSpec& sp = set.steps[z.step];
+    z.startMs = nowMs;
+    z.base1   = stepStartP1_;
+    z.base2   = stepStartP2_;
+    flowMon_.watch(i, sp.idx, z.line, sp.flowLph, nowMs);
+    effectiveTargets_(z.step, durMs, volMl, fert);
+    feedDoser_(i, sp, z.line, fert);
+  }
+}
+
+void AutoMode::effectiveTargets_(size_t idx, uint32_t& durMs, uint32_t& volMl, uint8_t* fertPct) const {
+  durMs = 0; volMl = 0;
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) return;
+  const StepSet& set = prog_->sets[curSetIdx_];
+  if (idx >= set.steps.size()) return;
 
-  // ====== Objetivos efectivos (NVS zonas) ======
   // 1) escalados a partir del StepSpec
   const StepSpec& sp = set.steps[idx];
   const uint32_t durScaled = sp.maxDurationMs ? (uint32_t)lroundf((float)sp.maxDurationMs * timeScale_) : 0;
   const uint32_t volScaled = sp.targetMl     ? (uint32_t)lroundf((float)sp.targetMl     * volScale_ ) : 0;
 
-  // 2) leer NVS: "zones" -> z{idx}_time / z{idx}_vol
-  uint32_t zVol = 0, zTime = 0;
-  (void)readZoneTargetsNVS_((int)idx, zVol, zTime);
+  // 2) objetivos de la zona (ZoneTable en RAM: sin flash en el arranque del paso)
+  const ZoneTable::Zone z = zoneTable().get((int)idx);
+  if (fertPct) { fertPct[0] = z.fert1Pct; fertPct[1] = z.fert2Pct; }
 
-  // 3) elegir objetivos efectivos (preferir NVS si >0)
-  effDurMs_ = (zTime > 0) ? zTime : durScaled;
-  effVolMl_ = (zVol  > 0) ? zVol  : volScaled;
+  // 3) elegir objetivos efectivos (preferir los de la zona si >0)
+  durMs = (z.timeMs   > 0) ? z.timeMs   : durScaled;
+  volMl = (z.volumeMl > 0) ? z.volumeMl : volScaled;
 
-  // ====== PUBLICACIÓN: inicio de estado con objetivos efectivos ======
-  publishStateStart_(idx, effDurMs_, effVolMl_);
+  // 4) orden a demanda: sus objetivos mandan
+  if (orderActive_) {
+    if (order_.durationMs) durMs = order_.durationMs;
+    if (order_.volumeMl)   volMl = order_.volumeMl;
+  }
 }
 
 void AutoMode::finishStep_() {
+  // Paso completo: si no hubo anomalía, su caudal alimenta la línea base
+  learnFlow_(0);
+
   // suma volumen del paso al acumulado
-  noInterrupts();
-  unsigned long p1 = pulse1_, p2 = pulse2_;
-  interrupts();
+  uint64_t p1, p2;
+  flow_.totals(p1, p2);
   uint32_t d1 = (uint32_t)(p1 - stepStartP1_);
   uint32_t d2 = (uint32_t)(p2 - stepStartP2_);
   runVolumeMl_ += volumeMlFromPulses_(d1, d2);
@@ -431,17 +861,36 @@ void AutoMode::finishStep_() {
   if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) { stopProgram(); return; }
   const StepSet& set = prog_->sets[curSetIdx_];
 
+  // ¿hay pausa?
+  uint32_t pauseMs = set.pauseMsBetweenSteps ? (uint32_t)lroundf((float)set.pauseMsBetweenSteps * timeScale_) : 0;
+
+  // ¿relevo sin corte? Requiere las máscaras (RelayState) de ambas zonas.
+  // Sustituye la pausa y las etapas OFF/BANK/MAIN de la transición suave.
+  const size_t next = stepIdx_ + 1;
+  const bool handover = prog_->handoverMs > 0 && !holdForReload_ && !orderActive_ && next < set.steps.size() &&
+                        set.steps[stepIdx_].mainsMask != 0 && set.steps[next].mainsMask != 0;
+  handoverPauseMs_ = handover ? pauseMs : 0;
+
   // ====== PUBLICACIÓN: fin de estado (volumen/tiempo reales) ======
   uint32_t durReal = msSince(stepStartMs_);
   uint32_t volReal = volumeMlFromPulses_(d1, d2);
-  publishStateEnd_(stepIdx_, durReal, volReal);
+  publishStateEnd_(stepIdx_, durReal, volReal, stepSavedMs_);
 
-  // ¿hay pausa?
-  uint32_t pauseMs = set.pauseMsBetweenSteps ? (uint32_t)lroundf((float)set.pauseMsBetweenSteps * timeScale_) : 0;
+  if (orderActive_) { endOrder_(); return; }
+
+  if (handover) {
+    const StepSpec& from = set.steps[stepIdx_];
+    stepIdx_ = next;
+    beginStep_(stepIdx_, &from);
+    phase_ = Phase::RUN_STEP;
+    return;
+  }
 
-  if (pauseMs > 0) {
+  if (pauseMs > 0 || holdForReload_) {
+    // holdForReload_: pausa de 0 ms para cambiar de programa entre pasos
     allOff_();
-    bank_.setToggleNext(false); bank_.setTogglePrev(false);
+    if (doser_) doser_->stop();
+    bank_.setToggleNext(false); bank_.setTogglePrev(alarm_());
     pauseStartMs_ = millis();
     phase_ = Phase::PAUSE;
   } else {
@@ -456,10 +905,201 @@ void AutoMode::finishStep_() {
   }
 }
 
+void AutoMode::feedDoser_(uint8_t slot, const StepSpec& sp, int8_t line, const uint8_t* fertPct) {
+  if (!doser_ || !fertPct) return;
+  FertDoser::Feed f;
+  f.line   = line;
+  f.pct[0] = fertPct[0];
+  f.pct[1] = fertPct[1];
+  // pct es ciclo útil exacto al caudal aprendido de la zona (o al declarado)
+  f.refLph = flowMon_.baselineLph(sp.idx);
+  doser_->setFeed(slot, f);
+}
+
+// ------------------- Programado: modo concurrente -------------------
+void AutoMode::beginRun_() {
+  slots_.clear();
+  handoverSavedMs_ = 0;
+  flowAlarm_     = false;   // las alarmas duran hasta el siguiente inicio
+  pressureAlarm_ = false;
+  if (prog_ && prog_->concurrent && prog_->pumpCapacityLph > 0 &&
+      curSetIdx_ >= 0 && (size_t)curSetIdx_ < prog_->sets.size()) {
+    std::vector<ZoneSlot> packed = packZones(prog_->sets[curSetIdx_].steps, prog_->pumpCapacityLph);
+    // Sólo vale la pena si algún slot junta zonas; si no, corrida secuencial
+    for (const ZoneSlot& sl : packed) {
+      if (sl.n > 1) { slots_.swap(packed); break; }
+    }
+  }
+  if (slots_.empty()) beginStep_(stepIdx_);
+  else                beginSlot_(stepIdx_);
+}
+
+void AutoMode::beginSlot_(size_t slotIdx) {
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size() || slotIdx >= slots_.size()) {
+    stopProgram(); return;
+  }
+  const StepSet&  set = prog_->sets[curSetIdx_];
+  const ZoneSlot& sl  = slots_[slotIdx];
+
+  // Provisional: el reloj de cada zona arranca con startStepClock_
+  stepStartMs_ = millis();
+  flow_.totals(stepStartP1_, stepStartP2_);
+  stepSavedMs_ = 0;
+  handoverIn_  = false;
+  if (doser_) doser_->stop();
+
+  bool any = false;
+  for (uint8_t i = 0; i < ZoneSlot::MAX_ZONES; ++i) {
+    ZoneRun& z = zones_[i];
+    z = ZoneRun{};
+    if (i >= sl.n || sl.step[i] >= set.steps.size()) continue;   // set acortado por recarga
+
+    z.active  = true;
+    z.step    = sl.step[i];
+    z.line    = (sl.n > 1) ? (int8_t)flowLineOf(set.steps[z.step]) : -1;
+    z.startMs = stepStartMs_;
+    z.base1   = stepStartP1_;
+    z.base2   = stepStartP2_;
+    effectiveTargets_(z.step, z.durMs, z.volMl);
+    publishStateStart_(z.step, z.durMs, z.volMl);
+    any = true;
+  }
+  if (!any) { finishSlot_(); return; }
+
+  // Telemetría: objetivos de la primera zona del slot
+  effDurMs_ = zones_[0].durMs;
+  effVolMl_ = zones_[0].volMl;
+
+  applyZones_(/*smooth*/ true);
+  stepClockPending_ = trans_.busy();
+  if (!stepClockPending_) startStepClock_(millis());
+}
+
+uint32_t AutoMode::zoneVolumeMl_(const ZoneRun& z) const {
+  uint64_t p1, p2;
+  flow_.totals(p1, p2);
+  const uint32_t d1 = (uint32_t)(p1 - z.base1);
+  const uint32_t d2 = (uint32_t)(p2 - z.base2);
+  if (z.line < 0) return volumeMlFromPulses_(d1, d2);
+
+  // Zona con caudalímetro propio: sólo su línea (pulsos crudos si no hay calibración)
+  const uint32_t d   = (z.line == 0) ? d1 : d2;
+  const float    cal = (z.line == 0) ? cal_.pulsesPerMl1 : cal_.pulsesPerMl2;
+  return (cal > 0.f) ? (uint32_t)lroundf((float)d / cal) : d;
+}
+
+void AutoMode::applyZones_(bool smooth) {
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) return;
+  const StepSet& set = prog_->sets[curSetIdx_];
+
+  uint16_t mains = 0, secs = 0;
+  int n = 0, lone = -1;
+  for (const ZoneRun& z : zones_) {
+    if (!z.active) continue;
+    const StepSpec& sp = set.steps[z.step];
+    mains |= sp.mainsMask;
+    secs  |= sp.secsMask;
+    lone   = sp.idx;
+    n++;
+  }
+
+  // Zona sola sin hidráulica declarada: patrón clásico por idx
+  if (n == 1 && mains == 0) {
+    if (smooth) smoothTransition(lone);
+    return;
+  }
+  if (smooth) {
+    trans_.startMask(mains, secs, millis(), doser_ ? RelayTransition::LATCH_PREV : RelayTransition::LATCH_BOTH);
+  } else {
+    // Una zona terminó: se quita sin pasar por OFF (la otra sigue regando)
+    trans_.cancel();
+    bank_.applyMask(mains, secs, true, true);
+  }
+}
+
+void AutoMode::learnFlow_(uint8_t slot) {
+  flowMon_.unwatch(slot, /*learn*/ true, millis());
+  FlowBaselines b;
+  for (uint16_t z = 0; z < FlowMonitor::MAX_ZONES; ++z) b.lph[z] = flowMon_.baselineLph(z);
+  baselines_.publish(b);
+}
+
+void AutoMode::finishZone_(ZoneRun& z) {
+  const uint32_t volReal = zoneVolumeMl_(z);
+  const uint32_t durReal = msSince(z.startMs);
+  runVolumeMl_ += volReal;
+  z.active = false;
+  const uint8_t slot = (uint8_t)(&z - zones_);
+  learnFlow_(slot);
+  publishStateEnd_(z.step, durReal, volReal);
+  if (doser_) doser_->clearFeed(slot);
+}
+
+void AutoMode::runSlot_() {
+  bool changed = false, any = false;
+  for (ZoneRun& z : zones_) {
+    if (!z.active) continue;
+    const bool volDone = z.volMl > 0 && zoneVolumeMl_(z) >= z.volMl;
+    const bool durDone = z.durMs > 0 && msSince(z.startMs) >= z.durMs;
+    if (volDone || durDone || z.cut) { finishZone_(z); changed = true; }
+    else any = true;
+  }
+  if (!any)          finishSlot_();
+  else if (changed)  applyZones_(/*smooth*/ false);
+}
+
+void AutoMode::finishSlot_() {
+  if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) { stopProgram(); return; }
+  const StepSet& set = prog_->sets[curSetIdx_];
+
+  uint32_t pauseMs = set.pauseMsBetweenSteps ? (uint32_t)lroundf((float)set.pauseMsBetweenSteps * timeScale_) : 0;
+  if (pauseMs > 0 || holdForReload_) {
+    allOff_();
+    if (doser_) doser_->stop();
+    bank_.setToggleNext(false); bank_.setTogglePrev(alarm_());
+    pauseStartMs_ = millis();
+    phase_ = Phase::PAUSE;
+  } else {
+    stepIdx_++;
+    if (stepIdx_ < slots_.size()) beginSlot_(stepIdx_);
+    else                          stopProgram();
+  }
+}
+
+void AutoMode::armSlotWake_() {
+  flow_.disarmWake();
+  const float cal[2] = { cal_.pulsesPerMl1, cal_.pulsesPerMl2 };
+  for (const ZoneRun& z : zones_) {
+    if (!z.active || z.volMl == 0) continue;
+    const uint32_t ml = zoneVolumeMl_(z);
+    if (ml >= z.volMl) continue;
+    const float rem = (float)(z.volMl - ml);
+    if (z.line >= 0) {
+      if (cal[z.line] > 0.f) flow_.armWake(z.line, (uint32_t)ceilf(rem * cal[z.line]));
+    } else {
+      // Suma de ambas líneas: cada canal a la mitad (ver armFlowWake_)
+      for (int ch = 0; ch < 2; ++ch)
+        if (cal[ch] > 0.f) flow_.armWake(ch, (uint32_t)ceilf(rem * 0.5f * cal[ch]));
+    }
+  }
+}
+
+size_t AutoMode::currentStep_() const {
+  if (slots_.empty()) return stepIdx_;
+  for (const ZoneRun& z : zones_) if (z.active) return z.step;
+  return (stepIdx_ < slots_.size()) ? slots_[stepIdx_].step[0] : stepIdx_;
+}
+
 void AutoMode::runScheduled() {
   struct tm nowTm;
   bool haveTime = timeNow(nowTm);
 
+  // Orden desde reposo: un StartSpec de este minuto se difiere hasta que termine
+  if (orderActive_ && !resume_.valid && haveTime && allowedNowByWindows_()) {
+    const int sIdx = shouldStartNow(nowTm);
+    if (sIdx >= 0) deferredStart_ = sIdx;
+  }
+
   // Arranque por horario (sólo si hay franja activa)
   if (phase_ == Phase::IDLE && haveTime) {
     if (allowedNowByWindows_()) {   // dentro de alguna franja
@@ -471,25 +1111,11 @@ void AutoMode::runScheduled() {
       }
 
       // 2) Fallback: Arrancar al entrar (o si aún no se arrancó) en la ventana -> Set 0
-      //    Lee ventanas desde NVS y detecta en cuál estamos (s,e) con s<e
+      //    Franja actual desde el índice en RAM (schedule/WindowIndex.h)
       int md = nowTm.tm_hour * 60 + nowTm.tm_min;
       int curStart = -1;
-      {
-        Preferences p;
-        if (p.begin("windows", true)) {
-          uint8_t cnt = p.getUChar("count", 0);
-          for (uint8_t i = 0; i < cnt && i < 60; ++i) {
-            uint8_t sh = p.getUChar((String("w")+i+"_sh").c_str(), 0);
-            uint8_t sm = p.getUChar((String("w")+i+"_sm").c_str(), 0);
-            uint8_t eh = p.getUChar((String("w")+i+"_eh").c_str(), 0);
-            uint8_t em = p.getUChar((String("w")+i+"_em").c_str(), 0);
-            int s = (int)sh*60 + (int)sm;
-            int e = (int)eh*60 + (int)em;
-            if (s < e && md >= s && md < e) { curStart = s; break; }
-          }
-          p.end();
-        }
-      }
+      WindowIndex::Window w;
+      if (windowIndex().current(WindowIndex::dowOf(nowTm), md, w)) curStart = (int)w.startMin;
 
       if (curStart >= 0 && prog_ && prog_->enabled && !prog_->sets.empty()) {
         // ¿ya arrancamos esta ventana hoy?
@@ -503,15 +1129,12 @@ void AutoMode::runScheduled() {
           stepIdx_     = 0;
           runVolumeMl_ = 0;
 
-          noInterrupts();
-          stepStartP1_ = pulse1_;
-          stepStartP2_ = pulse2_;
-          interrupts();
+          flow_.totals(stepStartP1_, stepStartP2_);
 
           effDurMs_ = 0;
           effVolMl_ = 0;
 
-          beginStep_(stepIdx_);
+          beginRun_();
 
           gLastWinYDay     = nowTm.tm_yday;
           gLastWinStartMin = curStart;
@@ -522,30 +1145,25 @@ void AutoMode::runScheduled() {
   }
 
   // Si estamos corriendo o en pausa y salimos de franja: detener **publicando** fin de estado
-  if ((phase_ == Phase::RUN_STEP || phase_ == Phase::PAUSE) && !allowedNowByWindows_()) {
-
-    if (phase_ == Phase::RUN_STEP) {
-      // Medidas reales hasta este instante
-      noInterrupts();
-      unsigned long p1 = pulse1_, p2 = pulse2_;
-      interrupts();
-
-      uint32_t d1 = (uint32_t)(p1 - stepStartP1_);
-      uint32_t d2 = (uint32_t)(p2 - stepStartP2_);
-      uint32_t volReal = volumeMlFromPulses_(d1, d2);
-      uint32_t durReal = msSince(stepStartMs_);
-
-      // Publicar el cierre
-      publishStateEnd_(stepIdx_, durReal, volReal);
-    }
-
-    stopProgram();   // apaga y resetea fase
+  // (una orden a demanda no depende de franjas: termina y la corrida que retoma se corta;
+  // una corrida remota tampoco: la corta su último paso o stopNow)
+  if (!orderActive_ && !remoteRun_ && (phase_ == Phase::RUN_STEP || phase_ == Phase::PAUSE) && !allowedNowByWindows_()) {
+    abortRun_();
     return;
   }
 
   if (!prog_ || curSetIdx_ < 0 || (size_t)curSetIdx_ >= prog_->sets.size()) return;
   const StepSet& set = prog_->sets[curSetIdx_];
 
+  // Transición en curso: el paso todavía no empezó a contar
+  if (phase_ == Phase::RUN_STEP && stepClockPending_) return;
+
+  // Slot concurrente en ejecución (cada zona corta por su objetivo)
+  if (phase_ == Phase::RUN_STEP && !slots_.empty()) {
+    runSlot_();
+    return;
+  }
+
   // Paso en ejecución
   if (phase_ == Phase::RUN_STEP) {
     // Objetivos efectivos ya están en effDurMs_/effVolMl_ (inicializados en beginStep_)
@@ -553,9 +1171,8 @@ void AutoMode::runScheduled() {
 
     // Volumen (si hay objetivo)
     if (effVolMl_ > 0 && (cal_.pulsesPerMl1 > 0.f || cal_.pulsesPerMl2 > 0.f)) {
-      noInterrupts();
-      unsigned long p1 = pulse1_, p2 = pulse2_;
-      interrupts();
+      uint64_t p1, p2;
+      flow_.totals(p1, p2);
       uint32_t d1 = (uint32_t)(p1 - stepStartP1_);
       uint32_t d2 = (uint32_t)(p2 - stepStartP2_);
       uint32_t ml  = volumeMlFromPulses_(d1, d2);
@@ -567,9 +1184,8 @@ void AutoMode::runScheduled() {
       // Si no hay objetivo por NVS, revisa si StepSpec trae volumen escalado (>0)
       uint32_t volScaled = sp.targetMl ? (uint32_t)lroundf((float)sp.targetMl * volScale_) : 0;
       if (volScaled > 0 && (cal_.pulsesPerMl1 > 0.f || cal_.pulsesPerMl2 > 0.f)) {
-        noInterrupts();
-        unsigned long p1 = pulse1_, p2 = pulse2_;
-        interrupts();
+        uint64_t p1, p2;
+        flow_.totals(p1, p2);
         uint32_t d1 = (uint32_t)(p1 - stepStartP1_);
         uint32_t d2 = (uint32_t)(p2 - stepStartP2_);
         uint32_t ml  = volumeMlFromPulses_(d1, d2);
@@ -599,9 +1215,11 @@ void AutoMode::runScheduled() {
     uint32_t pauseMs = set.pauseMsBetweenSteps ? (uint32_t)lroundf((float)set.pauseMsBetweenSteps * timeScale_) : 0;
     if (msSince(pauseStartMs_) >= pauseMs) {
       stepIdx_++;
-      if (stepIdx_ < set.steps.size()) {
-        beginStep_(stepIdx_);
+      const size_t units = slots_.empty() ? set.steps.size() : slots_.size();
+      if (stepIdx_ < units) {
         phase_ = Phase::RUN_STEP;
+        if (slots_.empty()) beginStep_(stepIdx_);
+        else                beginSlot_(stepIdx_);
       } else {
         stopProgram();
       }
@@ -621,102 +1239,43 @@ uint32_t AutoMode::volumeMlFromPulses_(uint32_t p1, uint32_t p2) const {
 }
 
 uint32_t AutoMode::computeNextStartEpoch_() const {
-  if (!prog_ || !prog_->enabled || prog_->starts.empty()) return 0;
+  if (!prog_ || !prog_->enabled || startIndex_.empty()) return 0;
 
   time_t nowEpoch = time(nullptr);
   if (nowEpoch <= 100000) return 0; // sin hora válida
 
-  time_t best = 0;
-
-  for (int d = 0; d <= 7; ++d) {
-    time_t dayBase = nowEpoch + d * 86400;
-    struct tm dayTm;
-    if (!localtime_r(&dayBase, &dayTm)) continue;
-
-    for (const auto& st : prog_->starts) {
-      if (!st.enabled) continue;
-      if (!todayMatches(st.dowMask, dayTm.tm_wday)) continue;
+  struct tm nowTm;
+  if (!localtime_r(&nowEpoch, &nowTm)) return 0;
 
-      struct tm ts = dayTm;
-      ts.tm_hour = st.hour;
-      ts.tm_min  = st.minute;
-      ts.tm_sec  = 0;
+  // O(log n) en el índice semanal; un solo mktime (respeta cambios de hora)
+  const int delta = startIndex_.minutesToNextAfter(StartIndex::minuteOfWeek(nowTm));
+  if (delta < 0) return 0;
 
-      time_t cand = mktime(&ts); // epoch local
-      if (cand <= nowEpoch) continue; // futuro únicamente
-      if (best == 0 || cand < best) best = cand;
-    }
-  }
-  return (best > 0) ? (uint32_t)best : 0;
+  struct tm ts = nowTm;
+  ts.tm_sec  = 0;
+  ts.tm_min += delta;
+  time_t cand = mktime(&ts);
+  return (cand > nowEpoch) ? (uint32_t)cand : 0;
 }
 
 // =================== Ventanas (permiso por hora) ===================
 bool AutoMode::allowedNowByWindows_() const {
-  // Cache simple para evitar I/O constante en NVS (refresca cada 5s)
-  struct Win { uint8_t sh, sm, eh, em; };
-  static Win cache[60];
-  static uint8_t cacheCnt = 0;
-  static uint32_t lastReadMs = 0;
-
-  const uint32_t nowMs = millis();
-  if (lastReadMs == 0 || (nowMs - lastReadMs) > 5000) {
-    cacheCnt = 0;
-    Preferences p;
-    if (p.begin("windows", true)) {
-      uint8_t cnt = p.getUChar("count", 0);
-      for (uint8_t i = 0; i < cnt && i < 60; ++i) {
-        Win w;
-        w.sh = p.getUChar((String("w")+i+"_sh").c_str(), 0);
-        w.sm = p.getUChar((String("w")+i+"_sm").c_str(), 0);
-        w.eh = p.getUChar((String("w")+i+"_eh").c_str(), 0);
-        w.em = p.getUChar((String("w")+i+"_em").c_str(), 0);
-        // Validar rango: semi-abierto [start, end), sin cruzar medianoche
-        int s = (int)w.sh*60 + (int)w.sm;
-        int e = (int)w.eh*60 + (int)w.em;
-        if (s < e) cache[cacheCnt++] = w;
-      }
-      p.end();
-    }
-    lastReadMs = nowMs ? nowMs : 1;
-  }
+  // Otro core: consultas por valor, nunca una referencia a la foto
+  const WindowIndex& win = windowIndex();
 
   // Si no hay franjas: permitir (compatibilidad hacia atrás)
-  if (cacheCnt == 0) return true;
+  if (win.empty()) return true;
 
   // Si no hay hora válida (sin NTP), permitir (no bloquear)
   struct tm tmnow;
   if (!timeNow(tmnow)) return true;
 
-  const int md = tmnow.tm_hour * 60 + tmnow.tm_min;
-  for (uint8_t i = 0; i < cacheCnt; ++i) {
-    const int s = (int)cache[i].sh*60 + (int)cache[i].sm;
-    const int e = (int)cache[i].eh*60 + (int)cache[i].em;
-    if (md >= s && md < e) return true;
-  }
-  return false;
+  return win.inside(WindowIndex::dowOf(tmnow), tmnow.tm_hour * 60 + tmnow.tm_min);
 }
 
 // =================== Helpers nuevos (ventana + JSON) ===================
 String AutoMode::two_(int v){ if (v<0) v=0; if (v>99) v%=100; char b[3]; snprintf(b,sizeof(b),"%02d",v); return String(b); }
 String AutoMode::hhmm_(int m){ if (m<0) m=0; if (m>=1440) m%=1440; return two_(m/60)+":"+two_(m%60); }
-String AutoMode::isoLocal_(time_t epoch){
-  if (epoch <= 0) return String("-");
-  struct tm tm; if (!localtime_r(&epoch, &tm)) return String("-");
-  char b[32]; strftime(b, sizeof(b), "%Y-%m-%d %H:%M:%S", &tm);
-  return String(b);
-}
-String AutoMode::jsonEscape_(const String& s){
-  String o; o.reserve(s.length()+4);
-  for (size_t i=0;i<s.length();++i){
-    char c=s[i];
-    if (c=='\\' || c=='"'){ o += '\\'; o += c; }
-    else if (c=='\n'){ o += "\\n"; }
-    else if (c=='\r'){ o += "\\r"; }
-    else if (c=='\t'){ o += "\\t"; }
-    else { o += c; }
-  }
-  return o;
-}
 
 bool AutoMode::computeCurrentWindow_(int& sminOut, int& eminOut, time_t& startEpochOut, time_t& endEpochOut, String& nameOut) const {
   sminOut = -1; eminOut = -1; startEpochOut = 0; endEpochOut = 0; nameOut = "";
@@ -725,22 +1284,10 @@ bool AutoMode::computeCurrentWindow_(int& sminOut, int& eminOut, time_t& startEp
 
   int md = nowTm.tm_hour*60 + nowTm.tm_min;
 
-  struct Win { uint8_t sh, sm, eh, em; };
   bool found=false; int smin=0, emin=0;
-
-  Preferences p;
-  if (p.begin("windows", true)) {
-    uint8_t cnt = p.getUChar("count", 0);
-    for (uint8_t i=0;i<cnt && i<60;i++){
-      uint8_t sh = p.getUChar((String("w")+i+"_sh").c_str(), 0);
-      uint8_t sm = p.getUChar((String("w")+i+"_sm").c_str(), 0);
-      uint8_t eh = p.getUChar((String("w")+i+"_eh").c_str(), 0);
-      uint8_t em = p.getUChar((String("w")+i+"_em").c_str(), 0);
-      int s = (int)sh*60 + (int)sm;
-      int e = (int)eh*60 + (int)em;
-      if (s<e && md>=s && md<e){ found=true; smin=s; emin=e; break; }
-    }
-    p.end();
+  WindowIndex::Window w;
+  if (windowIndex().current(WindowIndex::dowOf(nowTm), md, w)) {
+    found = true; smin = w.startMin; emin = w.endMin;
   }
 
   if (!found) {
@@ -767,8 +1314,25 @@ bool AutoMode::computeCurrentWindow_(int& sminOut, int& eminOut, time_t& startEp
   return true;
 }
 
+// Ventana cacheada en state_start (la misma en state_end)
+void AutoMode::putWindow_(payload::Writer& w) const {
+  using payload::Key;
+  w.beginMap(Key::WINDOW);
+  w.str(Key::NAME, curWindowName_);
+  w.time(Key::START, curWindowStartEpoch_);
+  w.time(Key::END, curWindowEndEpoch_);
+  w.endMap();
+}
+
+// Una sola copia al payload; si no entró en evBuf_ no se publica a medias
+void AutoMode::emit_(const payload::Writer& w) {
+  if (!w.ok()) return;
+  publisher_(pubTopic_, w.toString());
+}
+
 void AutoMode::publishStateStart_(size_t stepIdx, uint32_t durMsTarget, uint32_t volMlTarget) {
   if (!publisher_) return;
+  using payload::Key;
 
   // Refrescar/obtener ventana actual
   int smin=0, emin=0; time_t se=0, ee=0; String wname;
@@ -783,60 +1347,127 @@ void AutoMode::publishStateStart_(size_t stepIdx, uint32_t durMsTarget, uint32_t
     curWindowName_       = "—";
   }
 
-  String stateName = nameRes_ ? nameRes_((int)stepIdx) : (String("Paso ")+String((int)stepIdx));
-
-  time_t nowE = time(nullptr);
-  String payload = "{"
-    "\"event\":\"state_start\","
-    "\"window\":{"
-      "\"name\":\""+jsonEscape_(curWindowName_)+"\","
-      "\"start\":\""+isoLocal_(curWindowStartEpoch_)+"\","
-      "\"end\":\""+isoLocal_(curWindowEndEpoch_)+"\"},"
-    "\"state\":{"
-      "\"name\":\""+jsonEscape_(stateName)+"\","
-      "\"volume_ml\":" + String(volMlTarget) + ","
-      "\"duration_ms\":" + String(durMsTarget) + "},"
-    "\"at\":\""+isoLocal_(nowE)+"\""
-  "}";
-
-  publisher_(pubTopic_, payload);
+  const String stateName = nameRes_ ? nameRes_((int)stepIdx) : (String("Paso ")+String((int)stepIdx));
+
+  payload::Writer w(pubFormat_, evBuf_, sizeof(evBuf_));
+  w.beginEvent();
+  w.str(Key::EVENT, "state_start");
+  putWindow_(w);
+  w.beginMap(Key::STATE);
+  w.str(Key::NAME, stateName);
+  w.u32(Key::VOLUME_ML, volMlTarget);
+  w.u32(Key::DURATION_MS, durMsTarget);
+  w.endMap();
+  // Orden a demanda: id y espera en cola
+  if (orderActive_) {
+    w.beginMap(Key::ORDER);
+    w.u32(Key::ID, order_.id);
+    w.u32(Key::PRIORITY, order_.priority);
+    w.u32(Key::QUEUE_MS, orderQueueMs_);
+    w.u32(Key::BACKLOG, orders_ ? orders_->backlog() : 0);
+    w.endMap();
+  }
+  w.time(Key::AT, time(nullptr));
+  w.endMap();
+  emit_(w);
 }
 
-void AutoMode::publishStateEnd_(size_t stepIdx, uint32_t durMsReal, uint32_t volMlReal) {
+void AutoMode::publishStateEnd_(size_t stepIdx, uint32_t durMsReal, uint32_t volMlReal, uint32_t handoverSavedMs) {
   if (!publisher_) return;
+  using payload::Key;
+
+  const String stateName = nameRes_ ? nameRes_((int)stepIdx) : (String("Paso ")+String((int)stepIdx));
+
+  // Usamos las MISMAS claves que en state_start
+  payload::Writer w(pubFormat_, evBuf_, sizeof(evBuf_));
+  w.beginEvent();
+  w.str(Key::EVENT, "state_end");
+  putWindow_(w);
+  w.beginMap(Key::STATE);
+  w.str(Key::NAME, stateName);
+  w.u32(Key::VOLUME_ML, volMlReal);
+  w.u32(Key::DURATION_MS, durMsReal);
+  w.endMap();
+
+  // Relevo sin corte: tiempo muerto evitado por el relevo que abrió este paso
+  // (medido en startStepClock_) y acumulado del run
+  if (prog_ && prog_->handoverMs > 0) {
+    w.beginMap(Key::HANDOVER);
+    w.u32(Key::SAVED_MS, handoverSavedMs);
+    w.u32(Key::RUN_SAVED_MS, handoverSavedMs_);
+    w.endMap();
+  }
 
-  String stateName = nameRes_ ? nameRes_((int)stepIdx) : (String("Paso ")+String((int)stepIdx));
-  time_t nowE = time(nullptr);
-
-  // Usamos las MISMAS claves que en state_start para reducir tamaño
-  String payload = "{"
-    "\"event\":\"state_end\","
-    "\"window\":{"
-      "\"name\":\""+jsonEscape_(curWindowName_)+"\","
-      "\"start\":\""+isoLocal_(curWindowStartEpoch_)+"\","
-      "\"end\":\""+isoLocal_(curWindowEndEpoch_)+"\"},"
-    "\"state\":{"
-      "\"name\":\""+jsonEscape_(stateName)+"\","
-      "\"volume_ml\":" + String(volMlReal) + ","
-      "\"duration_ms\":" + String(durMsReal) + "},"
-    "\"at\":\""+isoLocal_(nowE)+"\""
-  "}";
+  // Fertirriego: dosis pedida vs entregada y retraso de los flancos
+  if (doser_ && doser_->active()) {
+    const uint32_t nowMs = millis();
+    w.beginArray(Key::FERT);
+    for (int ch = 0; ch < FertDoser::NUM_CH; ++ch) {
+      const FertDoser::Stats st = doser_->stats(ch, nowMs);
+      w.beginMap();
+      w.u32(Key::PCT, st.pct);
+      w.u32(Key::TARGET_MS, st.targetMs);
+      w.u32(Key::ON_MS, st.deliveredMs);
+      w.i32(Key::ERR_MS, st.errorMs);
+      w.u32(Key::PULSES, st.pulses);
+      w.u32(Key::JITTER_AVG_MS, st.jitterAvgMs);
+      w.u32(Key::JITTER_MAX_MS, st.jitterMaxMs);
+      if (st.saturated) w.boolean(Key::SATURATED, true);
+      w.endMap();
+    }
+    w.endArray();
+  }
 
-  publisher_(pubTopic_, payload);
+  w.time(Key::AT, time(nullptr));
+  w.endMap();
+  emit_(w);
 }
 
+void AutoMode::publishFlowAlarm_(const FlowMonitor::Alarm& a) {
+  if (!publisher_) return;
+  using payload::Key;
+
+  payload::Writer w(pubFormat_, evBuf_, sizeof(evBuf_));
+  w.beginEvent();
+  w.str(Key::EVENT, "flow_alarm");
+  w.str(Key::KIND, FlowMonitor::name(a.kind));
+  w.i32(Key::LINE, (int32_t)a.line);
+  w.u32(Key::RATE_LPH, a.rateLph);
+  w.u32(Key::BASELINE_LPH, a.baselineLph);
+
+  // Reposo: no hay zona; regando: nombre del paso dueño de la vigilancia
+  if (a.slot >= 0) {
+    const size_t stepIdx = slots_.empty() ? stepIdx_ : (size_t)zones_[a.slot].step;
+    const String stateName = nameRes_ ? nameRes_((int)stepIdx) : (String("Paso ")+String((int)stepIdx));
+    w.beginMap(Key::STATE);
+    w.str(Key::NAME, stateName);
+    w.u32(Key::ELAPSED_MS, msSince(slots_.empty() ? stepStartMs_ : zones_[a.slot].startMs));
+    w.endMap();
+  }
 
-// =================== NVS zonas ===================
-bool AutoMode::readZoneTargetsNVS_(int zoneIdx, uint32_t& volMlOut, uint32_t& timeMsOut) {
-  volMlOut = 0; timeMsOut = 0;
-  if (zoneIdx < 0) return false;
-
-  Preferences p;
-  if (!p.begin("zones", /*ro*/ true)) return false;
+  w.time(Key::AT, time(nullptr));
+  w.endMap();
+  emit_(w);
+}
 
-  String base = String("z") + String(zoneIdx) + "_";
-  volMlOut = p.getUInt((base + "vol").c_str(),  0);
-  timeMsOut= p.getUInt((base + "time").c_str(), 0);
-  p.end();
-  return (volMlOut > 0 || timeMsOut > 0);
+void AutoMode::publishPressureLow_(float kpa) {
+  if (!publisher_) return;
+  using payload::Key;
+
+  const size_t stepIdx = currentStep_();
+  const String stateName = nameRes_ ? nameRes_((int)stepIdx) : (String("Paso ")+String((int)stepIdx));
+
+  payload::Writer w(pubFormat_, evBuf_, sizeof(evBuf_));
+  w.beginEvent();
+  w.str(Key::EVENT, "pressure_low");
+  w.real(Key::KPA, kpa, 1);
+  w.real(Key::MIN_KPA, lowKpa_, 1);
+  w.u32(Key::HOLD_MS, lowHoldMs_);
+  w.beginMap(Key::STATE);
+  w.str(Key::NAME, stateName);
+  w.u32(Key::ELAPSED_MS, msSince(stepStartMs_));
+  w.endMap();
+  w.time(Key::AT, time(nullptr));
+  w.endMap();
+  emit_(w);
 }
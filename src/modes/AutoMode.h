@@ -5,8 +5,18 @@
 #include <functional>
 
 #include "../hw/RelayBank.h"
+#include "../hw/RelayTransition.h"
+#include "../flow/FlowMeterService.h"
+#include "../flow/FlowMonitor.h"
+#include "../flow/FertDoser.h"
+#include "../sensors/SensorService.h"
+#include "../core/SeqLock.h"
+#include "../core/PayloadEncoder.h"
 #include "IMode.h"
+#include "OrderQueue.h"
 #include "../schedule/IrrigationSchedule.h"
+#include "../schedule/StartIndex.h"
+#include "../schedule/ZonePacker.h"
 
 // ======================= AutoMode con StepSets + escalados por horario =======================
 // - Si program.sets.size()>0: cada StartSpec elige el StepSet (stepSetIndex) y sus escalas.
@@ -19,22 +29,34 @@ public:
            unsigned long stateDurationMs,
            unsigned long offDurationMs,
            unsigned long stepDelayMs,
+           FlowMeterService& flow,
            int pinFlow1, int pinFlow2);
 
   void begin() override;
   void reset() override;
   void run()   override;
 
-  struct IrrigationOrder {
-    int  mainIndex = -1;
-    bool direct    = true;
-    unsigned long durationMs = 0;
-    unsigned long volumeMl   = 0;
-  };
-  void enqueueOrder(const IrrigationOrder& ord);
+  // ====== Órdenes a demanda (modes/OrderQueue.h) ======
+  // Una orden corre su zona (paso del Set 0) como un paso más: misma
+  // transición, objetivos, vigilancia de caudal/presión y fertirriego. Arranca
+  // en reposo o en la pausa entre pasos de una corrida secuencial (que sigue
+  // después); una corrida concurrente la deja esperando hasta terminar. No
+  // depende de franjas ni del programa habilitado. Cada orden sacada de la
+  // cola se informa con OrderQueue::report (arrancada o rechazada).
+  void attachOrders(OrderQueue* q) { orders_ = q; }
 
   void setSchedule(const ProgramSpec* prog, const FlowCalibration* cal);
 
+  // ====== Recarga en caliente (sin reiniciar) ======
+  // Punto seguro para cambiar de programa: reposo o pausa entre pasos.
+  bool atSafePoint() const { return phase_ == Phase::IDLE || phase_ == Phase::PAUSE; }
+  // Hay un programa nuevo esperando: el próximo fin de paso pasa por PAUSE
+  // (aunque la pausa sea 0) para que la fachada pueda aplicarlo.
+  void holdForReload(bool on) { holdForReload_ = on; }
+  // Adopta el programa en el punto seguro sin tocar salidas en reposo;
+  // en pausa conserva la corrida si el set actual sigue existiendo.
+  void reloadSchedule(const ProgramSpec* prog, const FlowCalibration* cal);
+
   struct Tele {
     bool     running = false;        // RUN_STEP o PAUSE
     bool     pausing = false;        // en pausa entre pasos
@@ -56,22 +78,70 @@ public:
 
     bool     programEnabled = false;
     uint32_t nextStartEpoch = 0;
+
+    bool     flowAlarm = false;      // anomalía de caudal desde el último inicio
+    uint32_t flowLph   = 0;          // última muestra de 1 s (suma de líneas)
+
+    FertDoser::Stats fert[FertDoser::NUM_CH];   // dosis del paso actual
+
+    SensorService::Reading analog[SensorService::NUM_CH];   // presión / nivel (VP, VN)
+    bool     pressureAlarm = false;  // paso cortado por baja presión desde el último inicio
+
+    // Órdenes a demanda
+    int      orderZone      = -1;    // zona de la orden en curso (-1 = ninguna)
+    uint32_t orderBacklog   = 0;     // en cola
+    uint32_t ordersDone     = 0;
+    uint32_t ordersRejected = 0;     // zona inexistente o sin objetivo alcanzable
+    uint32_t ordersDropped  = 0;     // cola llena al encolar
+    uint32_t orderQueueMs   = 0;     // espera en cola de la última orden arrancada
+    uint32_t orderQueueMaxMs = 0;
+
+    bool     remoteRun      = false; // corrida pedida por control remoto (runSetNow)
+  };
+  // ms hasta el próximo instante en que run() tiene algo que hacer (fin de
+  // etapa de transición, fin de paso/pausa, fase legacy o próximo minuto de
+  // inicio). UINT32_MAX = nada pendiente. El volumen despierta por PCNT.
+  uint32_t msUntilNextDeadline(uint32_t nowMs) const;
+
+  // Snapshot publicado por la tarea de control en cada tick (SeqLock):
+  // se puede leer desde otro core sin tocar el estado vivo del modo.
+  Tele telemetry() const { return tele_.read(); }
+
+  // Caudal aprendido por zona (FlowMonitor::baselineLph, índice StepSpec::idx;
+  // 0 = sin base todavía). Se publica al aprender, no en cada tick.
+  struct FlowBaselines {
+    uint32_t lph[FlowMonitor::MAX_ZONES] = {};
   };
-  Tele telemetry() const;
+  FlowBaselines flowBaselines() const { return baselines_.read(); }
 
   // ====== Callbacks para publicar eventos y resolver nombres ======
   using EventPublisher     = std::function<void(const String& topic, const String& payload)>;
   using StateNameResolver  = std::function<String(int stepIdx)>; // stepIdx dentro del set activo
 
-  void setEventPublisher(EventPublisher pub, const String& topic);
+  // fmt: codificación de los eventos en ese tópico (core/PayloadEncoder.h)
+  void setEventPublisher(EventPublisher pub, const String& topic,
+                         payload::Format fmt = payload::Format::JSON);
   void setStateNameResolver(StateNameResolver res);
 
-private:
-  // ISR caudal
-  static void IRAM_ATTR isrFlow1Thunk();
-  static void IRAM_ATTR isrFlow2Thunk();
+  // Fertirriego proporcional (ZoneParams f1/f2). Sin dosificador, la
+  // transición enciende Fert1 fijo como siempre.
+  void attachDoser(FertDoser* doser) { doser_ = doser; }
 
-  // Actuación
+  // ====== Control remoto (MQTT, vía la fachada: sólo irrigationTask) ======
+  // Corre un StepSet ya, sin StartSpec, franja ni programa habilitado (como una
+  // orden). Sólo desde reposo: false si hay corrida o el set no existe/está vacío.
+  bool runSetNow(size_t setIdx, float timeScale, float volScale);
+  // Corta lo que esté corriendo (corrida, orden y la corrida que ésta retomaría)
+  // publicando el fin del paso. false = ya estaba en reposo.
+  bool stopNow();
+
+  // Sensores analógicos (sensors/SensorService.h): lecturas para la telemetría
+  // y corte de paso por baja presión. minKpa <= 0 desactiva el corte.
+  void attachSensors(const SensorService* sensors) { sensors_ = sensors; }
+  void setLowPressureCut(float minKpa, uint32_t holdMs) { lowKpa_ = minKpa; lowHoldMs_ = holdMs; }
+
+private:
+  // Actuación (no bloqueante: arranca el secuenciador, run() lo avanza)
   void smoothTransition(int idx);
   void allOff_();
 
@@ -81,34 +151,79 @@ private:
   // Programado
   void runScheduled();
   bool timeNow(struct tm& out) const;
-  bool todayMatches(uint8_t dowMask, int wday) const;
   int  shouldStartNow(const struct tm& nowTm); // devuelve índice del StartSpec matcheado o -1
   void startProgramForStart(size_t startIdx);  // inicia usando sets + escalas
   void stopProgram();
-  void beginStep_(size_t idx);
+  // Cierra el/los paso(s) en curso publicando state_end y detiene (franja / stopNow)
+  void abortRun_();
+  // handoverFrom != nullptr: relevo sin corte desde ese paso (RelayTransition::handover)
+  void beginStep_(size_t idx, const StepSpec* handoverFrom = nullptr);
   void finishStep_();
+  // Reloj del paso/slot (tiempo, líneas base de volumen, vigilancia de caudal y
+  // dosis): corre desde que la transición dejó los relés quietos, como cuando
+  // smoothTransition bloqueaba. En el relevo arranca enseguida (el agua no para).
+  void startStepClock_(uint32_t nowMs);
+  // Programa con algo que correr por horario (o una orden en curso)
+  bool scheduled_() const;
+  // Órdenes: arranca la siguiente si el punto lo permite / cierra la actual
+  void pollOrders_(uint32_t nowMs);
+  bool startOrder_(const OrderQueue::Order& o, uint32_t nowMs);
+  void endOrder_();
+
+  // Objetivos efectivos de un paso: ZoneTable si hay, si no StepSpec escalado
+  // (orden en curso: sus objetivos si > 0)
+  // (fertPct != nullptr: además los % de fertilizante de la zona)
+  void effectiveTargets_(size_t idx, uint32_t& durMs, uint32_t& volMl, uint8_t* fertPct = nullptr) const;
+  // Alta de la zona en el dosificador (slot = ZoneRun / 0 en secuencial)
+  void feedDoser_(uint8_t slot, const StepSpec& sp, int8_t line, const uint8_t* fertPct);
+
+  // Modo concurrente: corrida por slots de zonas (schedule/ZonePacker.h)
+  void beginRun_();                 // tras fijar set/escalas: secuencial o por slots
+  void beginSlot_(size_t slotIdx);
+  void runSlot_();
+  void finishSlot_();
+  size_t currentStep_() const;      // paso a mostrar (1ª zona activa del slot)
   uint32_t msSince(uint32_t t0) const;
   bool waitForValidIP(uint32_t timeoutMs = 7000) const;
 
+  // Objetivos efectivos del paso actual (0 = sin límite)
+  uint32_t stepDurTargetMs_() const;
+  uint32_t stepVolTargetMl_() const;
+  // Arma el despertar PCNT para el objetivo de volumen del paso
+  void armFlowWake_();
+  // Muestra de 1 s + detector (flow/FlowMonitor.h): corta el paso/zona anómalo,
+  // levanta la alarma (TOGGLE_PREV) y publica "flow_alarm"
+  void pollFlowMonitor_(uint32_t nowMs);
+  // Presión por debajo de lowKpa_ durante lowHoldMs_ (tras el llenado): corta
+  // el paso (o todas las zonas del slot), levanta la alarma y publica "pressure_low"
+  void pollPressure_(uint32_t nowMs);
+  // Salida de alarma (TOGGLE_PREV): caudal anómalo o baja presión
+  bool alarm_() const { return flowAlarm_ || pressureAlarm_; }
+
+  // Telemetría: arma el snapshot desde el estado vivo y lo publica
+  Tele buildTelemetry_(uint32_t nowMs);
+  void publishTelemetry_();
+
   // util volumen/epoch
   uint32_t volumeMlFromPulses_(uint32_t d1, uint32_t d2) const;
   uint32_t computeNextStartEpoch_() const;
 
-  // ====== Franjas (/windows en NVS) ======
-  bool allowedNowByWindows_() const;   // true si hora actual cae en alguna franja válida
+  // ====== Franjas (índice en RAM: schedule/WindowIndex.h) ======
+  bool allowedNowByWindows_() const;   // true si hora actual cae en alguna franja válida (O(1))
 
-  // ====== helpers para ventana + timestamps + JSON ======
+  // ====== helpers para ventana + eventos ======
   bool   computeCurrentWindow_(int& sminOut, int& eminOut, time_t& startEpochOut, time_t& endEpochOut, String& nameOut) const;
   static String two_(int v);
   static String hhmm_(int minuteOfDay);
-  static String isoLocal_(time_t epoch);
-  static String jsonEscape_(const String& s);
 
-  void   publishStateStart_(size_t stepIdx, uint32_t durMsTarget, uint32_t volMlTarget);
-  void   publishStateEnd_  (size_t stepIdx, uint32_t durMsReal,    uint32_t volMlReal);
+  void   putWindow_(payload::Writer& w) const;
+  void   emit_(const payload::Writer& w);
 
-  // ====== NVS zonas (targets efectivos por zona) ======
-  static bool readZoneTargetsNVS_(int zoneIdx, uint32_t& volMlOut, uint32_t& timeMsOut);
+  void   publishStateStart_(size_t stepIdx, uint32_t durMsTarget, uint32_t volMlTarget);
+  void   publishStateEnd_  (size_t stepIdx, uint32_t durMsReal,    uint32_t volMlReal,
+                            uint32_t handoverSavedMs = 0);
+  void   publishFlowAlarm_(const FlowMonitor::Alarm& a);
+  void   publishPressureLow_(float kpa);
 
 private:
   // Dependencias
@@ -120,13 +235,32 @@ private:
   const unsigned long stepDelayMs_;
   const int       pinFlow1_;
   const int       pinFlow2_;
+  FlowMeterService& flow_;
+
+  // Caudal por segundo + detector de fugas / sin caudal
+  FlowMonitor flowMon_;
+  bool        flowAlarm_ = false;   // se mantiene hasta el próximo inicio de corrida
+
+  FertDoser*  doser_ = nullptr;     // opcional (attachDoser)
+
+  // Presión (opcional, attachSensors)
+  const SensorService* sensors_ = nullptr;
+  float       lowKpa_        = 0.f;      // 0 = sin corte
+  uint32_t    lowHoldMs_     = 10000;
+  bool        lowActive_     = false;    // presión baja, contando lowHoldMs_
+  uint32_t    lowSinceMs_    = 0;
+  bool        pressureAlarm_ = false;    // hasta el próximo inicio de corrida
 
-  // ISR state
-  volatile static unsigned long pulse1_;
-  volatile static unsigned long pulse2_;
-  volatile static unsigned long lastMicros1_;
-  volatile static unsigned long lastMicros2_;
-  static const unsigned long DEBOUNCE_US = 5000UL;
+  // Secuenciador de transición (sin delay)
+  RelayTransition trans_;
+
+  // Telemetría publicada (escritor: run(); lectores: WebUI)
+  SeqLock<Tele> tele_;
+  SeqLock<FlowBaselines> baselines_;
+  void learnFlow_(uint8_t slot);   // unwatch con aprendizaje + publica baselines_
+  uint32_t      nextStartEpoch_     = 0;   // caché (mktime x8 es caro)
+  uint32_t      nextStartComputedMs_ = 0;
+  bool          nextStartValid_     = false;
 
   // Legacy blink
   bool      initialized_   = false;
@@ -135,20 +269,44 @@ private:
   uint32_t  phaseStart_    = 0;
   uint32_t  stateStart_    = 0;
   unsigned long pulseCount_ = 0;
-
-  std::vector<IrrigationOrder> queue_;
+  uint64_t  blinkLastTotal_ = 0;   // total PCNT de la última lectura (legacy)
+
+  // Órdenes a demanda
+  OrderQueue* orders_ = nullptr;         // opcional (attachOrders)
+  bool        orderActive_ = false;
+  OrderQueue::Order order_;
+  struct Resume {                        // corrida interrumpida en su pausa
+    bool   valid = false;
+    int    startIdx = -1, setIdx = -1;
+    size_t stepIdx  = 0;
+    float  timeScale = 1.0f, volScale = 1.0f;
+    uint32_t runVolumeMl = 0;
+  } resume_;
+  int         deferredStart_   = -1;     // StartSpec que cayó durante una orden
+  uint32_t    ordersDone_      = 0;
+  uint32_t    ordersRejected_  = 0;
+  uint32_t    orderQueueMs_    = 0;
+  uint32_t    orderQueueMaxMs_ = 0;
+  bool        remoteRun_       = false;  // runSetNow: no la corta la franja
 
   // Programación
   const ProgramSpec*   prog_   = nullptr;
   FlowCalibration      cal_    {};
   enum class Phase { IDLE, RUN_STEP, PAUSE } phase_ = Phase::IDLE;
+  bool holdForReload_ = false;   // ver holdForReload()
 
   size_t     stepIdx_       = 0;    // índice paso dentro del set activo
   uint32_t   stepStartMs_   = 0;
+  bool       stepClockPending_ = false;   // transición en curso: reloj aún sin arrancar
   uint32_t   pauseStartMs_  = 0;
-  unsigned long stepStartP1_ = 0;
-  unsigned long stepStartP2_ = 0;
+  uint64_t   stepStartP1_   = 0;    // línea base PCNT del paso
+  uint64_t   stepStartP2_   = 0;
   uint32_t   runVolumeMl_   = 0;
+  uint32_t   handoverSavedMs_ = 0;  // tiempo muerto evitado por relevos en este run
+  uint32_t   stepSavedMs_     = 0;  // ... por el relevo que abrió el paso actual
+  uint32_t   cutTransMs_      = 0;  // última transición con corte, medida (inicio -> reloj)
+  uint32_t   handoverPauseMs_ = 0;  // pausa que se saltó el relevo en curso
+  bool       handoverIn_      = false;   // el paso actual entró por relevo
 
   // “contexto” del arranque actual
   int        curStartIdx_   = -1;   // StartSpec elegido
@@ -156,6 +314,9 @@ private:
   float      timeScale_     = 1.0f; // escalas de ese Start
   float      volScale_      = 1.0f;
 
+  // Inicios compilados (se reconstruye en setSchedule)
+  StartIndex startIndex_;
+
   // Anti-redoble
   int lastStartYDay_ = -1;
   int lastStartMin_  = -1;
@@ -163,6 +324,10 @@ private:
   // Publicación y nombres
   EventPublisher    publisher_  = nullptr;
   String            pubTopic_   = "public/riegoArandanosDeMiPueblo";
+  payload::Format   pubFormat_  = payload::Format::JSON;
+  // Buffer de codificación (sólo irrigationTask); state_end con fert es el mayor
+  static constexpr size_t EVENT_BUF_BYTES = 768;
+  uint8_t           evBuf_[EVENT_BUF_BYTES];
   StateNameResolver nameRes_    = nullptr;
 
   // Ventana actual (caché para mensajes)
@@ -171,6 +336,26 @@ private:
   time_t curWindowEndEpoch_     = 0;
   String curWindowName_;
 
+  // ====== Modo concurrente ======
+  struct ZoneRun {
+    bool     active  = false;
+    uint16_t step    = 0;      // índice en StepSet::steps
+    int8_t   line    = -1;     // caudalímetro propio (0/1); -1 = suma de ambos
+    uint32_t startMs = 0;
+    uint64_t base1   = 0;      // líneas base PCNT al arrancar la zona
+    uint64_t base2   = 0;
+    uint32_t durMs   = 0;      // objetivos efectivos (0 = sin límite)
+    uint32_t volMl   = 0;
+    bool     cut     = false;  // cortada por FlowMonitor
+  };
+  std::vector<ZoneSlot> slots_;                 // vacío = corrida secuencial
+  ZoneRun               zones_[ZoneSlot::MAX_ZONES];
+
+  uint32_t zoneVolumeMl_(const ZoneRun& z) const;
+  void     finishZone_(ZoneRun& z);
+  void     applyZones_(bool smooth);            // relés = unión de zonas activas
+  void     armSlotWake_();
+
   // ====== Targets efectivos (lo que realmente se usa) ======
   uint32_t effDurMs_ = 0;   // tiempo objetivo del paso (zona) en ms; 0 = sin límite
   uint32_t effVolMl_ = 0;   // volumen objetivo del paso (zona) en mL; 0 = sin límite
@@ -2,35 +2,27 @@
 #pragma once
 #include <Arduino.h>
 #include "../hw/RelayBank.h"
+#include "../hw/RelayTransition.h"
+#include "../hw/InputService.h"
+#include "../flow/FlowMeterService.h"
+#include "../flow/FertDoser.h"
+#include "../core/SeqLock.h"
 #include "../state/RelayState.h"
 
 class ManualMode {
 public:
-  struct Pins { int pinNext; int pinPrev; };
+  // Botones frontales: los muestrea y filtra hw/InputService; aquí llegan
+  // ya como eventos (flanco de pulsación / pulsación larga)
+  enum class Button : uint8_t { NEXT, PREV };
 
-  // Debounce ISR en microsegundos para entradas de caudal
-  static constexpr unsigned long DEBOUNCE_US_  = 1500;
-  static constexpr int           NUM_MAINS_    = 12;
-  static constexpr int           NUM_SECS_     = 2;
   static constexpr unsigned long SAFE_BOOT_MS_ = 50;
-
-  // Mapeo eléctrico (orden EXACTO al README)
-  static const uint8_t MAIN_PINS_[NUM_MAINS_];
-  static const bool    MAIN_AL_[NUM_MAINS_];
-  static const uint8_t SEC_PINS_[NUM_SECS_];
-  static const bool    SEC_AL_[NUM_SECS_];
-
-  // “Always on” (bomba/12V) en tu HW
-  static constexpr int PIN_ALWAYS_ON_    = 33;
-  static constexpr int PIN_ALWAYS_ON_12_ = 12;
+  // Mapeo eléctrico: lo aporta el RelayBank (PinMap único de hw/Board.h)
 
   ManualMode(RelayBank& bank,
-             const Pins& pins,
              const int* customStates,
              int numStates,
-             unsigned long debounceMs,
-             unsigned long longPressMs,
              unsigned long stepDelayMs,
+             FlowMeterService& flow,
              int pinFlow1 = 34,
              int pinFlow2 = 35);
 
@@ -39,12 +31,26 @@ public:
   void reset();
   void run();
 
-  // latch manual desde Web
-  void webStartState(const RelayState& rs);
+  // latch manual desde Web; fertPct: % de Fert1/Fert2 (sliders p1/p2 de /mode)
+  void webStartState(const RelayState& rs, const uint8_t* fertPct = nullptr);
   void webStopState();
   inline bool webIsActive() const { return webActive_; }
 
-  // telemetría cruda para WebUI (/mode.json)
+  // Fertirriego proporcional durante el latch web (opcional)
+  void attachDoser(FertDoser* doser) { doser_ = doser; }
+
+  // Evento de botón (desde irrigationTask). PRESS = estado siguiente/anterior,
+  // LONG = conmuta la salida auxiliar (NEXT -> TOGGLE_NEXT, PREV -> TOGGLE_PREV).
+  // Con el latch web activo se ignoran, como antes.
+  void onButton(Button b, InputService::Kind kind);
+
+  // ms hasta el próximo instante en que run() tiene trabajo (etapa de
+  // transición o flanco de fertilizante). UINT32_MAX = nada pendiente: los
+  // botones llegan como eventos de InputService (ctl::SIG_BUTTON).
+  uint32_t msUntilNextDeadline(uint32_t nowMs) const;
+
+  // telemetría cruda para WebUI (/mode.json): copia del snapshot publicado
+  // por run() (SeqLock), segura desde el otro core
   bool telemetryRaw(uint32_t& d1, uint32_t& d2,
                     uint32_t& elapsedMs, int& stateIdx, bool& active) const;
 
@@ -52,27 +58,32 @@ private:
   // helpers relés
   void allMainsOff();
   void allSecsOff();
-  void applyMainsPattern(int m, bool direct);
-  void smoothTransitionTo(int idx);
+  void smoothTransitionTo(int idx);   // no bloqueante (ver RelayTransition)
   void applyRelayState_(const RelayState& rs);
 
-  // caudal (ISR)
-  static void IRAM_ATTR isrFlow1_();
-  static void IRAM_ATTR isrFlow2_();
-  void attachFlowIsr_();
-  void detachFlowIsr_();
+  // caudal (PCNT compartido)
   void resetFlowCounters_();
 
+  // snapshot de telemetría
+  struct Tele {
+    bool     valid     = false;   // modo inicializado
+    uint32_t d1        = 0;       // pulsos desde inicio/cambio de zona
+    uint32_t d2        = 0;
+    uint32_t elapsedMs = 0;
+    int      stateIdx  = -1;
+  };
+  void publishTelemetry_();
+
   // estado
   RelayBank&     bank_;
-  Pins           pins_;
   const int*     customStates_;
   int            numCustomStates_;
-  unsigned long  debounceMs_;
-  unsigned long  longPressMs_;
   unsigned long  stepDelayMs_;
   int            pinFlow1_;
   int            pinFlow2_;
+  FlowMeterService& flow_;
+
+  RelayTransition trans_;
 
   bool           initialized_ = false;
 
@@ -81,25 +92,15 @@ private:
   bool           toggleNextState_  = false;
   bool           togglePrevState_  = false;
 
-  unsigned long  lastNextChange_   = 0;
-  unsigned long  lastPrevChange_   = 0;
-  unsigned long  nextPressStart_   = 0;
-  unsigned long  prevPressStart_   = 0;
-  bool           lastNextRaw_      = false;
-  bool           lastPrevRaw_      = false;
-  bool           nextLongHandled_  = false;
-  bool           prevLongHandled_  = false;
-
   // latch web
   RelayState     webState_;
   bool           webActive_        = false;
+  FertDoser*     doser_            = nullptr;
 
   // medición actual
   unsigned long  webStartMs_       = 0;
+  uint64_t       base1_            = 0;   // líneas base PCNT
+  uint64_t       base2_            = 0;
 
-  // contadores ISR compartidos
-  static volatile unsigned long pulses1_;
-  static volatile unsigned long pulses2_;
-  static volatile unsigned long lastUs1_;
-  static volatile unsigned long lastUs2_;
+  SeqLock<Tele>  tele_;
 };
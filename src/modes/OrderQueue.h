@@ -0,0 +1,142 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "../core/SeqLock.h"
+
+// ===================== Órdenes de riego a demanda (MPSC, acotada) =====================
+// "Regar la zona X por N mL / T ms ahora", desde la WebUI o MQTT (varias tareas
+// productoras) hacia AutoMode en irrigationTask (consumidor único). Un anillo
+// por prioridad, cada uno una cola acotada sin locks de tipo Vyukov: cada celda
+// lleva su número de secuencia, el productor reserva posición con un CAS y la
+// publica al escribir la secuencia; el consumidor nunca bloquea a nadie.
+//
+// pop() vacía primero la prioridad URGENT. Con el anillo lleno push() devuelve
+// false (y cuenta el descarte): no asigna memoria ni espera.
+//
+// El consumidor informa el destino de cada orden (arrancada / rechazada) en un
+// anillo de resultados numerados; cada lector lleva su propio cursor y los
+// recorre en orden con nextResult(), así ninguna orden queda sin respuesta
+// aunque varias se resuelvan en el mismo tick.
+class OrderQueue {
+public:
+  static constexpr uint8_t  LEVELS   = 2;
+  static constexpr uint8_t  CAPACITY = 8;   // por prioridad (potencia de 2)
+
+  static constexpr uint8_t  RESULTS  = 16;  // resultados que un lector puede atrasarse
+
+  enum Priority : uint8_t { NORMAL = 0, URGENT = 1 };
+  enum class Outcome : uint8_t { STARTED = 1, REJECTED = 2 };
+
+  struct Order {
+    int16_t  zone       = -1;    // paso del Set 0 (= índice de RelayState)
+    uint8_t  priority   = NORMAL;
+    uint32_t volumeMl   = 0;     // 0 = el de la zona (ZoneTable / StepSpec)
+    uint32_t durationMs = 0;     // 0 = el de la zona
+    uint32_t id         = 0;     // lo asigna push()
+    uint32_t queuedMs   = 0;     // millis() al encolar (latencia de cola)
+  };
+
+  struct Result {
+    uint32_t n       = 0;        // número de resultado (1, 2, ...)
+    uint32_t id      = 0;        // id de la orden
+    Outcome  outcome = Outcome::REJECTED;
+    uint32_t atMs    = 0;        // millis() al arrancar (relés comandados) o rechazar
+    uint32_t queueMs = 0;        // espera en cola
+  };
+
+  // Productores (cualquier tarea, no ISR). Devuelve el id asignado o 0 si está llena.
+  uint32_t push(Order o) {
+    if (o.priority >= LEVELS) o.priority = URGENT;
+    o.id       = nextId_.fetch_add(1, std::memory_order_relaxed);
+    o.queuedMs = millis();
+    Ring& r = ring_[o.priority];
+
+    uint32_t pos = r.enq.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& c = r.cell[pos & (CAPACITY - 1)];
+      const int32_t dif = (int32_t)(c.seq.load(std::memory_order_acquire) - pos);
+      if (dif == 0) {
+        if (r.enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          c.order = o;
+          c.seq.store(pos + 1, std::memory_order_release);
+          return o.id;
+        }
+      } else if (dif < 0) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+      } else {
+        pos = r.enq.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Consumidor único (irrigationTask)
+  bool pop(Order& out) {
+    for (int lv = LEVELS - 1; lv >= 0; --lv) {
+      Ring& r = ring_[lv];
+      const uint32_t pos = r.deq;
+      Cell& c = r.cell[pos & (CAPACITY - 1)];
+      if ((int32_t)(c.seq.load(std::memory_order_acquire) - (pos + 1)) < 0) continue;
+      out = c.order;
+      c.seq.store(pos + CAPACITY, std::memory_order_release);
+      r.deq = pos + 1;
+      r.deqPub.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+    return false;
+  }
+
+  // Órdenes en espera (cualquier core; aproximado si se cruza con push/pop)
+  uint32_t backlog() const {
+    uint32_t n = 0;
+    for (const Ring& r : ring_)
+      n += r.enq.load(std::memory_order_acquire) - r.deqPub.load(std::memory_order_acquire);
+    return n;
+  }
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // Consumidor único: destino de una orden sacada con pop()
+  void report(uint32_t id, Outcome oc, uint32_t atMs, uint32_t queueMs) {
+    Result r;
+    r.n       = resHead_.load(std::memory_order_relaxed) + 1;
+    r.id      = id;
+    r.outcome = oc;
+    r.atMs    = atMs;
+    r.queueMs = queueMs;
+    res_[(r.n - 1) % RESULTS].publish(r);
+    resHead_.store(r.n, std::memory_order_release);
+  }
+
+  // Lectores (cualquier tarea): siguiente resultado tras *cursor. Si el lector
+  // se atrasó más de RESULTS, salta a los más viejos que siguen en el anillo.
+  bool nextResult(uint32_t& cursor, Result& out) const {
+    for (;;) {
+      const uint32_t head = resHead_.load(std::memory_order_acquire);
+      if (cursor >= head) return false;
+      if (head - cursor > RESULTS) cursor = head - RESULTS;
+      out = res_[cursor % RESULTS].read();
+      if (out.n == cursor + 1) { cursor = out.n; return true; }
+      // Celda reescrita mientras leíamos: el cursor quedó atrás, reintenta
+    }
+  }
+  uint32_t resultHead() const { return resHead_.load(std::memory_order_acquire); }
+
+private:
+  struct Cell {
+    std::atomic<uint32_t> seq{0};
+    Order                 order;
+  };
+  struct Ring {
+    Ring() { for (uint32_t i = 0; i < CAPACITY; ++i) cell[i].seq.store(i, std::memory_order_relaxed); }
+    Cell                  cell[CAPACITY];
+    std::atomic<uint32_t> enq{0};
+    uint32_t              deq = 0;        // sólo el consumidor
+    std::atomic<uint32_t> deqPub{0};      // copia para backlog()
+  };
+
+  Ring                  ring_[LEVELS];
+  std::atomic<uint32_t> nextId_{1};
+  std::atomic<uint32_t> dropped_{0};
+  SeqLock<Result>       res_[RESULTS];
+  std::atomic<uint32_t> resHead_{0};      // resultados publicados
+};
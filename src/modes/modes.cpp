@@ -2,110 +2,104 @@
 #include "modes.h"
 #include "ManualMode.h"
 #include "AutoMode.h"
-#include "../hw/PinMap.h"
+#include "OrderQueue.h"
+#include "../hw/RelayPins.h"
 #include "../hw/RelayBank.h"
+#include "../hw/InputService.h"
+#include "../flow/FlowMeterService.h"
+#include "../flow/FertDoser.h"
+#include "../sensors/SensorService.h"
+#include "../core/ControlSignals.h"
+#include "../core/SeqLock.h"
 #include "../schedule/IrrigationSchedule.h"
 #include "../state/RelayState.h"
 #include <vector>
+#include <atomic>
 #include <math.h>   // lroundf
+#include <Preferences.h>
+#include <freertos/semphr.h>
 
-// -------------------- Pines/const originales --------------------
+// -------------------- Constantes de modo (pines: hw/Board.h) --------------------
 namespace FULL {
-  enum {
-    // Pulsadores con pull-down -> activo HIGH
-    PIN_NEXT              = 13,  // activo HIGH
-    PIN_PREV              = 4,   // activo HIGH
-
-    PIN_ALWAYS_ON         = 33,
-    PIN_ALWAYS_ON_12      = 12,
-
-    // Auxiliares según README: 25=Fert1 (AH), 14=Alarma (AH)
-    PIN_TOGGLE_NEXT       = 25,
-    PIN_TOGGLE_PREV       = 14
-  };
-
-  // === Orden/AL EXACTO del README ===
-  static const int  MAIN_PINS[]       = { 0, 2, 5, 15, 16, 17, 1, 3, 18, 21, 22, 23 };
-  static const bool MAIN_ACTIVE_LOW[] = { 1, 1, 1,  1,  1,  1, 1, 1,  1,  1,  1,  1 };
-  static const int  NUM_MAINS         = sizeof(MAIN_PINS)/sizeof(MAIN_PINS[0]);
-
-  static const int  SEC_PINS[]        = { 26, 27 };     // (AH)
-  static const bool SEC_ACTIVE_LOW[]  = { 0, 0 };
-  static const int  NUM_SECS          = sizeof(SEC_PINS)/sizeof(SEC_PINS[0]);
-
   // Tabla de estados personalizada (índices [0..NUM_MAINS*2])
   static const int CUSTOM_STATES[] = {
      15,17,3,1,11,9,7,13,19,5,23,21,
       8,12,16,
-      NUM_MAINS*2
+      RP::NUM_MAINS*2
   };
   static const int NUM_CUSTOM_STATES = sizeof(CUSTOM_STATES)/sizeof(CUSTOM_STATES[0]);
 
-  static const unsigned long DEBOUNCE_MS   = 100;
   static const unsigned long LONGPRESS_MS  = 5000;
   static const unsigned long STEP_MS       = 500;
 }
 
 namespace BLINK {
-  enum {
-    PIN_ALWAYS_ON        = 33,
-    PIN_ALWAYS_ON_12     = 12,
-    PIN_TOGGLE_NEXT      = 25,   // Fert1
-    PIN_TOGGLE_PREV      = 14,   // Alarma
-    PIN_OVR_NEXT         = 13,   // activo HIGH (pull-down)
-    PIN_OVR_PREV         = 4     // activo HIGH (pull-down)
-  };
-
-  // Uso mismo orden que README
-  static const int  MAIN_PINS[]       = { 0, 2, 5, 15, 16, 17, 1, 3, 18, 21, 22, 23 };
-  static const bool MAIN_ACTIVE_LOW[] = { 1, 1, 1,  1,  1,  1, 1, 1,  1,  1,  1,  1 };
-  static const int  SEC_PINS[]        = { 26, 27 };
-  static const bool SEC_ACTIVE_LOW[]  = { 0, 0 };
-
   static const int CUSTOM_STATES[] = { 15,17,3,1,11,9,7,13,19,5,23,21,8,12,16 };
   static const int NUM_CUSTOM_STATES = sizeof(CUSTOM_STATES)/sizeof(CUSTOM_STATES[0]);
 
   static const unsigned long STATE_MS = 5UL * 60UL * 1000UL;
   static const unsigned long OFF_MS   = 4UL * 60UL * 60UL * 1000UL;
   static const unsigned long STEP_MS  = 500UL;
-
-  static const int PIN_FLOW_1 = 34;  // pull-up externo
-  static const int PIN_FLOW_2 = 35;  // pull-up externo
 }
 
 // -------------------- Objetos --------------------
-static const PinMap pinmapFull = {
-  FULL::MAIN_PINS, FULL::MAIN_ACTIVE_LOW, (int)(sizeof(FULL::MAIN_PINS)/sizeof(int)),
-  FULL::SEC_PINS,  FULL::SEC_ACTIVE_LOW,  (int)(sizeof(FULL::SEC_PINS)/sizeof(FULL::SEC_PINS[0])),
-  FULL::PIN_ALWAYS_ON, FULL::PIN_ALWAYS_ON_12,
-  FULL::PIN_TOGGLE_NEXT, FULL::PIN_TOGGLE_PREV
-};
-static RelayBank relayFull(pinmapFull);
-
-static ManualMode::Pins fullPins = { FULL::PIN_NEXT, FULL::PIN_PREV };
+// Caudalímetros: un único servicio PCNT para ambos modos. El umbral de
+// volumen despierta a irrigationTask (ctl::SIG_FLOW).
+static void IRAM_ATTR flowWake_() { ctl::notifyFromIsr(ctl::SIG_FLOW); }
+static FlowMeterService flowMeter(defaultPcntHal(), flowWake_);
+
+// Un PinMap y máscaras de registro únicos (constexpr, RP::) para ambos bancos
+static RelayBank relayFull(RP::PIN_MAP, RP::RELAY_MASKS);
+
 static ManualMode manualMode(
-  relayFull, fullPins,
+  relayFull,
   FULL::CUSTOM_STATES, FULL::NUM_CUSTOM_STATES,
-  FULL::DEBOUNCE_MS, FULL::LONGPRESS_MS, FULL::STEP_MS,
-  BLINK::PIN_FLOW_1, BLINK::PIN_FLOW_2   // <<< ACTIVAR MEDICIÓN DE CAUDAL EN MODO MANUAL
+  FULL::STEP_MS,
+  flowMeter,
+  RP::PIN_FLOW_1, RP::PIN_FLOW_2   // <<< ACTIVAR MEDICIÓN DE CAUDAL EN MODO MANUAL
 );
 
-static const PinMap pinmapBlink = {
-  BLINK::MAIN_PINS, BLINK::MAIN_ACTIVE_LOW, (int)(sizeof(BLINK::MAIN_PINS)/sizeof(int)),
-  BLINK::SEC_PINS,  BLINK::SEC_ACTIVE_LOW,  2,
-  BLINK::PIN_ALWAYS_ON, BLINK::PIN_ALWAYS_ON_12,
-  BLINK::PIN_TOGGLE_NEXT, BLINK::PIN_TOGGLE_PREV
-};
-static RelayBank relayBlink(pinmapBlink);
+static RelayBank relayBlink(RP::PIN_MAP, RP::RELAY_MASKS);
+
+// Entradas físicas (selector + botones, pull-down -> HIGH activo): un único
+// muestreo con debounce fijo; los eventos despiertan a irrigationTask
+namespace {
+  enum : uint8_t { IN_SWITCH = 0, IN_NEXT = 1, IN_PREV = 2 };
+  const InputService::Spec INPUTS[] = {
+    { RP::PIN_SWITCH_MANUAL, INPUT_PULLDOWN, true, 0 },
+    { RP::PIN_NEXT,          INPUT_PULLDOWN, true, FULL::LONGPRESS_MS },
+    { RP::PIN_PREV,          INPUT_PULLDOWN, true, FULL::LONGPRESS_MS },
+  };
+  void inputsWake_(uint32_t mask) {
+    if (mask & (1u << IN_SWITCH)) ctl::notify(ctl::SIG_SWITCH);
+    if (mask & ~(1u << IN_SWITCH)) ctl::notify(ctl::SIG_BUTTON);
+  }
+}
+static InputService inputs(INPUTS, sizeof(INPUTS) / sizeof(INPUTS[0]), inputsWake_);
+
+// Fertirriego (Fert1 = TOGGLE_NEXT, Fert2 = AUX_FERT2): uno para ambos modos,
+// sólo lo mueve el modo activo (el otro lo suelta en su reset)
+static FertDoser fertDoser(RP::PIN_TOGGLE_NEXT, RP::PIN_AUX_FERT2);
+
+// Presión / nivel en VP/VN (ADC continuo, tarea propia en core 1)
+static SensorService sensors(defaultAdcHal(), RP::PIN_FLOW_VP, RP::PIN_FLOW_VN);
+
+// Órdenes a demanda (Web/MQTT -> AutoMode): cola sin locks, la drena irrigationTask
+static OrderQueue orderQueue;
+// Zonas del Set 0 del último programa (-1 = aún ninguno): filtro al encolar
+static std::atomic<int32_t> gOrderZones{-1};
+static int32_t orderZones_(const ProgramSpec& p) { return p.sets.empty() ? 0 : (int32_t)p.sets[0].steps.size(); }
 
 static AutoMode autoMode(relayBlink,
                          BLINK::CUSTOM_STATES, BLINK::NUM_CUSTOM_STATES,
                          BLINK::STATE_MS, BLINK::OFF_MS, BLINK::STEP_MS,
-                         BLINK::PIN_FLOW_1, BLINK::PIN_FLOW_2);
+                         flowMeter,
+                         RP::PIN_FLOW_1, RP::PIN_FLOW_2);
 
 // Programa/cali “vivos” dentro de este módulo (que AutoMode referenciará)
 static ProgramSpec     gProg;
 static FlowCalibration gCal;
+static SeqLock<FlowCalibration> gCalPub;   // copia de gCal para la WebUI (otro core)
 static bool            gProgInit = false;
 
 // Por si el loop arranca antes de que el main le pase algo sensato
@@ -129,48 +123,276 @@ static void ensureProgramInit() {
 
   gCal.pulsesPerMl1 = 4.5f;
   gCal.pulsesPerMl2 = 4.5f;
+  gCalPub.publish(gCal);
 
   autoMode.setSchedule(&gProg, &gCal);
+  int32_t none = -1;     // si ya llegó un programa pendiente, manda ése
+  gOrderZones.compare_exchange_strong(none, orderZones_(gProg), std::memory_order_relaxed);
   gProgInit = true;
 }
 
 // -------------------- Fachada C-like --------------------
-void resetFullMode()  { manualMode.reset(); }
+void resetFullMode()  { manualMode.attachDoser(&fertDoser); manualMode.reset(); }
 void runFullMode()    { manualMode.run();   }
 
-void resetBlinkMode() { autoMode.reset();   }
+void resetBlinkMode() {
+  autoMode.attachDoser(&fertDoser);
+  autoMode.attachSensors(&sensors);
+  autoMode.attachOrders(&orderQueue);
+  autoMode.reset();
+}
 void runBlinkMode()   { ensureProgramInit(); autoMode.run(); }
 
 AutoMode::Tele getAutoTelemetry() { return autoMode.telemetry(); }
+AutoMode::FlowBaselines getAutoFlowBaselines() { return autoMode.flowBaselines(); }
 
-// El main llama esto tras guardar/editar en WebUI
+// -------------------- Programa pendiente (recarga en caliente) --------------------
+// La WebUI (otro core) deja el programa nuevo aquí con un número de versión;
+// irrigationTask lo copia a gProg/gCal en un punto seguro de AutoMode
+// (reposo o entre pasos). gProg sólo lo toca irrigationTask.
+namespace {
+  ProgramSpec            gPendProg;
+  FlowCalibration        gPendCal;
+  std::atomic<uint32_t>  gPendVer{0};
+  uint32_t               gAppliedVer = 0;   // sólo irrigationTask
+
+  SemaphoreHandle_t pendMutex_() {
+    static SemaphoreHandle_t m = xSemaphoreCreateMutex();
+    return m;
+  }
+}
+
+// El main llama esto tras guardar/editar en WebUI: no bloquea ni reinicia
 void modesSetProgram(const ProgramSpec& p, const FlowCalibration& c) {
-  gProg = p;             // copiamos (vive dentro de este módulo)
-  gCal  = c;
+  xSemaphoreTake(pendMutex_(), portMAX_DELAY);
+  gPendProg = p;         // copiamos (vive dentro de este módulo)
+  gPendCal  = c;
+  gPendVer.fetch_add(1, std::memory_order_release);
+  gOrderZones.store(orderZones_(p), std::memory_order_relaxed);
+  xSemaphoreGive(pendMutex_());
+  ctl::notify(ctl::SIG_PROGRAM);
+}
+
+// Sólo irrigationTask
+static void applyPendingProgram_() {
+  const uint32_t ver = gPendVer.load(std::memory_order_acquire);
+  if (ver == gAppliedVer) return;
+  if (!autoMode.atSafePoint()) {       // paso en curso: se aplica al terminarlo
+    autoMode.holdForReload(true);
+    return;
+  }
+
+  xSemaphoreTake(pendMutex_(), portMAX_DELAY);
+  gProg = gPendProg;
+  gCal  = gPendCal;
+  gAppliedVer = gPendVer.load(std::memory_order_relaxed);
+  xSemaphoreGive(pendMutex_());
+  gCalPub.publish(gCal);
+
   gProgInit = true;      // ya tenemos un programa real
-  autoMode.setSchedule(&gProg, &gCal);
+  autoMode.reloadSchedule(&gProg, &gCal);
+}
+
+uint32_t modesNextWakeMs(bool manual) {
+  const uint32_t now = millis();
+  return manual ? manualMode.msUntilNextDeadline(now) : autoMode.msUntilNextDeadline(now);
 }
 
 // -------------------- Control manual desde Web (latch de RelayState) --------------------
-void manualWeb_startState(const RelayState& rs) { manualMode.webStartState(rs); }
-void manualWeb_stopState()                      { manualMode.webStopState();    }
-bool manualWeb_isActive()                       { return manualMode.webIsActive(); }
+// La WebUI corre en el otro core: la orden se deja en un buzón (última gana)
+// y la aplica irrigationTask en modesPollCommands().
+namespace {
+  struct ManualCmd {
+    uint8_t  op;          // 0 = nada, 1 = start, 2 = stop
+    uint16_t mainsMask;
+    uint16_t secsMask;
+    bool     alwaysOn;
+    bool     alwaysOn12;
+    uint8_t  fertPct[2];  // sliders p1/p2 de /mode
+    uint16_t flowLph;     // caudal declarado del estado (referencia de la dosis)
+  };
+  SeqLock<ManualCmd> gManualCmd;
+  uint32_t           gManualCmdSeen = 0;   // sólo lo toca irrigationTask
+}
+
+void manualWeb_startState(const RelayState& rs, uint8_t fert1Pct, uint8_t fert2Pct) {
+  gManualCmd.publish(ManualCmd{ 1, rs.mainsMask, rs.secsMask, rs.alwaysOn, rs.alwaysOn12,
+                                { fert1Pct, fert2Pct }, rs.flowLph });
+  ctl::notify(ctl::SIG_MANUAL_CMD);
+}
+void manualWeb_stopState() {
+  gManualCmd.publish(ManualCmd{ 2, 0, 0, false, false, { 0, 0 }, 0 });
+  ctl::notify(ctl::SIG_MANUAL_CMD);
+}
+bool manualWeb_isActive() { return manualMode.webIsActive(); }
+
+// -------------------- Entradas físicas --------------------
+void modesBeginInputs() {
+  if (!inputs.begin()) Serial.println(F("[IN] timer de muestreo no arrancó"));
+}
+bool modesSwitchManual() { return inputs.active(IN_SWITCH); }
+
+// Botones: sólo MANUAL los usa; en AUTO se vacía la cola igual
+static void pollInputs_(bool manual) {
+  InputService::Event e;
+  while (inputs.pop(e)) {
+    if (!manual || e.input == IN_SWITCH) continue;   // el selector se lee por estado
+    manualMode.onButton(e.input == IN_NEXT ? ManualMode::Button::NEXT : ManualMode::Button::PREV, e.kind);
+  }
+}
+
+static void applyAutoCmd_(bool manual);
+
+void modesPollCommands(bool manual) {
+  applyPendingProgram_();
+  pollInputs_(manual);
+  applyAutoCmd_(manual);
+
+  uint32_t ver = 0;
+  const ManualCmd c = gManualCmd.read(&ver);
+  if (ver == gManualCmdSeen) return;
+  gManualCmdSeen = ver;
+  if (!manual) return;           // en AUTO se descarta (no pelear por los relés)
+
+  if (c.op == 1) {
+    RelayState rs;
+    rs.mainsMask  = c.mainsMask;
+    rs.secsMask   = c.secsMask;
+    rs.alwaysOn   = c.alwaysOn;
+    rs.alwaysOn12 = c.alwaysOn12;
+    rs.flowLph    = c.flowLph;
+    manualMode.reset();          // arranque limpio (antes lo hacía la WebUI)
+    manualMode.webStartState(rs, c.fertPct);
+  } else if (c.op == 2) {
+    manualMode.webStopState();
+  }
+}
+
+uint32_t modesAutoStepDelayMs() { return (uint32_t)BLINK::STEP_MS; }
+
+// -------------------- Órdenes a demanda --------------------
+uint32_t modesEnqueueOrder(int zone, uint32_t volumeMl, uint32_t durationMs, bool urgent,
+                           OrderEnqueue* why) {
+  // Contra el último programa conocido; AutoMode vuelve a validar al sacarla
+  const int32_t zones = gOrderZones.load(std::memory_order_relaxed);
+  if (zone < 0 || zone > INT16_MAX || (zones >= 0 && zone >= zones)) {
+    if (why) *why = OrderEnqueue::BAD_ZONE;
+    return 0;
+  }
+  OrderQueue::Order o;
+  o.zone       = (int16_t)zone;
+  o.volumeMl   = volumeMl;
+  o.durationMs = durationMs;
+  o.priority   = urgent ? OrderQueue::URGENT : OrderQueue::NORMAL;
+  const uint32_t id = orderQueue.push(o);
+  if (why) *why = id ? OrderEnqueue::OK : OrderEnqueue::QUEUE_FULL;
+  if (id) ctl::notify(ctl::SIG_ORDER);
+  return id;
+}
+uint32_t modesOrderBacklog() { return orderQueue.backlog(); }
+bool     modesNextOrderResult(uint32_t& cursor, OrderQueue::Result& out) { return orderQueue.nextResult(cursor, out); }
+uint32_t modesOrderResultHead() { return orderQueue.resultHead(); }
+
+// -------------------- Comandos remotos (MQTT) --------------------
+// Mismo buzón que el control manual Web: SeqLock de un lugar, lo lee irrigationTask
+namespace {
+  struct AutoCmd {
+    uint8_t  op;          // 0 = nada, 1 = stop, 2 = run_set
+    int16_t  set;
+    float    timeScale;
+    float    volScale;
+    uint32_t tag;
+  };
+  SeqLock<AutoCmd>       gAutoCmd;
+  uint32_t               gAutoCmdSeen = 0;   // sólo irrigationTask
+  SeqLock<AutoCmdResult> gAutoCmdResult;
+}
+
+void modesAutoStop(uint32_t tag) {
+  gAutoCmd.publish(AutoCmd{ 1, -1, 1.0f, 1.0f, tag });
+  ctl::notify(ctl::SIG_AUTO_CMD);
+}
+void modesAutoRunSet(uint32_t tag, int setIdx, float timeScale, float volScale) {
+  gAutoCmd.publish(AutoCmd{ 2, (int16_t)(setIdx < 0 || setIdx > INT16_MAX ? -1 : setIdx), timeScale, volScale, tag });
+  ctl::notify(ctl::SIG_AUTO_CMD);
+}
+AutoCmdResult modesAutoCmdResult() { return gAutoCmdResult.read(); }
+
+// Sólo irrigationTask
+static void applyAutoCmd_(bool manual) {
+  uint32_t ver = 0;
+  const AutoCmd c = gAutoCmd.read(&ver);
+  if (ver == gAutoCmdSeen) return;
+  gAutoCmdSeen = ver;
+
+  AutoCmdResult r;
+  r.tag = c.tag;
+  if (manual) {
+    r.status = AutoCmdStatus::MANUAL;          // los relés son del modo manual
+  } else if (c.op == 1) {
+    r.status = autoMode.stopNow() ? AutoCmdStatus::APPLIED : AutoCmdStatus::IDLE;
+  } else if (c.op == 2) {
+    ensureProgramInit();
+    if (c.set < 0 || (size_t)c.set >= gProg.sets.size() || gProg.sets[c.set].steps.empty())
+      r.status = AutoCmdStatus::BAD_SET;
+    else
+      r.status = autoMode.runSetNow((size_t)c.set, c.timeScale, c.volScale) ? AutoCmdStatus::APPLIED
+                                                                            : AutoCmdStatus::BUSY;
+  } else {
+    return;
+  }
+  r.appliedMs = millis();
+  gAutoCmdResult.publish(r);
+}
+
+// -------------------- Sensores analógicos --------------------
+// NVS "sensors": hz, dec, alpha, c{0,1}_kind (0=off, 1=presión, 2=nivel),
+// c{n}_zmv, c{n}_fmv, c{n}_fs, low_kpa, low_hold. Sin nada guardado los dos
+// canales quedan apagados (un pin al aire no debe cortar riegos).
+void modesBeginSensors() {
+  SensorService::Config c;
+  float    lowKpa  = 0.f;
+  uint32_t lowHold = 10000;
+
+  Preferences p;
+  if (p.begin("sensors", /*ro*/ true)) {
+    c.sampleHz   = p.getUInt  ("hz",    c.sampleHz);
+    c.decimation = p.getUShort("dec",   c.decimation);
+    c.iirAlpha   = p.getFloat ("alpha", c.iirAlpha);
+    for (int i = 0; i < SensorService::NUM_CH; ++i) {
+      const String base = String("c") + String(i) + "_";
+      SensorService::Channel& ch = c.ch[i];
+      ch.kind      = (SensorService::Kind)p.getUChar((base + "kind").c_str(), 0);
+      ch.zeroMv    = p.getUShort((base + "zmv").c_str(), ch.zeroMv);
+      ch.fullMv    = p.getUShort((base + "fmv").c_str(), ch.fullMv);
+      ch.fullScale = p.getFloat ((base + "fs").c_str(),  ch.fullScale);
+      if ((uint8_t)ch.kind > (uint8_t)SensorService::Kind::LEVEL) ch.kind = SensorService::Kind::OFF;
+    }
+    lowKpa  = p.getFloat("low_kpa",  lowKpa);
+    lowHold = p.getUInt ("low_hold", lowHold);
+    p.end();
+  }
+
+  if (!sensors.begin(c)) Serial.println(F("[SENS] ADC continuo no arrancó"));
+  autoMode.setLowPressureCut(lowKpa, lowHold);
+}
 
 // -------------------- Callbacks hacia AutoMode --------------------
-void modesSetEventPublisher(AutoMode::EventPublisher pub, const String& topic) {
-  autoMode.setEventPublisher(pub, topic);
+void modesSetEventPublisher(AutoMode::EventPublisher pub, const String& topic, payload::Format fmt) {
+  autoMode.setEventPublisher(pub, topic, fmt);
 }
 void modesSetStateNameResolver(AutoMode::StateNameResolver res) {
   autoMode.setStateNameResolver(res);
 }
 
 // ================== Telemetría MANUAL ==================
-static inline uint32_t mlFromPulses_(uint32_t p1, uint32_t p2) {
-  if (gCal.pulsesPerMl1 <= 0.f && gCal.pulsesPerMl2 <= 0.f) {
+// Corre en la WebUI: gCal es de irrigationTask, aquí se usa la copia publicada
+static inline uint32_t mlFromPulses_(const FlowCalibration& cal, uint32_t p1, uint32_t p2) {
+  if (cal.pulsesPerMl1 <= 0.f && cal.pulsesPerMl2 <= 0.f) {
     return p1 + p2; // “bruto” si no hay cal
   }
-  float ml1 = (gCal.pulsesPerMl1 > 0.f) ? (float)p1 / gCal.pulsesPerMl1 : 0.f;
-  float ml2 = (gCal.pulsesPerMl2 > 0.f) ? (float)p2 / gCal.pulsesPerMl2 : 0.f;
+  float ml1 = (cal.pulsesPerMl1 > 0.f) ? (float)p1 / cal.pulsesPerMl1 : 0.f;
+  float ml2 = (cal.pulsesPerMl2 > 0.f) ? (float)p2 / cal.pulsesPerMl2 : 0.f;
   float ml  = ml1 + ml2;
   if (ml < 0) ml = 0;
   return (uint32_t)lroundf(ml);
@@ -183,7 +405,7 @@ ManualTelemetry modesGetManualTelemetry() {
   if (manualMode.telemetryRaw(d1, d2, elapsed, idx, active)) {
     out.active     = active;
     out.elapsedMs  = elapsed;
-    out.volumeMl   = mlFromPulses_(d1, d2);
+    out.volumeMl   = mlFromPulses_(gCalPub.read(), d1, d2);
     out.stateIndex = idx;
   }
   return out;
@@ -18,15 +18,64 @@ void runFullMode();
 void resetBlinkMode();
 void runBlinkMode();
 AutoMode::Tele getAutoTelemetry();
+// Caudal aprendido por zona (StepSpec::idx), para el planificador
+AutoMode::FlowBaselines getAutoFlowBaselines();
+// Deja un programa nuevo pendiente (cualquier core); irrigationTask lo adopta
+// en un punto seguro (reposo o entre pasos) sin reiniciar.
 void modesSetProgram(const ProgramSpec& p, const FlowCalibration& c);
+// Espera por etapa de la transición suave de AutoMode (para el planificador)
+uint32_t modesAutoStepDelayMs();
 
-// Manual latch desde Web usando RelayState
-void manualWeb_startState(const RelayState& rs);
+// Orden de riego a demanda (cualquier tarea): zona = índice de RelayState,
+// objetivos 0 = los de la zona. La corre AutoMode sin cambiar de modo (en
+// MANUAL espera en cola). Devuelve el id o 0 si no se encoló; why (opcional)
+// dice por qué: zona fuera del programa o cola llena.
+enum class OrderEnqueue : uint8_t { OK = 0, BAD_ZONE = 1, QUEUE_FULL = 2 };
+uint32_t modesEnqueueOrder(int zone, uint32_t volumeMl, uint32_t durationMs, bool urgent = false,
+                           OrderEnqueue* why = nullptr);
+uint32_t modesOrderBacklog();
+// Destino de cada orden (arrancada / rechazada por AutoMode), en orden: cada
+// lector lleva su cursor, que arranca en modesOrderResultHead().
+bool     modesNextOrderResult(uint32_t& cursor, OrderQueue::Result& out);
+uint32_t modesOrderResultHead();
+
+// Comandos remotos para AutoMode (canal MQTT): buzón de un lugar (último gana)
+// que aplica irrigationTask en su próximo despertar. tag lo elige quien llama
+// y vuelve en el resultado junto con el instante de aplicación (latencia).
+enum class AutoCmdStatus : int8_t { PENDING = 0, APPLIED = 1, IDLE = 2, BUSY = 3, BAD_SET = 4, MANUAL = 5 };
+struct AutoCmdResult {
+  uint32_t      tag       = 0;
+  AutoCmdStatus status    = AutoCmdStatus::PENDING;
+  uint32_t      appliedMs = 0;   // millis() al aplicarlo (relés ya comandados)
+};
+void          modesAutoStop(uint32_t tag);
+void          modesAutoRunSet(uint32_t tag, int setIdx, float timeScale = 1.0f, float volScale = 1.0f);
+AutoCmdResult modesAutoCmdResult();
+
+// Manual latch desde Web usando RelayState (encola; lo aplica irrigationTask).
+// fert1Pct/fert2Pct: dosis proporcional al caudal (flow/FertDoser.h)
+void manualWeb_startState(const RelayState& rs, uint8_t fert1Pct = 0, uint8_t fert2Pct = 0);
 void manualWeb_stopState();
 bool manualWeb_isActive();
 
+// ====== Entradas físicas (selector Manual/Auto + botones NEXT/PREV) ======
+// Configura los pines y arranca el muestreo con debounce (hw/InputService.h).
+// Una vez, desde irrigationTask, antes de leer el selector.
+void modesBeginInputs();
+bool modesSwitchManual();               // estado filtrado del selector (cualquier core)
+
+// ====== Bucle de control (sólo desde irrigationTask) ======
+void     modesPollCommands(bool manual); // programa pendiente + botones, comandos remotos y órdenes Web (MANUAL)
+uint32_t modesNextWakeMs(bool manual);  // ms hasta el próximo deadline del modo activo
+
+// ====== Sensores analógicos (VP/VN) ======
+// Lee la config de NVS "sensors", arranca el muestreo (tarea en core 1) y fija
+// el corte por baja presión de AutoMode. Una vez, antes de irrigationTask.
+void modesBeginSensors();
+
 // ====== Callbacks hacia AutoMode ======
-void modesSetEventPublisher(AutoMode::EventPublisher pub, const String& topic);
+void modesSetEventPublisher(AutoMode::EventPublisher pub, const String& topic,
+                            payload::Format fmt = payload::Format::JSON);
 void modesSetStateNameResolver(AutoMode::StateNameResolver res);
 
 // ====== Telemetría Manual (para /mode) ======
@@ -0,0 +1,237 @@
+#include "CommandChannel.h"
+#include <string.h>
+#include "../modes/modes.h"
+
+bool CommandChannel::begin(MqttChat& chat, const char* prefix, payload::Format fmt) {
+  if (q_) return true;
+  chat_        = &chat;
+  replyFormat_ = fmt;
+  q_           = xQueueCreate(QUEUE_LEN, sizeof(Command));
+  if (!q_) return false;
+  resCursor_   = modesOrderResultHead();   // sólo órdenes de aquí en adelante
+
+  const String base = String(prefix ? prefix : "riego") + "/" + chat.clientId();
+  cmdTopic_   = base + "/cmd";
+  replyTopic_ = base + "/reply";
+
+  // Corre en mqttTask: escanear, sellar rxMs y pasar el Command (sin copiar el payload)
+  chat.on(cmdTopic_, [this](const char*, const char* payload, size_t len){
+    Command c;
+    if (!cmd::parse(payload, len, c)) errors_.fetch_add(1, std::memory_order_relaxed);
+    c.rxMs = millis();
+    received_.fetch_add(1, std::memory_order_relaxed);
+    if (xQueueSend(q_, &c, 0) != pdTRUE) dropped_.fetch_add(1, std::memory_order_relaxed);
+  });
+  return chat.addSubscription(cmdTopic_);
+}
+
+void CommandChannel::loop() {
+  if (!q_) return;
+  Command c;
+  while (xQueueReceive(q_, &c, 0) == pdTRUE) execute_(c);
+  pollPending_(millis());
+}
+
+// ------------------- Ejecución (tarea de loop()) -------------------
+void CommandChannel::execute_(const Command& c) {
+  if (c.error) {
+    Extra x; x.reason = c.error;
+    reply_(c.id, c.op, "error", x);
+    return;
+  }
+
+  switch (c.op) {
+    case Op::START_STATE: {
+      OrderEnqueue why = OrderEnqueue::OK;
+      const uint32_t oid = modesEnqueueOrder(c.state, c.volumeMl, c.durationMs, c.urgent, &why);
+      Extra x;
+      if (why == OrderEnqueue::BAD_ZONE) { st_.executed++; x.reason = "bad_state"; reply_(c.id, c.op, "rejected", x); return; }
+      if (!oid) { x.reason = "queue_full"; reply_(c.id, c.op, "busy", x); return; }
+      x.order = oid;
+      reply_(c.id, c.op, "queued", x);
+      track_(c, oid);
+      return;
+    }
+    case Op::STOP:
+    case Op::RUN_SET: {
+      // El buzón de AutoMode es de un lugar: un comando a la vez
+      for (const Pending& p : pending_) {
+        if (p.used && (p.op == Op::STOP || p.op == Op::RUN_SET)) {
+          Extra x; x.reason = "in_flight";
+          reply_(c.id, c.op, "busy", x);
+          return;
+        }
+      }
+      const uint32_t tag = nextTag_++;
+      if (!nextTag_) nextTag_ = 1;
+      if (c.op == Op::STOP) modesAutoStop(tag);
+      else                  modesAutoRunSet(tag, c.set, c.timeScale, c.volScale);
+      track_(c, tag);
+      return;
+    }
+    case Op::PROGRAM: {
+      Extra x;
+      if (!programEnable_) { x.reason = "unsupported"; reply_(c.id, c.op, "error", x); return; }
+      programEnable_(c.enabled > 0);
+      st_.executed++;
+      x.enabled = c.enabled;
+      reply_(c.id, c.op, "ok", x);
+      return;
+    }
+    case Op::TELEMETRY: {
+      st_.executed++;
+      Extra x; x.telemetry = true;
+      reply_(c.id, c.op, "ok", x);
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+void CommandChannel::track_(const Command& c, uint32_t key) {
+  for (Pending& p : pending_) {
+    if (p.used) continue;
+    p.used    = true;
+    p.op      = c.op;
+    p.key     = key;
+    p.rxMs    = c.rxMs;
+    p.sinceMs = millis();
+    memcpy(p.id, c.id, sizeof(p.id));
+    return;
+  }
+  // Sin hueco: se ejecuta igual, pero sin respuesta final ni latencia
+  reply_(c.id, c.op, "untracked", Extra());
+}
+
+void CommandChannel::pollPending_(uint32_t nowMs) {
+  // Resultados de órdenes: se consumen siempre (aunque no haya pendientes) para
+  // que el cursor no quede atrás; cada uno cierra su orden por id.
+  OrderQueue::Result res;
+  while (modesNextOrderResult(resCursor_, res)) {
+    for (Pending& p : pending_) {
+      if (!p.used || p.op != Op::START_STATE || p.key != res.id) continue;
+      Extra x; x.order = p.key;
+      if (res.outcome == OrderQueue::Outcome::STARTED) {
+        x.latencyMs = res.atMs - p.rxMs;
+        x.queueMs   = res.queueMs;
+        latency_(x.latencyMs);
+        reply_(p.id, p.op, "started", x);
+      } else {
+        st_.executed++;
+        reply_(p.id, p.op, "rejected", x);
+      }
+      p.used = false;
+      break;
+    }
+  }
+
+  bool any = false;
+  for (const Pending& p : pending_) any |= p.used;
+  if (!any) return;
+
+  const AutoCmdResult r = modesAutoCmdResult();
+
+  for (Pending& p : pending_) {
+    if (!p.used) continue;
+
+    if (p.op == Op::START_STATE) {
+      if (nowMs - p.sinceMs > ORDER_TIMEOUT_MS) {
+        st_.timeouts++;
+        Extra x; x.order = p.key;
+        reply_(p.id, p.op, "timeout", x);
+        p.used = false;
+      }
+      continue;
+    }
+
+    if (r.tag == p.key && r.status != AutoCmdStatus::PENDING) {
+      const char* s = "applied";
+      switch (r.status) {
+        case AutoCmdStatus::IDLE:    s = "idle";    break;
+        case AutoCmdStatus::BUSY:    s = "busy";    break;
+        case AutoCmdStatus::BAD_SET: s = "bad_set"; break;
+        case AutoCmdStatus::MANUAL:  s = "manual";  break;
+        default: break;
+      }
+      Extra x;
+      x.latencyMs = r.appliedMs - p.rxMs;
+      if (r.status == AutoCmdStatus::APPLIED) latency_(x.latencyMs);
+      else                                    st_.executed++;
+      reply_(p.id, p.op, s, x);
+      p.used = false;
+    } else if (nowMs - p.sinceMs > CMD_TIMEOUT_MS) {
+      st_.timeouts++;
+      reply_(p.id, p.op, "timeout", Extra());
+      p.used = false;
+    }
+  }
+}
+
+void CommandChannel::latency_(uint32_t ms) {
+  st_.executed++;
+  st_.lastLatencyMs = ms;
+  if (ms > st_.maxLatencyMs) st_.maxLatencyMs = ms;
+  st_.avgLatencyMs = st_.avgLatencyMs ? st_.avgLatencyMs + ((int32_t)(ms - st_.avgLatencyMs) >> 3) : ms;
+}
+
+// ------------------- Respuestas -------------------
+const char* CommandChannel::opName_(Op op) {
+  switch (op) {
+    case Op::START_STATE: return "start_state";
+    case Op::STOP:        return "stop";
+    case Op::RUN_SET:     return "run_set";
+    case Op::PROGRAM:     return "program";
+    case Op::TELEMETRY:   return "telemetry";
+    default:              return "";
+  }
+}
+
+void CommandChannel::reply_(const char* id, Op op, const char* status, const Extra& x) {
+  if (!chat_) return;
+  using payload::Key;
+  payload::Writer w(replyFormat_, replyBuf_, sizeof(replyBuf_));
+  w.beginEvent();
+  w.str(Key::ID, id);
+  w.str(Key::CMD, opName_(op));
+  w.str(Key::STATUS, status);
+  if (x.reason)                   w.str(Key::REASON, x.reason);
+  if (x.order)                    w.u32(Key::ORDER, x.order);
+  if (x.latencyMs != Extra::NONE) w.u32(Key::LATENCY_MS, x.latencyMs);
+  if (x.queueMs   != Extra::NONE) w.u32(Key::QUEUE_MS, x.queueMs);
+  if (x.enabled >= 0)             w.boolean(Key::ENABLED, x.enabled > 0);
+  if (x.telemetry)                putTelemetry_(w);
+  w.endMap();
+  if (w.ok()) (void)chat_->publishTo(replyTopic_, w.toString());
+}
+
+void CommandChannel::putTelemetry_(payload::Writer& w) const {
+  using payload::Key;
+  const AutoMode::Tele t = getAutoTelemetry();
+  const Stats st = stats();
+  w.boolean(Key::RUNNING, t.running);
+  w.boolean(Key::PAUSING, t.pausing);
+  w.boolean(Key::REMOTE_RUN, t.remoteRun);
+  w.i32(Key::STEP, t.stepIndex);
+  w.u32(Key::STATE_ELAPSED_MS, t.stateElapsedMs);
+  w.u32(Key::STATE_VOLUME_ML, t.stateVolumeMl);
+  w.u32(Key::RUN_VOLUME_ML, t.runVolumeMl);
+  w.u32(Key::FLOW_LPH, t.flowLph);
+  w.boolean(Key::FLOW_ALARM, t.flowAlarm);
+  w.boolean(Key::PRESSURE_ALARM, t.pressureAlarm);
+  w.boolean(Key::PROGRAM_ENABLED, t.programEnabled);
+  w.time(Key::NEXT_START, (time_t)t.nextStartEpoch);
+  w.i32(Key::ORDER_ZONE, t.orderZone);
+  w.u32(Key::ORDER_BACKLOG, t.orderBacklog);
+  w.boolean(Key::MANUAL, modesGetManualTelemetry().active);
+  w.u32(Key::CMD_LATENCY_MS, st.lastLatencyMs);
+  w.u32(Key::CMD_LATENCY_MAX_MS, st.maxLatencyMs);
+}
+
+CommandChannel::Stats CommandChannel::stats() const {
+  Stats s  = st_;
+  s.received = received_.load(std::memory_order_relaxed);
+  s.errors   = errors_.load(std::memory_order_relaxed);
+  s.dropped  = dropped_.load(std::memory_order_relaxed);
+  return s;
+}
@@ -0,0 +1,115 @@
+// File: src/mqtt/CommandChannel.h
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "MqttChat.h"
+#include "CommandParse.h"
+#include "../core/PayloadEncoder.h"
+
+// ===================== Canal de comandos MQTT (por equipo) =====================
+// Control remoto sin pasar por la WebUI: "<prefijo>/<clientId>/cmd" recibe un
+// objeto JSON por mensaje y las respuestas salen por "<prefijo>/<clientId>/reply"
+// con el "id" que mandó quien pregunta (correlación).
+//
+//   {"id":"a1","cmd":"start_state","state":2,"ml":5000,"ms":600000,"urgent":false}
+//   {"id":"a2","cmd":"stop"}
+//   {"id":"a3","cmd":"run_set","set":0,"time_scale":1.0,"vol_scale":1.0}
+//   {"id":"a4","cmd":"program","enabled":false}
+//   {"id":"a5","cmd":"telemetry"}
+//
+// El payload se escanea en mqttTask directamente sobre el buffer de
+// PubSubClient (core/JsonScan.h) hacia un Command de tamaño fijo, que viaja
+// por una cola FreeRTOS hasta loop(): ahí se ejecuta y se contesta. Ningún
+// paso asigna memoria hasta armar la respuesta, que se codifica en JSON o CBOR
+// según el formato del tópico reply (core/PayloadEncoder.h).
+//
+// Latencia: rxMs se toma al recibir el mensaje; "latency_ms" en la respuesta
+// final es hasta que irrigationTask comandó los relés (AutoCmdResult.appliedMs
+// o Result.atMs de OrderQueue). Una orden en cola contesta "queued" al
+// aceptarse y "started" (con queue_ms) o "rejected" cuando AutoMode la toma;
+// una zona fuera del programa se rechaza al encolar.
+class CommandChannel {
+public:
+  using ProgramEnableFn = std::function<void(bool)>;
+
+  static constexpr uint8_t  QUEUE_LEN        = 4;       // comandos sin ejecutar
+  static constexpr uint8_t  MAX_PENDING      = 4;       // esperando a irrigationTask
+  static constexpr size_t   ID_LEN           = cmd::ID_LEN;
+  static constexpr uint32_t CMD_TIMEOUT_MS   = 5000;    // stop / run_set
+  static constexpr uint32_t ORDER_TIMEOUT_MS = 12UL * 3600UL * 1000UL;   // orden en cola
+
+  // Escaneo del payload en mqtt/CommandParse.h (sin MqttChat: se prueba en el host)
+  using Op      = cmd::Op;
+  using Command = cmd::Command;
+
+  struct Stats {
+    uint32_t received     = 0;   // mensajes en el tópico cmd
+    uint32_t errors       = 0;   // JSON inválido / comando desconocido
+    uint32_t dropped      = 0;   // cola llena
+    uint32_t executed     = 0;   // con respuesta final
+    uint32_t timeouts     = 0;
+    uint32_t lastLatencyMs = 0;  // recepción -> relés comandados
+    uint32_t maxLatencyMs  = 0;
+    uint32_t avgLatencyMs  = 0;  // media móvil (1/8)
+  };
+
+  // Tras chat.begin() (necesita el clientId). prefix sin '/' final; fmt es la
+  // codificación del tópico reply (core/PayloadEncoder.h).
+  bool begin(MqttChat& chat, const char* prefix = "riego",
+             payload::Format fmt = payload::Format::JSON);
+  void loop();   // tarea de loop(): ejecuta, sigue pendientes y contesta
+
+  void attachProgramEnable(ProgramEnableFn fn) { programEnable_ = std::move(fn); }
+
+  const String& cmdTopic()   const { return cmdTopic_; }
+  const String& replyTopic() const { return replyTopic_; }
+  // Desde la tarea de loop() (WebUI)
+  Stats stats() const;
+
+private:
+  struct Pending {
+    bool     used    = false;
+    Op       op      = Op::NONE;
+    char     id[ID_LEN] = {0};
+    uint32_t key     = 0;     // tag del buzón de AutoMode o id de orden
+    uint32_t rxMs    = 0;
+    uint32_t sinceMs = 0;
+  };
+
+  // Campos opcionales de la respuesta (además de id/cmd/status)
+  struct Extra {
+    static constexpr uint32_t NONE = UINT32_MAX;
+    const char* reason    = nullptr;
+    uint32_t    order     = 0;
+    uint32_t    latencyMs = NONE;
+    uint32_t    queueMs   = NONE;
+    int8_t      enabled   = -1;
+    bool        telemetry = false;
+  };
+
+  void execute_(const Command& c);
+  void track_(const Command& c, uint32_t key);
+  void pollPending_(uint32_t nowMs);
+  void reply_(const char* id, Op op, const char* status, const Extra& x);
+  void latency_(uint32_t ms);
+  void putTelemetry_(payload::Writer& w) const;
+
+  static const char* opName_(Op op);
+
+  MqttChat*       chat_  = nullptr;
+  QueueHandle_t   q_     = nullptr;
+  String          cmdTopic_, replyTopic_;
+  ProgramEnableFn programEnable_;
+  payload::Format replyFormat_ = payload::Format::JSON;
+  uint8_t         replyBuf_[512];   // respuestas (tarea de loop())
+  Pending         pending_[MAX_PENDING];
+  uint32_t        nextTag_ = 1;
+  uint32_t        resCursor_ = 0;   // último resultado de orden leído (modesNextOrderResult)
+
+  // received/errors/dropped los cuenta mqttTask; el resto, la tarea de loop()
+  std::atomic<uint32_t> received_{0}, errors_{0}, dropped_{0};
+  Stats                 st_;
+};
@@ -0,0 +1,76 @@
+#include "CommandParse.h"
+#include "../core/JsonScan.h"
+
+namespace cmd {
+
+// "id" tal cual vuelve en la respuesta: sólo [A-Za-z0-9_.:-], así no hay que escaparlo
+static void copyId_(const json::Value& v, char* dst, size_t cap) {
+  size_t o = 0;
+  if (v.kind == json::Value::STRING) {
+    for (size_t i = 0; i < v.len && o + 1 < cap; ++i) {
+      const char c = v.raw[i];
+      const bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                      c == '_' || c == '.' || c == ':' || c == '-';
+      if (ok) dst[o++] = c;
+    }
+  } else if (v.kind == json::Value::NUMBER) {
+    for (size_t i = 0; i < v.len && o + 1 < cap; ++i) dst[o++] = v.raw[i];
+  }
+  dst[o] = '\0';
+}
+
+static uint32_t clampU32_(double d) {
+  if (!(d > 0)) return 0;
+  return d >= 4294967295.0 ? UINT32_MAX : (uint32_t)d;
+}
+
+bool parse(const char* payload, size_t len, Command& c) {
+  c = Command{};
+  bool   badType = false;
+  double state = -1, set = 0;
+
+  const bool ok = json::scanObject(payload, len, [&](const char* k, size_t kl, const json::Value& v){
+    using json::keyIs;
+    if (keyIs(k, kl, "id")) {
+      copyId_(v, c.id, sizeof(c.id));
+    } else if (keyIs(k, kl, "cmd")) {
+      if      (v.equals("start_state")) c.op = Op::START_STATE;
+      else if (v.equals("stop"))        c.op = Op::STOP;
+      else if (v.equals("run_set"))     c.op = Op::RUN_SET;
+      else if (v.equals("program"))     c.op = Op::PROGRAM;
+      else if (v.equals("telemetry"))   c.op = Op::TELEMETRY;
+      else badType = true;
+    } else if (keyIs(k, kl, "state") || keyIs(k, kl, "zone")) {
+      state = v.number(-1);
+    } else if (keyIs(k, kl, "set")) {
+      set = v.number(-1);
+    } else if (keyIs(k, kl, "ml")) {
+      c.volumeMl = clampU32_(v.number(0));
+    } else if (keyIs(k, kl, "ms")) {
+      c.durationMs = clampU32_(v.number(0));
+    } else if (keyIs(k, kl, "time_scale")) {
+      c.timeScale = (float)v.number(1.0);
+    } else if (keyIs(k, kl, "vol_scale")) {
+      c.volScale = (float)v.number(1.0);
+    } else if (keyIs(k, kl, "urgent")) {
+      c.urgent = v.boolean(false);
+    } else if (keyIs(k, kl, "enabled")) {
+      if (v.kind == json::Value::BOOL_TRUE || v.kind == json::Value::BOOL_FALSE) c.enabled = v.boolean() ? 1 : 0;
+    }
+  });
+
+  if (!ok)                 { c.op = Op::NONE; c.error = "bad_json";    return false; }
+  if (badType)             { c.op = Op::NONE; c.error = "unknown_cmd"; return false; }
+  if (c.op == Op::NONE)    { c.error = "missing_cmd"; return false; }
+
+  if (c.op == Op::START_STATE && !(state >= 0 && state <= INT16_MAX)) { c.error = "bad_state"; return false; }
+  if (c.op == Op::RUN_SET     && !(set   >= 0 && set   <= INT16_MAX)) { c.error = "bad_set";   return false; }
+  if (c.op == Op::PROGRAM     && c.enabled < 0)                       { c.error = "bad_enabled"; return false; }
+  if (c.op == Op::RUN_SET && !(c.timeScale > 0.0f && c.timeScale <= 10.0f &&
+                               c.volScale  > 0.0f && c.volScale  <= 10.0f)) { c.error = "bad_scale"; return false; }
+  c.state = (int16_t)state;
+  c.set   = (int16_t)set;
+  return true;
+}
+
+} // namespace cmd
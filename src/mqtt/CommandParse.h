@@ -0,0 +1,37 @@
+// File: src/mqtt/CommandParse.h
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ===================== Comandos remotos: payload -> Command =====================
+// Escaneo del JSON de "<prefijo>/<clientId>/cmd" (ver mqtt/CommandChannel.h)
+// hacia un Command de tamaño fijo. Sin MqttChat ni FreeRTOS: lo usa
+// CommandChannel en mqttTask y el simulador del host para probarlo.
+namespace cmd {
+
+static constexpr size_t ID_LEN = 24;   // "id" de correlación (truncado)
+
+enum class Op : uint8_t { NONE, START_STATE, STOP, RUN_SET, PROGRAM, TELEMETRY };
+
+// Todo por valor: se copia entero por la cola
+struct Command {
+  Op          op         = Op::NONE;
+  char        id[ID_LEN] = {0};
+  int16_t     state      = -1;
+  int16_t     set        = 0;
+  uint32_t    volumeMl   = 0;
+  uint32_t    durationMs = 0;
+  float       timeScale  = 1.0f;
+  float       volScale   = 1.0f;
+  bool        urgent     = false;
+  int8_t      enabled    = -1;       // -1 = no vino
+  uint32_t    rxMs       = 0;
+  const char* error      = nullptr;  // literal: payload inválido
+};
+
+// false con out.error = "bad_json" / "unknown_cmd" / "missing_cmd" / "bad_state" /
+// "bad_set" / "bad_enabled" / "bad_scale". El "id" se copia igual (truncado a
+// ID_LEN-1 y sólo [A-Za-z0-9_.:-]) para poder contestar el error.
+bool parse(const char* payload, size_t len, Command& out);
+
+} // namespace cmd
@@ -0,0 +1,329 @@
+#include "EventOutbox.h"
+#include "../schedule/IrrigationConfigCodec.h"   // irrcfg::crc32
+#include "../core/PayloadEncoder.h"                // payload::prependSeq
+
+static void put16_(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put32_(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> (8 * i)); }
+static uint16_t get16_(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t get32_(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t recCrc_(uint32_t seq, const uint8_t* t, size_t tl, const uint8_t* p, size_t pl) {
+  uint8_t s[4]; put32_(s, seq);
+  uint32_t c = irrcfg::crc32(s, 4);
+  c = irrcfg::crc32(t, tl, c);
+  return irrcfg::crc32(p, pl, c);
+}
+
+String EventOutbox::segPath_(uint32_t first) const {
+  char b[16];
+  snprintf(b, sizeof(b), "/%08lx.log", (unsigned long)first);
+  return String(dir_) + b;
+}
+
+// ------------------- Arranque -------------------
+bool EventOutbox::begin(fs::FS& fs) {
+  fs_ = &fs;
+  if (!fs.exists(dir_) && !fs.mkdir(dir_)) return false;
+
+  // Segmentos existentes, ordenados por primer seq
+  nSegs_ = 0;
+  File d = fs.open(dir_);
+  for (File e = d.openNextFile(); e; e = d.openNextFile()) {
+    String n = e.name();
+    const uint32_t size = (uint32_t)e.size();
+    e.close();
+    const int slash = n.lastIndexOf('/');
+    if (slash >= 0) n = n.substring(slash + 1);
+    if (!n.endsWith(".log")) continue;
+    const uint32_t first = strtoul(n.c_str(), nullptr, 16);
+    if (!first) continue;
+    if (nSegs_ == MAX_SEGS) {           // sobrante (p. ej. MAX_SEGS bajó): fuera el más viejo
+      uint8_t old = 0;
+      for (uint8_t i = 1; i < nSegs_; ++i) if (segs_[i].first < segs_[old].first) old = i;
+      if (first < segs_[old].first) { fs.remove(segPath_(first)); continue; }
+      fs.remove(segPath_(segs_[old].first));
+      segs_[old] = segs_[--nSegs_];
+    }
+    segs_[nSegs_++] = Seg{ first, size };
+  }
+  d.close();
+  for (uint8_t i = 1; i < nSegs_; ++i)
+    for (uint8_t j = i; j > 0 && segs_[j - 1].first > segs_[j].first; --j) std::swap(segs_[j - 1], segs_[j]);
+
+  // Último seq: recorrer el segmento más nuevo hasta el primer registro inválido
+  if (nSegs_) {
+    const uint8_t last = nSegs_ - 1;
+    uint32_t pos = 0, seq = 0, len = 0, lastSeq = segs_[last].first - 1;
+    while (readAt_(last, pos, nullptr, seq, len)) { lastSeq = seq; pos += len; }
+    if (pos < segs_[last].bytes) segs_[last].bytes = SEG_BYTES;   // cola cortada: no se anexa más ahí
+    nextSeq_ = lastSeq + 1;
+  }
+
+  // Cursor de ack
+  acked_ = nextSeq_ - 1;
+  if (nSegs_) acked_ = segs_[0].first - 1;
+  File a = fs.open(String(dir_) + "/ack", "r");
+  if (a) {
+    uint8_t b[8];
+    if (a.read(b, sizeof(b)) == sizeof(b)) {
+      const uint32_t s = get32_(b);
+      if (s >= acked_ && s < nextSeq_) acked_ = s;
+      ackMode_ = get32_(b + 4) != 0;
+    }
+    a.close();
+  }
+  sent_   = acked_;
+  hiSent_ = nextSeq_ - 1;          // lo de antes del reinicio cuenta como reenvío
+  rdValid_ = false;
+  ready_   = true;
+  publishStats_();
+  return true;
+}
+
+// ------------------- Escritura -------------------
+bool EventOutbox::openSegment_(uint32_t first) {
+  if (nSegs_ == MAX_SEGS) dropOldest_();
+  File f = fs_->open(segPath_(first), "w");
+  if (!f) return false;
+  f.close();
+  segs_[nSegs_++] = Seg{ first, 0 };
+  return true;
+}
+
+// Disco lleno: el segmento más viejo se va aunque tenga eventos sin confirmar
+void EventOutbox::dropOldest_() {
+  if (!nSegs_) return;
+  const uint32_t end = (nSegs_ > 1) ? segs_[1].first : nextSeq_;
+  if (end > acked_ + 1) {
+    st_.evicted += end - (acked_ + 1);
+    acked_   = end - 1;
+    ackDirty_ = true;
+  }
+  if (sent_ < acked_) sent_ = acked_;
+  fs_->remove(segPath_(segs_[0].first));
+  for (uint8_t i = 1; i < nSegs_; ++i) segs_[i - 1] = segs_[i];
+  nSegs_--;
+  rdValid_ = false;
+}
+
+uint32_t EventOutbox::append(const String& topic, const String& payload) {
+  if (!ready_) return 0;
+  const uint32_t seq = nextSeq_;
+
+  // "seq" como primer campo del evento, JSON o CBOR (el consumidor confirma con él)
+  String body;
+  payload::prependSeq(payload, seq, body);
+
+  const uint32_t tl = topic.length(), pl = body.length();
+  const uint32_t len = HDR_LEN + tl + pl;
+  if (tl > 0xFFFF || pl > 0xFFFF || len > SEG_BYTES) return 0;
+
+  if (!nSegs_ || segs_[nSegs_ - 1].bytes + len > SEG_BYTES) {
+    if (!openSegment_(seq)) return 0;
+  }
+
+  uint8_t h[HDR_LEN] = {0};
+  h[0] = MAGIC;
+  put16_(h + 2, (uint16_t)tl);
+  put16_(h + 4, (uint16_t)pl);
+  put32_(h + 8, seq);
+  put32_(h + 12, recCrc_(seq, (const uint8_t*)topic.c_str(), tl, (const uint8_t*)body.c_str(), pl));
+
+  Seg& s = segs_[nSegs_ - 1];
+  File f = fs_->open(segPath_(s.first), "a");
+  if (!f) return 0;
+  const bool ok = f.write(h, HDR_LEN) == HDR_LEN &&
+                  f.write((const uint8_t*)topic.c_str(), tl) == tl &&
+                  f.write((const uint8_t*)body.c_str(), pl) == pl;
+  f.close();
+  if (!ok) { s.bytes = SEG_BYTES; return 0; }   // el próximo va a un segmento nuevo
+
+  s.bytes += len;
+  nextSeq_++;
+  st_.appended++;
+  publishStats_();
+  return seq;
+}
+
+// ------------------- Lectura -------------------
+// n bytes del archivo a 'out', por bloques (concat con largo: el payload CBOR
+// puede traer '\0'). El '\0' tras el bloque es porque concat copia largo + 1.
+static bool readStr_(File& f, uint32_t n, String& out) {
+  out.reserve(n);
+  uint8_t buf[128 + 1];
+  while (n) {
+    const size_t got = f.read(buf, n < sizeof(buf) - 1 ? n : sizeof(buf) - 1);
+    if (!got) return false;
+    buf[got] = 0;
+    out.concat(reinterpret_cast<const char*>(buf), (unsigned)got);
+    n -= got;
+  }
+  return true;
+}
+
+// Lee la cabecera (y si out != nullptr el cuerpo) del registro en pos
+bool EventOutbox::readAt_(uint8_t seg, uint32_t pos, Record* out, uint32_t& seq, uint32_t& len) {
+  File f = fs_->open(segPath_(segs_[seg].first), "r");
+  if (!f) return false;
+  bool ok = false;
+  uint8_t h[HDR_LEN];
+  if (f.seek(pos) && f.read(h, HDR_LEN) == HDR_LEN && h[0] == MAGIC) {
+    const uint16_t tl = get16_(h + 2), pl = get16_(h + 4);
+    seq = get32_(h + 8);
+    len = HDR_LEN + tl + pl;
+    if (pos + len <= (uint32_t)f.size()) {
+      if (!out) {
+        ok = true;
+      } else {
+        String t, p;
+        ok = readStr_(f, tl, t) && readStr_(f, pl, p) &&
+             recCrc_(seq, (const uint8_t*)t.c_str(), tl, (const uint8_t*)p.c_str(), pl) == get32_(h + 12);
+        if (ok) { out->seq = seq; out->topic = t; out->payload = p; }
+      }
+    }
+  }
+  f.close();
+  return ok;
+}
+
+// Ubica el cursor de lectura en 'seq' (o en el primero disponible después)
+void EventOutbox::seekTo_(uint32_t seq) {
+  rdValid_ = false;
+  if (!nSegs_) return;
+  uint8_t i = 0;
+  while (i + 1 < nSegs_ && segs_[i + 1].first <= seq) ++i;
+  rdSeg_ = i; rdPos_ = 0; rdSeq_ = segs_[i].first;
+  uint32_t s = 0, len = 0;
+  while (rdSeq_ < seq && readAt_(rdSeg_, rdPos_, nullptr, s, len)) { rdPos_ += len; rdSeq_ = s + 1; }
+  rdValid_ = true;
+}
+
+bool EventOutbox::next_(Record& r) {
+  while (sent_ + 1 < nextSeq_) {
+    const uint32_t want = sent_ + 1;
+    if (!rdValid_ || rdSeq_ != want) seekTo_(want);
+    if (!rdValid_) return false;
+    if (rdSeq_ > want) {               // ya no está en flash (descartado)
+      if (acked_ < rdSeq_ - 1) { acked_ = rdSeq_ - 1; ackDirty_ = true; }
+      sent_ = rdSeq_ - 1;
+      continue;
+    }
+
+    uint32_t seq = 0, len = 0;
+    if (readAt_(rdSeg_, rdPos_, &r, seq, len) && seq == want) {
+      rdPos_ += len;
+      rdSeq_  = seq + 1;
+      return true;
+    }
+    // Fin (o registro dañado) del segmento: saltar al siguiente
+    if (rdSeg_ + 1 >= nSegs_) return false;
+    const uint32_t skip = segs_[rdSeg_ + 1].first;
+    if (skip > want) {
+      st_.evicted += skip - want;      // ilegibles: se dan por perdidos
+      if (acked_ < skip - 1) { acked_ = skip - 1; ackDirty_ = true; }
+      sent_ = skip - 1;
+    }
+    rdSeg_++; rdPos_ = 0; rdSeq_ = segs_[rdSeg_].first;
+  }
+  return false;
+}
+
+// ------------------- Envío / confirmación -------------------
+void EventOutbox::pump(uint32_t nowMs, const Sender& send) {
+  if (!ready_) return;
+  const uint32_t perMsg = 1000 / REPLAY_PER_SEC;
+
+  // Sin ack a tiempo: volver a enviar desde el último confirmado
+  if (ackMode_ && sent_ > acked_ && nowMs - waitAckSince_ >= ACK_TIMEOUT_MS) {
+    sent_ = acked_;
+    waitAckSince_ = nowMs;
+  }
+
+  tokensMs_ += nowMs - lastPumpMs_;
+  lastPumpMs_ = nowMs;
+  if (tokensMs_ > REPLAY_BATCH * perMsg) tokensMs_ = REPLAY_BATCH * perMsg;
+
+  bool changed = false;
+  Record r;
+  for (uint8_t n = 0; n < REPLAY_BATCH && tokensMs_ >= perMsg && next_(r); ++n) {
+    if (!send(r.topic, r.payload)) { rdValid_ = false; break; }
+    if (sent_ == acked_) waitAckSince_ = nowMs;
+    sent_ = r.seq;
+    tokensMs_ -= perMsg;
+    if (r.seq <= hiSent_) st_.replayed++;
+    else                  hiSent_ = r.seq;
+    // Sin consumidor que confirme: entregado = aceptado por el socket
+    if (!ackMode_) advanceAck_(r.seq, nowMs);
+    changed = true;
+  }
+  tick(nowMs);
+  if (changed) publishStats_();
+}
+
+void EventOutbox::rewind() {
+  sent_ = acked_;
+  rdValid_ = false;
+}
+
+bool EventOutbox::ack(uint32_t seq, uint32_t nowMs) {
+  if (!ready_) return false;
+  // Sólo vale lo que salió en esta sesión: ni el modo ack ni el cursor se
+  // mueven por un seq que nunca se envió
+  if (seq == 0 || seq > hiSent_) {
+    st_.badAcks++;
+    publishStats_();
+    return false;
+  }
+  if (!ackMode_) { ackMode_ = true; ackDirty_ = true; }
+  advanceAck_(seq, nowMs);
+  waitAckSince_ = nowMs;
+  tick(nowMs);
+  publishStats_();
+  return true;
+}
+
+void EventOutbox::advanceAck_(uint32_t seq, uint32_t nowMs) {
+  if (seq <= acked_) return;
+  st_.delivered += seq - acked_;
+  acked_ = seq;
+  if (sent_ < acked_) sent_ = acked_;
+  ackDirty_ = true;
+
+  // Segmentos completos y confirmados: fuera (el último sigue recibiendo)
+  bool removed = false;
+  while (nSegs_ > 1 && segs_[1].first <= acked_ + 1) {
+    fs_->remove(segPath_(segs_[0].first));
+    for (uint8_t i = 1; i < nSegs_; ++i) segs_[i - 1] = segs_[i];
+    nSegs_--;
+    removed = true;
+  }
+  if (removed) { rdValid_ = false; saveAck_(nowMs); }
+}
+
+void EventOutbox::tick(uint32_t nowMs) {
+  if (ackDirty_ && nowMs - lastAckSaveMs_ >= ACK_SAVE_MS) saveAck_(nowMs);
+}
+
+void EventOutbox::saveAck_(uint32_t nowMs) {
+  uint8_t b[8];
+  put32_(b, acked_);
+  put32_(b + 4, ackMode_ ? 1 : 0);
+  File f = fs_->open(String(dir_) + "/ack", "w");
+  if (f) { f.write(b, sizeof(b)); f.close(); }
+  ackDirty_      = false;
+  lastAckSaveMs_ = nowMs;
+}
+
+void EventOutbox::publishStats_() {
+  st_.backlog  = nextSeq_ - 1 - acked_;
+  st_.lastSeq  = nextSeq_ - 1;
+  st_.ackedSeq = acked_;
+  st_.bytes    = 0;
+  for (uint8_t i = 0; i < nSegs_; ++i) st_.bytes += segs_[i].bytes > SEG_BYTES ? SEG_BYTES : segs_[i].bytes;
+  st_.segments = nSegs_;
+  st_.ackMode  = ackMode_;
+  st_.ready    = ready_;
+  pub_.publish(st_);
+}
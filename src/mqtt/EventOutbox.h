@@ -0,0 +1,120 @@
+// File: src/mqtt/EventOutbox.h
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <functional>
+#include "../core/SeqLock.h"
+
+// ===================== Outbox persistente de eventos (LittleFS) =====================
+// Registro de sólo-anexar de los eventos de riego (state_start/state_end/...):
+// cada evento recibe un número de secuencia, se escribe en flash ANTES de
+// intentar publicarlo y sólo se borra cuando está confirmado. Sin Wi-Fi o sin
+// broker se acumula; al reconectar se reenvía en orden, por tandas y con
+// límite de tasa.
+//
+// Semántica QoS1 a nivel de aplicación (PubSubClient sólo publica con QoS0):
+// el payload (JSON o map CBOR) lleva "seq" y el consumidor confirma con "ack <seq>"
+// (acumulativo) en "riego/<clientId>/ack" (MqttChat). Un ack de un seq que este
+// equipo nunca envió se ignora. Sin confirmación en ACK_TIMEOUT_MS
+// se vuelve a enviar desde el último confirmado (el consumidor deduplica por
+// seq). Hasta recibir el primer ack (modo que queda persistido) se toma como
+// entregado lo que el socket aceptó, para no reenviar sin fin si nadie confirma.
+//
+// Disco acotado: segmentos de SEG_BYTES (nombre = primer seq en hex); con
+// MAX_SEGS llenos se descarta el segmento más viejo aunque no esté confirmado.
+// Registro: magic u8 | 0 u8 | tlen u16 | plen u16 | 0 u16 | seq u32 | crc32 u32
+// + tópico + payload (CRC32 de seq+tópico+payload; un registro cortado por un
+// reinicio cierra el segmento).
+//
+// Hilo único: todo lo usa mqttTask. stats() se puede leer desde cualquier core.
+class EventOutbox {
+public:
+  static constexpr uint32_t SEG_BYTES      = 8192;
+  static constexpr uint8_t  MAX_SEGS       = 8;        // 64 KB en flash como máximo
+  static constexpr uint8_t  REPLAY_BATCH   = 8;        // por llamada a pump()
+  static constexpr uint32_t REPLAY_PER_SEC = 10;
+  static constexpr uint32_t ACK_TIMEOUT_MS = 30000;
+  static constexpr uint32_t ACK_SAVE_MS    = 10000;    // cursor de ack a flash como mucho cada 10 s
+
+  using Sender = std::function<bool(const String& topic, const String& payload)>;
+
+  struct Stats {
+    uint32_t appended   = 0;   // desde el arranque
+    uint32_t delivered  = 0;   // confirmados (o aceptados por el socket sin modo ack)
+    uint32_t evicted    = 0;   // descartados sin entregar (disco lleno)
+    uint32_t replayed   = 0;   // reenvíos
+    uint32_t badAcks    = 0;   // acks de seq no enviados (ignorados)
+    uint32_t backlog    = 0;   // en flash sin confirmar
+    uint32_t lastSeq    = 0;
+    uint32_t ackedSeq   = 0;
+    uint32_t bytes      = 0;   // ocupados en flash
+    uint8_t  segments   = 0;
+    bool     ackMode    = false;
+    bool     ready      = false;
+  };
+
+  explicit EventOutbox(const char* dir = "/outbox") : dir_(dir) {}
+
+  // Monta sobre un FS ya iniciado (LittleFS.begin) y recupera seq/ack
+  bool begin(fs::FS& fs);
+
+  // Anexa un evento; devuelve su seq (0 = no se pudo escribir)
+  uint32_t append(const String& topic, const String& payload);
+
+  // Con enlace arriba: reenvía pendientes respetando tasa y tanda
+  void pump(uint32_t nowMs, const Sender& send);
+  // Tras (re)conectar: vuelve a enviar todo lo no confirmado
+  void rewind();
+  // Confirmación acumulativa del consumidor (false = seq nunca enviado: ignorado)
+  bool ack(uint32_t seq, uint32_t nowMs);
+  // Persiste el cursor de ack si quedó pendiente
+  void tick(uint32_t nowMs);
+
+  bool  pending() const { return ready_ && sent_ + 1 < nextSeq_; }
+  Stats stats()   const { return pub_.read(); }
+
+private:
+  struct Seg { uint32_t first; uint32_t bytes; };
+  struct Record { uint32_t seq; String topic; String payload; };
+
+  static constexpr uint8_t  MAGIC   = 0xE7;
+  static constexpr uint32_t HDR_LEN = 16;
+
+  String segPath_(uint32_t first) const;
+  bool   readAt_(uint8_t seg, uint32_t pos, Record* out, uint32_t& seq, uint32_t& len);
+  bool   next_(Record& r);
+  void   seekTo_(uint32_t seq);
+  bool   openSegment_(uint32_t first);
+  void   dropOldest_();
+  void   advanceAck_(uint32_t seq, uint32_t nowMs);
+  void   saveAck_(uint32_t nowMs);
+  void   publishStats_();
+
+  const char* dir_;
+  fs::FS*     fs_    = nullptr;
+  bool        ready_ = false;
+
+  Seg      segs_[MAX_SEGS];
+  uint8_t  nSegs_ = 0;
+
+  uint32_t nextSeq_ = 1;     // próximo a asignar
+  uint32_t acked_   = 0;     // último confirmado
+  uint32_t sent_    = 0;     // último enviado (>= acked_)
+  uint32_t hiSent_  = 0;     // mayor seq enviado alguna vez (para contar reenvíos)
+  bool     ackMode_ = false;
+
+  // Cursor de lectura (evita re-escanear el segmento en cada registro)
+  bool     rdValid_ = false;
+  uint8_t  rdSeg_   = 0;
+  uint32_t rdPos_   = 0;
+  uint32_t rdSeq_   = 0;
+
+  uint32_t tokensMs_      = 0;   // crédito de tasa, en ms de envío acumulados
+  uint32_t lastPumpMs_    = 0;
+  uint32_t waitAckSince_  = 0;   // desde cuándo hay enviados sin confirmar
+  bool     ackDirty_      = false;
+  uint32_t lastAckSaveMs_ = 0;
+
+  Stats           st_;
+  SeqLock<Stats>  pub_;
+};
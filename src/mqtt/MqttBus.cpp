@@ -32,11 +32,7 @@ void MqttBus::begin() {
 
   mqtt_.setServer(host_.c_str(), port_);
   mqtt_.setCallback([this](char* topic, uint8_t* payload, unsigned len){
-    if (!handler_) return;
-    String t(topic);
-    String p; p.reserve(len);
-    for (unsigned i=0;i<len;i++) p += (char)payload[i];
-    handler_(t,p);
+    router_.dispatch(topic, payload, len);
   });
 }
 
@@ -64,8 +60,6 @@ void MqttBus::subscribe(const String& topic) {
   if (ensureConnected()) mqtt_.subscribe(topic.c_str());
 }
 
-void MqttBus::onMessage(MessageHandler cb) { handler_ = cb; }
-
 bool MqttBus::publish(const String& topic, const String& payload, bool retained) {
   if (!ensureConnected()) return false;
   return mqtt_.publish(topic.c_str(), payload.c_str(), retained);
@@ -3,11 +3,10 @@
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
 #include <functional>
+#include "TopicRouter.h"
 
 class MqttBus {
 public:
-  using MessageHandler = std::function<void(const String& topic, const String& payload)>;
-
   MqttBus(const String& host, uint16_t port,
           const String& user, const String& pass);
 
@@ -21,7 +20,9 @@ public:
   bool ensureConnected();
 
   void subscribe(const String& topic);
-  void onMessage(MessageHandler cb);
+  // Handler por filtro: vista del buffer de PubSubClient, válida sólo durante la llamada
+  int  on(const String& filter, TopicRouter::Handler h) { return router_.add(filter, std::move(h)); }
+  void off(int id) { router_.remove(id); }
 
   bool publish(const String& topic, const String& payload, bool retained=false);
 
@@ -34,5 +35,5 @@ private:
 
   WiFiClientSecure tls_;
   PubSubClient     mqtt_;
-  MessageHandler   handler_;
+  TopicRouter      router_;
 };
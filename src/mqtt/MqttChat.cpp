@@ -7,6 +7,13 @@ static String macToStr(const uint8_t mac[6]) {
   return String(b);
 }
 
+// Tarea de red: core 1 junto a la WebUI, nunca en el core de riego
+static constexpr uint32_t TASK_STACK     = 8192;   // TLS
+static constexpr uint32_t IDLE_POLL_MS   = 20;     // mqtt_.loop() con enlace arriba
+static constexpr uint32_t DOWN_POLL_MS   = 250;    // sin Wi-Fi / esperando backoff
+static constexpr uint8_t  FLUSH_PER_TURN = 4;      // publicaciones por vuelta
+static constexpr uint16_t SOCKET_TIMEOUT_S = 5;
+
 MqttChat::MqttChat(const char* host,
                    uint16_t port,
                    const char* user,
@@ -17,6 +24,9 @@ MqttChat::MqttChat(const char* host,
   user_(user ? user : ""),
   pass_(pass ? pass : ""),
   topic_(topic_default ? topic_default : "public/chat"),
+  mu_(xSemaphoreCreateMutex()),
+  routeMu_(xSemaphoreCreateMutex()),
+  obMu_(xSemaphoreCreateMutex()),
   mqtt_(tls_) {}
 
 void MqttChat::setRootCA(const char* ca_pem) { root_ca_pem_ = ca_pem; }
@@ -30,115 +40,472 @@ String MqttChat::makeClientId() const {
 }
 
 void MqttChat::begin() {
-  mqtt_.setServer(host_.c_str(), port_);
+  if (task_) return;
   clientId_ = makeClientId();
   if (root_ca_pem_) tls_.setCACert(root_ca_pem_);
   else              tls_.setInsecure();    // simple para pruebas
+  mqtt_.setSocketTimeout(SOCKET_TIMEOUT_S);
 
-  // Callback de mensajes entrantes
+  // Callback de PubSubClient: corre en mqttTask, sólo encola
   mqtt_.setCallback([this](char* topic, uint8_t* payload, unsigned int len){
-    if (!handler_) return;
-    String t(topic);
-    String p; p.reserve(len);
-    for (unsigned int i = 0; i < len; ++i) p += static_cast<char>(payload[i]);
-    handler_(t, p);
+    received_(topic, payload, len);
   });
+
+  // Confirmaciones del outbox: sólo por el tópico propio del equipo
+  if (outbox_) {
+    ackTopic_ = String(ackPrefix_ ? ackPrefix_ : "riego") + "/" + clientId_ + "/ack";
+    addSubscription(ackTopic_);
+  }
+
+  xTaskCreatePinnedToCore(taskEntry_, "mqttTask", TASK_STACK, this, 1, &task_, 1);
 }
 
-bool MqttChat::ensureConnected() {
-  if (mqtt_.connected()) return true;
-  if (WiFi.status() != WL_CONNECTED) return false;
+// ------------------- Productores (cualquier tarea) -------------------
+bool MqttChat::enqueue_(Msg&& m) {
+  lock_();
+  const bool ok = !out_.full();
+  if (ok) out_.push(std::move(m));
+  else    st_.dropped++;
+  unlock_();
+  if (ok) wake_();
+  return ok;
+}
 
+bool MqttChat::publish(const String& msg) {
+  Msg m;
+  m.payload = msg;               // copia fuera del lock
+  lock_();
+  m.topic = topic_;
+  unlock_();
+  return enqueue_(std::move(m));
+}
+
+bool MqttChat::publishTo(const String& topic, const String& msg) {
+  Msg m;
+  m.topic   = topic;
+  m.payload = msg;
+  return enqueue_(std::move(m));
+}
+
+bool MqttChat::publishDurable(const String& topic, const String& msg) {
+  if (!outbox_) return publishTo(topic, msg);
+  Msg m;
+  m.topic   = topic;
+  m.payload = msg;
+  lock_();
+  const bool queued = !dur_.full();
+  if (queued) dur_.push(std::move(m));
+  unlock_();
+  if (queued) { wake_(); return true; }
+
+  // Cola llena (mqttTask ocupada): anexar aquí, detrás de lo ya encolado
+  obLock_();
+  drainDurableLocked_();
+  const bool ok = appendDurable_(m);
+  obUnlock_();
+  lock_();
+  st_.durableDirect++;
+  unlock_();
+  wake_();
+  return ok;
+}
+
+// Entrega de recibidos en la tarea que llama (loop de Arduino)
+void MqttChat::loop() {
+  for (;;) {
+    Msg m;
+    MessageHandler h;
+    lock_();
+    const bool any = in_.count > 0;
+    if (any) { m = std::move(in_.front()); in_.pop(); h = handler_; }
+    unlock_();
+    if (!any) return;
+    if (h) h(m.topic, m.payload);
+  }
+}
+
+// ------------------- mqttTask -------------------
+void MqttChat::taskEntry_(void* self) {
+  static_cast<MqttChat*>(self)->run_();
+}
+
+void MqttChat::run_() {
+  for (;;) {
+    const uint32_t now = millis();
+    uint32_t waitMs = DOWN_POLL_MS;
+
+    applyLink_();
+    drainDurable_();
+
+    if (WiFi.status() != WL_CONNECTED) {
+      if (mqtt_.connected()) mqtt_.disconnect();
+      onLinkDown_(now);
+    } else if (!mqtt_.connected()) {
+      onLinkDown_(now);
+      if ((int32_t)(now - nextTryMs_) >= 0) (void)connect_();
+      if (!mqtt_.connected()) {
+        const int32_t d = (int32_t)(nextTryMs_ - millis());
+        if (d > 0 && (uint32_t)d < waitMs) waitMs = (uint32_t)d;
+      }
+    }
+
+    if (mqtt_.connected()) {
+      syncSubscription_();
+      mqtt_.loop();
+      flushOutbox_();
+      if (outbox_) {
+        obLock_();
+        outbox_->pump(millis(), [this](const String& t, const String& p){
+          return mqtt_.publish(t.c_str(), reinterpret_cast<const uint8_t*>(p.c_str()), p.length(), false);
+        });
+        obUnlock_();
+      }
+      waitMs = IDLE_POLL_MS;
+      lock_();
+      if (out_.count || dur_.count) waitMs = 0;    // quedan pendientes: otra vuelta ya
+      unlock_();
+    } else if (outbox_) {
+      obLock_();
+      outbox_->tick(millis());
+      obUnlock_();
+    }
+
+    // Duerme hasta la próxima vuelta o hasta que alguien encole
+    if (waitMs) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+    else        taskYIELD();
+  }
+}
+
+// Servidor/credenciales nuevos: cortar y reconectar sin esperar el backoff
+void MqttChat::applyLink_() {
+  lock_();
+  const bool dirty = linkGen_ != linkApplied_;
+  if (dirty) {
+    linkApplied_ = linkGen_;
+    curHost_ = host_; curPort_ = port_;
+    curUser_ = user_; curPass_ = pass_;
+    if (bufferSize_) mqtt_.setBufferSize((uint16_t)bufferSize_);
+  }
+  unlock_();
+  if (!dirty) return;
+
+  if (mqtt_.connected()) mqtt_.disconnect();
+  mqtt_.setServer(curHost_.c_str(), curPort_);
+  backoffMs_ = 0;
+  nextTryMs_ = millis();
+}
+
+bool MqttChat::connect_() {
   const char* willTopic = "status/esp32-chat";
   const char* willMsg   = "offline";
 
-  bool ok = mqtt_.connect(clientId_.c_str(),
-                          user_.c_str(), pass_.c_str(),
-                          willTopic, 0, false, willMsg);
+  const uint32_t t0 = millis();
+  const bool ok = mqtt_.connect(clientId_.c_str(),
+                                curUser_.c_str(), curPass_.c_str(),
+                                willTopic, 0, false, willMsg);
+  const uint32_t took = millis() - t0;
+
   if (ok) {
     mqtt_.publish(willTopic, "online", false);
-    subscribed_ = false; // tras reconexión, forzar re-subscribe si activo
+    subApplied_   = UINT32_MAX;   // tras reconexión, forzar re-subscribe si activo
+    extraApplied_ = UINT32_MAX;
+    subNow_       = "";
+    backoffMs_    = 0;
+    wasUp_        = true;
+    if (outbox_) { obLock_(); outbox_->rewind(); obUnlock_(); }   // reenviar todo lo no confirmado
+    linkUp_.store(true, std::memory_order_release);
+  } else {
+    // Backoff exponencial con jitter: espera en [d/2, d], d = 1 s, 2 s, ... 60 s
+    backoffMs_ = backoffMs_ ? backoffMs_ * 2 : BACKOFF_MIN_MS;
+    if (backoffMs_ > BACKOFF_MAX_MS) backoffMs_ = BACKOFF_MAX_MS;
+    nextTryMs_ = millis() + backoffMs_ / 2 + (uint32_t)random((long)(backoffMs_ / 2) + 1);
   }
+
+  lock_();
+  st_.attempts++;
+  st_.backoffMs = backoffMs_;
+  if (ok) {
+    st_.connects++;
+    st_.lastConnectMs = took;
+    if (took > st_.maxConnectMs) st_.maxConnectMs = took;
+    st_.lastOutageMs  = millis() - downSinceMs_;
+  } else {
+    st_.failures++;
+  }
+  unlock_();
   return ok;
 }
 
-void MqttChat::loop() {
-  if (WiFi.status() != WL_CONNECTED) return;
-  (void)ensureConnected();
+// Primera vuelta sin enlace tras haberlo tenido: empieza a contar la caída
+void MqttChat::onLinkDown_(uint32_t nowMs) {
+  if (!wasUp_ && downSinceMs_) return;
+  wasUp_       = false;
+  downSinceMs_ = nowMs ? nowMs : 1;
+  linkUp_.store(false, std::memory_order_release);
+}
 
-  // Suscribirse si es necesario (incluida re-suscripción tras reconexión)
-  if (mqtt_.connected() && subActive_ && !subscribed_ && subTopic_.length()) {
-    if (mqtt_.subscribe(subTopic_.c_str())) {
-      subscribed_ = true;
+void MqttChat::syncSubscription_() {
+  lock_();
+  const uint32_t gen      = subGen_;
+  const uint32_t extraGen = extraGen_;
+  const bool     subDirty = gen != subApplied_;
+  if (!subDirty && extraGen == extraApplied_) { unlock_(); return; }
+  const String   want     = subDirty && subActive_ ? subTopic_ : String();
+  String         extra[MAX_EXTRA_SUBS];
+  uint8_t        nExtra   = 0;
+  if (extraGen != extraApplied_) {
+    nExtra = extraCount_;
+    for (uint8_t i = 0; i < nExtra; ++i) extra[i] = extraSubs_[i];
+  }
+  unlock_();
+
+  // Fijas: sólo se agregan, así que basta (re)suscribirlas todas
+  if (extraGen != extraApplied_) {
+    for (uint8_t i = 0; i < nExtra; ++i) {
+      if (!mqtt_.subscribe(extra[i].c_str())) return;   // se reintenta en la próxima vuelta
     }
+    extraApplied_ = extraGen;
   }
 
-  mqtt_.loop();
+  if (!subDirty) return;
+  if (subNow_.length() && subNow_ != want) {
+    mqtt_.unsubscribe(subNow_.c_str());
+    subNow_ = "";
+  }
+  if (want.length() && subNow_ != want) {
+    if (!mqtt_.subscribe(want.c_str())) return;
+    subNow_ = want;
+  }
+  subApplied_ = gen;
 }
 
-bool MqttChat::publish(const String& msg) {
-  if (!ensureConnected()) return false;
-  return mqtt_.publish(topic_.c_str(), msg.c_str(), false);
+void MqttChat::flushOutbox_() {
+  for (uint8_t n = 0; n < FLUSH_PER_TURN && mqtt_.connected(); ++n) {
+    Msg m;
+    lock_();
+    const bool any = out_.count > 0;
+    if (any) m = std::move(out_.front());   // el hueco sigue ocupado hasta confirmar
+    unlock_();
+    if (!any) return;
+
+    // Con largo explícito: los payloads CBOR pueden llevar bytes 0
+    const bool ok = mqtt_.publish(m.topic.c_str(), reinterpret_cast<const uint8_t*>(m.payload.c_str()),
+                                  m.payload.length(), false);
+    if (!ok && !mqtt_.connected()) {
+      // Se cayó a mitad: devolverlo al frente para la próxima conexión
+      lock_();
+      out_.front() = std::move(m);
+      unlock_();
+      return;
+    }
+    lock_();
+    out_.pop();
+    if (ok) st_.sent++;
+    else    st_.sendFailed++;
+    unlock_();
+  }
 }
 
-bool MqttChat::publishTo(const String& topic, const String& msg) {
-  if (!ensureConnected()) return false;
-  return mqtt_.publish(topic.c_str(), msg.c_str(), false);
+// Staging -> flash, haya o no enlace (el evento queda a salvo de un reinicio)
+void MqttChat::drainDurable_() {
+  if (!outbox_) return;
+  obLock_();
+  drainDurableLocked_();
+  obUnlock_();
+}
+
+void MqttChat::drainDurableLocked_() {
+  for (;;) {
+    Msg m;
+    lock_();
+    const bool any = dur_.count > 0;
+    if (any) { m = std::move(dur_.front()); dur_.pop(); }
+    unlock_();
+    if (!any) return;
+    (void)appendDurable_(m);
+  }
+}
+
+bool MqttChat::appendDurable_(const Msg& m) {
+  if (outbox_->append(m.topic, m.payload)) return true;
+  lock_();
+  st_.dropped++;   // la flash no lo aceptó
+  unlock_();
+  return false;
+}
+
+void MqttChat::received_(char* topic, uint8_t* payload, unsigned int len) {
+  // Confirmación del consumidor de eventos: "ack <seq>" en el tópico de ack
+  // (no llega a las rutas; lo que no sea un ack válido se ignora)
+  if (outbox_ && ackTopic_.length() && strcmp(topic, ackTopic_.c_str()) == 0) {
+    if (len > 4 && len < 16 && memcmp(payload, "ack ", 4) == 0) {
+      char b[16];
+      memcpy(b, payload + 4, len - 4);
+      b[len - 4] = 0;
+      char* end = nullptr;
+      const unsigned long seq = strtoul(b, &end, 10);
+      if (end != b && *end == 0) { obLock_(); outbox_->ack((uint32_t)seq, millis()); obUnlock_(); }
+    }
+    return;
+  }
+
+  xSemaphoreTake(routeMu_, portMAX_DELAY);
+  router_.dispatch(topic, payload, len);
+  xSemaphoreGive(routeMu_);
+}
+
+int MqttChat::on(const String& filter, TopicRouter::Handler h) {
+  xSemaphoreTake(routeMu_, portMAX_DELAY);
+  const int id = router_.add(filter, std::move(h));
+  xSemaphoreGive(routeMu_);
+  return id;
 }
 
+void MqttChat::off(int id) {
+  xSemaphoreTake(routeMu_, portMAX_DELAY);
+  router_.remove(id);
+  xSemaphoreGive(routeMu_);
+}
+
+// ------------------- Configuración / estado -------------------
 void MqttChat::setTopic(const String& topic) {
-  if (topic.length()) topic_ = topic;
+  if (!topic.length()) return;
+  lock_();
+  topic_ = topic;
+  unlock_();
+}
+
+String MqttChat::getTopic() const {
+  lock_();
+  String t = topic_;
+  unlock_();
+  return t;
 }
 
 void MqttChat::setSubTopic(const String& topic) {
   if (!topic.length()) return;
-  // Si ya estoy suscrito, cambiar exige desuscribir y volver a suscribir
-  if (subActive_ && mqtt_.connected() && subTopic_.length()) {
-    mqtt_.unsubscribe(subTopic_.c_str());
-  }
-  subTopic_  = topic;
-  subscribed_ = false; // forzar re-suscripción en siguiente loop()
+  lock_();
+  if (topic != subTopic_) { subTopic_ = topic; subGen_++; }   // mqttTask desuscribe el anterior
+  unlock_();
+  wake_();
+}
+
+String MqttChat::getSubTopic() const {
+  lock_();
+  String t = subTopic_;
+  unlock_();
+  return t;
 }
 
 void MqttChat::subscribe() {
-  subActive_  = true;
-  subscribed_ = false;
+  lock_();
+  subActive_ = true;
+  subGen_++;
+  unlock_();
+  wake_();
 }
 
 void MqttChat::unsubscribe() {
-  if (mqtt_.connected() && subTopic_.length()) {
-    mqtt_.unsubscribe(subTopic_.c_str());
-  }
-  subActive_  = false;
-  subscribed_ = false;
+  lock_();
+  subActive_ = false;
+  subGen_++;
+  unlock_();
+  wake_();
+}
+
+bool MqttChat::addSubscription(const String& filter) {
+  if (!TopicRouter::validFilter(filter)) return false;
+  lock_();
+  bool ok = true;
+  for (uint8_t i = 0; i < extraCount_; ++i) if (extraSubs_[i] == filter) { unlock_(); return true; }
+  if (extraCount_ < MAX_EXTRA_SUBS) { extraSubs_[extraCount_++] = filter; extraGen_++; }
+  else ok = false;
+  unlock_();
+  if (ok) wake_();
+  return ok;
+}
+
+MqttChat::Stats MqttChat::stats() const {
+  lock_();
+  Stats s = st_;
+  s.outbox = out_.count;
+  unlock_();
+  return s;
 }
 
 String MqttChat::status() {
+  const Stats st = stats();
   String s = "[chat] ";
   s += WiFi.isConnected() ? "wifi:up " : "wifi:down ";
-  s += mqtt_.connected() ? "mqtt:up " : "mqtt:down ";
+  s += connected() ? "mqtt:up " : "mqtt:down ";
+  lock_();
   s += "broker=" + host_ + ":" + String(port_) + " ";
   s += "topic=" + topic_;
   if (subTopic_.length()) s += " sub=" + subTopic_;
+  unlock_();
+  s += " | intentos=" + String(st.attempts) + " fallos=" + String(st.failures);
+  s += " conexiones=" + String(st.connects);
+  s += " connect=" + String(st.lastConnectMs) + "ms (máx " + String(st.maxConnectMs) + ")";
+  s += " caída=" + String(st.lastOutageMs) + "ms";
+  if (!connected() && st.backoffMs) s += " backoff=" + String(st.backoffMs) + "ms";
+  s += " | cola=" + String(st.outbox) + "/" + String(OUTBOX_LEN);
+  s += " enviados=" + String(st.sent) + " descartados=" + String(st.dropped);
+  if (st.sendFailed) s += " rechazados=" + String(st.sendFailed);
+  if (st.inDropped)  s += " entrada_descartados=" + String(st.inDropped);
+  if (st.durableDirect) s += " durables_directos=" + String(st.durableDirect);
+  if (outbox_) {
+    const EventOutbox::Stats ob = outbox_->stats();
+    s += " | outbox: " + String(ob.ready ? "" : "(sin flash) ");
+    s += "pendientes=" + String(ob.backlog) + " seq=" + String(ob.lastSeq);
+    s += " ack=" + String(ob.ackedSeq) + (ob.ackMode ? "" : " (sin ack)");
+    s += " flash=" + String(ob.bytes) + "B";
+  }
   return s;
 }
 
 void MqttChat::setServer(const String& host, uint16_t port) {
+  lock_();
   if (host.length()) host_ = host;
   port_ = port;
-  mqtt_.setServer(host_.c_str(), port_);
+  linkGen_++;
+  unlock_();
+  wake_();
 }
 
 void MqttChat::setAuth(const String& user, const String& pass) {
+  lock_();
   user_ = user;
   pass_ = pass;
+  linkGen_++;
+  unlock_();
+  wake_();
 }
 
 void MqttChat::onMessage(MqttChat::MessageHandler cb) {
+  lock_();
+  const bool had = (bool)handler_;
   handler_ = cb;
+  unlock_();
+  if (had == (bool)cb) return;
+
+  if (!cb) { off(copyRoute_); copyRoute_ = 0; return; }
+  // La única copia: tópico y payload de una vez a la cola de entrada
+  copyRoute_ = on("#", [this](const char* topic, const char* payload, size_t len){
+    Msg m;
+    m.topic = topic;
+    m.payload.concat(payload, (unsigned int)len);
+    lock_();
+    if (!in_.full()) in_.push(std::move(m));
+    else             st_.inDropped++;
+    unlock_();
+  });
 }
 
 // Opcional: ampliar el buffer para payloads JSON más grandes
 void MqttChat::setBufferSize(size_t n) {
-  mqtt_.setBufferSize(n);
+  lock_();
+  bufferSize_ = n;
+  linkGen_++;
+  unlock_();
+  wake_();
 }
@@ -4,37 +4,102 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
+#include <atomic>
 #include <functional>
-
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "EventOutbox.h"
+#include "TopicRouter.h"
+
+// ===================== Cliente MQTT (tarea de red propia) =====================
+// mqttTask (core 1) es la única dueña de PubSubClient/TLS: conecta, reintenta
+// con backoff exponencial con jitter, se suscribe y vacía la cola de salida.
+// Nadie más toca la red: publish()/publishTo() sólo encolan (cola acotada,
+// nunca esperan al broker) y loop() entrega en la tarea que lo llama los
+// mensajes recibidos, así el handler sigue corriendo donde corría antes.
+//
+// Entrada: cada mensaje pasa por un TopicRouter en mqttTask. Las rutas de on()
+// reciben una vista del buffer de PubSubClient (sin copia); onMessage() es la
+// ruta "#" que copia a la cola de entrada para quien lo quiera en loop().
+//
+// Los setters de configuración se pueden llamar en cualquier momento: la tarea
+// los aplica en su siguiente vuelta (reconexión o re-suscripción).
+//
+// Con un EventOutbox adjunto, publishDurable() pasa por flash (mqttTask lo
+// anexa aunque no haya enlace; si su cola de DURABLE_LEN está llena porque la
+// tarea está ocupada, p. ej. en un connect TLS, lo anexa el propio productor:
+// un evento durable nunca se descarta) y lo confirman los "ack <seq>" que lleguen a
+// "<prefijo>/<clientId>/ack" (sólo ese tópico: un ack en el chat compartido no
+// vale). El tópico de ack se atiende antes que cualquier ruta de on().
 class MqttChat {
 public:
   using MessageHandler = std::function<void(const String&, const String&)>;
 
+  static constexpr uint8_t  OUTBOX_LEN     = 16;     // publicaciones en espera
+  static constexpr uint8_t  INBOX_LEN      = 8;      // recibidos sin entregar
+  static constexpr uint8_t  DURABLE_LEN    = 8;      // eventos aún no anexados a flash
+  static constexpr uint8_t  MAX_EXTRA_SUBS = 4;      // suscripciones fijas (addSubscription)
+  static constexpr uint32_t BACKOFF_MIN_MS = 1000;
+  static constexpr uint32_t BACKOFF_MAX_MS = 60000;
+
   MqttChat(const char* host,
            uint16_t port,
            const char* user,
            const char* pass,
            const char* topic_default);
 
-  void begin();                 // Llamar en setup()
-  void loop();                  // Mantener MQTT (llamar en loop si hay WiFi)
+  void begin();                 // Llamar en setup(): arranca mqttTask
+  void loop();                  // Entrega los mensajes recibidos (no toca la red)
 
+  // Encolan (false = cola llena, se cuenta el descarte)
   bool publish(const String& msg);                         // publica a topic_ actual
   bool publishTo(const String& topic, const String& msg);  // publica a topic arbitrario
 
+  // Eventos que no se pueden perder (sin outbox adjunto = publishTo). Con la
+  // cola llena bloquea lo que tarde en escribir en flash; false = falló la flash
+  // Antes de begin(); prefix sin '/' final (mismo que CommandChannel)
+  void attachOutbox(EventOutbox* ob, const char* prefix = "riego") { outbox_ = ob; ackPrefix_ = prefix; }
+  bool publishDurable(const String& topic, const String& msg);
+  const EventOutbox* outbox() const { return outbox_; }
+  const String& ackTopic() const { return ackTopic_; }      // "" sin outbox
+
   // Tópicos
   void   setTopic(const String& topic);
-  String getTopic() const { return topic_; }
+  String getTopic() const;
 
   void   setSubTopic(const String& topic);
-  String getSubTopic() const { return subTopic_; }
+  String getSubTopic() const;
   void   subscribe();
   void   unsubscribe();
-
-  // Conexión
-  bool connected() { return mqtt_.connected(); }
-  void setRootCA(const char* ca_pem);      // opcional, para validar TLS
-  bool ensureConnected();
+  // Suscripción permanente aparte de la de chat (p. ej. el canal de comandos);
+  // se renueva en cada reconexión. false si no hay hueco o el filtro no vale.
+  bool   addSubscription(const String& filter);
+
+  // Id MQTT del equipo (válido tras begin())
+  const String& clientId() const { return clientId_; }
+
+  // Conexión (estado publicado por mqttTask)
+  bool connected() const { return linkUp_.load(std::memory_order_acquire); }
+  void setRootCA(const char* ca_pem);      // opcional, para validar TLS (antes de begin)
+
+  // Métricas de conexión y de la cola de salida
+  struct Stats {
+    uint32_t attempts       = 0;   // connect() intentados
+    uint32_t failures       = 0;
+    uint32_t connects       = 0;   // conexiones logradas
+    uint32_t lastConnectMs  = 0;   // duración del último connect() exitoso (TLS + CONNECT)
+    uint32_t maxConnectMs   = 0;
+    uint32_t lastOutageMs   = 0;   // caída -> reconectado (incluye el backoff)
+    uint32_t backoffMs      = 0;   // espera actual antes del próximo intento
+    uint32_t sent           = 0;
+    uint32_t sendFailed     = 0;   // rechazados por PubSubClient (p. ej. > buffer)
+    uint32_t dropped        = 0;   // cola de salida llena
+    uint32_t inDropped      = 0;   // cola de entrada llena
+    uint32_t durableDirect  = 0;   // eventos anexados por el productor (cola durable llena)
+    uint8_t  outbox         = 0;   // en espera ahora
+  };
+  Stats stats() const;
 
   // Estado
   String status();
@@ -43,30 +108,98 @@ public:
   void setServer(const String& host, uint16_t port);
   void setAuth(const String& user, const String& pass);
 
-  // Handler de mensajes entrantes
+  // Ruta por filtro (comodines MQTT). Corre en mqttTask: no bloquear, y copiar
+  // sólo lo que haya que guardar. Devuelve el id (0 = filtro inválido).
+  int  on(const String& filter, TopicRouter::Handler h);
+  void off(int id);
+
+  // Handler de mensajes entrantes con copia (se llama desde loop()); nullptr lo quita
   void onMessage(MessageHandler cb);
 
   // Opcional: ampliar buffer de PubSubClient (para JSON grandes)
   void setBufferSize(size_t n);
 
 private:
-  String makeClientId() const;
+  struct Msg { String topic; String payload; };
+
+  // Anillo acotado protegido por mu_ (sólo se mueven Strings dentro del lock)
+  template <uint8_t N>
+  struct Ring {
+    Msg     m[N];
+    uint8_t head = 0, count = 0;
+    bool full() const { return count == N; }
+    void push(Msg&& x) { m[(head + count) % N] = std::move(x); count++; }
+    Msg& front()       { return m[head]; }
+    void pop()         { m[head] = Msg{}; head = (head + 1) % N; count--; }
+  };
 
+  String makeClientId() const;
+  void   lock_()   const { xSemaphoreTake(mu_, portMAX_DELAY); }
+  void   unlock_() const { xSemaphoreGive(mu_); }
+  void   wake_()   { if (task_) xTaskNotifyGive(task_); }
+  bool   enqueue_(Msg&& m);
+  void   obLock_()   { xSemaphoreTake(obMu_, portMAX_DELAY); }
+  void   obUnlock_() { xSemaphoreGive(obMu_); }
+  // Bajo obMu_: la cola durable a flash, en orden, y un evento a flash
+  void   drainDurableLocked_();
+  bool   appendDurable_(const Msg& m);
+
+  // ---- Sólo mqttTask ----
+  static void taskEntry_(void* self);
+  void   run_();
+  void   applyLink_();
+  bool   connect_();
+  void   syncSubscription_();
+  void   flushOutbox_();
+  void   drainDurable_();
+  void   onLinkDown_(uint32_t nowMs);
+  void   received_(char* topic, uint8_t* payload, unsigned int len);
+
+  // ---- Configuración compartida (bajo mu_) ----
   String      host_;
   uint16_t    port_;
   String      user_;
   String      pass_;
   String      topic_;
-
-  // Suscripción
-  String          subTopic_;
-  bool            subActive_   = false;  // ¿debo estar suscrito?
-  bool            subscribed_  = false;  // ¿ya hice subscribe() con éxito?
+  String      subTopic_;
+  bool        subActive_   = false;  // ¿debo estar suscrito?
+  uint32_t    linkGen_     = 0;      // sube con setServer/setAuth/setBufferSize
+  uint32_t    subGen_      = 0;      // sube con setSubTopic/subscribe/unsubscribe
+  String      extraSubs_[MAX_EXTRA_SUBS];
+  uint8_t     extraCount_  = 0;
+  uint32_t    extraGen_    = 0;      // sube con addSubscription
+  size_t      bufferSize_  = 0;      // 0 = el de PubSubClient
   MessageHandler  handler_;
 
   const char*     root_ca_pem_ = nullptr;
 
+  mutable SemaphoreHandle_t mu_ = nullptr;
+  SemaphoreHandle_t         routeMu_ = nullptr;   // router_: on/off vs. dispatch
+  SemaphoreHandle_t         obMu_ = nullptr;      // outbox_: mqttTask vs. productor con dur_ lleno
+  TopicRouter               router_;
+  int                       copyRoute_ = 0;       // ruta de onMessage()
+  TaskHandle_t              task_ = nullptr;
+  Ring<OUTBOX_LEN>          out_;
+  Ring<INBOX_LEN>           in_;
+  Ring<DURABLE_LEN>         dur_;
+  EventOutbox*              outbox_ = nullptr;   // bajo obMu_
+  const char*               ackPrefix_ = "riego";
+  String                    ackTopic_;           // fijo tras begin()
+  Stats                     st_;          // bajo mu_ (lo escriben todos, lo lee stats())
+  std::atomic<bool>         linkUp_{false};
+
+  // ---- Estado propio de mqttTask ----
   WiFiClientSecure tls_;
   PubSubClient     mqtt_;
   String           clientId_;
+  String           curHost_, curUser_, curPass_;   // PubSubClient guarda el puntero del host
+  uint16_t         curPort_      = 0;
+  uint32_t         linkApplied_  = UINT32_MAX;
+  uint32_t         subApplied_   = UINT32_MAX;
+  String           subNow_;                    // tópico suscrito ahora ("" = ninguno)
+  uint32_t         extraApplied_ = UINT32_MAX;
+  uint32_t         nextTryMs_    = 0;
+  uint32_t         backoffMs_    = 0;
+  uint32_t         downSinceMs_  = 0;
+  bool             wasUp_        = false;
 };
@@ -0,0 +1,159 @@
+#include "TopicRouter.h"
+#include <string.h>
+
+bool TopicRouter::validFilter(const String& f) {
+  if (!f.length()) return false;
+  const char* s = f.c_str();
+  for (const char* lvl = s; ; ) {
+    const char* end = strchr(lvl, '/');
+    const size_t n = end ? (size_t)(end - lvl) : strlen(lvl);
+    for (size_t i = 0; i < n; ++i) {
+      if ((lvl[i] == '+' || lvl[i] == '#') && n != 1) return false;   // comodín con más texto
+    }
+    if (n == 1 && lvl[0] == '#' && end) return false;                  // '#' no al final
+    if (!end) return true;
+    lvl = end + 1;
+  }
+}
+
+// Reusa un nodo podado antes de crecer el vector (los índices no se mueven)
+int16_t TopicRouter::newNode_(int16_t parent) {
+  int16_t idx = freeNode_;
+  if (idx != NONE) {
+    freeNode_   = nodes_[idx].next;
+    nodes_[idx] = Node{};
+  } else {
+    nodes_.push_back(Node{});
+    idx = (int16_t)(nodes_.size() - 1);
+  }
+  nodes_[idx].parent = parent;
+  return idx;
+}
+
+int16_t TopicRouter::childFor_(int16_t node, const char* lvl, size_t n, bool create) {
+  for (int16_t c = nodes_[node].child; c != NONE; c = nodes_[c].next) {
+    const String& l = nodes_[c].level;
+    if (l.length() == n && memcmp(l.c_str(), lvl, n) == 0) return c;
+  }
+  if (!create) return NONE;
+  const int16_t idx = newNode_(node);
+  Node& nd = nodes_[idx];
+  nd.level.concat(lvl, n);
+  nd.next = nodes_[node].child;
+  nodes_[node].child = idx;
+  return idx;
+}
+
+// Sube desde node soltando los nodos sin rutas ni hijos (la raíz queda)
+void TopicRouter::prune_(int16_t node) {
+  while (node > 0) {
+    Node& nd = nodes_[node];
+    if (nd.exact != NONE || nd.hash != NONE || nd.child != NONE || nd.plus != NONE) return;
+    const int16_t parent = nd.parent;
+    Node& pa = nodes_[parent];
+    if (pa.plus == node) {
+      pa.plus = NONE;
+    } else {
+      for (int16_t* p = &pa.child; *p != NONE; p = &nodes_[*p].next) {
+        if (*p == node) { *p = nd.next; break; }
+      }
+    }
+    nd        = Node{};      // libera el String del nivel
+    nd.next   = freeNode_;
+    freeNode_ = node;
+    node      = parent;
+  }
+}
+
+size_t TopicRouter::nodeCount() const {
+  size_t n = nodes_.size();
+  for (int16_t f = freeNode_; f != NONE; f = nodes_[f].next) n--;
+  return n;
+}
+
+int TopicRouter::add(const String& filter, Handler h) {
+  if (!h || !validFilter(filter)) return 0;
+
+  int16_t node = 0;
+  bool    hash = false;
+  for (const char* lvl = filter.c_str(); ; ) {
+    const char* end = strchr(lvl, '/');
+    const size_t n = end ? (size_t)(end - lvl) : strlen(lvl);
+    if (n == 1 && lvl[0] == '#') { hash = true; break; }
+    if (n == 1 && lvl[0] == '+') {
+      if (nodes_[node].plus == NONE) {
+        const int16_t idx = newNode_(node);
+        nodes_[node].plus = idx;
+      }
+      node = nodes_[node].plus;
+    } else {
+      node = childFor_(node, lvl, n, true);
+    }
+    if (!end) break;
+    lvl = end + 1;
+  }
+
+  // Hueco libre o ruta nueva
+  int16_t r = NONE;
+  for (size_t i = 0; i < routes_.size(); ++i) if (routes_[i].id == 0) { r = (int16_t)i; break; }
+  if (r == NONE) { routes_.push_back(Route{}); r = (int16_t)(routes_.size() - 1); }
+
+  int16_t& head = hash ? nodes_[node].hash : nodes_[node].exact;
+  routes_[r].id   = nextId_++;
+  routes_[r].h    = std::move(h);
+  routes_[r].next = head;
+  head = r;
+  return routes_[r].id;
+}
+
+bool TopicRouter::remove(int id) {
+  if (id <= 0) return false;
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    Node& nd = nodes_[i];
+    for (int16_t* link : { &nd.exact, &nd.hash }) {
+      for (int16_t* p = link; *p != NONE; p = &routes_[*p].next) {
+        Route& r = routes_[*p];
+        if (r.id != id) continue;
+        *p     = r.next;
+        r      = Route{};     // libera el std::function
+        prune_((int16_t)i);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void TopicRouter::fire_(int16_t head, const char* topic, const char* payload, size_t len, size_t& calls) const {
+  for (int16_t r = head; r != NONE; r = routes_[r].next) {
+    routes_[r].h(topic, payload, len);
+    calls++;
+  }
+}
+
+// lvl = comienzo del nivel actual dentro de topic (nullptr = tópico agotado)
+void TopicRouter::walk_(int16_t node, const char* lvl, bool root, const char* topic,
+                        const char* payload, size_t len, size_t& calls) const {
+  const Node& nd = nodes_[node];
+  const bool  wildOk = !(root && topic[0] == '$');
+
+  if (nd.hash != NONE && wildOk) fire_(nd.hash, topic, payload, len, calls);
+  if (!lvl) { fire_(nd.exact, topic, payload, len, calls); return; }
+
+  const char*  end  = strchr(lvl, '/');
+  const size_t n    = end ? (size_t)(end - lvl) : strlen(lvl);
+  const char*  next = end ? end + 1 : nullptr;
+
+  for (int16_t c = nd.child; c != NONE; c = nodes_[c].next) {
+    const String& l = nodes_[c].level;
+    if (l.length() == n && memcmp(l.c_str(), lvl, n) == 0) { walk_(c, next, false, topic, payload, len, calls); break; }
+  }
+  if (nd.plus != NONE && wildOk) walk_(nd.plus, next, false, topic, payload, len, calls);
+}
+
+size_t TopicRouter::dispatch(const char* topic, const uint8_t* payload, size_t len) const {
+  size_t calls = 0;
+  if (!topic) return 0;
+  walk_(0, topic, true, topic, reinterpret_cast<const char*>(payload), len, calls);
+  return calls;
+}
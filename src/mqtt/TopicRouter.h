@@ -0,0 +1,62 @@
+// File: src/mqtt/TopicRouter.h
+#pragma once
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+// ===================== Ruteo de mensajes MQTT por filtro =====================
+// Los filtros ("riego/+/cmd", "public/#", ...) se compilan al registrarlos en
+// un trie por niveles: cada nodo es un nivel literal, con un hijo '+' aparte y
+// sus rutas exactas y '#'. dispatch() recorre el tópico una sola vez, sin
+// asignar memoria, y entrega a cada handler una vista (puntero + largo) del
+// buffer de PubSubClient: sólo copia el handler que necesita guardar el dato.
+// La vista deja de valer al volver del handler.
+//
+// Reglas MQTT: '#' sólo como último nivel (y "a/#" también cubre "a"); '+'
+// ocupa un nivel entero; los tópicos "$..." no entran por comodines en la raíz.
+//
+// No es reentrante: registrar/borrar rutas se sincroniza por fuera (MqttChat).
+class TopicRouter {
+public:
+  using Handler = std::function<void(const char* topic, const char* payload, size_t len)>;
+
+  // Devuelve el id de la ruta (> 0) o 0 si el filtro no es válido
+  int  add(const String& filter, Handler h);
+  bool remove(int id);
+  // Número de handlers llamados
+  size_t dispatch(const char* topic, const uint8_t* payload, size_t len) const;
+
+  static bool validFilter(const String& filter);
+  // Nodos del trie en uso (remove() poda los que quedan vacíos)
+  size_t nodeCount() const;
+
+private:
+  static constexpr int16_t NONE = -1;
+
+  struct Node {
+    String  level;              // vacío en la raíz y en los nodos '+'
+    int16_t parent = NONE;
+    int16_t child  = NONE;      // primer hijo literal
+    int16_t next   = NONE;      // siguiente hermano literal (o libre siguiente)
+    int16_t plus   = NONE;      // hijo '+'
+    int16_t exact  = NONE;      // rutas que terminan aquí
+    int16_t hash   = NONE;      // rutas "<aquí>/#"
+  };
+  struct Route {
+    int     id   = 0;           // 0 = hueco libre
+    Handler h;
+    int16_t next = NONE;
+  };
+
+  int16_t newNode_(int16_t parent);
+  void    prune_(int16_t node);
+  int16_t childFor_(int16_t node, const char* lvl, size_t n, bool create);
+  void    walk_(int16_t node, const char* lvl, bool root, const char* topic,
+                const char* payload, size_t len, size_t& calls) const;
+  void    fire_(int16_t head, const char* topic, const char* payload, size_t len, size_t& calls) const;
+
+  std::vector<Node>  nodes_{ Node{} };   // [0] = raíz
+  std::vector<Route> routes_;
+  int16_t            freeNode_ = NONE;   // nodos podados, encadenados por next
+  int                nextId_ = 1;
+};
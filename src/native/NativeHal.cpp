@@ -0,0 +1,243 @@
+#include "NativeHal.h"
+#include <Preferences.h>
+#include <atomic>
+#include <soc/gpio_reg.h>
+
+namespace {
+
+uint32_t gNowMs = 0;
+time_t   gEpoch = 0;
+
+constexpr int NUM_PINS = 64;
+uint8_t  gLevel[NUM_PINS] = {};
+uint32_t gEdges[NUM_PINS] = {};
+uint32_t gWrites = 0;
+
+// PCNT por software: mismo contrato que EspPcntHal (auto-reinicio en wrapLimit,
+// umbral THRES_0). Por defecto la "ISR" corre en el acto; con setDeferred(true)
+// el desborde queda pendiente (cuenta ya en 0, flag levantado) hasta isrEnter/
+// isrExit, que reproducen la ISR real: callbacks -> reconocer, con isrSeq()
+// impar en medio.
+class HostPcntHal : public PcntHal {
+public:
+  static constexpr uint8_t MAX_UNITS = 8;
+
+  bool configure(uint8_t unit, int pin, uint16_t, int16_t wrapLimit) override {
+    if (unit >= MAX_UNITS || wrapLimit <= 0) return false;
+    u_[unit] = Unit{};
+    u_[unit].pin  = pin;
+    u_[unit].wrap = wrapLimit;
+    return true;
+  }
+  bool attach(WrapFn onWrap, WrapFn onThreshold, void* arg) override {
+    onWrap_ = onWrap; onThres_ = onThreshold; arg_ = arg;
+    return true;
+  }
+  void setThreshold(uint8_t unit, int16_t value) override {
+    if (unit < MAX_UNITS) u_[unit].thres = value > 0 ? value : 0;
+  }
+  int16_t  count(uint8_t unit) const override { return unit < MAX_UNITS ? u_[unit].count.load() : 0; }
+  bool     wrapPending(uint8_t unit) const override { return unit < MAX_UNITS && u_[unit].pending.load(); }
+  uint32_t isrSeq() const override { return isrSeq_.load(std::memory_order_acquire); }
+
+  void inject(uint8_t unit, uint32_t n) {
+    if (unit >= MAX_UNITS || u_[unit].wrap <= 0) return;
+    Unit& u = u_[unit];
+    while (n > 0) {
+      const int16_t  old  = u.count.load();
+      const uint32_t room = (uint32_t)(u.wrap - old);
+      const uint32_t step = n < room ? n : room;
+      u.count.store((int16_t)(old + step));
+      n -= step;
+      if (u.thres > 0 && old < u.thres && u.count.load() >= u.thres && onThres_) onThres_(arg_, unit);
+      if (u.count.load() >= u.wrap) {
+        // El hardware tiene un solo flag por unidad: un segundo desborde sin
+        // atender se perdería. El host atiende el anterior para seguir exacto.
+        if (u.pending.load()) isr(unit);
+        u.count.store(0);
+        u.pending.store(true);
+        if (!deferred_) isr(unit);
+      }
+    }
+  }
+
+  void setDeferred(bool on) { deferred_ = on; }
+  void isrEnter(uint8_t unit) {
+    if (unit >= MAX_UNITS) return;
+    const uint32_t s = isrSeq_.load(std::memory_order_relaxed);
+    isrSeq_.store(s + 1, std::memory_order_relaxed);        // impar: ISR en curso
+    std::atomic_thread_fence(std::memory_order_release);
+    if (u_[unit].pending.load() && onWrap_) onWrap_(arg_, unit);
+  }
+  void isrExit(uint8_t unit) {
+    if (unit >= MAX_UNITS) return;
+    u_[unit].pending.store(false);                          // int_clr
+    isrSeq_.store(isrSeq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  void isr(uint8_t unit) { isrEnter(unit); isrExit(unit); }
+
+  void reset() {
+    for (Unit& u : u_) { u.count.store(0); u.pending.store(false); }
+    deferred_ = false;
+  }
+
+private:
+  struct Unit {
+    int pin = -1; int16_t wrap = 0; int16_t thres = 0;
+    std::atomic<int16_t> count{0};     // el check lee desde otro hilo en medio de la ISR
+    std::atomic<bool>    pending{false};
+    Unit() {}
+    Unit& operator=(const Unit& o) {
+      pin = o.pin; wrap = o.wrap; thres = o.thres;
+      count.store(o.count.load()); pending.store(o.pending.load());
+      return *this;
+    }
+  };
+  Unit                  u_[MAX_UNITS];
+  WrapFn                onWrap_  = nullptr;
+  WrapFn                onThres_ = nullptr;
+  void*                 arg_     = nullptr;
+  bool                  deferred_ = false;
+  std::atomic<uint32_t> isrSeq_{0};
+};
+
+HostPcntHal gPcnt;
+
+// ADC continuo por software: las conversiones vencidas desde la última lectura
+// se entregan alternando canales como el patrón del DMA; si nadie lee en más
+// de RING_MS se pierden (desborde, como el ring del driver).
+uint16_t gAnalogMv[NUM_PINS] = {};
+
+class HostAdcHal : public AdcHal {
+public:
+  static constexpr uint32_t FULL_MV      = 3100;      // 11 dB
+  static constexpr uint32_t RING_SAMPLES = 4 * 128;   // como EspAdcHal: 4 bloques DMA
+
+  bool start(const int* pins, uint8_t n, uint32_t sampleHz) override {
+    n_ = 0;
+    for (uint8_t i = 0; i < n && i < MAX_CH; ++i) {
+      if (pins[i] < 0 || pins[i] >= NUM_PINS) continue;
+      pin_[n_] = pins[i]; ch_[n_] = i; n_++;
+    }
+    if (n_ == 0 || sampleHz == 0) return false;
+    hz_ = sampleHz; lastMs_ = gNowMs; frac_ = 0; pending_ = 0; pat_ = 0;
+    return true;
+  }
+  void stop() override { n_ = 0; }
+
+  size_t read(Sample* out, size_t max, uint32_t) override {
+    if (n_ == 0) return 0;
+    const uint64_t acc = (uint64_t)(gNowMs - lastMs_) * hz_ + frac_;
+    lastMs_   = gNowMs;
+    frac_     = acc % 1000;
+    pending_ += acc / 1000;
+    if (pending_ > RING_SAMPLES) { pending_ = RING_SAMPLES; overruns_++; }
+
+    // El nivel no cambia dentro de una lectura: un raw por canal
+    uint16_t raw[MAX_CH];
+    for (uint8_t i = 0; i < n_; ++i) {
+      const uint32_t mv = gAnalogMv[pin_[i]];
+      raw[i] = (uint16_t)((mv >= FULL_MV ? FULL_MV : mv) * 4095UL / FULL_MV);
+    }
+    const size_t k = (size_t)(pending_ < max ? pending_ : max);
+    for (size_t j = 0; j < k; ++j) {
+      out[j].ch  = ch_[pat_];
+      out[j].raw = raw[pat_];
+      if (++pat_ == n_) pat_ = 0;
+    }
+    pending_ -= k;
+    return k;
+  }
+  uint32_t rawToMv(uint16_t raw) const override { return (uint32_t)raw * FULL_MV / 4095UL; }
+  uint32_t overruns() const override { return overruns_; }
+
+  void reset() { n_ = 0; overruns_ = 0; }
+
+private:
+  int      pin_[MAX_CH] = { -1, -1 };
+  uint8_t  ch_[MAX_CH]  = { 0, 0 };
+  uint8_t  n_ = 0, pat_ = 0;
+  uint32_t hz_ = 0, lastMs_ = 0, overruns_ = 0;
+  uint64_t frac_ = 0, pending_ = 0;
+};
+
+HostAdcHal gAdc;
+
+} // namespace
+
+// ---------- Arduino (native/hal/Arduino.h) ----------
+uint32_t millis() { return gNowMs; }
+uint32_t micros() { return gNowMs * 1000UL; }
+void     delay(uint32_t ms) { gNowMs += ms; }
+
+void pinMode(int, int) {}
+void digitalWrite(int pin, int lvl) {
+  gWrites++;
+  if (pin < 0 || pin >= NUM_PINS) return;
+  const uint8_t v = lvl ? 1 : 0;
+  if (gLevel[pin] != v) { gLevel[pin] = v; gEdges[pin]++; }
+}
+int digitalRead(int pin) { return (pin >= 0 && pin < NUM_PINS) ? gLevel[pin] : LOW; }
+
+// W1TS/W1TC (native/hal/soc/gpio_reg.h): una escritura para todo el banco
+void hostGpioRegWrite(uint32_t reg, uint32_t bits) {
+  gWrites++;
+  const int     base = (reg >> 1) ? 32 : 0;
+  const uint8_t v    = (reg & 1) ? 0 : 1;
+  while (bits) {
+    const int pin = base + __builtin_ctz(bits);
+    bits &= bits - 1;
+    if (pin < NUM_PINS && gLevel[pin] != v) { gLevel[pin] = v; gEdges[pin]++; }
+  }
+}
+
+// time() del núcleo -> reloj virtual (platformio.ini: -Wl,--wrap=time)
+extern "C" time_t __wrap_time(time_t* out) {
+  const time_t t = sim::nowEpoch();
+  if (out) *out = t;
+  return t;
+}
+
+// ---------- PCNT y ADC por defecto de la plataforma ----------
+PcntHal& defaultPcntHal() { return gPcnt; }
+AdcHal&  defaultAdcHal()  { return gAdc; }
+
+// ---------- Simulador ----------
+namespace sim {
+
+std::map<std::string, NvsNamespace>& nvs() {
+  static std::map<std::string, NvsNamespace> store;
+  return store;
+}
+
+void     setEpoch(time_t epochAtZero) { gEpoch = epochAtZero; }
+void     advanceMs(uint32_t ms)       { gNowMs += ms; }
+uint32_t nowMs()                      { return gNowMs; }
+time_t   nowEpoch()                   { return gEpoch + (time_t)(gNowMs / 1000UL); }
+
+int      level(int pin)  { return (pin >= 0 && pin < NUM_PINS) ? gLevel[pin] : LOW; }
+uint32_t writes()        { return gWrites; }
+uint32_t edges(int pin)  { return (pin >= 0 && pin < NUM_PINS) ? gEdges[pin] : 0; }
+void     setInput(int pin, int lvl) { if (pin >= 0 && pin < NUM_PINS) gLevel[pin] = lvl ? 1 : 0; }
+
+void     pulses(uint8_t unit, uint32_t n) { gPcnt.inject(unit, n); }
+void     pcntDeferIsr(bool on)            { gPcnt.setDeferred(on); }
+void     pcntIsrEnter(uint8_t unit)       { gPcnt.isrEnter(unit); }
+void     pcntIsrExit(uint8_t unit)        { gPcnt.isrExit(unit); }
+
+void     analogMv(int pin, uint16_t mv) { if (pin >= 0 && pin < NUM_PINS) gAnalogMv[pin] = mv; }
+
+void     nvsClear() { nvs().clear(); }
+
+void resetAll() {
+  gNowMs  = 0;
+  gWrites = 0;
+  memset(gLevel, 0, sizeof(gLevel));
+  memset(gEdges, 0, sizeof(gEdges));
+  gPcnt.reset();
+  gAdc.reset();
+  memset(gAnalogMv, 0, sizeof(gAnalogMv));
+  nvsClear();
+}
+
+} // namespace sim
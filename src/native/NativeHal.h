@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include <time.h>
+#include "../flow/PcntHal.h"
+#include "../sensors/AdcHal.h"
+
+// ===================== HAL del host para el simulador (env:native) =====================
+// Reloj virtual: millis()/micros()/delay() y time() (enlazado con -Wl,--wrap=time)
+// avanzan sólo con sim::advanceMs(), así una semana de riego corre en
+// milisegundos de CPU. GPIO: digitalWrite y los registros W1TS/W1TC de
+// RelayBank (native/hal/soc/gpio_reg.h) quedan capturados por pin (nivel y
+// flancos) y digitalRead devuelve lo que fije sim::setInput(). Caudal:
+// defaultPcntHal() es un PCNT por software al que se le inyectan pulsos con
+// desbordes y umbrales iguales al hardware. ADC: defaultAdcHal() entrega, a la
+// tasa pedida y según el reloj virtual, el nivel fijado con sim::analogMv().
+namespace sim {
+
+// ---- Reloj virtual ----
+void     setEpoch(time_t epochAtZero);   // hora de pared cuando millis() == 0
+void     advanceMs(uint32_t ms);
+uint32_t nowMs();
+time_t   nowEpoch();
+
+// ---- GPIO ----
+int      level(int pin);                 // último nivel escrito (o fijado como entrada)
+uint32_t writes();                       // digitalWrite + REG_WRITE totales
+uint32_t edges(int pin);                 // cambios de nivel del pin
+void     setInput(int pin, int level);   // botones, selector, etc.
+
+// ---- Caudal (unidad PCNT == canal de FlowMeterService) ----
+void     pulses(uint8_t unit, uint32_t n);
+// ISR de desborde diferida: con on=true el desborde deja la cuenta en 0 y
+// wrapPending() en true hasta que el test corre la ISR (Enter: callbacks,
+// Exit: reconocer). resetAll() vuelve al modo inmediato.
+void     pcntDeferIsr(bool on);
+void     pcntIsrEnter(uint8_t unit);
+void     pcntIsrExit(uint8_t unit);
+
+// ---- ADC (pines analógicos) ----
+void     analogMv(int pin, uint16_t mv);
+
+// ---- NVS en memoria ----
+void     nvsClear();
+
+// Estado a cero (reloj, GPIO, PCNT, ADC, NVS) entre escenarios
+void     resetAll();
+
+} // namespace sim
@@ -0,0 +1,114 @@
+#pragma once
+// ===================== Arduino mínimo para el host (env:native) =====================
+// Sólo lo que usan los módulos del núcleo de riego que compila el simulador
+// (modes/, hw/, flow/, schedule/). millis()/delay() van contra el reloj virtual
+// y digitalWrite/digitalRead contra la captura de GPIO de native/NativeHal.h.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define F(x) (x)
+
+#define LOW            0
+#define HIGH           1
+#define INPUT          0x01
+#define OUTPUT         0x03
+#define INPUT_PULLUP   0x05
+#define INPUT_PULLDOWN 0x09
+#define RISING         0x01
+#define FALLING        0x02
+#define CHANGE         0x03
+
+uint32_t millis();
+uint32_t micros();
+void     delay(uint32_t ms);
+inline void yield() {}
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int level);
+int  digitalRead(int pin);
+
+// ---------- String (subconjunto de WString sobre std::string) ----------
+class String {
+public:
+  String() {}
+  String(const char* c)        { if (c) s_ = c; }
+  String(const std::string& s) : s_(s) {}
+  explicit String(char c)      : s_(1, c) {}
+  String(int v)                : s_(std::to_string(v)) {}
+  String(unsigned v)           : s_(std::to_string(v)) {}
+  String(long v)               : s_(std::to_string(v)) {}
+  String(unsigned long v)      : s_(std::to_string(v)) {}
+  String(long long v)          : s_(std::to_string(v)) {}
+  String(unsigned long long v) : s_(std::to_string(v)) {}
+  String(float v,  unsigned decimals = 2) { fmt_((double)v, decimals); }
+  String(double v, unsigned decimals = 2) { fmt_(v, decimals); }
+
+  unsigned    length() const { return (unsigned)s_.size(); }
+  bool        isEmpty() const { return s_.empty(); }
+  const char* c_str() const  { return s_.c_str(); }
+  void        reserve(unsigned n) { s_.reserve(n); }
+
+  String& operator+=(const String& o) { s_ += o.s_; return *this; }
+  String& operator+=(const char* o)   { if (o) s_ += o; return *this; }
+  String& operator+=(char c)          { s_ += c; return *this; }
+  String& operator+=(int v)           { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned v)      { s_ += std::to_string(v); return *this; }
+  String& operator+=(long v)          { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned long v) { s_ += std::to_string(v); return *this; }
+  bool    concat(const String& o)     { s_ += o.s_; return true; }
+  bool    concat(char c)              { s_ += c; return true; }
+  bool    concat(const char* c, unsigned n) { if (c) s_.append(c, n); return true; }
+
+  bool operator==(const String& o) const { return s_ == o.s_; }
+  bool operator==(const char* o)   const { return o && s_ == o; }
+  bool operator!=(const String& o) const { return s_ != o.s_; }
+  bool operator!=(const char* o)   const { return !(*this == o); }
+  bool operator<(const String& o)  const { return s_ < o.s_; }
+
+  char  operator[](unsigned i) const { return i < s_.size() ? s_[i] : '\0'; }
+  char& operator[](unsigned i)       { return s_[i]; }
+
+  long  toInt()   const { return atol(s_.c_str()); }
+  float toFloat() const { return (float)atof(s_.c_str()); }
+
+  int indexOf(char c, unsigned from = 0) const {
+    const size_t p = s_.find(c, from); return p == std::string::npos ? -1 : (int)p;
+  }
+  int indexOf(const String& t, unsigned from = 0) const {
+    const size_t p = s_.find(t.s_, from); return p == std::string::npos ? -1 : (int)p;
+  }
+  String substring(unsigned a) const { return a < s_.size() ? String(s_.substr(a)) : String(); }
+  String substring(unsigned a, unsigned b) const {
+    if (b > s_.size()) b = (unsigned)s_.size();
+    return a < b ? String(s_.substr(a, b - a)) : String();
+  }
+  bool startsWith(const String& p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String& p) const {
+    return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+  }
+  void trim() {
+    const size_t a = s_.find_first_not_of(" \t\r\n");
+    const size_t b = s_.find_last_not_of(" \t\r\n");
+    s_ = (a == std::string::npos) ? std::string() : s_.substr(a, b - a + 1);
+  }
+
+private:
+  void fmt_(double v, unsigned d) { char b[40]; snprintf(b, sizeof(b), "%.*f", (int)d, v); s_ = b; }
+  std::string s_;
+};
+
+inline String operator+(String a, const String& b) { a += b; return a; }
+inline String operator+(String a, const char* b)   { a += b; return a; }
+inline String operator+(String a, char c)          { a += c; return a; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
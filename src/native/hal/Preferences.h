@@ -0,0 +1,78 @@
+#pragma once
+// ===================== Preferences en memoria (env:native) =====================
+// Misma semántica que la NVS del ESP32 para lo que usa el núcleo: namespaces,
+// begin(ro) falla si el namespace no existe, claves tipadas como bytes crudos.
+// El almacén es global (native/NativeHal.h: sim::nvsClear() entre escenarios).
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+namespace sim {
+using NvsNamespace = std::map<std::string, std::vector<uint8_t>>;
+std::map<std::string, NvsNamespace>& nvs();
+}
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false) {
+    auto& all = sim::nvs();
+    if (readOnly && all.find(name) == all.end()) return false;
+    ns_ = &all[name];
+    ro_ = readOnly;
+    return true;
+  }
+  void end() { ns_ = nullptr; }
+
+  bool clear()                { if (!ns_ || ro_) return false; ns_->clear(); return true; }
+  bool remove(const char* k)  { return ns_ && !ro_ && ns_->erase(k) > 0; }
+  bool isKey(const char* k)   { return ns_ && ns_->count(k) > 0; }
+
+  size_t putUChar (const char* k, uint8_t v)        { return put_(k, &v, sizeof(v)); }
+  size_t putUShort(const char* k, uint16_t v)       { return put_(k, &v, sizeof(v)); }
+  size_t putInt   (const char* k, int32_t v)        { return put_(k, &v, sizeof(v)); }
+  size_t putUInt  (const char* k, uint32_t v)       { return put_(k, &v, sizeof(v)); }
+  size_t putFloat (const char* k, float v)          { return put_(k, &v, sizeof(v)); }
+  size_t putBool  (const char* k, bool v)           { const uint8_t b = v; return put_(k, &b, 1); }
+  size_t putString(const char* k, const String& v)  { return put_(k, v.c_str(), v.length()); }
+  size_t putBytes (const char* k, const void* v, size_t n) { return put_(k, v, n); }
+
+  uint8_t  getUChar (const char* k, uint8_t d = 0)  { return get_(k, d); }
+  uint16_t getUShort(const char* k, uint16_t d = 0) { return get_(k, d); }
+  int32_t  getInt   (const char* k, int32_t d = 0)  { return get_(k, d); }
+  uint32_t getUInt  (const char* k, uint32_t d = 0) { return get_(k, d); }
+  float    getFloat (const char* k, float d = 0)    { return get_(k, d); }
+  bool     getBool  (const char* k, bool d = false) { return get_(k, (uint8_t)d) != 0; }
+  String   getString(const char* k, const String& d = String()) {
+    const std::vector<uint8_t>* v = find_(k);
+    return v ? String(std::string(v->begin(), v->end())) : d;
+  }
+  size_t getBytesLength(const char* k) { const std::vector<uint8_t>* v = find_(k); return v ? v->size() : 0; }
+  size_t getBytes(const char* k, void* out, size_t n) {
+    const std::vector<uint8_t>* v = find_(k);
+    if (!v || v->size() > n) return 0;
+    memcpy(out, v->data(), v->size());
+    return v->size();
+  }
+
+private:
+  size_t put_(const char* k, const void* p, size_t n) {
+    if (!ns_ || ro_) return 0;
+    const uint8_t* b = static_cast<const uint8_t*>(p);
+    (*ns_)[k].assign(b, b + n);
+    return n;
+  }
+  const std::vector<uint8_t>* find_(const char* k) const {
+    if (!ns_) return nullptr;
+    auto it = ns_->find(k);
+    return it == ns_->end() ? nullptr : &it->second;
+  }
+  template<class T> T get_(const char* k, T d) const {
+    const std::vector<uint8_t>* v = find_(k);
+    if (!v || v->size() != sizeof(T)) return d;
+    T out; memcpy(&out, v->data(), sizeof(T));
+    return out;
+  }
+
+  sim::NvsNamespace* ns_ = nullptr;
+  bool               ro_ = false;
+};
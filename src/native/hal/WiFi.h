@@ -0,0 +1,27 @@
+#pragma once
+// ===================== WiFi de mentira (env:native) =====================
+// AutoMode sólo consulta si hay IP; en el simulador siempre hay red.
+#include <Arduino.h>
+
+class IPAddress {
+public:
+  explicit IPAddress(uint32_t v = 0) : v_(v) {}
+  operator uint32_t() const { return v_; }
+  String toString() const {
+    char b[16];
+    snprintf(b, sizeof(b), "%u.%u.%u.%u", v_ & 0xFF, (v_ >> 8) & 0xFF, (v_ >> 16) & 0xFF, v_ >> 24);
+    return String(b);
+  }
+private:
+  uint32_t v_;
+};
+
+#define WL_CONNECTED 3
+
+class WiFiClass {
+public:
+  int       status()  const { return WL_CONNECTED; }
+  IPAddress localIP() const { return IPAddress(0x0100007F); }   // 127.0.0.1
+};
+
+inline WiFiClass WiFi;
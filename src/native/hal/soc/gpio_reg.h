@@ -0,0 +1,14 @@
+#pragma once
+// ===================== Registros de salida GPIO del ESP32 (env:native) =====================
+// RelayBank::commit_ escribe W1TS/W1TC directo. En el host cada REG_WRITE
+// cuenta como una escritura y cambia de una vez todos los pines de su banco
+// (native/NativeHal.cpp), igual que el hardware: sin estados por pin.
+#include <stdint.h>
+
+#define GPIO_OUT_W1TS_REG   0u   // banco 0 (GPIO0..31): pone en HIGH
+#define GPIO_OUT_W1TC_REG   1u   // banco 0: pone en LOW
+#define GPIO_OUT1_W1TS_REG  2u   // banco 1 (GPIO32..39)
+#define GPIO_OUT1_W1TC_REG  3u
+
+void hostGpioRegWrite(uint32_t reg, uint32_t bits);
+#define REG_WRITE(reg, v) hostGpioRegWrite((reg), (uint32_t)(v))
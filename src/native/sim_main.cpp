@@ -0,0 +1,1855 @@
+// ===================== Simulador + benchmark del núcleo de riego (env:native) =====================
+// Corre AutoMode contra el reloj virtual de native/NativeHal.h igual que
+// irrigationTask: run(), dormir hasta msUntilNextDeadline() y repetir (sin el
+// tope de 1 s del firmware: el reloj salta directo al próximo plazo). El
+// caudal sale del estado de los relés: cada zona abierta inyecta los pulsos de
+// su flowLph en su caudalímetro.
+//
+// Por escenario imprime: coste de run() por tick (reposo / regando), asignaciones
+// de heap por tick, escrituras de GPIO, eventos MQTT, volumen entregado y la
+// predicción de schedule/SchedulePlanner.h para el mismo programa. Los escenarios
+// "Falla" inyectan una válvula trabada o un lateral roto para ver el corte de
+// flow/FlowMonitor.h (evento flow_alarm + alarma en TOGGLE_PREV).
+//
+// Al final compara los backends de core/PayloadEncoder.h (JSON / CBOR) con
+// los eventos state_start / state_end: bytes, ns y asignaciones por evento.
+// Y prueba el escaneo de comandos MQTT (mqtt/CommandParse.h): JSON mal
+// formado, escapes, anidamiento, errores de comando e "id" truncado/saneado;
+// el ruteo por filtro de mqtt/TopicRouter.h (comodines, "$...", remove()) y
+// el codec de schedule/IrrigationConfigCodec.h (corrupción, versiones viejas),
+// los bytes exactos de core/PayloadEncoder.h (JSON, CBOR y prependSeq),
+// la EWMA, las líneas base y las alarmas de flow/FlowMonitor.h con caudales
+// sintéticos, los límites de config/ZoneTable.h (MAX_ZONES, NVS, compactación)
+// y el total de flow/FlowMeterService.h con el desborde del PCNT pendiente o
+// leído en medio de la ISR (hilo lector).
+//
+// Cada escenario además verifica lo que debe cumplir (corridas, alarmas, dosis,
+// órdenes, lo previsto por el planificador, cero asignaciones en reposo...):
+// una falla se imprime como "FALLA:" y el programa sale con código 1, así
+// sirve de prueba de regresión.
+//
+//   pio run -e native && .pio/build/native/program [días] [-v]
+#include <Arduino.h>
+#include <Preferences.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdarg.h>
+#include <thread>
+#include <vector>
+
+#include "NativeHal.h"
+#include "../hw/RelayPins.h"
+#include "../hw/RelayBank.h"
+#include "../config/ZoneTable.h"
+#include "../hw/InputService.h"
+#include "../flow/FlowMeterService.h"
+#include "../flow/FertDoser.h"
+#include "../flow/FlowMonitor.h"
+#include "../sensors/SensorService.h"
+#include "../modes/AutoMode.h"
+#include "../modes/ManualMode.h"
+#include "../modes/OrderQueue.h"
+#include "../schedule/IrrigationSchedule.h"
+#include "../schedule/IrrigationConfigCodec.h"
+#include "../schedule/SchedulePlanner.h"
+#include "../schedule/StartIndex.h"
+#include "../schedule/WindowIndex.h"
+#include "../schedule/ZonePacker.h"
+#include "../core/PayloadEncoder.h"
+#include "../mqtt/CommandParse.h"
+#include "../mqtt/TopicRouter.h"
+
+// ---------- Conteo de asignaciones (todo el proceso; se mide por diferencia) ----------
+static uint64_t gAllocs = 0;
+
+void* operator new(size_t n) {
+  ++gAllocs;
+  if (void* p = malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept         { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// ---------- Constantes (mismas que modes.cpp / main.cpp) ----------
+static constexpr time_t        EPOCH_MON_2025   = 1736121600;   // lunes 2025-01-06 00:00 UTC
+static constexpr uint32_t      CONTROL_MAX_SLEEP_MS = 1000;
+static constexpr uint32_t      CONTROL_MIN_SLEEP_MS = 1;
+static constexpr unsigned long STEP_MS          = 500;
+static constexpr float         PULSES_PER_ML    = 4.5f;
+static const int LEGACY_STATES[] = { 0 };
+
+static bool gVerbose = false;
+static uint32_t gRouteHits = 0;   // runTopicRouterCheck
+static void flowWake_() {}
+
+// ---------- Verificaciones (salida != 0 si alguna falla) ----------
+static uint32_t gChecks = 0, gFailures = 0;
+
+static bool check(bool ok, const char* fmt, ...) {
+  gChecks++;
+  if (ok) return true;
+  gFailures++;
+  va_list ap;
+  va_start(ap, fmt);
+  printf("  FALLA: ");
+  vprintf(fmt, ap);
+  printf("\n");
+  va_end(ap);
+  return false;
+}
+
+// ---------- Estadística de ticks ----------
+struct TickStats {
+  uint64_t n = 0, sumNs = 0, maxNs = 0;
+  uint64_t allocs = 0, maxAllocs = 0, ticksWithAlloc = 0;
+
+  void add(uint64_t ns, uint64_t a) {
+    n++; sumNs += ns; if (ns > maxNs) maxNs = ns;
+    allocs += a; if (a > maxAllocs) maxAllocs = a; if (a) ticksWithAlloc++;
+  }
+  void print(const char* name) const {
+    if (!n) { printf("  %-8s sin ticks\n", name); return; }
+    printf("  %-8s ticks=%-7llu run() medio=%6.0f ns  máx=%7llu ns | allocs/tick medio=%.2f máx=%llu (ticks con alloc: %llu)\n",
+           name, (unsigned long long)n, (double)sumNs / (double)n, (unsigned long long)maxNs,
+           (double)allocs / (double)n, (unsigned long long)maxAllocs, (unsigned long long)ticksWithAlloc);
+  }
+};
+
+// CPU del proceso (no reloj de pared: en una máquina cargada la pared miente)
+template<class F> static uint64_t cpuNs(F&& f) {
+  timespec a, b;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &a);
+  f();
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &b);
+  return (uint64_t)(b.tv_sec - a.tv_sec) * 1000000000ULL + (uint64_t)b.tv_nsec - (uint64_t)a.tv_nsec;
+}
+
+template<class F> static uint64_t timedNs(F&& f) {
+  const auto t0 = std::chrono::steady_clock::now();
+  f();
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// ---------- Programa de demostración ----------
+// 6 zonas (una MAIN cada una), 05:00 y 17:30 todos los días dentro de dos franjas.
+// splitLines: las impares van por S0 (caudalímetro 1) para poder empaquetarse
+// (AutoMode abre cada zona por sus máscaras en cualquier modo).
+static ProgramSpec demoProgram(bool splitLines) {
+  ProgramSpec p;
+  p.enabled = true;
+  const uint8_t everyday = DOW_MON|DOW_TUE|DOW_WED|DOW_THU|DOW_FRI|DOW_SAT|DOW_SUN;
+  p.starts.push_back(StartSpec(5,  0, everyday, 0, true, 1.0f, 1.0f));
+  p.starts.push_back(StartSpec(17, 30, everyday, 0, true, 0.5f, 0.5f));
+
+  StepSet s;
+  s.name = "Demo";
+  s.pauseMsBetweenSteps = 10000;
+  static const uint16_t FLOW_LPH[] = { 600, 900, 750, 1200, 500, 800 };
+  for (int i = 0; i < 6; ++i) {
+    const bool direct = !splitLines || (i & 1) == 0;  // direct = S1, alterno = S0
+    StepSpec sp{ i * 2 + (direct ? 0 : 1), 8UL * 60UL * 1000UL, 60000 + 10000u * (uint32_t)i };
+    sp.mainsMask = (uint16_t)(1u << i);
+    sp.secsMask  = (uint16_t)(direct ? 0x2 : 0x1);
+    sp.flowLph   = FLOW_LPH[i];
+    s.steps.push_back(sp);
+  }
+  p.sets.push_back(s);
+  return p;
+}
+
+static void demoWindows() {
+  WindowIndex::Window w[2] = {
+    { 4 * 60 + 30, 8 * 60,  0x7F, "Mañana" },
+    { 17 * 60,     20 * 60, 0x7F, "Tarde"  },
+  };
+  windowIndex().build(w, 2);
+}
+
+// Relé ON según polaridad del tablero
+static bool mainOn(int m) { return sim::level(RP::MAIN_PINS[m]) == (RP::MAIN_ACTIVE_LOW[m] ? LOW : HIGH); }
+static bool secOn(int s)  { return sim::level(RP::SEC_PINS[s])  == (RP::SEC_ACTIVE_LOW[s]  ? LOW : HIGH); }
+
+// Zona abierta: válvula principal + todos sus MAIN y SEC
+static bool zoneOpen(const StepSpec& sp) {
+  if (sim::level(RP::PIN_ALWAYS_ON_12) != HIGH || sp.mainsMask == 0) return false;
+  for (int m = 0; m < RP::NUM_MAINS; ++m) if ((sp.mainsMask & (1u << m)) && !mainOn(m)) return false;
+  for (int s = 0; s < RP::NUM_SECS;  ++s) if ((sp.secsMask  & (1u << s)) && !secOn(s))  return false;
+  return true;
+}
+
+// ---------- Fallas hidráulicas inyectadas ----------
+// Desde el día 'fromDay' el paso 'step' entrega factor × su flowLph
+// (0 = válvula trabada, > 1 = lateral roto) y pressure × la presión nominal.
+// step -1 = sin falla.
+struct Fault {
+  int      step     = -1;
+  float    factor   = 1.0f;
+  float    pressure = 1.0f;
+  uint32_t fromDay  = 0;
+};
+
+// ---------- Presión (transductor en VP) ----------
+// Con zonas abiertas la línea está a NOMINAL_KPA; cerrada, a 0. El nivel no
+// cambia entre dos pasos del reloj virtual, así que el ADC del host entrega
+// directamente las salidas diezmadas (una conversión por salida, SIM_ADC_HZ)
+// en vez de llenar un DMA de 20 kHz, y sólo se bombea cuando SensorService
+// tiene una salida pendiente. 2/s alcanza: STALE_MS es 2 s y el corte por baja
+// presión espera LOW_HOLD_MS.
+static constexpr float    NOMINAL_KPA = 300.f;
+static constexpr float    LOW_CUT_KPA = 150.f;
+static constexpr uint32_t LOW_HOLD_MS = 10000;
+static constexpr uint32_t SIM_ADC_HZ  = 2;
+// Tramo máximo entre dos bombeos al saltar el reloj: la mitad del anillo del
+// ADC del host (4x128 salidas a SIM_ADC_HZ = 256 s), para que no desborde
+static constexpr uint32_t SIM_ADC_CHUNK_MS = 128000;
+
+static SensorService::Config simSensorConfig() {
+  SensorService::Config c;
+  c.sampleHz   = SIM_ADC_HZ;
+  c.decimation = 1;                                // salidas ya diezmadas
+  c.ch[0].kind = SensorService::Kind::PRESSURE;
+  return c;
+}
+
+static uint16_t mvOfKpa(float kpa) {
+  const SensorService::Channel ch = simSensorConfig().ch[0];
+  return (uint16_t)lroundf((float)ch.zeroMv + kpa * (float)(ch.fullMv - ch.zeroMv) / ch.fullScale);
+}
+
+// ---------- Fertirriego ----------
+// % de Fert1/Fert2 en todas las zonas (NVS "zones" z{i}_f1/_f2) y caudal que
+// oscila ±wobble con periodo de 5 min alrededor del declarado.
+struct FertPlan {
+  uint8_t pct[FertDoser::NUM_CH] = { 0, 0 };
+  float   wobble = 0.0f;
+};
+
+// ---------- Órdenes a demanda ----------
+// Cada everyMs llega una orden de volumeMl a la zona siguiente (algunas caen en
+// reposo, otras durante una corrida); cada burstEvery órdenes llegan tres
+// juntas y la tercera es urgente (debe arrancar antes que las otras dos).
+struct OrderPlan {
+  uint32_t everyMs    = 0;     // 0 = sin órdenes
+  uint32_t volumeMl   = 0;
+  uint32_t burstEvery = 4;
+};
+
+// ---------- Escenario AutoMode ----------
+// Lo que main() verifica de cada escenario
+struct AutoReport {
+  uint32_t runs = 0, stateEnds = 0;
+  uint32_t flowAlarms = 0, pressureLows = 0;
+  bool     flowAlarm = false, pressureAlarm = false;   // al final
+  uint64_t idleMaxAllocs = 0;
+  uint32_t adcOutputs = 0, adcOverruns = 0;
+  double   litres = 0;
+  double   fertErrPct[FertDoser::NUM_CH] = { 0, 0 };
+  uint32_t fertJitterMaxMs = 0;
+  uint32_t enqueued = 0, resStarted = 0, resRejected = 0, ordersDone = 0, backlog = 0;
+  uint32_t urgentFirst = 0, bursts = 0;
+  bool     orderActive = false;
+  // schedule/SchedulePlanner.h con el mismo programa y franjas
+  uint32_t planRuns = 0, planSteps = 0, planTruncations = 0;
+  double   planLitres = 0;           // con el caudal aprendido (declarado hasta tener base)
+  double   planLitresDeclared = 0;   // sólo con StepSpec::flowLph
+  uint32_t maxFlowLph = 0;
+  uint64_t cpuNs = 0;
+  std::vector<std::vector<double>> zoneMl;   // [paso] mL entregados en cada apertura
+  uint64_t savedMs = 0;                       // suma de handover.saved_ms (state_end)
+  uint64_t runningMs = 0;                     // con corrida en curso (duración de las corridas)
+};
+
+static AutoReport runAutoScenario(const char* name, const ProgramSpec& prog, uint32_t days,
+                                  const Fault& fault = Fault(), const FertPlan& fert = FertPlan(),
+                                  const OrderPlan& orders = OrderPlan()) {
+  sim::resetAll();
+  sim::setEpoch(EPOCH_MON_2025);
+
+  if (fert.pct[0] || fert.pct[1]) {
+    Preferences z;
+    z.begin("zones", false);
+    for (size_t i = 0; i < prog.sets[0].steps.size(); ++i) {
+      const String base = String("z") + String((int)i) + "_";
+      z.putUChar((base + "f1").c_str(), fert.pct[0]);
+      z.putUChar((base + "f2").c_str(), fert.pct[1]);
+    }
+    z.end();
+  }
+  zoneTable().load();   // como setup(): una lectura y luego todo en RAM
+
+  FlowCalibration cal;
+  cal.pulsesPerMl1 = PULSES_PER_ML;
+  cal.pulsesPerMl2 = PULSES_PER_ML;
+
+  RelayBank        bank(RP::PIN_MAP, RP::RELAY_MASKS);
+  FlowMeterService flow(defaultPcntHal(), flowWake_);
+  AutoMode autoMode(bank, LEGACY_STATES, 1, 60000, 60000, STEP_MS, flow, RP::PIN_FLOW_1, RP::PIN_FLOW_2);
+  FertDoser doser(RP::PIN_TOGGLE_NEXT, RP::PIN_AUX_FERT2);
+  autoMode.attachDoser(&doser);
+  SensorService sensors(defaultAdcHal(), RP::PIN_FLOW_VP, RP::PIN_FLOW_VN);
+  sensors.begin(simSensorConfig());
+  autoMode.attachSensors(&sensors);
+  autoMode.setLowPressureCut(LOW_CUT_KPA, LOW_HOLD_MS);
+  OrderQueue queue;
+  autoMode.attachOrders(&queue);
+
+  uint32_t published = 0, stateEnds = 0, flowAlarms = 0, pressureLows = 0;
+  uint32_t orderStarts = 0, urgentFirst = 0, enqueued = 0;
+  uint32_t resCursor = 0, resStarted = 0, resRejected = 0;   // como CommandChannel
+  uint64_t orderWaitSum = 0, savedMs = 0;
+  autoMode.setEventPublisher([&](const String& topic, const String& payload) {
+    published++;
+    if (payload.indexOf("state_end") >= 0) stateEnds++;
+    const int q = payload.indexOf("\"queue_ms\":");
+    if (q >= 0) {
+      orderStarts++;
+      orderWaitSum += (uint64_t)atol(payload.c_str() + q + 11);
+      // La urgente de una ráfaga sale con las otras dos aún en cola
+      if (payload.indexOf("\"priority\":1") >= 0 && payload.indexOf("\"backlog\":2") >= 0) urgentFirst++;
+    }
+    const int sv = payload.indexOf("\"saved_ms\":");
+    if (sv >= 0) savedMs += (uint64_t)atol(payload.c_str() + sv + 11);
+    if (payload.indexOf("flow_alarm") >= 0) flowAlarms++;
+    if (payload.indexOf("pressure_low") >= 0) pressureLows++;
+    if (gVerbose) printf("    [%s] %s\n", topic.c_str(), payload.c_str());
+  }, String("sim/riego"));
+  autoMode.setSchedule(&prog, &cal);
+  autoMode.reset();
+
+  const std::vector<StepSpec>& steps = prog.sets[0].steps;
+  double   frac[2]  = { 0, 0 };
+  uint64_t pulses[2] = { 0, 0 };
+  uint64_t flowingMs = 0, runningMs = 0;
+  // Agua de cada zona por apertura (de que abre hasta que cierra, solapes incluidos)
+  std::vector<double>              zoneCur(steps.size(), 0.0);
+  std::vector<uint32_t>            zoneLph(steps.size(), 0);
+  std::vector<std::vector<double>> zoneMl(steps.size());
+  uint32_t runs = 0;
+  bool     wasRunning = false;
+  TickStats idle, busy;
+  static const int FERT_PINS[FertDoser::NUM_CH] = { RP::PIN_TOGGLE_NEXT, RP::PIN_AUX_FERT2 };
+  double   fertWantMs[FertDoser::NUM_CH] = { 0, 0 };   // ciclo útil ideal × caudal real
+  uint64_t fertOnMs[FertDoser::NUM_CH]   = { 0, 0 };
+  uint32_t fertJitterMax = 0;
+  float    kpaMin = 1e9f, kpaMax = 0.f;   // lecturas filtradas mientras riega
+
+  const uint32_t endMs = days * 86400000UL;
+  uint32_t nextOrderMs = orders.everyMs, orderN = 0;
+  uint32_t adcPumpMs = 0;
+  const uint64_t wall = cpuNs([&] {
+    while (sim::nowMs() < endMs) {
+      if (orders.everyMs && sim::nowMs() >= nextOrderMs) {
+        nextOrderMs += orders.everyMs;
+        const bool burst = (++orderN % orders.burstEvery) == 0;
+        for (int k = 0; k < (burst ? 3 : 1); ++k) {
+          OrderQueue::Order o;
+          o.zone     = (int16_t)((orderN + k) % steps.size());
+          o.volumeMl = orders.volumeMl;
+          o.priority = (burst && k == 2) ? OrderQueue::URGENT : OrderQueue::NORMAL;
+          if (queue.push(o)) enqueued++;
+        }
+      }
+
+      const uint64_t a0 = gAllocs;
+      const uint64_t ns = timedNs([&] { autoMode.run(); });
+      const AutoMode::Tele tl = autoMode.telemetry();
+      (tl.running ? busy : idle).add(ns, gAllocs - a0);
+      for (OrderQueue::Result r; queue.nextResult(resCursor, r); )
+        (r.outcome == OrderQueue::Outcome::STARTED ? resStarted : resRejected)++;
+      if (tl.running && !wasRunning) runs++;
+      wasRunning = tl.running;
+      for (const FertDoser::Stats& st : tl.fert) if (st.jitterMaxMs > fertJitterMax) fertJitterMax = st.jitterMaxMs;
+      if (tl.running && !tl.pausing && tl.stateElapsedMs > FlowMonitor::SETTLE_MS && tl.analog[0].valid) {
+        kpaMin = std::min(kpaMin, tl.analog[0].value);
+        kpaMax = std::max(kpaMax, tl.analog[0].value);
+      }
+
+      // Caudal por línea según relés abiertos (S0 -> caudalímetro 1, S1 -> 2)
+      uint32_t lph[2] = { 0, 0 };
+      float    kpa = 0.f;
+      double   duty[FertDoser::NUM_CH] = { 0, 0 };
+      const bool  faulty = sim::nowMs() >= fault.fromDay * 86400000UL;
+      const float wob    = 1.0f + fert.wobble * sinf(6.2831853f * (float)(sim::nowMs() % 300000UL) / 300000.0f);
+      for (size_t i = 0; i < steps.size(); ++i) {
+        const StepSpec& sp = steps[i];
+        zoneLph[i] = 0;
+        if (!zoneOpen(sp)) {
+          if (zoneCur[i] > 0) { zoneMl[i].push_back(zoneCur[i]); zoneCur[i] = 0; }
+          continue;
+        }
+        const int line = flowLineOf(sp);
+        const bool  bad = faulty && (int)i == fault.step;
+        const float k   = (bad ? fault.factor : 1.0f) * wob;
+        kpa = std::max(kpa, NOMINAL_KPA * (bad ? fault.pressure : 1.0f));
+        zoneLph[i] = (uint32_t)lroundf((float)sp.flowLph * k);
+        lph[line < 0 ? 0 : line] += zoneLph[i];
+        for (int ch = 0; ch < FertDoser::NUM_CH; ++ch) duty[ch] += (double)fert.pct[ch] / 100.0 * k;
+      }
+      const bool flowing = lph[0] || lph[1];
+      sim::analogMv(RP::PIN_FLOW_VP, mvOfKpa(kpa));
+
+      // Sin el tope de 1 s de irrigationTask: se salta directo al próximo plazo
+      // (paso, muestra de caudal regando, arranque de franja u orden). Ese tope
+      // sólo refresca la telemetría y la vigilancia de fugas en reposo, que aquí
+      // no ve caudal (todo cerrado) y se resincroniza tras el salto.
+      uint32_t wait = autoMode.msUntilNextDeadline(sim::nowMs());
+      if (orders.everyMs && nextOrderMs - sim::nowMs() < wait) wait = nextOrderMs - sim::nowMs();
+      if (wait < CONTROL_MIN_SLEEP_MS) wait = CONTROL_MIN_SLEEP_MS;
+      if (wait > endMs - sim::nowMs()) wait = endMs - sim::nowMs();
+
+      for (int ch = 0; ch < 2; ++ch) {
+        if (!lph[ch]) continue;
+        frac[ch] += (double)lph[ch] * (double)wait / 3600.0 * PULSES_PER_ML;   // L/h -> mL/ms * pulsos/mL
+        const uint32_t n = (uint32_t)frac[ch];
+        frac[ch] -= n;
+        pulses[ch] += n;
+        sim::pulses((uint8_t)ch, n);
+      }
+      if (flowing) flowingMs += wait;
+      if (tl.running) runningMs += wait;
+      for (size_t i = 0; i < steps.size(); ++i) zoneCur[i] += (double)zoneLph[i] * (double)wait / 3600.0;
+      for (int ch = 0; ch < FertDoser::NUM_CH; ++ch) {
+        fertWantMs[ch] += duty[ch] * (double)wait;
+        if (sim::level(FERT_PINS[ch]) == HIGH) fertOnMs[ch] += wait;
+      }
+      // La tarea del ADC (core 1 en el ESP32) sigue durante el salto: se bombea
+      // sólo con una salida pendiente y en tramos que no desbordan su anillo
+      for (uint32_t left = wait; left; ) {
+        const uint32_t d = std::min(left, SIM_ADC_CHUNK_MS);
+        sim::advanceMs(d);
+        left -= d;
+        if (sim::nowMs() - adcPumpMs >= 1000 / SIM_ADC_HZ) {
+          adcPumpMs = sim::nowMs();
+          while (sensors.pump(0)) {}
+        }
+      }
+    }
+  });
+
+  const double litres = (double)(pulses[0] + pulses[1]) / PULSES_PER_ML / 1000.0;
+
+  // Predicción del planificador con las mismas reglas (sin NVS "zones")
+  plan::Params pp;
+  pp.prog        = &prog;
+  pp.windows     = &windowIndex().snapshot();
+  pp.stepDelayMs = STEP_MS;
+  pp.horizonMs   = endMs;
+  pp.maxEvents   = 0;
+  const plan::Result prDeclared = plan::simulate(pp);
+  // Con el caudal que aprendió AutoMode (como planJson en el firmware)
+  const AutoMode::FlowBaselines learned = autoMode.flowBaselines();
+  pp.learnedLph  = learned.lph;
+  pp.nLearned    = FlowMonitor::MAX_ZONES;
+  const plan::Result pr = plan::simulate(pp);
+
+  printf("== %s: %lu días simulados en %.1f ms de CPU (x%.0f)\n", name, (unsigned long)days,
+         (double)wall / 1e6, (double)endMs * 1e6 / (double)(wall ? wall : 1));
+  idle.print("reposo");
+  busy.print("regando");
+  printf("  corridas=%lu  eventos MQTT=%lu (state_end=%lu)  escrituras GPIO=%lu\n",
+         (unsigned long)runs, (unsigned long)published, (unsigned long)stateEnds, (unsigned long)sim::writes());
+  if (fault.step >= 0 || flowAlarms)
+    printf("  alarmas de caudal=%lu (paso %d x%.1f desde el día %lu) | alarma (TOGGLE_PREV)=%s\n",
+           (unsigned long)flowAlarms, fault.step, (double)fault.factor, (unsigned long)fault.fromDay,
+           autoMode.telemetry().flowAlarm ? "activa" : "apagada");
+  if (fault.pressure < 1.0f || pressureLows)
+    printf("  cortes por baja presión=%lu (< %.0f kPa por %lu s) | alarma (TOGGLE_PREV)=%s\n",
+           (unsigned long)pressureLows, (double)LOW_CUT_KPA, (unsigned long)(LOW_HOLD_MS / 1000),
+           autoMode.telemetry().pressureAlarm ? "activa" : "apagada");
+  if (kpaMax > 0.f)
+    printf("  presión regando (VP, filtrada): %.0f..%.0f kPa | ADC: %lu salidas, %lu desbordes\n",
+           (double)kpaMin, (double)kpaMax, (unsigned long)sensors.snapshot().outputs,
+           (unsigned long)sensors.snapshot().overruns);
+  if (orders.everyMs) {
+    const AutoMode::Tele tl = autoMode.telemetry();
+    printf("  órdenes: %lu encoladas, %lu arrancadas, %lu hechas, %lu rechazadas, %lu descartadas, %lu en cola\n",
+           (unsigned long)enqueued, (unsigned long)orderStarts, (unsigned long)tl.ordersDone,
+           (unsigned long)tl.ordersRejected, (unsigned long)tl.ordersDropped, (unsigned long)tl.orderBacklog);
+    printf("  órdenes: espera en cola media %.1f s, máx %.1f s | urgentes adelantadas %lu de %lu\n",
+           orderStarts ? (double)orderWaitSum / orderStarts / 1000.0 : 0.0, (double)tl.orderQueueMaxMs / 1000.0,
+           (unsigned long)urgentFirst, (unsigned long)(orderN / orders.burstEvery));
+    printf("  órdenes: resultados %lu arrancadas, %lu rechazadas (cursor %lu de %lu)\n",
+           (unsigned long)resStarted, (unsigned long)resRejected,
+           (unsigned long)resCursor, (unsigned long)queue.resultHead());
+  }
+  if (fert.pct[0] || fert.pct[1]) {
+    for (int ch = 0; ch < FertDoser::NUM_CH; ++ch) {
+      const double want = fertWantMs[ch], got = (double)fertOnMs[ch];
+      printf("  Fert%d %u%%: inyector %.1f min, ideal %.1f min (error %+.2f%%)\n", ch + 1, fert.pct[ch],
+             got / 60000.0, want / 60000.0, want > 0 ? (got - want) * 100.0 / want : 0.0);
+    }
+    printf("  Fert: retraso máx. de flanco %lu ms\n", (unsigned long)fertJitterMax);
+  }
+  if (runs)
+    printf("  corridas: %.1f min de media, %.1f zonas/h\n", (double)runningMs / runs / 60000.0,
+           runningMs ? (double)stateEnds * 3600000.0 / (double)runningMs : 0.0);
+  printf("  agua: %.1f L en %.1f min con caudal | planificador: %.1f L, %lu corridas, %lu cortes\n",
+         litres, (double)flowingMs / 60000.0, (double)pr.totalMl / 1000.0,
+         (unsigned long)pr.runs, (unsigned long)pr.truncations);
+
+  const AutoMode::Tele tl = autoMode.telemetry();
+  AutoReport r;
+  r.runs          = runs;
+  r.stateEnds     = stateEnds;
+  r.flowAlarms    = flowAlarms;
+  r.pressureLows  = pressureLows;
+  r.flowAlarm     = tl.flowAlarm;
+  r.pressureAlarm = tl.pressureAlarm;
+  r.idleMaxAllocs = idle.maxAllocs;
+  r.adcOutputs    = sensors.snapshot().outputs;
+  r.adcOverruns   = sensors.snapshot().overruns;
+  r.litres        = litres;
+  for (int ch = 0; ch < FertDoser::NUM_CH; ++ch)
+    r.fertErrPct[ch] = fertWantMs[ch] > 0 ? ((double)fertOnMs[ch] - fertWantMs[ch]) * 100.0 / fertWantMs[ch] : 0.0;
+  r.fertJitterMaxMs = fertJitterMax;
+  r.enqueued      = enqueued;
+  r.resStarted    = resStarted;
+  r.resRejected   = resRejected;
+  r.ordersDone    = tl.ordersDone;
+  r.backlog       = tl.orderBacklog;
+  r.urgentFirst   = urgentFirst;
+  r.bursts        = orders.everyMs ? orderN / orders.burstEvery : 0;
+  r.orderActive   = tl.orderZone >= 0;
+  r.cpuNs           = wall;
+  r.zoneMl.swap(zoneMl);
+  r.savedMs         = savedMs;
+  r.runningMs       = runningMs;
+  r.planRuns        = pr.runs;
+  r.planSteps       = pr.steps;
+  r.planTruncations = pr.truncations;
+  r.planLitres      = (double)pr.totalMl / 1000.0;
+  r.planLitresDeclared = (double)prDeclared.totalMl / 1000.0;
+  for (const StepSpec& sp : steps) r.maxFlowLph = std::max<uint32_t>(r.maxFlowLph, sp.flowLph);
+  return r;
+}
+
+// Comunes a todos los escenarios AutoMode
+static void checkCommon(const AutoReport& r, uint32_t days, bool idleAllocFree = true) {
+  check(r.adcOverruns == 0, "ADC con %lu desbordes", (unsigned long)r.adcOverruns);
+  check(r.adcOutputs >= days * 86400UL * SIM_ADC_HZ, "ADC: %lu salidas (< %lu/s)", (unsigned long)r.adcOutputs,
+        (unsigned long)SIM_ADC_HZ);
+  if (idleAllocFree) check(r.idleMaxAllocs == 0, "reposo asigna memoria (máx %llu por tick)", (unsigned long long)r.idleMaxAllocs);
+  check(r.litres > 0, "no corrió agua");
+  // Presupuesto de CPU: ~0.1 s por semana saltando entre plazos; el tope deja
+  // margen para una máquina cargada pero no para volver a tickear cada segundo
+  const uint64_t budgetNs = (uint64_t)days * 500000000ULL / 7;
+  check(r.cpuNs <= budgetNs, "CPU: %.0f ms para %lu días (presupuesto %.0f ms)", (double)r.cpuNs / 1e6,
+        (unsigned long)days, (double)budgetNs / 1e6);
+}
+
+// Planificador vs AutoMode: mismas corridas y pasos, sin cortes y, con el
+// caudal nominal (withLitres), el mismo volumen. El simulador ve el objetivo
+// de volumen en la muestra de 1 s (su flowWake_ no despierta), así que cada
+// paso puede pasarse hasta 1 s del caudal máximo.
+static void checkPlan(const AutoReport& r, const char* name, bool withLitres) {
+  check(r.runs == r.planRuns, "%s: %lu corridas, el planificador prevé %lu", name,
+        (unsigned long)r.runs, (unsigned long)r.planRuns);
+  check(r.planTruncations == 0, "%s: el planificador prevé %lu cortes por franja", name, (unsigned long)r.planTruncations);
+  if (!withLitres) return;
+  check(r.stateEnds == r.planSteps, "%s: %lu pasos, el planificador prevé %lu", name,
+        (unsigned long)r.stateEnds, (unsigned long)r.planSteps);
+  const double tolL = (double)r.planSteps * (double)r.maxFlowLph / 3600.0;
+  check(fabs(r.litres - r.planLitres) <= tolL, "%s: %.1f L, el planificador prevé %.1f L (tolerancia %.1f L)", name,
+        r.litres, r.planLitres, tolL);
+}
+
+// ---------- Transición de relés (hw/RelayTransition.h) ----------
+// Pasos de 60 s por run_set, avanzando el reloj de 1 ms en 1 ms mientras
+// los relés cambian: run() no puede mover el reloj virtual (no bloquea), su
+// coste por tick queda bajo 1 ms y el paso cuenta su tiempo recién cuando la
+// transición termina (4 etapas de STEP_MS), así que riega los 60 s completos.
+static void runTransitionCheck(uint32_t reps) {
+  sim::resetAll();
+  sim::setEpoch(EPOCH_MON_2025);
+  zoneTable().load();
+
+  ProgramSpec prog;
+  prog.enabled = false;   // sólo run_set
+  StepSet s;
+  s.name = "Transición";
+  StepSpec sp{ 0, 60000, 0 };
+  s.steps.push_back(sp);
+  prog.sets.push_back(s);
+
+  FlowCalibration cal;
+  cal.pulsesPerMl1 = PULSES_PER_ML;
+  cal.pulsesPerMl2 = PULSES_PER_ML;
+
+  RelayBank        bank(RP::PIN_MAP, RP::RELAY_MASKS);
+  FlowMeterService flow(defaultPcntHal(), flowWake_);
+  AutoMode autoMode(bank, LEGACY_STATES, 1, 60000, 60000, STEP_MS, flow, RP::PIN_FLOW_1, RP::PIN_FLOW_2);
+  uint32_t lastDurMs = 0, ends = 0;
+  autoMode.setEventPublisher([&](const String&, const String& payload) {
+    const int d = payload.indexOf("\"duration_ms\":");
+    if (payload.indexOf("state_end") >= 0 && d >= 0) { ends++; lastDurMs = (uint32_t)atol(payload.c_str() + d + 14); }
+  }, String("sim/riego"));
+  autoMode.setSchedule(&prog, &cal);
+  autoMode.reset();
+  autoMode.run();
+
+  TickStats trans;
+  uint32_t moved = 0, earlyClock = 0, badWake = 0, lateClock = 0, shortSteps = 0;
+  for (uint32_t rep = 0; rep < reps; ++rep) {
+    if (!check(autoMode.runSetNow(0, 1.0f, 1.0f), "transición: run_set rechazado")) return;
+    const uint32_t t0 = sim::nowMs(), settle = 4 * STEP_MS;
+
+    while (sim::nowMs() - t0 < settle) {
+      const uint32_t before = sim::nowMs();
+      const uint64_t ns = timedNs([&] { autoMode.run(); });
+      trans.add(ns, 0);
+      if (sim::nowMs() != before) moved++;
+      const uint32_t el = sim::nowMs() - t0;
+      const AutoMode::Tele tl = autoMode.telemetry();
+      if (el < settle && tl.stateElapsedMs != 0) earlyClock++;
+      if (autoMode.msUntilNextDeadline(sim::nowMs()) > STEP_MS) badWake++;
+      sim::advanceMs(1);
+    }
+    autoMode.run();
+    const uint32_t el = sim::nowMs() - t0;
+    if (autoMode.telemetry().stateElapsedMs != el - settle) lateClock++;
+
+    // Resto del paso como irrigationTask
+    const uint32_t e0 = ends;
+    while (ends == e0 && sim::nowMs() - t0 < 120000) {
+      uint32_t wait = autoMode.msUntilNextDeadline(sim::nowMs());
+      if (wait > CONTROL_MAX_SLEEP_MS) wait = CONTROL_MAX_SLEEP_MS;
+      if (wait < CONTROL_MIN_SLEEP_MS) wait = CONTROL_MIN_SLEEP_MS;
+      sim::advanceMs(wait);
+      autoMode.run();
+    }
+    if (ends == e0 || lastDurMs < 60000) shortSteps++;
+    while (autoMode.telemetry().running) { sim::advanceMs(STEP_MS); autoMode.run(); }
+    for (int k = 0; k < 5; ++k) { sim::advanceMs(STEP_MS); autoMode.run(); }   // relés a reposo
+  }
+
+  printf("== Transición de relés: %lu pasos, reloj virtual de 1 ms\n", (unsigned long)reps);
+  trans.print("cambio");
+  printf("  run() movió el reloj: %lu | reloj del paso antes de tiempo: %lu, corrido: %lu | pasos cortos: %lu\n",
+         (unsigned long)moved, (unsigned long)earlyClock, (unsigned long)lateClock, (unsigned long)shortSteps);
+
+  check(moved == 0, "transición: run() avanzó el reloj virtual en %lu ticks (bloquea)", (unsigned long)moved);
+  check(trans.sumNs < trans.n * 1000000ULL, "transición: run() medio %.0f ns (tope 1 ms)",
+        (double)trans.sumNs / (double)(trans.n ? trans.n : 1));
+  check(badWake == 0, "transición: %lu ticks con espera > %lu ms", (unsigned long)badWake, (unsigned long)STEP_MS);
+  check(earlyClock == 0 && lateClock == 0, "transición: el paso cuenta antes/después de quedar quietos los relés (%lu/%lu)",
+        (unsigned long)earlyClock, (unsigned long)lateClock);
+  check(shortSteps == 0, "transición: %lu pasos con menos de 60 s (último %lu ms)",
+        (unsigned long)shortSteps, (unsigned long)lastDurMs);
+}
+
+// ---------- Aplicación de relés (hw/RelayBank.h) ----------
+// applyMask (W1TS/W1TC por banco) contra el bucle anterior de un
+// digitalWrite por pin, con los mismos patrones pseudoaleatorios: latencia
+// por aplicación, escrituras por aplicación y mismo nivel final en cada pin.
+// En el host un REG_WRITE emulado cuesta lo que un digitalWrite; lo que vale
+// para el ESP32 es la cuenta de escrituras (y de estados intermedios).
+static void applyLegacy(const PinMap& m, uint16_t mainsMask, uint16_t secsMask, bool always, bool always12) {
+  for (int i=0;i<m.numMains;i++) {
+    const bool on = mainsMask & (1u<<i);
+    digitalWrite(m.mainPins[i], m.mainActiveLow[i] ? (on?LOW:HIGH) : (on?HIGH:LOW));
+  }
+  for (int j=0;j<m.numSecs;j++) {
+    const bool on = secsMask & (1u<<j);
+    digitalWrite(m.secPins[j], m.secActiveLow[j] ? (on?LOW:HIGH) : (on?HIGH:LOW));
+  }
+  if (m.pinAlwaysOn   >= 0) digitalWrite(m.pinAlwaysOn,   always   ? HIGH : LOW);
+  if (m.pinAlwaysOn12 >= 0) digitalWrite(m.pinAlwaysOn12, always12 ? HIGH : LOW);
+}
+
+static void runRelayBench(uint32_t iters) {
+  sim::resetAll();
+  const PinMap& pm = RP::PIN_MAP;
+  RelayBank bank(pm, RP::RELAY_MASKS);
+  bank.begin();
+
+  struct Pattern { uint16_t mains, secs; bool always, always12; };
+  static Pattern pats[256];
+  uint32_t lcg = 12345;
+  for (Pattern& p : pats) {
+    lcg = lcg * 1664525u + 1013904223u;
+    p.mains    = (uint16_t)((lcg >> 8) & ((1u << pm.numMains) - 1));
+    p.secs     = (uint16_t)((lcg >> 24) & ((1u << pm.numSecs) - 1));
+    p.always   = (lcg >> 4) & 1;
+    p.always12 = (lcg >> 5) & 1;
+  }
+
+  // Mismo nivel final por pin y escrituras por aplicación
+  uint32_t mismatches = 0, maxRegWrites = 0;
+  for (const Pattern& p : pats) {
+    applyLegacy(pm, p.mains, p.secs, p.always, p.always12);
+    uint8_t want[64];
+    for (int pin = 0; pin < 64; ++pin) want[pin] = (uint8_t)sim::level(pin);
+    applyLegacy(pm, (uint16_t)~p.mains, (uint16_t)~p.secs, !p.always, !p.always12);   // todo al revés
+    const uint32_t w0 = sim::writes();
+    bank.applyMask(p.mains, p.secs, p.always, p.always12);
+    const uint32_t w = sim::writes() - w0;
+    if (w > maxRegWrites) maxRegWrites = w;
+    for (int pin = 0; pin < 64; ++pin) if (sim::level(pin) != want[pin]) { mismatches++; break; }
+  }
+  const uint32_t legacyWrites = (uint32_t)(pm.numMains + pm.numSecs + (pm.pinAlwaysOn >= 0) + (pm.pinAlwaysOn12 >= 0));
+
+  uint64_t nsMask = 0, nsLegacy = 0;
+  for (int round = 0; round < 3; ++round) {   // alternado: el ruido de la máquina pega a los dos
+    nsMask += cpuNs([&] {
+      for (uint32_t i = 0; i < iters; ++i) {
+        const Pattern& p = pats[i & 255];
+        bank.applyMask(p.mains, p.secs, p.always, p.always12);
+      }
+    });
+    nsLegacy += cpuNs([&] {
+      for (uint32_t i = 0; i < iters; ++i) {
+        const Pattern& p = pats[i & 255];
+        applyLegacy(pm, p.mains, p.secs, p.always, p.always12);
+      }
+    });
+  }
+  const double n = 3.0 * (double)iters;
+
+  printf("== Aplicación de relés: %lu patrones x3 (%d MAIN + %d SEC + always/always12)\n",
+         (unsigned long)iters, pm.numMains, pm.numSecs);
+  printf("  applyMask  %5.0f ns/aplicación | %lu escrituras de registro máx. (W1TS/W1TC)\n",
+         (double)nsMask / n, (unsigned long)maxRegWrites);
+  printf("  por pin    %5.0f ns/aplicación | %lu digitalWrite (un estado intermedio por pin)\n",
+         (double)nsLegacy / n, (unsigned long)legacyWrites);
+  printf("  niveles distintos de los del bucle por pin: %lu de %zu patrones\n", (unsigned long)mismatches, sizeof(pats) / sizeof(pats[0]));
+
+  check(mismatches == 0, "RelayBank: applyMask deja %lu patrones distintos al bucle por pin", (unsigned long)mismatches);
+  check(maxRegWrites <= 4, "RelayBank: %lu escrituras de registro (tope W1TS + W1TC por banco)", (unsigned long)maxRegWrites);
+}
+
+// ---------- Índice de inicios (schedule/StartIndex.h) ----------
+// Programas pseudoaleatorios (hasta cientos de StartSpec, días y minutos
+// repetidos, algunos deshabilitados) contra el escaneo lineal que hacía
+// AutoMode antes del índice: shouldStartNow por StartSpec y
+// computeNextStartEpoch_ con 8 días × StartSpec × mktime. Mismo inicio en
+// el minuto y mismo próximo epoch en cada consulta; después, ns por consulta.
+static int linearStartAt(const ProgramSpec& p, const struct tm& t) {
+  const int dowBit = (t.tm_wday + 6) % 7;
+  for (size_t i = 0; i < p.starts.size(); ++i) {
+    const StartSpec& st = p.starts[i];
+    if (!st.enabled || !(st.dowMask & (1 << dowBit))) continue;
+    if (st.hour == (uint8_t)t.tm_hour && st.minute == (uint8_t)t.tm_min) return (int)i;
+  }
+  return -1;
+}
+
+static time_t linearNextEpoch(const ProgramSpec& p, time_t now) {
+  time_t best = 0;
+  for (int d = 0; d <= 7; ++d) {
+    const time_t dayBase = now + d * 86400;
+    struct tm dayTm;
+    if (!localtime_r(&dayBase, &dayTm)) continue;
+    for (const StartSpec& st : p.starts) {
+      if (!st.enabled || !(st.dowMask & (1 << ((dayTm.tm_wday + 6) % 7)))) continue;
+      struct tm ts = dayTm;
+      ts.tm_hour = st.hour;
+      ts.tm_min  = st.minute;
+      ts.tm_sec  = 0;
+      const time_t cand = mktime(&ts);
+      if (cand > now && (best == 0 || cand < best)) best = cand;
+    }
+  }
+  return best;
+}
+
+// Igual que AutoMode::computeNextStartEpoch_
+static time_t indexNextEpoch(const StartIndex& idx, time_t now) {
+  struct tm t;
+  localtime_r(&now, &t);
+  const int delta = idx.minutesToNextAfter(StartIndex::minuteOfWeek(t));
+  if (delta < 0) return 0;
+  t.tm_sec  = 0;
+  t.tm_min += delta;
+  const time_t cand = mktime(&t);
+  return cand > now ? cand : 0;
+}
+
+static ProgramSpec randomStarts(uint32_t& lcg, size_t n) {
+  ProgramSpec p;
+  for (size_t i = 0; i < n; ++i) {
+    lcg = lcg * 1664525u + 1013904223u;
+    const uint32_t r = lcg;
+    // Pocos minutos distintos para forzar coincidencias entre StartSpec
+    p.starts.push_back(StartSpec((uint8_t)((r >> 8) % 24), (uint8_t)(((r >> 16) % 12) * 5),
+                                 (uint8_t)((r >> 24) & 0x7F), 0, (r & 0xF) != 0, 1.0f, 1.0f));
+  }
+  return p;
+}
+
+static void runStartIndexBench(size_t bigStarts, uint32_t bigQueries) {
+  uint32_t lcg = 777;
+  uint32_t queries = 0, atDiff = 0, nextDiff = 0, hits = 0;
+  auto compare = [&](const ProgramSpec& p, const StartIndex& idx, uint32_t n) {
+    for (uint32_t q = 0; q < n; ++q) {
+      lcg = lcg * 1664525u + 1013904223u;
+      // Cualquier segundo de 2025; uno de cada cuatro cae justo en :00
+      time_t now = (time_t)EPOCH_MON_2025 + (time_t)(lcg % (365UL * 86400UL));
+      if ((lcg >> 30) == 0) now -= now % 60;
+      struct tm t;
+      localtime_r(&now, &t);
+      const int want = linearStartAt(p, t);
+      if (idx.startAt(StartIndex::minuteOfWeek(t)) != want) atDiff++;
+      if (idx.hasStartAt(StartIndex::minuteOfWeek(t)) != (want >= 0)) atDiff++;
+      if (indexNextEpoch(idx, now) != linearNextEpoch(p, now)) nextDiff++;
+      if (want >= 0) hits++;
+      queries++;
+    }
+  };
+
+  // Equivalencia: 60 programas de 0..177 inicios + uno grande
+  for (size_t k = 0; k < 60; ++k) {
+    const ProgramSpec p = randomStarts(lcg, k * 3);
+    StartIndex idx;
+    idx.build(&p);
+    compare(p, idx, 100);
+  }
+  const ProgramSpec big = randomStarts(lcg, bigStarts);
+  StartIndex idx;
+  const uint64_t buildNs = cpuNs([&] { idx.build(&big); });
+  compare(big, idx, bigQueries);
+
+  // Coste por consulta con el programa grande (minutos en orden, como irrigationTask)
+  const uint32_t N = bigQueries;
+  time_t t0 = (time_t)EPOCH_MON_2025;
+  volatile int sink = 0;
+  const uint64_t atIdx = cpuNs([&] {
+    for (uint32_t i = 0; i < N * 20; ++i) {
+      const time_t now = t0 + (time_t)i * 60;
+      struct tm t; localtime_r(&now, &t);
+      sink += idx.hasStartAt(StartIndex::minuteOfWeek(t)) ? idx.startAt(StartIndex::minuteOfWeek(t)) : -1;
+    }
+  });
+  const uint64_t atLin = cpuNs([&] {
+    for (uint32_t i = 0; i < N * 20; ++i) {
+      const time_t now = t0 + (time_t)i * 60;
+      struct tm t; localtime_r(&now, &t);
+      sink += linearStartAt(big, t);
+    }
+  });
+  const uint64_t nextIdx = cpuNs([&] { for (uint32_t i = 0; i < N; ++i) sink += (int)indexNextEpoch(idx, t0 + (time_t)i * 97); });
+  const uint64_t nextLin = cpuNs([&] { for (uint32_t i = 0; i < N; ++i) sink += (int)linearNextEpoch(big, t0 + (time_t)i * 97); });
+  (void)sink;
+
+  printf("== Índice de inicios: %zu StartSpec (%zu entradas), build %.1f µs\n",
+         big.starts.size(), idx.size(), (double)buildNs / 1e3);
+  printf("  inicio en el minuto: índice %6.0f ns | lineal %8.0f ns   (con localtime_r)\n",
+         (double)atIdx / (N * 20.0), (double)atLin / (N * 20.0));
+  printf("  próximo inicio:      índice %6.0f ns | lineal %8.0f ns   (8 días x StartSpec x mktime)\n",
+         (double)nextIdx / N, (double)nextLin / N);
+  printf("  equivalencia: %lu consultas (%lu con inicio), %lu distintas en el minuto, %lu en el próximo\n",
+         (unsigned long)queries, (unsigned long)hits, (unsigned long)atDiff, (unsigned long)nextDiff);
+
+  check(atDiff == 0, "StartIndex: %lu consultas de minuto distintas del escaneo lineal", (unsigned long)atDiff);
+  check(nextDiff == 0, "StartIndex: %lu próximos inicios distintos del escaneo lineal", (unsigned long)nextDiff);
+  check(hits > 0, "StartIndex: ninguna consulta cayó en un inicio");
+}
+
+// ---------- Escenario ManualMode (botonera) ----------
+static void runManualBench(uint32_t seconds) {
+  sim::resetAll();
+  sim::setEpoch(EPOCH_MON_2025);
+
+  static const int STATES[] = { 0, 2, 4, 6, RP::NUM_MAINS * 2 };
+  RelayBank        bank(RP::PIN_MAP, RP::RELAY_MASKS);
+  FlowMeterService flow(defaultPcntHal(), flowWake_);
+  ManualMode manual(bank, STATES, 5, STEP_MS, flow, RP::PIN_FLOW_1, RP::PIN_FLOW_2);
+  manual.reset();
+
+  // Mismo muestreo que el firmware; aquí el "timer" es el bucle cada SCAN_MS
+  static const InputService::Spec SPECS[] = {
+    { RP::PIN_NEXT, INPUT_PULLDOWN, true, 5000 },
+    { RP::PIN_PREV, INPUT_PULLDOWN, true, 5000 },
+  };
+  InputService inputs(SPECS, 2);
+  inputs.begin();
+
+  TickStats st;
+  uint32_t presses = 0, bounces = 0;
+  uint32_t nextScan = 0;
+  const uint32_t endMs = seconds * 1000UL;
+  const uint64_t wall = timedNs([&] {
+    while (sim::nowMs() < endMs) {
+      // Un toque de NEXT (300 ms) cada 10 s, con 30 ms de rebote al pulsar
+      const uint32_t ph = sim::nowMs() % 10000UL;
+      const bool level  = ph < 30 ? ((ph / 10) & 1) == 0 : ph < 300;
+      sim::setInput(RP::PIN_NEXT, level ? HIGH : LOW);
+      if (ph < 30 && (ph % 10) == 0) bounces++;
+
+      if ((int32_t)(sim::nowMs() - nextScan) >= 0) {
+        inputs.scanNow(sim::nowMs());
+        nextScan += InputService::SCAN_MS;
+      }
+      InputService::Event e;
+      while (inputs.pop(e)) {
+        if (e.kind == InputService::Kind::PRESS) presses++;
+        manual.onButton(e.input == 0 ? ManualMode::Button::NEXT : ManualMode::Button::PREV, e.kind);
+      }
+
+      const uint64_t a0 = gAllocs;
+      const uint64_t ns = timedNs([&] { manual.run(); });
+      st.add(ns, gAllocs - a0);
+      uint32_t wait = manual.msUntilNextDeadline(sim::nowMs());
+      const uint32_t toScan = nextScan - sim::nowMs();
+      if (wait > toScan) wait = toScan;
+      sim::advanceMs(wait ? wait : 1);
+    }
+  });
+  printf("== ManualMode: %lu s simulados en %.1f ms de CPU\n", (unsigned long)seconds, (double)wall / 1e6);
+  st.print("botonera");
+  printf("  botones: %lu pulsaciones aceptadas de %lu (con %lu flancos de rebote), %lu descartadas por cola\n",
+         (unsigned long)presses, (unsigned long)(endMs / 10000UL), (unsigned long)bounces,
+         (unsigned long)inputs.dropped());
+  check(presses == endMs / 10000UL, "botonera: %lu pulsaciones de %lu", (unsigned long)presses, (unsigned long)(endMs / 10000UL));
+  check(inputs.dropped() == 0, "botonera: %lu eventos descartados", (unsigned long)inputs.dropped());
+  check(st.maxAllocs == 0, "botonera asigna memoria (máx %llu por tick)", (unsigned long long)st.maxAllocs);
+}
+
+// ---------- Codificación de eventos (core/PayloadEncoder.h) ----------
+// Mismos campos que AutoMode::publishStateStart_ / publishStateEnd_ (con orden
+// y fertirriego, el caso más largo), incluida la copia final al String.
+static String encodeStart(payload::Format f, uint8_t* buf, size_t cap, time_t now) {
+  using payload::Key;
+  payload::Writer w(f, buf, cap);
+  w.beginEvent();
+  w.str(Key::EVENT, "state_start");
+  w.beginMap(Key::WINDOW);
+  w.str(Key::NAME, "Ventana 04:30–08:00");
+  w.time(Key::START, now - 600);
+  w.time(Key::END, now + 12000);
+  w.endMap();
+  w.beginMap(Key::STATE);
+  w.str(Key::NAME, "Paso 3");
+  w.u32(Key::VOLUME_ML, 60000);
+  w.u32(Key::DURATION_MS, 480000);
+  w.endMap();
+  w.beginMap(Key::ORDER);
+  w.u32(Key::ID, 17);
+  w.u32(Key::PRIORITY, 1);
+  w.u32(Key::QUEUE_MS, 135000);
+  w.u32(Key::BACKLOG, 2);
+  w.endMap();
+  w.time(Key::AT, now);
+  w.endMap();
+  return w.toString();
+}
+
+static String encodeEnd(payload::Format f, uint8_t* buf, size_t cap, time_t now) {
+  using payload::Key;
+  payload::Writer w(f, buf, cap);
+  w.beginEvent();
+  w.str(Key::EVENT, "state_end");
+  w.beginMap(Key::WINDOW);
+  w.str(Key::NAME, "Ventana 04:30–08:00");
+  w.time(Key::START, now - 600);
+  w.time(Key::END, now + 12000);
+  w.endMap();
+  w.beginMap(Key::STATE);
+  w.str(Key::NAME, "Paso 3");
+  w.u32(Key::VOLUME_ML, 60083);
+  w.u32(Key::DURATION_MS, 362000);
+  w.endMap();
+  w.beginArray(Key::FERT);
+  for (int ch = 0; ch < FertDoser::NUM_CH; ++ch) {
+    w.beginMap();
+    w.u32(Key::PCT, ch ? 5 : 20);
+    w.u32(Key::TARGET_MS, 72400);
+    w.u32(Key::ON_MS, 72150);
+    w.i32(Key::ERR_MS, -250);
+    w.u32(Key::PULSES, 1629);
+    w.u32(Key::JITTER_AVG_MS, 3);
+    w.u32(Key::JITTER_MAX_MS, 11);
+    w.endMap();
+  }
+  w.endArray();
+  w.time(Key::AT, now);
+  w.endMap();
+  return w.toString();
+}
+
+static void runEncodeBench(uint32_t iters) {
+  static const struct { const char* name; payload::Format f; } FORMATS[] = {
+    { "JSON", payload::Format::JSON },
+    { "CBOR", payload::Format::CBOR },
+  };
+  static uint8_t buf[768];
+  const time_t now = EPOCH_MON_2025 + 5 * 3600;
+
+  printf("== Codificación de eventos: %lu por formato\n", (unsigned long)iters);
+  size_t jsonBytes[2] = { 0, 0 };
+  for (const auto& fm : FORMATS) {
+    size_t bytes[2] = { 0, 0 };
+    uint64_t ns[2] = { 0, 0 }, allocs[2] = { 0, 0 };
+    for (int ev = 0; ev < 2; ++ev) {
+      const uint64_t a0 = gAllocs;
+      ns[ev] = timedNs([&] {
+        for (uint32_t i = 0; i < iters; ++i) {
+          const String s = ev ? encodeEnd(fm.f, buf, sizeof(buf), now + i) : encodeStart(fm.f, buf, sizeof(buf), now + i);
+          bytes[ev] = s.length();
+        }
+      });
+      allocs[ev] = gAllocs - a0;
+    }
+    if (fm.f == payload::Format::JSON) { jsonBytes[0] = bytes[0]; jsonBytes[1] = bytes[1]; }
+    printf("  %s  state_start %3zu B %6.0f ns | state_end %3zu B %6.0f ns | allocs/evento %.1f",
+           fm.name, bytes[0], (double)ns[0] / iters, bytes[1], (double)ns[1] / iters,
+           (double)(allocs[0] + allocs[1]) / (2.0 * iters));
+    if (fm.f != payload::Format::JSON)
+      printf(" | %.1fx / %.1fx menos bytes que JSON", (double)jsonBytes[0] / (double)bytes[0],
+             (double)jsonBytes[1] / (double)bytes[1]);
+    printf("\n");
+    // Una sola asignación (el String final) y nada truncado
+    check(allocs[0] + allocs[1] <= 2ULL * iters, "%s: %.1f asignaciones por evento", fm.name,
+          (double)(allocs[0] + allocs[1]) / (2.0 * iters));
+    check(bytes[0] > 0 && bytes[1] > 0, "%s: evento vacío (buffer corto)", fm.name);
+    if (fm.f != payload::Format::JSON)
+      check(bytes[0] < jsonBytes[0] && bytes[1] < jsonBytes[1], "%s no es más corto que JSON", fm.name);
+    if (gVerbose) {
+      const String s = encodeStart(fm.f, buf, sizeof(buf), now);
+      printf("    ");
+      for (size_t i = 0; i < s.length(); ++i) {
+        const uint8_t c = (uint8_t)s.c_str()[i];
+        if (fm.f == payload::Format::JSON) putchar(c);
+        else                               printf("%02x", c);
+      }
+      printf("\n");
+    }
+  }
+}
+
+// ---------- Codec binario de la configuración (schedule/IrrigationConfigCodec.h) ----------
+// Blob de una versión dada con el formato documentado en el codec: para la
+// última debe coincidir byte a byte con irrcfg::encode; las anteriores son las
+// que quedaron guardadas en NVS antes de cada cambio de formato.
+static std::vector<uint8_t> encodeVersion(const IrrigationConfig& c, uint16_t ver) {
+  std::vector<uint8_t> b;
+  auto u8  = [&](uint8_t v)  { b.push_back(v); };
+  auto u16 = [&](uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); };
+  auto u32 = [&](uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); };
+  auto f32 = [&](float v)    { uint32_t u; memcpy(&u, &v, 4); u32(u); };
+  auto str = [&](const String& s) { u8((uint8_t)s.length()); b.insert(b.end(), s.c_str(), s.c_str() + s.length()); };
+
+  u32(irrcfg::MAGIC); u16(ver); u16(0); u32(0); u32(0);
+  str(c.tz);
+  f32(c.flowCal.pulsesPerMl1);
+  f32(c.flowCal.pulsesPerMl2);
+  u8(c.program.enabled ? 1 : 0);
+  if (ver >= 2) { u8(c.program.concurrent ? 1 : 0); u32(c.program.pumpCapacityLph); }
+  if (ver >= 3) u32(c.program.handoverMs);
+  u16((uint16_t)c.program.starts.size());
+  for (const StartSpec& st : c.program.starts) {
+    u8(st.hour); u8(st.minute); u8(st.dowMask); u8(st.stepSetIndex); u8(st.enabled ? 1 : 0);
+    f32(st.timeScale); f32(st.volumeScale);
+  }
+  u16((uint16_t)c.program.sets.size());
+  for (const StepSet& set : c.program.sets) {
+    str(set.name);
+    u32(set.pauseMsBetweenSteps);
+    u16((uint16_t)set.steps.size());
+    for (const StepSpec& sp : set.steps) {
+      u32((uint32_t)sp.idx); u32(sp.maxDurationMs); u32(sp.targetMl);
+      if (ver >= 2) { u16(sp.mainsMask); u16(sp.secsMask); u16(sp.flowLph); }
+    }
+  }
+  const size_t len = b.size() - irrcfg::HEADER_LEN;
+  const uint32_t crc = irrcfg::crc32(b.data() + irrcfg::HEADER_LEN, len);
+  for (int i = 0; i < 4; ++i) { b[8 + i] = (uint8_t)(len >> (8 * i)); b[12 + i] = (uint8_t)(crc >> (8 * i)); }
+  return b;
+}
+
+// Igualdad campo a campo; ver < 3 / < 2 espera los defaults de lo que no existía
+static bool sameConfig(const IrrigationConfig& a, const IrrigationConfig& b, uint16_t ver) {
+  const ProgramSpec& p = a.program;
+  const ProgramSpec& q = b.program;
+  if (a.tz != b.tz || a.flowCal.pulsesPerMl1 != b.flowCal.pulsesPerMl1 ||
+      a.flowCal.pulsesPerMl2 != b.flowCal.pulsesPerMl2 || p.enabled != q.enabled) return false;
+  if (q.concurrent != (ver >= 2 && p.concurrent) || q.pumpCapacityLph != (ver >= 2 ? p.pumpCapacityLph : 0) ||
+      q.handoverMs != (ver >= 3 ? p.handoverMs : 0)) return false;
+  if (p.starts.size() != q.starts.size() || p.sets.size() != q.sets.size()) return false;
+  for (size_t i = 0; i < p.starts.size(); ++i) {
+    const StartSpec& x = p.starts[i];
+    const StartSpec& y = q.starts[i];
+    if (x.hour != y.hour || x.minute != y.minute || x.dowMask != y.dowMask || x.stepSetIndex != y.stepSetIndex ||
+        x.enabled != y.enabled || x.timeScale != y.timeScale || x.volumeScale != y.volumeScale) return false;
+  }
+  for (size_t i = 0; i < p.sets.size(); ++i) {
+    const StepSet& x = p.sets[i];
+    const StepSet& y = q.sets[i];
+    if (x.name != y.name || x.pauseMsBetweenSteps != y.pauseMsBetweenSteps || x.steps.size() != y.steps.size()) return false;
+    for (size_t k = 0; k < x.steps.size(); ++k) {
+      const StepSpec& s = x.steps[k];
+      const StepSpec& t = y.steps[k];
+      if (s.idx != t.idx || s.maxDurationMs != t.maxDurationMs || s.targetMl != t.targetMl) return false;
+      if (t.mainsMask != (ver >= 2 ? s.mainsMask : 0) || t.secsMask != (ver >= 2 ? s.secsMask : 0) ||
+          t.flowLph != (ver >= 2 ? s.flowLph : 0)) return false;
+    }
+  }
+  return true;
+}
+
+static void runConfigCodecCheck() {
+  printf("== Codec de configuración: ida y vuelta, corrupción y versiones\n");
+  IrrigationConfig c;
+  c.tz = "Europe/Madrid";
+  c.flowCal.pulsesPerMl1 = 4.5f;
+  c.flowCal.pulsesPerMl2 = 0.45f;
+  c.program = demoProgram(true);
+  c.program.concurrent      = true;
+  c.program.pumpCapacityLph = 2000;
+  c.program.handoverMs      = 1500;
+  c.program.starts[1].enabled = false;
+  StepSet night;
+  night.name = "Noche";
+  night.steps.push_back(StepSpec{ -1, 0, 0 });
+  c.program.sets.push_back(night);
+  c.program.starts.push_back(StartSpec(22, 15, DOW_SAT | DOW_SUN, 1, true, 2.0f, 0.25f));
+
+  std::vector<uint8_t> blob;
+  irrcfg::encode(c, blob);
+  IrrigationConfig d;
+  check(irrcfg::decode(blob.data(), blob.size(), d) && sameConfig(c, d, irrcfg::VERSION),
+        "codec: la ida y vuelta no devuelve la misma configuración");
+  std::vector<uint8_t> again;
+  irrcfg::encode(d, again);
+  check(again == blob, "codec: re-codificar lo decodificado cambia el blob");
+  check(encodeVersion(c, irrcfg::VERSION) == blob, "codec: el blob de la prueba no sigue el formato documentado");
+  IrrigationConfig empty;
+  irrcfg::encode(empty, blob);
+  check(irrcfg::decode(blob.data(), blob.size(), d) && sameConfig(empty, d, irrcfg::VERSION), "codec: configuración vacía");
+
+  // Blobs que deben rechazarse sin tocar 'out'
+  irrcfg::encode(c, blob);
+  auto rejects = [&](const std::vector<uint8_t>& b, size_t len, const char* what) {
+    IrrigationConfig o;
+    o.tz = "intacto";
+    const bool ok = irrcfg::decode(b.data(), len, o);
+    check(!ok && o.tz == "intacto", "codec: acepta %s", what);
+  };
+  std::vector<uint8_t> bad = blob;
+  bad[12] ^= 0x01;                         rejects(bad, bad.size(), "un CRC malo");
+  bad = blob; bad[bad.size() / 2] ^= 0x40; rejects(bad, bad.size(), "la carga alterada");
+  bad = blob; bad[0] ^= 0xFF;              rejects(bad, bad.size(), "un magic malo");
+  rejects(blob, blob.size() - 1, "un blob truncado");
+  rejects(blob, irrcfg::HEADER_LEN - 1, "una cabecera truncada");
+  rejects(blob, 0, "un blob vacío");
+  bad = blob; bad.push_back(0);            rejects(bad, bad.size(), "un byte de más");
+  bad = blob; bad[4] = (uint8_t)(irrcfg::VERSION + 1); rejects(bad, bad.size(), "una versión futura");
+  bad = blob; bad[4] = 0;                  rejects(bad, bad.size(), "la versión 0");
+  // Largo interno que no cuadra con la carga (CRC recalculado: sólo falla el conteo)
+  bad = blob;
+  bad[irrcfg::HEADER_LEN + 1 + c.tz.length() + 8 + 1 + 5 + 4] = 0xFF;   // nStarts = ...FF
+  {
+    const uint32_t crc = irrcfg::crc32(bad.data() + irrcfg::HEADER_LEN, bad.size() - irrcfg::HEADER_LEN);
+    for (int i = 0; i < 4; ++i) bad[12 + i] = (uint8_t)(crc >> (8 * i));
+  }
+  rejects(bad, bad.size(), "un conteo de horarios mayor que la carga");
+
+  // Blobs guardados por firmwares anteriores: se leen con los defaults de lo nuevo
+  for (uint16_t ver = 1; ver < irrcfg::VERSION; ++ver) {
+    const std::vector<uint8_t> old = encodeVersion(c, ver);
+    check(irrcfg::decode(old.data(), old.size(), d) && sameConfig(c, d, ver), "codec: v%u no se lee bien", (unsigned)ver);
+    irrcfg::encode(d, again);
+    check(again == encodeVersion(d, irrcfg::VERSION), "codec: v%u no se re-guarda como v%u", (unsigned)ver,
+          (unsigned)irrcfg::VERSION);
+  }
+}
+
+// ---------- PayloadEncoder: bytes exactos de JSON y CBOR ----------
+// Payload en hex (CBOR) o tal cual (JSON) para el mensaje de falla
+static String showPayload(payload::Format f, const uint8_t* p, size_t n) {
+  String s;
+  for (size_t i = 0; i < n; ++i) {
+    if (f == payload::Format::JSON) { s += (char)p[i]; continue; }
+    char h[3];
+    snprintf(h, sizeof(h), "%02x", p[i]);
+    s += h;
+  }
+  return s;
+}
+
+static void expectBytes(const char* what, payload::Format f, const String& got, const uint8_t* want, size_t n) {
+  const bool same = got.length() == n && memcmp(got.c_str(), want, n) == 0;
+  check(same, "payload %s: %s, se esperaba %s", what,
+        showPayload(f, (const uint8_t*)got.c_str(), got.length()).c_str(), showPayload(f, want, n).c_str());
+}
+
+// Todos los tipos de valor, anidamiento, escapes e instantes (TZ=UTC0)
+static String encodeSample(payload::Format f, uint8_t* buf, size_t cap) {
+  using payload::Key;
+  payload::Writer w(f, buf, cap);
+  w.beginEvent();
+  w.str(Key::EVENT, "a\"b\\c\n\x01");
+  w.u32(Key::STATE, 5);
+  w.i32(Key::ELAPSED_MS, -3);
+  w.real(Key::KPA, 1.5f, 2);
+  w.boolean(Key::RUNNING, true);
+  w.time(Key::AT, EPOCH_MON_2025 + 3661);
+  w.time(Key::NEXT_START, 0);
+  w.beginArray(Key::FERT);
+  w.beginMap(); w.u32(Key::PCT, 24); w.endMap();
+  w.u32(Key::NONE, 300);
+  w.u32(Key::NONE, 70000);
+  w.endArray();
+  w.endMap();
+  return w.toString();
+}
+
+static void runPayloadCheck() {
+  printf("== PayloadEncoder: JSON y CBOR byte a byte\n");
+  using payload::Format;
+  using payload::Key;
+  static uint8_t buf[256];
+
+  static const char JSON[] =
+    "{\"v\":1,\"event\":\"a\\\"b\\\\c\\n\\u0001\",\"state\":5,\"elapsed_ms\":-3,\"kpa\":1.50,"
+    "\"running\":true,\"at\":\"2025-01-06 01:01:01\",\"next_start\":\"-\",\"fert\":[{\"pct\":24},300,70000]}";
+  static const uint8_t CBOR[] = {
+    0xA9,                                                     // map(9)
+    0x00, 0x01,                                               // v: 1
+    0x02, 0x67, 'a', '"', 'b', '\\', 'c', '\n', 0x01,         // event: text(7), sin escapes
+    0x08, 0x05,                                               // state: 5
+    0x0B, 0x22,                                               // elapsed_ms: -3 (negativo, -1 - 2)
+    0x18, 0x21, 0xFA, 0x3F, 0xC0, 0x00, 0x00,                 // kpa (33): float32 1.5
+    0x18, 0x29, 0xF5,                                         // running (41): true
+    0x03, 0xC1, 0x1A, 0x67, 0x7B, 0x2B, 0x4D,                 // at: tag 1, epoch uint32
+    0x18, 0x34, 0xF6,                                         // next_start (52): null
+    0x14, 0x83,                                               // fert: array(3)
+    0xA1, 0x15, 0x18, 0x18,                                   //   {pct (21): 24}
+    0x19, 0x01, 0x2C,                                         //   300
+    0x1A, 0x00, 0x01, 0x11, 0x70,                             //   70000
+  };
+  expectBytes("JSON", Format::JSON, encodeSample(Format::JSON, buf, sizeof(buf)), (const uint8_t*)JSON, strlen(JSON));
+  expectBytes("CBOR", Format::CBOR, encodeSample(Format::CBOR, buf, sizeof(buf)), CBOR, sizeof(CBOR));
+
+  // Más de 23 elementos: la cabecera CBOR pasa a 2 bytes y el contenido se corre
+  {
+    payload::Writer w(Format::CBOR, buf, sizeof(buf));
+    w.beginArray();
+    for (uint32_t i = 0; i < 30; ++i) w.u32(Key::NONE, i);
+    w.endArray();
+    uint8_t want[2 + 30 + 6];
+    size_t n = 0;
+    want[n++] = 0x98; want[n++] = 30;
+    for (uint8_t i = 0; i < 30; ++i) { if (i >= 24) want[n++] = 0x18; want[n++] = i; }
+    expectBytes("array(30)", Format::CBOR, w.toString(), want, n);
+  }
+
+  // Mal armado o sin espacio: ok() false y toString() vacío (nunca un payload truncado)
+  for (Format f : { Format::JSON, Format::CBOR }) {
+    const char* fn = f == Format::JSON ? "JSON" : "CBOR";
+    size_t full = encodeSample(f, buf, sizeof(buf)).length();
+    check(encodeSample(f, buf, full).length() == 0, "payload %s: buffer justo sin '\\0' aceptado", fn);
+    check(encodeSample(f, buf, full + 1).length() == full, "payload %s: buffer exacto rechazado", fn);
+    { payload::Writer w(f, buf, sizeof(buf)); w.beginEvent(); w.beginArray(Key::FERT); w.u32(Key::PCT, 1);
+      w.endArray(); w.endMap(); check(!w.ok(), "payload %s: clave dentro de un array aceptada", fn); }
+    { payload::Writer w(f, buf, sizeof(buf)); w.beginEvent(); w.u32(Key::NONE, 1);
+      w.endMap(); check(!w.ok(), "payload %s: valor sin clave en un map aceptado", fn); }
+    { payload::Writer w(f, buf, sizeof(buf)); w.beginEvent(); w.beginMap(Key::FERT); w.endMap();
+      check(!w.ok() && w.toString().length() == 0, "payload %s: map sin cerrar aceptado", fn); }
+    { payload::Writer w(f, buf, sizeof(buf)); w.beginEvent(); w.endArray();
+      check(!w.ok(), "payload %s: endArray() cierra un map", fn); }
+    { payload::Writer w(f, buf, sizeof(buf));
+      for (int d = 0; d <= payload::Writer::MAX_DEPTH; ++d) w.beginArray();
+      for (int d = 0; d <= payload::Writer::MAX_DEPTH; ++d) w.endArray();
+      check(!w.ok(), "payload %s: más de MAX_DEPTH niveles aceptados", fn); }
+  }
+
+  // prependSeq (EventOutbox): "seq" al frente, en JSON y en CBOR
+  String out;
+  payload::prependSeq(String("{\"v\":1}"), 7, out);
+  check(out == "{\"seq\":7,\"v\":1}", "prependSeq JSON: %s", out.c_str());
+  payload::prependSeq(String("{}"), 4000000000UL, out);
+  check(out == "{\"seq\":4000000000}", "prependSeq JSON vacío: %s", out.c_str());
+  {
+    const uint8_t in[] = { 0xA1, 0x00, 0x01 }, want[] = { 0xA2, 0x01, 0x19, 0x01, 0x2C, 0x00, 0x01 };
+    String src; src.concat((const char*)in, sizeof(in));
+    payload::prependSeq(src, 300, out);
+    expectBytes("prependSeq CBOR", Format::CBOR, out, want, sizeof(want));
+  }
+  {
+    // Map de 23 entradas: la nueva cabecera pasa a 2 bytes
+    uint8_t in[1 + 2 * 23], want[2 + 2 + 2 * 23];
+    in[0] = 0xB7; want[0] = 0xB8; want[1] = 24; want[2] = 0x01; want[3] = 0x07;
+    for (uint8_t i = 0; i < 23; ++i) { in[1 + 2 * i] = want[4 + 2 * i] = i; in[2 + 2 * i] = want[5 + 2 * i] = 0x00; }
+    String src; src.concat((const char*)in, sizeof(in));
+    payload::prependSeq(src, 7, out);
+    expectBytes("prependSeq CBOR map(23)", Format::CBOR, out, want, sizeof(want));
+  }
+  payload::prependSeq(String("[1]"), 7, out);
+  check(out == "[1]", "prependSeq: un payload que no es map cambió (%s)", out.c_str());
+}
+
+// ---------- FlowMonitor: EWMA y detección de anomalías ----------
+// Caudal constante por línea con 1 pulso/ml; múltiplos de 3.6 L/h dan ml
+// enteros por segundo y la muestra sale exacta.
+struct MonitorRig {
+  FlowMonitor fm;
+  uint32_t    t = 0;
+  uint64_t    p[2] = { 0, 0 };
+  uint32_t    alarms = 0;
+
+  MonitorRig() { fm.begin(); FlowMonitor::Alarm a; fm.poll(t, 0, 0, a); }   // 1er poll: referencia
+
+  // Avanza 'secs' segundos; devuelve la primera alarma (kind NONE si no hubo) y su instante
+  FlowMonitor::Alarm run(uint32_t secs, uint32_t lph0, uint32_t lph1 = 0, uint32_t* atMs = nullptr) {
+    FlowMonitor::Alarm first;
+    for (uint32_t i = 0; i < secs; ++i) {
+      t += FlowMonitor::SAMPLE_MS;
+      p[0] += lph0 / 36 * 10;   // ml en 1 s
+      p[1] += lph1 / 36 * 10;
+      FlowMonitor::Alarm a;
+      if (!fm.poll(t, p[0], p[1], a)) continue;
+      alarms++;
+      if (first.kind == FlowMonitor::Anomaly::NONE) { first = a; if (atMs) *atMs = t; }
+    }
+    return first;
+  }
+  // Paso completo a 'lph' en la línea 0 y cierre (aprende si está limpio)
+  void step(int zone, uint32_t declaredLph, uint32_t lph, uint32_t secs, bool learn = true) {
+    fm.watch(0, zone, 0, declaredLph, t);
+    run(secs, lph);
+    fm.unwatch(0, learn, t);
+  }
+};
+
+static void runFlowMonitorCheck() {
+  printf("== FlowMonitor: EWMA, líneas base y alarmas\n");
+  using A = FlowMonitor::Anomaly;
+  const uint32_t SETTLE_S = FlowMonitor::SETTLE_MS / 1000;
+
+  // EWMA: escalón 1080 -> 2160 L/h converge como 2160 - 1080 * (1 - ALPHA)^k
+  {
+    MonitorRig r;
+    r.fm.watch(0, 1, 0, 1080, r.t);
+    r.run(5, 1080);
+    check(r.fm.ewmaLph(0) == 1080 && r.fm.rateLph(0) == 1080 && r.fm.rateLph(-1) == 1080,
+          "monitor: EWMA constante da %lu", (unsigned long)r.fm.ewmaLph(0));
+    for (int k = 1; k <= 6; ++k) {
+      r.run(1, 2160);
+      const long want = lroundf(2160.f - 1080.f * powf(1.f - FlowMonitor::ALPHA, (float)k));
+      check(labs((long)r.fm.ewmaLph(0) - want) <= 1, "monitor: EWMA tras %d muestras = %lu (esperado %ld)", k,
+            (unsigned long)r.fm.ewmaLph(0), want);
+    }
+    uint16_t hist[8] = {};
+    const size_t n = r.fm.recent(0, hist, 8);
+    check(n == 8 && hist[0] == 1080 && hist[1] == 1080 && hist[2] == 2160 && hist[7] == 2160,
+          "monitor: recent() devuelve %lu muestras fuera de orden", (unsigned long)n);
+    check(r.alarms == 0, "monitor: escalón sin base da alarma");
+  }
+
+  // NO_FLOW con sólo el caudal declarado: se evalúa tras SETTLE_MS y se
+  // confirma con CONFIRM_S muestras; se informa una vez por vigilancia
+  {
+    MonitorRig r;
+    r.fm.watch(0, 3, 0, 1080, r.t);
+    const uint32_t start = r.t;
+    uint32_t at = 0;
+    const FlowMonitor::Alarm a = r.run(SETTLE_S + 30, 0, 0, &at);
+    check(a.kind == A::NO_FLOW && a.zone == 3 && a.slot == 0 && a.line == 0 && a.baselineLph == 1080,
+          "monitor: válvula trabada da %s (zona %d, base %lu)", FlowMonitor::name(a.kind), a.zone,
+          (unsigned long)a.baselineLph);
+    check(at == start + FlowMonitor::SETTLE_MS + (FlowMonitor::CONFIRM_S - 1) * FlowMonitor::SAMPLE_MS,
+          "monitor: NO_FLOW confirmado a los %lu ms", (unsigned long)(at - start));
+    check(r.alarms == 1 && r.fm.flagged(0), "monitor: NO_FLOW informado %lu veces", (unsigned long)r.alarms);
+    r.fm.unwatch(0, true, r.t);
+    check(r.fm.baselineLph(3) == 1080, "monitor: un paso con alarma cambió la base (%lu)",
+          (unsigned long)r.fm.baselineLph(3));
+  }
+
+  // Sin referencia (nada declarado ni aprendido) no se juzga; una caída más
+  // corta que CONFIRM_S tampoco
+  {
+    MonitorRig r;
+    r.fm.watch(0, 4, 0, 0, r.t);
+    r.run(SETTLE_S + 30, 0);
+    r.fm.unwatch(0, false, r.t);
+    r.fm.watch(0, 5, 0, 1080, r.t);
+    r.run(SETTLE_S + 5, 1080);
+    r.run(FlowMonitor::CONFIRM_S - 1, 0);
+    r.run(30, 1080);
+    check(r.alarms == 0, "monitor: %lu alarmas sin referencia o por una caída breve", (unsigned long)r.alarms);
+  }
+
+  // Líneas base: el primer paso limpio fija la base, los siguientes pesan
+  // LEARN; un paso corto no aprende. HIGH_FLOW sólo con base aprendida.
+  {
+    MonitorRig r;
+    r.step(7, 1080, 2160, SETTLE_S + 60);               // sin base: no juzga el exceso
+    check(r.alarms == 0, "monitor: HIGH_FLOW contra el caudal declarado");
+    check(r.fm.baselineLph(7) == 2160, "monitor: 1er paso limpio da base %lu", (unsigned long)r.fm.baselineLph(7));
+    r.step(7, 1080, 1080, SETTLE_S + 60);
+    const long want = lroundf(2160.f + FlowMonitor::LEARN * (1080.f - 2160.f));
+    check((long)r.fm.baselineLph(7) == want, "monitor: 2º paso da base %lu (esperado %ld)",
+          (unsigned long)r.fm.baselineLph(7), want);
+    r.step(7, 1080, 1800, SETTLE_S + FlowMonitor::MIN_LEARN_S - 2);  // MIN_LEARN_S - 1 muestras
+    check((long)r.fm.baselineLph(7) == want && r.alarms == 0, "monitor: un paso corto cambió la base");
+
+    r.fm.watch(0, 8, 0, 1080, r.t);                     // base aprendida 1080
+    r.run(SETTLE_S + 60, 1080);
+    r.fm.unwatch(0, true, r.t);
+    r.fm.watch(0, 8, 0, 1080, r.t);
+    const FlowMonitor::Alarm ok = r.run(SETTLE_S + 30, 1440);   // < HIGH_FRAC * base + FLOOR
+    check(ok.kind == A::NONE, "monitor: 1440 L/h sobre base 1080 da %s", FlowMonitor::name(ok.kind));
+    const FlowMonitor::Alarm hi = r.run(30, 2160);
+    check(hi.kind == A::HIGH_FLOW && hi.zone == 8 && hi.baselineLph == 1080 && hi.rateLph > 1640,
+          "monitor: lateral roto da %s (%lu L/h, base %lu)", FlowMonitor::name(hi.kind),
+          (unsigned long)hi.rateLph, (unsigned long)hi.baselineLph);
+    r.fm.unwatch(0, true, r.t);
+  }
+
+  // IDLE_FLOW: caudal con todo cerrado tras IDLE_GRACE_MS (suma de líneas);
+  // una vez, hasta que el caudal vuelva a cero
+  {
+    MonitorRig r;
+    r.fm.setIdleWatch(true, r.t);
+    const uint32_t graceS = FlowMonitor::IDLE_GRACE_MS / 1000;
+    check(r.run(graceS - 1, 36, 36).kind == A::NONE, "monitor: IDLE_FLOW durante la gracia de drenado");
+    const FlowMonitor::Alarm a = r.run(FlowMonitor::CONFIRM_S + 1, 36, 36);
+    check(a.kind == A::IDLE_FLOW && a.slot == -1 && a.line == -1 && a.rateLph >= 20,
+          "monitor: fuga en reposo da %s (%lu L/h)", FlowMonitor::name(a.kind), (unsigned long)a.rateLph);
+    r.run(60, 36, 36);
+    check(r.alarms == 1, "monitor: IDLE_FLOW informado %lu veces", (unsigned long)r.alarms);
+    r.run(60, 0, 0);
+    check(r.run(30, 0, 72).kind == A::IDLE_FLOW && r.alarms == 2, "monitor: IDLE_FLOW no se rearma");
+    r.fm.watch(0, 1, 0, 1080, r.t);                     // vigilando una zona no se mira el reposo
+    r.run(10, 0, 72);
+    check(r.alarms == 2, "monitor: IDLE_FLOW con una zona abierta");
+  }
+}
+
+// ---------- ZoneTable: límites, NVS y compactación ----------
+static bool sameZone(const ZoneTable::Zone& a, uint32_t vol, uint32_t ms, uint8_t f1, uint8_t f2) {
+  return a.volumeMl == vol && a.timeMs == ms && a.fert1Pct == f1 && a.fert2Pct == f2;
+}
+
+static void runZoneTableCheck() {
+  printf("== ZoneTable: límites, NVS y compactación\n");
+  sim::nvsClear();
+  const int MAX = ZoneTable::MAX_ZONES;
+  ZoneTable t("zt_check");
+  t.load();
+  check(t.count() == 0 && sameZone(t.get(0), 0, 0, 0, 0), "zonas: tabla vacía con datos");
+
+  const uint32_t v0 = t.version();
+  check(t.save(0, { 1000, 60000, 10, 20 }) && t.count() == 1 && t.version() == v0 + 1,
+        "zonas: save(0) da count %d", t.count());
+  check(t.save(MAX - 1, { 9000, 1000, 250, 101 }) && t.count() == MAX, "zonas: save(MAX-1) da count %d", t.count());
+  check(sameZone(t.get(MAX - 1), 9000, 1000, 100, 100), "zonas: porcentajes sin recortar a 100");
+  const uint32_t v1 = t.version();
+  check(!t.save(MAX, { 1, 1, 1, 1 }) && !t.save(-1, { 1, 1, 1, 1 }) && !t.erase(MAX) && !t.erase(-1),
+        "zonas: índice fuera de 0..%d aceptado", MAX - 1);
+  check(t.count() == MAX && t.version() == v1 && sameZone(t.get(MAX), 0, 0, 0, 0) && sameZone(t.get(-1), 0, 0, 0, 0),
+        "zonas: un índice rechazado cambió la tabla");
+  t.setCount(MAX + 10);
+  check(t.count() == MAX, "zonas: setCount() pasa de MAX_ZONES (%d)", t.count());
+
+  // Lo guardado sobrevive a un arranque: otra tabla sobre la misma NVS
+  for (int i = 1; i < MAX - 1; ++i) t.save(i, { (uint32_t)i * 100, (uint32_t)i * 1000, (uint8_t)i, (uint8_t)(i / 2) });
+  {
+    ZoneTable boot("zt_check");
+    boot.load();
+    bool same = boot.count() == MAX;
+    for (int i = 0; i < MAX; ++i) {
+      const ZoneTable::Zone a = t.get(i), b = boot.get(i);
+      same = same && sameZone(b, a.volumeMl, a.timeMs, a.fert1Pct, a.fert2Pct);
+    }
+    check(same, "zonas: load() no reproduce lo guardado (count %d)", boot.count());
+  }
+
+  // Borrar el estado 5: las siguientes corren una posición, en RAM y en NVS
+  t.compactAfterDelete(5, MAX - 1);
+  check(t.count() == MAX - 1 && sameZone(t.get(5), 600, 6000, 6, 3) && sameZone(t.get(MAX - 2), 9000, 1000, 100, 100) &&
+        sameZone(t.get(MAX - 1), 0, 0, 0, 0), "zonas: compactAfterDelete() deja count %d", t.count());
+  {
+    ZoneTable boot("zt_check");
+    boot.load();
+    check(boot.count() == MAX - 1 && sameZone(boot.get(5), 600, 6000, 6, 3) && sameZone(boot.get(MAX - 1), 0, 0, 0, 0),
+          "zonas: la compactación no quedó en NVS");
+  }
+  check(t.erase(0) && sameZone(t.get(0), 0, 0, 0, 0) && t.count() == MAX - 1, "zonas: erase(0)");
+  sim::nvsClear();
+}
+
+// ---------- PCNT: total de 64 bits con la ISR de desborde diferida ----------
+static void runPcntWrapCheck() {
+  printf("== PCNT: total con desborde pendiente y ISR en curso\n");
+  sim::resetAll();
+  sim::pcntDeferIsr(true);
+  FlowMeterService flow(defaultPcntHal(), flowWake_);
+  check(flow.begin(RP::PIN_FLOW_1, RP::PIN_FLOW_2), "pcnt: begin() falló");
+  const uint64_t W = (uint64_t)FlowMeterService::WRAP_LIMIT;
+
+  uint64_t injected = 0, last = 0;
+  bool monotonic = true, exact = true;
+  auto observe = [&](uint64_t t) {
+    if (t < last) monotonic = false;
+    if (t != injected) exact = false;
+    last = t;
+  };
+  static const uint32_t CHUNKS[] = { 1, 29998, 1, 1, 7, 29993, 30000, 12345, 17655, 3 };
+  for (int round = 0; round < 40; ++round) {
+    for (uint32_t n : CHUNKS) {
+      const uint32_t before = flow.wraps(0);
+      sim::pulses(0, n);
+      injected += n;
+      observe(flow.total(0));                       // desborde pendiente o nada que atender
+      if (!defaultPcntHal().wrapPending(0)) continue;
+      check(flow.wraps(0) == before, "pcnt: la ISR corrió sin diferirse");
+
+      // Lector en el otro core justo entre el callback y el reconocimiento:
+      // el desborde ya está en wraps_ y el flag sigue arriba
+      sim::pcntIsrEnter(0);
+      std::atomic<bool>     done{false};
+      std::atomic<uint64_t> midIsr{0};
+      std::thread reader([&] { midIsr.store(flow.total(0)); done.store(true); });
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      const bool waited = !done.load();
+      sim::pcntIsrExit(0);
+      reader.join();
+      if (round == 0) check(waited, "pcnt: total() no esperó a que la ISR reconociera");
+      observe(midIsr.load());
+      observe(flow.total(0));
+    }
+  }
+  check(monotonic, "pcnt: el total retrocedió");
+  check(exact, "pcnt: el total difiere de los pulsos inyectados");
+  check(flow.total(0) == injected && flow.wraps(0) == injected / W,
+        "pcnt: total %llu / %lu desbordes, inyectados %llu", (unsigned long long)flow.total(0),
+        (unsigned long)flow.wraps(0), (unsigned long long)injected);
+  // Dos desbordes sin atender: el host atiende el primero (el hardware lo perdería)
+  sim::pulses(1, 2 * (uint32_t)W + 5);
+  check(flow.total(1) == 2 * W + 5, "pcnt: doble desborde da %llu", (unsigned long long)flow.total(1));
+  sim::pcntIsrEnter(1); sim::pcntIsrExit(1);
+  check(flow.total(1) == 2 * W + 5 && !defaultPcntHal().wrapPending(1), "pcnt: tras la ISR da %llu",
+        (unsigned long long)flow.total(1));
+  printf("  %llu pulsos en %lu desbordes diferidos: total exacto y monótono\n",
+         (unsigned long long)injected, (unsigned long)flow.wraps(0));
+  sim::resetAll();
+}
+
+// ---------- Ruteo MQTT por filtro (mqtt/TopicRouter.h) ----------
+// Bit i de la máscara = la ruta i recibió el mensaje
+static uint32_t routeMask(const TopicRouter& tr, const char* topic) {
+  gRouteHits = 0;
+  tr.dispatch(topic, (const uint8_t*)"", 0);
+  return gRouteHits;
+}
+
+static void runTopicRouterCheck() {
+  printf("== Ruteo MQTT: filtros y poda del trie\n");
+  static const char* const FILTERS[] = { "a/#", "#", "+/+", "a/+/c", "a/b/c", "$SYS/#", "+", "a" };
+  const size_t n = sizeof(FILTERS) / sizeof(FILTERS[0]);
+  TopicRouter tr;
+  const size_t emptyNodes = tr.nodeCount();
+  int ids[sizeof(FILTERS) / sizeof(FILTERS[0])];
+  for (size_t i = 0; i < n; ++i) {
+    ids[i] = tr.add(FILTERS[i], [i](const char*, const char*, size_t){ gRouteHits |= 1u << i; });
+    check(ids[i] > 0, "router: '%s' rechazado", FILTERS[i]);
+  }
+  static const char* const INVALID[] = { "", "a/#/b", "a+/b", "a/b#", "##" };
+  for (const char* f : INVALID) check(tr.add(f, [](const char*, const char*, size_t){}) == 0, "router: '%s' aceptado", f);
+
+  // Bits: 0 a/#, 1 #, 2 +/+, 3 a/+/c, 4 a/b/c, 5 $SYS/#, 6 +, 7 a
+  static const struct { const char* topic; uint32_t mask; } CASES[] = {
+    { "a",          0x01 | 0x02 | 0x40 | 0x80 },   // "a/#" también cubre "a"
+    { "a/b",        0x01 | 0x02 | 0x04 },
+    { "a/b/c",      0x01 | 0x02 | 0x08 | 0x10 },
+    { "a/x/c",      0x01 | 0x02 | 0x08 },
+    { "/x",         0x02 | 0x04 },                 // primer nivel vacío: "+" lo cubre
+    { "b/",         0x02 | 0x04 },
+    { "$SYS/x",     0x20 },                        // ni "#" ni "+/+" en la raíz
+    { "$SYS",       0x20 },
+    { "x/$SYS",     0x02 | 0x04 },                 // '$' sólo cuenta en la raíz
+  };
+  for (const auto& c : CASES) {
+    const uint32_t got = routeMask(tr, c.topic);
+    check(got == c.mask, "router: '%s' llega a 0x%02lx, se esperaba 0x%02lx", c.topic,
+          (unsigned long)got, (unsigned long)c.mask);
+  }
+
+  // remove(): deja de entregar, no borra dos veces y poda los nodos vacíos
+  const size_t full = tr.nodeCount();
+  check(tr.remove(ids[3]) && routeMask(tr, "a/x/c") == (0x01 | 0x02), "router: remove(a/+/c) sigue entregando");
+  check(!tr.remove(ids[3]) && !tr.remove(0), "router: remove() repetido devuelve true");
+  check(tr.nodeCount() == full - 2, "router: remove(a/+/c) deja %lu nodos (esperados %lu)",
+        (unsigned long)tr.nodeCount(), (unsigned long)(full - 2));
+  check(tr.remove(ids[4]) && routeMask(tr, "a/b/c") == (0x01 | 0x02), "router: remove(a/b/c) sigue entregando");
+  for (size_t i = 0; i < n; ++i) if (i != 3 && i != 4) tr.remove(ids[i]);
+  check(tr.nodeCount() == emptyNodes, "router: vacío quedan %lu nodos (esperado %lu)",
+        (unsigned long)tr.nodeCount(), (unsigned long)emptyNodes);
+  check(routeMask(tr, "a/b/c") == 0, "router: vacío sigue entregando");
+  // Los nodos podados se reusan: agregar y quitar no hace crecer el trie
+  for (int k = 0; k < 100; ++k) tr.remove(tr.add("x/+/y/#", [](const char*, const char*, size_t){}));
+  check(tr.nodeCount() == emptyNodes, "router: add/remove repetido deja %lu nodos", (unsigned long)tr.nodeCount());
+}
+
+// ---------- Canal de comandos: payload -> Command (mqtt/CommandParse.h) ----------
+static bool parseLit(const char* s, cmd::Command& c) { return cmd::parse(s, strlen(s), c); }
+
+// El payload debe fallar con ese error (nullptr = debe pasar)
+static void expectParse(const char* s, const char* error) {
+  cmd::Command c;
+  const bool ok = parseLit(s, c);
+  if (!error) check(ok, "comando: '%s' rechazado (%s)", s, c.error ? c.error : "?");
+  else        check(!ok && c.error && !strcmp(c.error, error), "comando: '%s' da %s, se esperaba %s", s,
+                    ok ? "ok" : (c.error ? c.error : "?"), error);
+}
+
+static void runCommandParseCheck() {
+  printf("== Canal de comandos: escaneo del payload\n");
+  cmd::Command c;
+  check(parseLit("{\"id\":\"a1\",\"cmd\":\"start_state\",\"state\":2,\"ml\":5000,\"ms\":6e5,\"urgent\":true}", c) &&
+        c.op == cmd::Op::START_STATE && c.state == 2 && c.volumeMl == 5000 && c.durationMs == 600000 &&
+        c.urgent && !strcmp(c.id, "a1"), "comando: start_state mal escaneado");
+  check(parseLit("{\"cmd\":\"run_set\",\"set\":1,\"time_scale\":0.5,\"vol_scale\":2}", c) &&
+        c.op == cmd::Op::RUN_SET && c.set == 1 && c.timeScale == 0.5f && c.volScale == 2.0f, "comando: run_set mal escaneado");
+  check(parseLit("{\"cmd\":\"program\",\"enabled\":false}", c) && c.enabled == 0, "comando: program mal escaneado");
+  expectParse(" {\"cmd\" : \"stop\" }\n", nullptr);
+  const char nul[] = "{\"cmd\":\"stop\"}";
+  check(cmd::parse(nul, sizeof(nul), c), "comando: no tolera el '\\0' final");
+
+  // JSON mal formado
+  static const char* const BAD[] = {
+    "", "[]", "{", "{\"cmd\":\"stop\"", "{\"cmd\":\"stop\",}", "{cmd:\"stop\"}", "{\"cmd\" \"stop\"}",
+    "{\"cmd\":\"stop\"} x", "{\"cmd\":\"stop\"}{}", "{\"cmd\":stop}", "{\"cmd\":\"stop\",\"a\":tru}",
+    "{\"a\":[1,],\"cmd\":\"stop\"}", "{\"a\":{\"b\"},\"cmd\":\"stop\"}",
+    // números fuera de la gramática de JSON
+    "{\"a\":01,\"cmd\":\"stop\"}", "{\"a\":1e,\"cmd\":\"stop\"}", "{\"a\":1.,\"cmd\":\"stop\"}",
+    "{\"a\":.5,\"cmd\":\"stop\"}", "{\"a\":-,\"cmd\":\"stop\"}", "{\"a\":+1,\"cmd\":\"stop\"}",
+    "{\"a\":1e+,\"cmd\":\"stop\"}", "{\"a\":1.2.3,\"cmd\":\"stop\"}", "{\"a\":--1,\"cmd\":\"stop\"}",
+    // cadenas: sin cerrar, escape al final, control crudo
+    "{\"cmd\":\"stop}", "{\"cmd\":\"stop\\\"}", "{\"x\":\"a\nb\",\"cmd\":\"stop\"}",
+  };
+  for (const char* b : BAD) expectParse(b, "bad_json");
+  static const char* const NUMS[] = { "0", "-0", "10", "-1.5", "0.25e-3", "1E+2", "2e9" };
+  for (const char* n : NUMS) {
+    char b[64];
+    snprintf(b, sizeof(b), "{\"a\":%s,\"cmd\":\"stop\"}", n);
+    expectParse(b, nullptr);
+  }
+
+  // Escapes: se saltan sin cortar la cadena; "cmd" sólo vale sin escapes
+  expectParse("{\"x\":\"a\\\"}b\\\\\",\"cmd\":\"stop\"}", nullptr);
+  expectParse("{\"x\":\"\\u00e9\\n\\/\",\"cmd\":\"stop\"}", nullptr);
+  expectParse("{\"cmd\":\"st\\u006fp\"}", "unknown_cmd");
+
+  // Anidamiento: hasta 8 niveles se valida y se salta; el 9.º es JSON inválido
+  expectParse("{\"x\":[[[[[[[[1]]]]]]]],\"cmd\":\"stop\"}", nullptr);
+  expectParse("{\"x\":[[[[[[[[[1]]]]]]]]],\"cmd\":\"stop\"}", "bad_json");
+  expectParse("{\"x\":{\"y\":{\"cmd\":\"reboot\"}},\"cmd\":\"telemetry\"}", nullptr);
+
+  // Errores de comando (el id se copia igual para contestar)
+  check(!parseLit("{\"id\":\"q9\",\"cmd\":\"reboot\"}", c) && c.error && !strcmp(c.error, "unknown_cmd") &&
+        !strcmp(c.id, "q9"), "comando: unknown_cmd sin id");
+  expectParse("{\"cmd\":7}", "unknown_cmd");
+  expectParse("{\"id\":\"x\"}", "missing_cmd");
+  expectParse("{\"cmd\":\"start_state\"}", "bad_state");
+  expectParse("{\"cmd\":\"start_state\",\"state\":-1}", "bad_state");
+  expectParse("{\"cmd\":\"start_state\",\"state\":40000}", "bad_state");
+  expectParse("{\"cmd\":\"start_state\",\"state\":\"x\"}", "bad_state");
+  expectParse("{\"cmd\":\"run_set\",\"set\":-2}", "bad_set");
+  expectParse("{\"cmd\":\"run_set\",\"time_scale\":0}", "bad_scale");
+  expectParse("{\"cmd\":\"program\"}", "bad_enabled");
+
+  // id: truncado a ID_LEN-1 y sólo [A-Za-z0-9_.:-]
+  check(parseLit("{\"id\":\"0123456789abcdefghijklmnopqrstuvwxyz\",\"cmd\":\"stop\"}", c) &&
+        strlen(c.id) == cmd::ID_LEN - 1 && !strncmp(c.id, "0123456789abcdefghijklm", cmd::ID_LEN - 1),
+        "comando: id no truncado a %u (%s)", (unsigned)(cmd::ID_LEN - 1), c.id);
+  check(parseLit("{\"id\":\"a b/\\\"c<d>_e.f:g-h\",\"cmd\":\"stop\"}", c) && !strcmp(c.id, "abcd_e.f:g-h"),
+        "comando: id sin sanear (%s)", c.id);
+  check(parseLit("{\"id\":42,\"cmd\":\"stop\"}", c) && !strcmp(c.id, "42"), "comando: id numérico (%s)", c.id);
+  check(parseLit("{\"id\":true,\"cmd\":\"stop\"}", c) && c.id[0] == '\0', "comando: id no textual copiado (%s)", c.id);
+}
+
+int main(int argc, char** argv) {
+  uint32_t days = 7;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-v")) gVerbose = true;
+    else if (atoi(argv[i]) > 0) days = (uint32_t)atoi(argv[i]);
+  }
+  setenv("TZ", "UTC0", 1);
+  tzset();
+  demoWindows();
+
+  // Secuencial: 2 corridas de 6 pasos por día (la de la franja de 04:30 / 17:00
+  // sigue hasta pasadas las 05:00 / 17:30 y el inicio programado no entra)
+  const uint32_t runsPerWeek = 2 * days;
+  ProgramSpec seq = demoProgram(false);
+  {
+    const AutoReport r = runAutoScenario("Secuencial", seq, days);
+    checkCommon(r, days);
+    check(r.runs == runsPerWeek, "secuencial: %lu corridas (esperadas %lu)", (unsigned long)r.runs, (unsigned long)runsPerWeek);
+    check(r.stateEnds == 6 * runsPerWeek, "secuencial: %lu state_end", (unsigned long)r.stateEnds);
+    check(r.flowAlarms == 0 && r.pressureLows == 0, "secuencial: alarmas sin falla");
+    checkPlan(r, "secuencial", true);
+  }
+
+  // Relevo: todos los pasos terminan por volumen (tope de tiempo holgado) para
+  // comparar lo entregado a cada zona con su objetivo
+  ProgramSpec ho = demoProgram(false);
+  ho.handoverMs = 2000;
+  for (StepSpec& sp : ho.sets[0].steps) sp.maxDurationMs = 12UL * 60UL * 1000UL;
+  {
+    const AutoReport r = runAutoScenario("Relevo sin corte (2 s)", ho, days);
+    checkCommon(r, days);
+    check(r.runs == runsPerWeek, "relevo: %lu corridas", (unsigned long)r.runs);
+    check(r.stateEnds == 6 * runsPerWeek, "relevo: %lu state_end", (unsigned long)r.stateEnds);
+    check(r.flowAlarms == 0 && r.pressureLows == 0, "relevo: alarmas sin falla");
+    checkPlan(r, "relevo", true);
+    // Ahorro medido por relevo: transición con corte (4 etapas) + pausa - solape
+    const uint64_t savedWant = (uint64_t)r.runs * 5 * (4 * STEP_MS + ho.sets[0].pauseMsBetweenSteps - ho.handoverMs);
+    check(r.savedMs == savedWant, "relevo: saved_ms suma %llu ms (esperados %llu)", (unsigned long long)r.savedMs,
+          (unsigned long long)savedWant);
+    // Cada zona recibe su objetivo (el paso cuenta con los relés quietos) más
+    // el agua propia antes de contar (etapa SEC o solape de entrada) y el
+    // solape de salida; el simulador ve el objetivo en la muestra de 1 s.
+    const std::vector<StepSpec>& hs = ho.sets[0].steps;
+    for (size_t i = 0; i < hs.size(); ++i) {
+      const double mlPerMs = (double)hs[i].flowLph / 3600.0;
+      const double preMs   = i == 0 ? (double)STEP_MS : (double)ho.handoverMs;
+      const double postMs  = i + 1 < hs.size() ? (double)ho.handoverMs : 0.0;
+      const double want    = (double)hs[i].targetMl + (preMs + postMs) * mlPerMs;
+      const double tol     = 1000.0 * mlPerMs + 1.0;
+      double worst = 0;
+      for (double ml : r.zoneMl[i]) if (fabs(ml - want) > fabs(worst)) worst = ml - want;
+      check(r.zoneMl[i].size() == r.runs, "relevo: zona %u abrió %lu veces en %lu corridas", (unsigned)i,
+            (unsigned long)r.zoneMl[i].size(), (unsigned long)r.runs);
+      check(fabs(worst) <= tol, "relevo: zona %u se desvía %+.0f mL (objetivo %lu + solapes = %.0f, tolerancia %.0f)",
+            (unsigned)i, worst, (unsigned long)hs[i].targetMl, want, tol);
+    }
+  }
+
+  ProgramSpec conc = demoProgram(true);
+  conc.concurrent      = true;
+  conc.pumpCapacityLph = 2000;
+  {
+    // Empaquetado termina antes de las 05:00 / 17:30: corren la entrada a la
+    // franja y también el inicio programado (4 corridas por día)
+    const AutoReport r = runAutoScenario("Concurrente (2000 L/h)", conc, days);
+    checkCommon(r, days);
+    check(r.runs == 2 * runsPerWeek, "concurrente: %lu corridas (esperadas %lu)", (unsigned long)r.runs, (unsigned long)(2 * runsPerWeek));
+    check(r.stateEnds == 6 * r.runs, "concurrente: %lu state_end", (unsigned long)r.stateEnds);
+    check(r.flowAlarms == 0 && r.pressureLows == 0, "concurrente: alarmas sin falla");
+    checkPlan(r, "concurrente", true);
+  }
+
+  // Mismo programa (líneas separadas) en ambos modos y con las mismas corridas:
+  // sin horarios, sólo la entrada a cada franja (2 por día, escala 1). El
+  // concurrente tiene que terminar cada corrida antes y regar más zonas por hora.
+  {
+    ProgramSpec same = demoProgram(true);
+    same.starts.clear();
+    const AutoReport s = runAutoScenario("Mismo programa: secuencial", same, days);
+    checkCommon(s, days);
+    checkPlan(s, "mismo programa secuencial", true);
+    same.concurrent      = true;
+    same.pumpCapacityLph = 2000;
+    const AutoReport c = runAutoScenario("Mismo programa: concurrente (2000 L/h)", same, days);
+    checkCommon(c, days);
+    checkPlan(c, "mismo programa concurrente", true);
+    check(s.runs == runsPerWeek && c.runs == s.runs && c.stateEnds == s.stateEnds,
+          "mismo programa: %lu/%lu corridas y %lu/%lu pasos (secuencial/concurrente)", (unsigned long)s.runs,
+          (unsigned long)c.runs, (unsigned long)s.stateEnds, (unsigned long)c.stateEnds);
+    const double seqMin  = s.runs ? (double)s.runningMs / s.runs / 60000.0 : 0.0;
+    const double concMin = c.runs ? (double)c.runningMs / c.runs / 60000.0 : 0.0;
+    printf("  secuencial %.1f min por corrida, concurrente %.1f min (%.0f%% menos)\n", seqMin, concMin,
+           seqMin > 0 ? (seqMin - concMin) * 100.0 / seqMin : 0.0);
+    check(concMin > 0 && concMin < seqMin, "mismo programa: el concurrente tarda %.1f min por corrida, el secuencial %.1f",
+          concMin, seqMin);
+  }
+
+  // Planificador con caudal aprendido: la zona 5 entrega desde el principio el
+  // 70 % de lo declarado (sin alarma: no hay base con qué compararla). Sus
+  // pasos terminan por tiempo, así que el agua prevista depende del caudal.
+  Fault low;
+  low.step = 5; low.factor = 0.7f; low.fromDay = 0;
+  {
+    const AutoReport r = runAutoScenario("Caudal real 70 % del declarado (zona 5)", seq, days, low);
+    checkCommon(r, days);
+    check(r.flowAlarms == 0, "caudal aprendido: %lu alarmas de caudal", (unsigned long)r.flowAlarms);
+    checkPlan(r, "caudal aprendido", true);
+    const double tolL = (double)r.planSteps * (double)r.maxFlowLph / 3600.0;
+    printf("  planificador con el caudal declarado: %.1f L\n", r.planLitresDeclared);
+    check(fabs(r.litres - r.planLitresDeclared) > tolL,
+          "caudal aprendido: con el declarado el planificador ya acierta (%.1f L vs %.1f L)", r.planLitresDeclared, r.litres);
+  }
+
+  // FlowMonitor: válvula trabada y lateral roto tras aprender la línea base
+  Fault stuck;
+  stuck.step = 2; stuck.factor = 0.0f; stuck.fromDay = 2;
+  {
+    const AutoReport r = runAutoScenario("Falla: válvula trabada", seq, days, stuck);
+    checkCommon(r, days);
+    if (days > stuck.fromDay)
+      check(r.flowAlarms > 0 && r.flowAlarm, "válvula trabada: sin alarma de caudal");
+    checkPlan(r, "válvula trabada", false);   // el corte cambia el agua, no las corridas
+  }
+
+  Fault burst;
+  burst.step = 4; burst.factor = 2.5f; burst.fromDay = 2;
+  {
+    const AutoReport r = runAutoScenario("Falla: lateral roto", seq, days, burst);
+    checkCommon(r, days);
+    if (days > burst.fromDay)
+      check(r.flowAlarms > 0 && r.flowAlarm, "lateral roto: sin alarma de caudal");
+    checkPlan(r, "lateral roto", false);
+  }
+
+  // SensorService: la bomba pierde presión en el paso 3 (caudal al 40 %)
+  Fault weak;
+  weak.step = 3; weak.factor = 0.4f; weak.pressure = 0.3f; weak.fromDay = 1;
+  {
+    const AutoReport r = runAutoScenario("Falla: baja presión", seq, days, weak);
+    checkCommon(r, days);
+    if (days > weak.fromDay)
+      check(r.pressureLows > 0 && r.pressureAlarm, "baja presión: sin corte");
+    check(r.flowAlarms == 0, "baja presión: %lu alarmas de caudal (la corta la presión)", (unsigned long)r.flowAlarms);
+    checkPlan(r, "baja presión", false);
+  }
+
+  // FertDoser: dosis proporcional con caudal oscilando ±30 %
+  FertPlan fp;
+  fp.pct[0] = 20; fp.pct[1] = 5; fp.wobble = 0.3f;
+  {
+    const AutoReport r = runAutoScenario("Fertirriego (caudal ±30 %)", seq, days, Fault(), fp);
+    checkCommon(r, days);
+    for (int ch = 0; ch < FertDoser::NUM_CH; ++ch)
+      check(fabs(r.fertErrPct[ch]) < 3.0, "Fert%d: error de dosis %+.2f%% (tope 3 %%)", ch + 1, r.fertErrPct[ch]);
+    check(r.fertJitterMaxMs <= 50, "Fert: retraso de flanco %lu ms", (unsigned long)r.fertJitterMaxMs);
+    checkPlan(r, "fertirriego", false);   // el caudal oscila: el volumen no es el nominal
+  }
+
+  // OrderQueue: 20 L a demanda cada 2 h 17 min, con ráfagas que traen una urgente
+  OrderPlan op;
+  op.everyMs  = (2UL * 60UL + 17UL) * 60000UL;
+  op.volumeMl = 20000;
+  {
+    const AutoReport r = runAutoScenario("Órdenes a demanda", seq, days, Fault(), FertPlan(), op);
+    checkCommon(r, days, /*idleAllocFree*/ false);   // el evento de la orden sale desde reposo
+    // Sin checkPlan: las órdenes agregan corridas que el planificador no conoce
+    check(r.enqueued > 0 && r.resStarted + r.backlog == r.enqueued,
+          "órdenes: %lu encoladas, %lu arrancadas, %lu en cola", (unsigned long)r.enqueued,
+          (unsigned long)r.resStarted, (unsigned long)r.backlog);
+    check(r.resRejected == 0, "órdenes: %lu rechazadas", (unsigned long)r.resRejected);
+    check(r.ordersDone + (r.orderActive ? 1 : 0) == r.resStarted, "órdenes: %lu hechas de %lu",
+          (unsigned long)r.ordersDone, (unsigned long)r.resStarted);
+    check(r.urgentFirst == r.bursts, "órdenes: urgentes adelantadas %lu de %lu",
+          (unsigned long)r.urgentFirst, (unsigned long)r.bursts);
+  }
+
+  runTransitionCheck(20);
+  runRelayBench(200000);
+  runStartIndexBench(400, 200);
+  runManualBench(3600);
+  runEncodeBench(20000);
+  runCommandParseCheck();
+  runTopicRouterCheck();
+  runConfigCodecCheck();
+  runPayloadCheck();
+  runFlowMonitorCheck();
+  runZoneTableCheck();
+  runPcntWrapCheck();
+
+  printf("== Verificaciones: %lu, fallas: %lu\n", (unsigned long)gChecks, (unsigned long)gFailures);
+  return gFailures ? 1 : 0;
+}
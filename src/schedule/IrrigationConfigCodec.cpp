@@ -0,0 +1,179 @@
+// File: src/schedule/IrrigationConfigCodec.cpp
+#include "IrrigationConfigCodec.h"
+#include <string.h>
+
+namespace irrcfg {
+
+// ---- CRC32 IEEE (polinomio reflejado 0xEDB88320), tabla de 16 entradas ----
+uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc) {
+  static const uint32_t T[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+  crc = ~crc;
+  for (size_t i = 0; i < len; ++i) {
+    crc = (crc >> 4) ^ T[(crc ^ data[i]) & 0x0F];
+    crc = (crc >> 4) ^ T[(crc ^ (data[i] >> 4)) & 0x0F];
+  }
+  return ~crc;
+}
+
+namespace {
+
+// ---- Escritura ----
+struct Writer {
+  std::vector<uint8_t>& b;
+  void u8 (uint8_t v)  { b.push_back(v); }
+  void u16(uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); }
+  void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+  void f32(float v)    { uint32_t u; memcpy(&u, &v, 4); u32(u); }
+  void str(const String& s) {
+    const size_t n = s.length() > 255 ? 255 : s.length();
+    u8((uint8_t)n);
+    b.insert(b.end(), (const uint8_t*)s.c_str(), (const uint8_t*)s.c_str() + n);
+  }
+  void put32At(size_t off, uint32_t v) { for (int i = 0; i < 4; ++i) b[off + i] = (uint8_t)(v >> (8 * i)); }
+};
+
+// ---- Lectura con control de límites (ok=false ante truncado) ----
+struct Reader {
+  const uint8_t* p;
+  size_t         n;
+  bool           ok = true;
+
+  bool need(size_t k) { if (!ok || n < k) { ok = false; return false; } return true; }
+  uint8_t  u8()  { if (!need(1)) return 0; uint8_t v = p[0]; p += 1; n -= 1; return v; }
+  uint16_t u16() { uint16_t lo = u8(); return (uint16_t)(lo | ((uint16_t)u8() << 8)); }
+  uint32_t u32() { uint32_t lo = u16(); return lo | ((uint32_t)u16() << 16); }
+  float    f32() { uint32_t u = u32(); float v; memcpy(&v, &u, 4); return v; }
+  String   str() {
+    const uint8_t k = u8();
+    if (!need(k)) return String();
+    String s; s.reserve(k);
+    for (uint8_t i = 0; i < k; ++i) s += (char)p[i];
+    p += k; n -= k;
+    return s;
+  }
+};
+
+} // namespace
+
+void encode(const IrrigationConfig& c, std::vector<uint8_t>& out) {
+  out.clear();
+  out.reserve(HEADER_LEN + 64 + c.program.starts.size() * 13 + c.program.sets.size() * 64);
+  Writer w{out};
+
+  w.u32(MAGIC);
+  w.u16(VERSION);
+  w.u16(0);
+  w.u32(0);   // largo (se completa al final)
+  w.u32(0);   // crc
+
+  w.str(c.tz);
+  w.f32(c.flowCal.pulsesPerMl1);
+  w.f32(c.flowCal.pulsesPerMl2);
+  w.u8(c.program.enabled ? 1 : 0);
+  w.u8(c.program.concurrent ? 1 : 0);
+  w.u32(c.program.pumpCapacityLph);
+  w.u32(c.program.handoverMs);
+
+  const size_t ns = c.program.starts.size() > 0xFFFF ? 0xFFFF : c.program.starts.size();
+  w.u16((uint16_t)ns);
+  for (size_t i = 0; i < ns; ++i) {
+    const StartSpec& st = c.program.starts[i];
+    w.u8(st.hour); w.u8(st.minute); w.u8(st.dowMask); w.u8(st.stepSetIndex); w.u8(st.enabled ? 1 : 0);
+    w.f32(st.timeScale);
+    w.f32(st.volumeScale);
+  }
+
+  const size_t nsets = c.program.sets.size() > 0xFFFF ? 0xFFFF : c.program.sets.size();
+  w.u16((uint16_t)nsets);
+  for (size_t i = 0; i < nsets; ++i) {
+    const StepSet& set = c.program.sets[i];
+    w.str(set.name);
+    w.u32(set.pauseMsBetweenSteps);
+    const size_t np = set.steps.size() > 0xFFFF ? 0xFFFF : set.steps.size();
+    w.u16((uint16_t)np);
+    for (size_t k = 0; k < np; ++k) {
+      w.u32((uint32_t)set.steps[k].idx);
+      w.u32(set.steps[k].maxDurationMs);
+      w.u32(set.steps[k].targetMl);
+      w.u16(set.steps[k].mainsMask);
+      w.u16(set.steps[k].secsMask);
+      w.u16(set.steps[k].flowLph);
+    }
+  }
+
+  const size_t len = out.size() - HEADER_LEN;
+  w.put32At(8,  (uint32_t)len);
+  w.put32At(12, crc32(out.data() + HEADER_LEN, len));
+}
+
+bool decode(const uint8_t* data, size_t len, IrrigationConfig& out) {
+  if (!data || len < HEADER_LEN) return false;
+
+  Reader h{data, HEADER_LEN};
+  if (h.u32() != MAGIC) return false;
+  const uint16_t ver = h.u16();
+  if (ver == 0 || ver > VERSION) return false;   // versión futura: no adivinar
+  (void)h.u16();
+  const uint32_t plen = h.u32();
+  const uint32_t crc  = h.u32();
+  if (plen != len - HEADER_LEN) return false;
+  if (crc32(data + HEADER_LEN, plen) != crc) return false;
+
+  Reader r{data + HEADER_LEN, plen};
+  IrrigationConfig c;
+  c.tz = r.str();
+  c.flowCal.pulsesPerMl1 = r.f32();
+  c.flowCal.pulsesPerMl2 = r.f32();
+  c.program.enabled = r.u8() != 0;
+  if (ver >= 2) {
+    c.program.concurrent      = r.u8() != 0;
+    c.program.pumpCapacityLph = r.u32();
+  }
+  if (ver >= 3) c.program.handoverMs = r.u32();
+
+  const uint16_t ns = r.u16();
+  if (!r.need((size_t)ns * 13)) return false;
+  c.program.starts.reserve(ns);
+  for (uint16_t i = 0; i < ns; ++i) {
+    StartSpec st;
+    st.hour = r.u8(); st.minute = r.u8(); st.dowMask = r.u8(); st.stepSetIndex = r.u8();
+    st.enabled     = r.u8() != 0;
+    st.timeScale   = r.f32();
+    st.volumeScale = r.f32();
+    c.program.starts.push_back(st);
+  }
+
+  const uint16_t nsets = r.u16();
+  c.program.sets.reserve(nsets);
+  for (uint16_t i = 0; i < nsets && r.ok; ++i) {
+    StepSet set;
+    set.name = r.str();
+    set.pauseMsBetweenSteps = r.u32();
+    const uint16_t np = r.u16();
+    const size_t stepLen = (ver >= 2) ? 18 : 12;
+    if (!r.need((size_t)np * stepLen)) return false;
+    set.steps.reserve(np);
+    for (uint16_t k = 0; k < np; ++k) {
+      StepSpec sp;
+      sp.idx           = (int)(int32_t)r.u32();
+      sp.maxDurationMs = r.u32();
+      sp.targetMl      = r.u32();
+      if (ver >= 2) {
+        sp.mainsMask = r.u16();
+        sp.secsMask  = r.u16();
+        sp.flowLph   = r.u16();
+      }
+      set.steps.push_back(sp);
+    }
+    c.program.sets.push_back(set);
+  }
+
+  if (!r.ok || r.n != 0) return false;
+  out = c;
+  return true;
+}
+
+} // namespace irrcfg
@@ -0,0 +1,38 @@
+// File: src/schedule/IrrigationConfigCodec.h
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "IrrigationSchedule.h"
+
+// ===================== Codec binario de IrrigationConfig =====================
+// Todo el IrrigationConfig (tz, calibración, starts y TODOS los StepSets) en un
+// único blob para Preferences::putBytes. Little-endian, sin padding:
+//
+//   Cabecera (16 B): magic u32 | version u16 | reservado u16 | len u32 | crc32 u32
+//   Carga (len B):   tz str8 | cal1 f32 | cal2 f32 | enabled u8
+//                    [v2] concurrent u8 | pumpLph u32
+//                    [v3] handoverMs u32
+//                    nStarts u16 × { h,m,dow,set,en u8 | tscale f32 | vscale f32 }
+//                    nSets   u16 × { name str8 | pause u32 | nSteps u16 × STEP }
+//   STEP v1 = idx i32 | dur u32 | ml u32
+//   STEP v2 = v1 | mains u16 | secs u16 | lph u16
+//   str8 = largo u8 + bytes (se recorta a 255)
+// Se escribe siempre la última versión; las anteriores se leen con sus defaults.
+//
+// El CRC32 (IEEE, el de zlib) cubre sólo la carga. Los límites los pone la RAM.
+namespace irrcfg {
+
+static constexpr uint32_t MAGIC      = 0x31475249;   // "IRG1"
+static constexpr uint16_t VERSION    = 3;
+static constexpr size_t   HEADER_LEN = 16;
+
+// Serializa en 'out' (se reemplaza su contenido)
+void encode(const IrrigationConfig& c, std::vector<uint8_t>& out);
+
+// false si magic/versión/largo/CRC no cuadran o la carga está truncada;
+// 'out' sólo se modifica si todo es válido.
+bool decode(const uint8_t* data, size_t len, IrrigationConfig& out);
+
+uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+} // namespace irrcfg
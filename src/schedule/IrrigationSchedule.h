@@ -14,6 +14,12 @@ struct StepSpec {
   int      idx;            // estado (main*2 + (direct?0:1))
   uint32_t maxDurationMs;  // límite de tiempo (0=sin límite)
   uint32_t targetMl;       // volumen objetivo (0=sin objetivo)
+
+  // Hidráulica de la zona (copiada de su RelayState): relés que abre AutoMode
+  // y empaquetado concurrente
+  uint16_t mainsMask = 0;  // 0 = sin datos -> por idx y la zona corre sola
+  uint16_t secsMask  = 0;
+  uint16_t flowLph   = 0;  // caudal esperado (L/h); 0 = desconocido -> sola
 };
 
 // Conjunto de pasos reutilizable
@@ -49,6 +55,9 @@ struct StartSpec {
 // Programa de riego
 struct ProgramSpec {
   bool enabled = true;
+  bool     concurrent      = false; // empaquetar zonas compatibles en paralelo
+  uint32_t pumpCapacityLph = 0;     // capacidad bomba/línea (L/h); 0 = secuencial
+  uint32_t handoverMs      = 0;     // solape entre pasos (make-before-break); 0 = corte clásico
   std::vector<StepSet>  sets;    // catálogos de pasos
   std::vector<StartSpec> starts; // horarios que apuntan a un set
 };
@@ -0,0 +1,307 @@
+#include "SchedulePlanner.h"
+#include "StartIndex.h"
+#include "ZonePacker.h"
+#include <math.h>
+#include <memory>
+
+namespace plan {
+namespace {
+
+constexpr uint32_t MS_PER_MIN = 60000UL;
+constexpr uint32_t MS_PER_DAY = 1440UL * MS_PER_MIN;
+constexpr uint32_t NEVER      = UINT32_MAX;
+
+uint32_t clampMs(uint64_t v) { return v >= NEVER ? NEVER - 1 : (uint32_t)v; }
+
+// Volumen entregado x ms después de arrancar la zona (el agua corre tras la latencia)
+uint32_t deliveredMl(uint32_t x, uint32_t latencyMs, uint32_t flowLph) {
+  if (flowLph == 0 || x <= latencyMs) return 0;
+  return (uint32_t)(((uint64_t)flowLph * (x - latencyMs)) / 3600ULL);   // L/h == mL / 3.6 s
+}
+
+class Sim {
+public:
+  Sim(const Params& p, Result& r)
+  : p_(p), r_(r), origin_((uint64_t)(p.startDow % 7) * MS_PER_DAY + p.startMsOfDay) {}
+
+  void run();
+
+private:
+  struct Zone {
+    uint16_t step   = 0;
+    uint32_t durMs  = 0;
+    uint32_t volMl  = 0;
+    uint32_t flow   = 0;
+    uint32_t endOff = NEVER;   // ms desde el inicio del slot
+  };
+
+  // Minuto absoluto desde el lunes 00:00 de la semana del origen
+  uint64_t absMin_(uint32_t t) const { return (origin_ + t) / MS_PER_MIN; }
+  uint32_t relMs_(uint64_t absMinute) const {
+    const uint64_t a = absMinute * MS_PER_MIN;
+    return a <= origin_ ? 0 : clampMs(a - origin_);
+  }
+  bool hasWindows_() const { return p_.windows && !p_.windows->empty(); }
+  const WindowIndex::Window* windowAt_(uint64_t A) const {
+    const int mow = (int)(A % StartIndex::MINUTES_PER_WEEK);
+    return p_.windows->current(mow / 1440, mow % 1440);
+  }
+  bool insideMin_(uint64_t A) const {
+    if (!hasWindows_()) return true;
+    const int mow = (int)(A % StartIndex::MINUTES_PER_WEEK);
+    return p_.windows->inside(mow / 1440, mow % 1440);
+  }
+
+  uint32_t closeAfter_(uint32_t t) const;
+  void     targets_(const StepSpec& sp, size_t step, float ts, float vs, Zone& z) const;
+  uint32_t runProgram_(uint32_t t, int startIdx, size_t setIdx, float ts, float vs);
+  void     emit_(uint32_t t, Kind k, int startIdx, size_t setIdx, uint16_t step, uint32_t ml);
+
+  const Params& p_;
+  Result&       r_;
+  const uint64_t origin_;   // ms desde el lunes 00:00
+};
+
+void Sim::emit_(uint32_t t, Kind k, int startIdx, size_t setIdx, uint16_t step, uint32_t ml) {
+  if (r_.events.size() >= p_.maxEvents) { r_.overflow = true; return; }
+  r_.events.push_back(Event{ t, k, (int8_t)startIdx, (uint8_t)setIdx, step, ml });
+}
+
+// Primer instante >= t fuera de franja (AutoMode lo comprueba por minuto).
+// Encadena franjas contiguas; NEVER si no hay franjas o no cierra nunca.
+uint32_t Sim::closeAfter_(uint32_t t) const {
+  if (!hasWindows_()) return NEVER;
+  uint64_t A = absMin_(t);
+  for (int guard = 0; guard < 8 * WindowIndex::MAX_WINDOWS + 16; ++guard) {
+    const WindowIndex::Window* w = windowAt_(A);
+    if (!w) { const uint32_t c = relMs_(A); return c > t ? c : t; }
+    A += (uint64_t)(w->endMin - (int)(A % 1440));
+  }
+  return NEVER;
+}
+
+// Igual que AutoMode::effectiveTargets_: ZoneParams si > 0, si no StepSpec escalado
+void Sim::targets_(const StepSpec& sp, size_t step, float ts, float vs, Zone& z) const {
+  z.step  = (uint16_t)step;
+  z.flow  = sp.flowLph;
+  if (p_.learnedLph && sp.idx >= 0 && (size_t)sp.idx < p_.nLearned && p_.learnedLph[sp.idx] > 0)
+    z.flow = p_.learnedLph[sp.idx];
+  z.durMs = sp.maxDurationMs ? (uint32_t)lroundf((float)sp.maxDurationMs * ts) : 0;
+  z.volMl = sp.targetMl      ? (uint32_t)lroundf((float)sp.targetMl      * vs) : 0;
+  if (p_.zones && step < p_.nZones) {
+    if (p_.zones[step].timeMs   > 0) z.durMs = p_.zones[step].timeMs;
+    if (p_.zones[step].volumeMl > 0) z.volMl = p_.zones[step].volumeMl;
+  }
+}
+
+// Una corrida completa desde t; devuelve el instante en que vuelve a reposo (NEVER = atascada)
+uint32_t Sim::runProgram_(uint32_t t, int startIdx, size_t setIdx, float ts, float vs) {
+  const ProgramSpec& pr  = *p_.prog;
+  const StepSet&     set = pr.sets[setIdx];
+  r_.runs++;
+
+  // Unidades de ejecución: slots concurrentes (AutoMode::beginRun_) o un paso por unidad
+  std::vector<ZoneSlot> slots;
+  if (pr.concurrent && pr.pumpCapacityLph > 0) {
+    std::vector<ZoneSlot> packed = packZones(set.steps, pr.pumpCapacityLph);
+    for (const ZoneSlot& sl : packed) if (sl.n > 1) { slots.swap(packed); break; }
+  }
+  const bool packedRun = !slots.empty();
+  if (!packedRun) {
+    slots.resize(set.steps.size());
+    for (size_t i = 0; i < set.steps.size(); ++i) { slots[i].n = 1; slots[i].step[0] = (uint16_t)i; }
+  }
+
+  const uint32_t pauseMs   = set.pauseMsBetweenSteps ? (uint32_t)lroundf((float)set.pauseMsBetweenSteps * ts) : 0;
+  // Transición suave OFF -> BANK -> MAIN -> SEC -> quieta: el agua corre desde
+  // SEC y el paso cuenta (tiempo y volumen) desde que termina (startStepClock_)
+  // Relevo sin corte: el agua de la entrante corre desde el inicio del solape
+  // y el paso cuenta al terminar éste; la saliente sigue abierta handoverMs
+  // tras cumplir su objetivo (agua suya, no del paso entrante).
+  const uint32_t waterLat = 3UL * p_.stepDelayMs;
+  const uint32_t clockLat = 4UL * p_.stepDelayMs;
+  bool handoverIn = false;
+
+  for (size_t u = 0; u < slots.size(); ++u) {
+    const ZoneSlot& sl    = slots[u];
+    const uint32_t  lat   = handoverIn ? 0 : waterLat;
+    const uint32_t  clk   = handoverIn ? pr.handoverMs : clockLat;
+    const uint32_t  close = closeAfter_(t);
+
+    // ¿Relevo hacia la siguiente unidad? (AutoMode::finishStep_)
+    const bool handoverOut = !packedRun && pr.handoverMs > 0 && u + 1 < slots.size() &&
+                             set.steps[sl.step[0]].mainsMask != 0 && set.steps[slots[u + 1].step[0]].mainsMask != 0;
+
+    Zone zs[ZoneSlot::MAX_ZONES];
+    uint32_t slotEnd = 0;
+    for (uint8_t i = 0; i < sl.n; ++i) {
+      Zone& z = zs[i];
+      targets_(set.steps[sl.step[i]], sl.step[i], ts, vs, z);
+      if (z.durMs > 0) z.endOff = clampMs((uint64_t)clk + z.durMs);
+      if (z.volMl > 0 && z.flow > 0 && p_.flowCalibrated) {
+        const uint32_t ve = clampMs((uint64_t)clk + ((uint64_t)z.volMl * 3600ULL + z.flow - 1) / z.flow);
+        if (ve < z.endOff) z.endOff = ve;
+      }
+      if (z.endOff > slotEnd) slotEnd = z.endOff;
+      emit_(t, Kind::STEP_START, startIdx, setIdx, z.step, 0);
+      r_.steps++;
+    }
+
+    // Sin objetivo alcanzable ni franja que cierre: AutoMode se quedaría regando
+    if (slotEnd == NEVER && close == NEVER) {
+      for (uint8_t i = 0; i < sl.n; ++i)
+        if (zs[i].endOff == NEVER) emit_(t, Kind::UNBOUNDED, startIdx, setIdx, zs[i].step, 0);
+      r_.unbounded = true;
+      return NEVER;
+    }
+
+    // Cierres en orden temporal (a lo sumo 2 zonas)
+    uint8_t order[ZoneSlot::MAX_ZONES] = { 0, 1 };
+    if (sl.n == 2 && zs[1].endOff < zs[0].endOff) { order[0] = 1; order[1] = 0; }
+
+    bool cut = false;
+    for (uint8_t k = 0; k < sl.n; ++k) {
+      const Zone&    z   = zs[order[k]];
+      const uint64_t end = (uint64_t)t + z.endOff;
+      if (z.flow == 0) r_.unknownVol++;
+      if (z.endOff == NEVER || end >= close) {
+        const uint32_t ml = deliveredMl(close - t, lat, z.flow);
+        emit_(close, Kind::TRUNCATED, startIdx, setIdx, z.step, ml);
+        r_.totalMl += ml;
+        r_.truncations++;
+        cut = true;
+      } else {
+        // Agua real: la que corrió desde SEC o desde el solape de entrada (con
+        // objetivo de volumen, éste más la que pasó antes de que el paso
+        // empezara a contar) y, si sigue un relevo, la del solape de salida
+        const uint32_t ml = deliveredMl(z.endOff, lat, z.flow) +
+                            (handoverOut ? deliveredMl(pr.handoverMs, 0, z.flow) : 0);
+        emit_((uint32_t)end, Kind::STEP_END, startIdx, setIdx, z.step, ml);
+        r_.totalMl += ml;
+      }
+    }
+    if (cut) { r_.busyMs += close - t; return close; }
+
+    r_.busyMs += slotEnd;
+    t = clampMs((uint64_t)t + slotEnd);
+    if (u + 1 >= slots.size()) return t;
+
+    // Relevo sin corte: sin pausa ni etapas OFF/BANK/MAIN
+    handoverIn = handoverOut;
+
+    if (!handoverIn && pauseMs > 0) {
+      // La franja puede cerrar durante la pausa: el siguiente paso no llega a arrancar
+      const uint32_t c = closeAfter_(t);
+      if (c != NEVER && c <= (uint64_t)t + pauseMs) {
+        emit_(c, Kind::TRUNCATED, startIdx, setIdx, slots[u + 1].step[0], 0);
+        r_.truncations++;
+        return c;
+      }
+      t = clampMs((uint64_t)t + pauseMs);
+    }
+  }
+  return t;
+}
+
+void Sim::run() {
+  if (!p_.prog || p_.prog->sets.empty()) return;
+
+  std::unique_ptr<StartIndex> starts(new StartIndex());
+  starts->build(p_.prog);
+
+  int64_t lastStartMin = -1;   // AutoMode::shouldStartNow: un disparo por minuto
+  int64_t lastWinKey   = -1;   // fallback por franja: (día absoluto, inicio de franja)
+
+  // La franja en curso en el origen se da por atendida (AutoMode ya la arrancó)
+  if (hasWindows_()) {
+    const uint64_t A = absMin_(0);
+    if (const WindowIndex::Window* w = windowAt_(A)) lastWinKey = (int64_t)(A / 1440) * 1440 + w->startMin;
+  }
+
+  uint32_t t = 0;
+  while (t < p_.horizonMs) {
+    const uint64_t A = absMin_(t);
+
+    if (p_.prog->enabled && insideMin_(A)) {
+      // 1) StartSpec explícito
+      const int mow = (int)(A % StartIndex::MINUTES_PER_WEEK);
+      if ((int64_t)A != lastStartMin && starts->hasStartAt(mow)) {
+        const int sIdx = starts->startAt(mow);
+        if (sIdx >= 0) {
+          lastStartMin = (int64_t)A;
+          const StartSpec& st = p_.prog->starts[sIdx];
+          if (st.stepSetIndex < p_.prog->sets.size() && !p_.prog->sets[st.stepSetIndex].steps.empty()) {
+            t = runProgram_(t, sIdx, st.stepSetIndex,
+                            st.timeScale   > 0.f ? st.timeScale   : 1.0f,
+                            st.volumeScale > 0.f ? st.volumeScale : 1.0f);
+            if (t == NEVER) return;
+            continue;
+          }
+        }
+      }
+
+      // 2) Fallback: Set 0 al entrar en una franja (una vez por franja y día)
+      if (hasWindows_()) {
+        if (const WindowIndex::Window* w = windowAt_(A)) {
+          const int64_t key = (int64_t)(A / 1440) * 1440 + w->startMin;
+          if (key != lastWinKey) {
+            lastWinKey = key;
+            if (!p_.prog->sets[0].steps.empty()) {
+              t = runProgram_(t, -1, 0, 1.0f, 1.0f);
+              if (t == NEVER) return;
+              continue;
+            }
+          }
+        }
+      }
+    }
+
+    t = relMs_(A + 1);   // siguiente minuto
+  }
+}
+
+} // namespace
+
+Result simulate(const Params& p) {
+  Result r;
+  Sim sim(p, r);
+  sim.run();
+  return r;
+}
+
+String toJson(const Result& r, const Params& p) {
+  static const char* const KIND[] = { "start", "end", "trunc", "open" };
+
+  String out;
+  out.reserve(160 + r.events.size() * 80);
+
+  char b[160];
+  snprintf(b, sizeof(b),
+           "{\"origin_dow\":%u,\"origin_ms\":%lu,\"horizon_ms\":%lu,\"runs\":%lu,\"steps\":%lu,",
+           (unsigned)(p.startDow % 7), (unsigned long)p.startMsOfDay, (unsigned long)p.horizonMs,
+           (unsigned long)r.runs, (unsigned long)r.steps);
+  out += b;
+  snprintf(b, sizeof(b),
+           "\"truncations\":%lu,\"unknown_vol\":%lu,\"busy_ms\":%lu,\"total_ml\":%llu,\"unbounded\":%s,\"overflow\":%s,\"events\":[",
+           (unsigned long)r.truncations, (unsigned long)r.unknownVol, (unsigned long)r.busyMs,
+           (unsigned long long)r.totalMl, r.unbounded ? "true" : "false", r.overflow ? "true" : "false");
+  out += b;
+
+  const uint64_t origin = (uint64_t)(p.startDow % 7) * MS_PER_DAY + p.startMsOfDay;
+  for (size_t i = 0; i < r.events.size(); ++i) {
+    const Event&   e   = r.events[i];
+    const uint64_t abs = origin + e.tMs;
+    const uint32_t dow = (uint32_t)((abs / MS_PER_DAY) % 7);
+    const uint32_t sod = (uint32_t)((abs % MS_PER_DAY) / 1000UL);
+    snprintf(b, sizeof(b),
+             "%s{\"t\":%lu,\"d\":%lu,\"at\":\"%02lu:%02lu:%02lu\",\"ev\":\"%s\",\"start\":%d,\"set\":%u,\"step\":%u,\"ml\":%lu}",
+             i ? "," : "", (unsigned long)e.tMs, (unsigned long)dow,
+             (unsigned long)(sod / 3600), (unsigned long)((sod / 60) % 60), (unsigned long)(sod % 60),
+             KIND[(int)e.kind], (int)e.startIdx, (unsigned)e.setIdx, (unsigned)e.step, (unsigned long)e.volumeMl);
+    out += b;
+  }
+  out += "]}";
+  return out;
+}
+
+} // namespace plan
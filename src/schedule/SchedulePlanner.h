@@ -0,0 +1,83 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "IrrigationSchedule.h"
+#include "WindowIndex.h"
+
+// ===================== Planificador en seco (dry-run) =====================
+// Simula el programa sobre un reloj virtual en ms (por defecto 7 días) sin
+// tocar relés, NVS ni millis(): función pura, sirve en el ESP32 (/sched/plan,
+// petición MQTT "plan") y en el host. Reproduce las reglas de AutoMode:
+//   - arranque por StartSpec (dentro de franja si hay franjas) o, a falta de
+//     uno, Set 0 al entrar en una franja (una vez por franja y día),
+//   - objetivos efectivos: ZoneParams (config/ZoneTable) si > 0, si no StepSpec
+//     escalado por el horario,
+//   - transición suave (el agua corre tras 3 etapas de stepDelayMs y el paso
+//     cuenta tiempo/volumen desde la 4ª, con los relés quietos), pausa entre
+//     pasos escalada, relevo sin corte (solape de handoverMs con ambas zonas
+//     abiertas; el paso entrante cuenta desde que termina) y empaquetado
+//     concurrente,
+//   - corte al cerrar la franja (granularidad de minuto, como runScheduled).
+// El volumen se predice con el caudal aprendido de la zona (learnedLph) o, hasta
+// tenerlo, con el declarado (StepSpec::flowLph); sin caudal el paso sólo puede
+// terminar por tiempo y su volumen queda "desconocido". El empaquetado
+// concurrente usa siempre el declarado, como AutoMode.
+namespace plan {
+
+// Objetivos por zona desde ZoneParams (índice = paso del set, como AutoMode); 0 = usar StepSpec
+struct ZoneTarget {
+  uint32_t timeMs   = 0;
+  uint32_t volumeMl = 0;
+};
+
+struct Params {
+  const ProgramSpec*             prog       = nullptr;
+  const WindowIndex::Snapshot*   windows    = nullptr;   // nullptr o vacío = sin restricción
+  const ZoneTarget*              zones      = nullptr;
+  size_t                         nZones     = 0;
+  bool                           flowCalibrated = true;  // sin calibración AutoMode ignora el volumen
+  // Caudal aprendido por zona (FlowMonitor::baselineLph, índice = StepSpec::idx);
+  // 0 o fuera de rango = todavía sin base: se usa el declarado (StepSpec::flowLph)
+  const uint32_t*                learnedLph = nullptr;
+  size_t                         nLearned   = 0;
+  uint32_t stepDelayMs  = 0;                             // espera por etapa de RelayTransition
+  uint8_t  startDow     = 0;                             // origen: 0=Lun..6=Dom
+  uint32_t startMsOfDay = 0;                             // origen: ms desde 00:00
+  uint32_t horizonMs    = 7UL * 24UL * 3600UL * 1000UL;
+  size_t   maxEvents    = 192;                           // tope de la línea de tiempo
+};
+
+enum class Kind : uint8_t {
+  STEP_START,   // la zona arranca (comienza la transición)
+  STEP_END,     // cumple su objetivo de tiempo o volumen
+  TRUNCATED,    // la franja cerró antes (o durante la pausa previa)
+  UNBOUNDED     // sin objetivo alcanzable ni franja que la corte: AutoMode no terminaría
+};
+
+struct Event {
+  uint32_t tMs;        // ms desde el origen
+  Kind     kind;
+  int8_t   startIdx;   // StartSpec que lanzó la corrida (-1 = arranque por franja)
+  uint8_t  setIdx;
+  uint16_t step;       // índice en StepSet::steps
+  uint32_t volumeMl;   // END/TRUNCATED: volumen previsto del paso
+};
+
+struct Result {
+  std::vector<Event> events;
+  uint32_t runs        = 0;
+  uint32_t steps       = 0;   // pasos que arrancan
+  uint32_t truncations = 0;
+  uint32_t unknownVol  = 0;   // pasos sin caudal conocido (volumen no sumado)
+  uint32_t busyMs      = 0;   // tiempo con zona(s) regando
+  uint64_t totalMl     = 0;
+  bool     unbounded   = false;
+  bool     overflow    = false;   // se alcanzó maxEvents (los totales siguen completos)
+};
+
+Result simulate(const Params& p);
+
+// JSON compacto para la WebUI / MQTT
+String toJson(const Result& r, const Params& p);
+
+} // namespace plan
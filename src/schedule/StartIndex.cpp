@@ -0,0 +1,45 @@
+#include "StartIndex.h"
+#include <algorithm>
+#include <string.h>
+
+void StartIndex::clear() {
+  entries_.clear();
+  memset(bits_, 0, sizeof(bits_));
+}
+
+void StartIndex::build(const ProgramSpec* prog) {
+  clear();
+  if (!prog) return;
+
+  for (size_t i = 0; i < prog->starts.size(); ++i) {
+    const StartSpec& st = prog->starts[i];
+    if (!st.enabled || st.hour > 23 || st.minute > 59) continue;
+    for (int d = 0; d < 7; ++d) {
+      if (!(st.dowMask & (1 << d))) continue;
+      const int mow = d * 1440 + st.hour * 60 + st.minute;
+      entries_.push_back(Entry{ (uint16_t)mow, (uint16_t)i });
+      bits_[mow >> 5] |= (1u << (mow & 31));
+    }
+  }
+
+  std::sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) {
+    return (a.mow != b.mow) ? (a.mow < b.mow) : (a.startIdx < b.startIdx);
+  });
+  entries_.shrink_to_fit();
+}
+
+int StartIndex::startAt(int mow) const {
+  if (!hasStartAt(mow)) return -1;
+  auto it = std::lower_bound(entries_.begin(), entries_.end(), mow,
+                             [](const Entry& e, int m) { return (int)e.mow < m; });
+  return (it != entries_.end() && (int)it->mow == mow) ? (int)it->startIdx : -1;
+}
+
+int StartIndex::minutesToNextAfter(int mow) const {
+  if (entries_.empty()) return -1;
+  auto it = std::upper_bound(entries_.begin(), entries_.end(), mow,
+                             [](int m, const Entry& e) { return m < (int)e.mow; });
+  if (it != entries_.end()) return (int)it->mow - mow;
+  // Vuelta de semana: el primero de la línea de tiempo, la semana siguiente
+  return MINUTES_PER_WEEK - mow + (int)entries_.front().mow;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include <time.h>
+#include "IrrigationSchedule.h"
+
+// ===================== Índice semanal de inicios =====================
+// Compila los StartSpec habilitados a una línea de tiempo semanal ordenada
+// (minuto-de-semana -> índice de StartSpec) más un bitmap de 7*1440 bits.
+// Se reconstruye sólo al cambiar el programa (AutoMode::setSchedule).
+//   - hay inicio en este minuto:  O(1) (bitmap)
+//   - cuál inicio / el próximo:   O(log n) (búsqueda binaria)
+// Minuto-de-semana: 0 = Lunes 00:00 ... 10079 = Domingo 23:59 (igual que DOW_*).
+class StartIndex {
+public:
+  static constexpr int MINUTES_PER_WEEK = 7 * 1440;
+
+  void build(const ProgramSpec* prog);
+  void clear();
+
+  bool empty() const { return entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+
+  // O(1): ¿algún inicio habilitado cae en este minuto-de-semana?
+  bool hasStartAt(int mow) const {
+    return mow >= 0 && mow < MINUTES_PER_WEEK && (bits_[mow >> 5] & (1u << (mow & 31))) != 0;
+  }
+
+  // Índice (en prog->starts) del inicio en 'mow', o -1. Con varios en el mismo
+  // minuto devuelve el de menor índice (como el escaneo lineal original).
+  int startAt(int mow) const;
+
+  // Minutos hasta el próximo inicio estrictamente posterior a 'mow'
+  // (1..MINUTES_PER_WEEK; el mismo minuto la semana siguiente cuenta). -1 si no hay.
+  int minutesToNextAfter(int mow) const;
+
+  // tm local -> minuto-de-semana (tm_wday: 0=Dom)
+  static int minuteOfWeek(const struct tm& t) {
+    const int dow = (t.tm_wday + 6) % 7;   // 0=Lun..6=Dom
+    return dow * 1440 + t.tm_hour * 60 + t.tm_min;
+  }
+
+private:
+  struct Entry { uint16_t mow; uint16_t startIdx; };
+  std::vector<Entry> entries_;                          // orden (mow, startIdx)
+  uint32_t           bits_[(MINUTES_PER_WEEK + 31) / 32] = {};
+};
@@ -0,0 +1,76 @@
+#include "WindowIndex.h"
+#include <algorithm>
+#include <string.h>
+
+void WindowIndex::build(const Window* w, int n) {
+  // Buffer inactivo (sólo un escritor)
+  const Snapshot* live = cur_.load(std::memory_order_relaxed);
+  Snapshot& s = (live == &buf_[0]) ? buf_[1] : buf_[0];
+
+  const uint32_t q = seq_.load(std::memory_order_relaxed);
+  seq_.store(q + 1, std::memory_order_relaxed);          // impar: escribiendo
+  std::atomic_thread_fence(std::memory_order_release);
+
+  memset(&s, 0, sizeof(s));
+  for (int i = 0; i < n && s.count < MAX_WINDOWS; ++i) {
+    const Window& src = w[i];
+    if (src.startMin >= src.endMin || src.endMin > 1440 || (src.dowMask & 0x7F) == 0) continue;
+    Window& dst = s.win[s.count];
+    dst = src;
+    dst.name[NAME_LEN - 1] = '\0';
+
+    for (int d = 0; d < 7; ++d) {
+      if (!(dst.dowMask & (1 << d))) continue;
+      s.byDay[d][s.nDay[d]++] = s.count;
+      for (int m = dst.startMin; m < dst.endMin; ++m) s.bits[d][m >> 5] |= (1u << (m & 31));
+    }
+    s.count++;
+  }
+
+  for (int d = 0; d < 7; ++d) {
+    std::sort(&s.byDay[d][0], &s.byDay[d][0] + s.nDay[d], [&s](uint8_t a, uint8_t b) {
+      return s.win[a].startMin < s.win[b].startMin;
+    });
+  }
+
+  cur_.store(&s, std::memory_order_release);
+  seq_.store(q + 2, std::memory_order_release);          // par: estable
+}
+
+const WindowIndex::Window* WindowIndex::Snapshot::current(int dow, int minute) const {
+  if (!inside(dow, minute)) return nullptr;
+  // Última franja del día con inicio <= minute
+  const uint8_t* b = byDay[dow];
+  const uint8_t* e = b + nDay[dow];
+  const uint8_t* it = std::upper_bound(b, e, minute, [this](int m, uint8_t wi) { return m < (int)win[wi].startMin; });
+  while (it != b) {
+    --it;
+    const Window& cand = win[*it];
+    if (minute < (int)cand.endMin) return &cand;
+  }
+  return nullptr;
+}
+
+const WindowIndex::Window* WindowIndex::Snapshot::next(int dow, int minute, int& minutesAhead) const {
+  minutesAhead = -1;
+  if (count == 0 || dow < 0 || dow > 6) return nullptr;
+  for (int k = 0; k <= 7; ++k) {
+    const int d = (dow + k) % 7;
+    const uint8_t* b = byDay[d];
+    const uint8_t* e = b + nDay[d];
+    if (b == e) continue;
+    const uint8_t* it = b;
+    if (k == 0) it = std::upper_bound(b, e, minute, [this](int m, uint8_t wi) { return m < (int)win[wi].startMin; });
+    if (k == 7) it = b;   // mismo día la semana siguiente
+    if (it == e) continue;
+    minutesAhead = k * 1440 + (int)win[*it].startMin - minute;
+    if (minutesAhead <= 0) continue;
+    return &win[*it];
+  }
+  return nullptr;
+}
+
+WindowIndex& windowIndex() {
+  static WindowIndex idx;
+  return idx;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <time.h>
+
+// ===================== Índice de franjas horarias =====================
+// Una foto inmutable (Snapshot) con:
+//   - bitmap de 1440 bits (180 bytes) por día de semana -> "¿dentro?" en O(1)
+//   - por día, las franjas ordenadas por inicio -> actual/próxima en O(log n)
+// La construye la WebUI al guardar franjas (y al arrancar). Doble buffer: se
+// escribe el inactivo y se publica con un puntero atómico.
+//
+// Lectura desde otra tarea (AutoMode en core 0): sólo con las consultas por
+// valor (inside/current/next de WindowIndex), que copian el resultado bajo una
+// secuencia tipo SeqLock y reintentan si se cruzaron con un build(); dos
+// build() seguidos reutilizan el buffer que un lector lento podía estar
+// mirando. snapshot() devuelve una referencia sin esa protección: sólo para la
+// tarea que llama build() (loop(): Home, planificador, MQTT) o un solo hilo
+// (simulador), y nunca se guarda más allá de la llamada.
+// Días: 0 = Lunes ... 6 = Domingo (igual que DOW_* de IrrigationSchedule.h).
+class WindowIndex {
+public:
+  static constexpr int MAX_WINDOWS   = 60;   // igual al tope persistido en NVS
+  static constexpr int NAME_LEN      = 24;
+  static constexpr int WORDS_PER_DAY = (1440 + 31) / 32;
+
+  struct Window {
+    uint16_t startMin;        // [startMin, endMin) sin cruzar medianoche
+    uint16_t endMin;
+    uint8_t  dowMask;         // bit0=Lun..bit6=Dom
+    char     name[NAME_LEN];
+  };
+
+  struct Snapshot {
+    uint8_t  count;                            // franjas válidas (estático: arranca en 0)
+    Window   win[MAX_WINDOWS];
+    uint32_t bits[7][WORDS_PER_DAY];
+    uint8_t  nDay[7];                          // franjas por día
+    uint8_t  byDay[7][MAX_WINDOWS];            // índices en win[], orden por inicio
+
+    bool empty() const { return count == 0; }
+
+    // O(1)
+    bool inside(int dow, int minute) const {
+      if (dow < 0 || dow > 6 || minute < 0 || minute >= 1440) return false;
+      return (bits[dow][minute >> 5] & (1u << (minute & 31))) != 0;
+    }
+    // Franja que contiene (dow, minute) o nullptr
+    const Window* current(int dow, int minute) const;
+    // Próxima franja que EMPIEZA estrictamente después (hasta 7 días); minutesAhead > 0
+    const Window* next(int dow, int minute, int& minutesAhead) const;
+  };
+
+  // Escritor único (WebUI). Descarta rangos inválidos y recorta a MAX_WINDOWS.
+  void build(const Window* w, int n);
+
+  // Sólo la tarea escritora: referencia a la foto vigente (ver arriba)
+  const Snapshot& snapshot() const { return *cur_.load(std::memory_order_acquire); }
+
+  // Cualquier tarea: copias consistentes de la foto vigente
+  bool empty() const { return read_([](const Snapshot& s) { return s.empty(); }); }
+  bool inside(int dow, int minute) const {
+    return read_([&](const Snapshot& s) { return s.inside(dow, minute); });
+  }
+  bool current(int dow, int minute, Window& out) const {
+    return read_([&](const Snapshot& s) {
+      const Window* w = s.current(dow, minute);
+      if (w) out = *w;
+      return w != nullptr;
+    });
+  }
+  bool next(int dow, int minute, Window& out, int& minutesAhead) const {
+    return read_([&](const Snapshot& s) {
+      const Window* w = s.next(dow, minute, minutesAhead);
+      if (w) out = *w;
+      return w != nullptr;
+    });
+  }
+
+  // tm local -> día 0=Lun..6=Dom
+  static int dowOf(const struct tm& t) { return (t.tm_wday + 6) % 7; }
+
+private:
+  // Par = estable; build() la deja impar mientras escribe el buffer inactivo
+  template <typename F>
+  bool read_(F f) const {
+    for (;;) {
+      const uint32_t s1 = seq_.load(std::memory_order_acquire);
+      if (s1 & 1u) continue;
+      const bool r = f(*cur_.load(std::memory_order_acquire));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == s1) return r;
+    }
+  }
+
+  Snapshot                     buf_[2];
+  std::atomic<const Snapshot*> cur_{ &buf_[0] };
+  std::atomic<uint32_t>        seq_{0};
+};
+
+// Índice compartido del proyecto
+WindowIndex& windowIndex();
@@ -0,0 +1,50 @@
+// File: src/schedule/ZonePacker.cpp
+#include "ZonePacker.h"
+
+int flowLineOf(const StepSpec& sp) {
+  const bool s0 = (sp.secsMask & 0x1) != 0;
+  const bool s1 = (sp.secsMask & 0x2) != 0;
+  if (s0 == s1) return -1;        // ninguna o ambas: no separable
+  return s0 ? 0 : 1;
+}
+
+bool zonesCompatible(const StepSpec& a, const StepSpec& b, uint32_t capacityLph) {
+  if (capacityLph == 0) return false;
+  if (a.mainsMask == 0 || b.mainsMask == 0) return false;
+  if (a.flowLph == 0 || b.flowLph == 0) return false;
+  if ((a.mainsMask & b.mainsMask) || (a.secsMask & b.secsMask)) return false;
+
+  const int la = flowLineOf(a), lb = flowLineOf(b);
+  if (la < 0 || lb < 0 || la == lb) return false;
+
+  return (uint32_t)a.flowLph + (uint32_t)b.flowLph <= capacityLph;
+}
+
+std::vector<ZoneSlot> packZones(const std::vector<StepSpec>& steps, uint32_t capacityLph) {
+  std::vector<ZoneSlot> out;
+  out.reserve(steps.size());
+  std::vector<bool> used(steps.size(), false);
+
+  for (size_t i = 0; i < steps.size(); ++i) {
+    if (used[i]) continue;
+    used[i] = true;
+
+    ZoneSlot slot;
+    slot.step[slot.n++] = (uint16_t)i;
+
+    // Best-fit: compañero posterior que deja menos capacidad ociosa
+    int      best     = -1;
+    uint32_t bestLoad = 0;
+    for (size_t j = i + 1; j < steps.size(); ++j) {
+      if (used[j] || !zonesCompatible(steps[i], steps[j], capacityLph)) continue;
+      const uint32_t load = (uint32_t)steps[i].flowLph + steps[j].flowLph;
+      if (best < 0 || load > bestLoad) { best = (int)j; bestLoad = load; }
+    }
+    if (best >= 0) {
+      used[best] = true;
+      slot.step[slot.n++] = (uint16_t)best;
+    }
+    out.push_back(slot);
+  }
+  return out;
+}
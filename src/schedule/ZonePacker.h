@@ -0,0 +1,31 @@
+// File: src/schedule/ZonePacker.h
+#pragma once
+#include <Arduino.h>
+#include <vector>
+#include "IrrigationSchedule.h"
+
+// ===================== Empaquetado de zonas por capacidad hidráulica =====================
+// Agrupa los pasos de un StepSet en "slots" que corren en paralelo.
+// Dos zonas son compatibles si:
+//   - ambas declaran hidráulica (mainsMask != 0 y flowLph > 0),
+//   - no comparten relés MAIN ni SEC,
+//   - miden por caudalímetros distintos (S0 -> línea 1, S1 -> línea 2), para
+//     poder cortar cada una por su propio volumen,
+//   - la suma de caudales esperados cabe en la capacidad de la bomba.
+// Con dos caudalímetros, un slot lleva como mucho 2 zonas.
+//
+// Greedy en orden del set: cada paso no asignado abre un slot y se le suma el
+// compañero compatible posterior que más aprovecha la capacidad (best-fit).
+struct ZoneSlot {
+  static constexpr uint8_t MAX_ZONES = 2;
+  uint8_t  n = 0;
+  uint16_t step[MAX_ZONES] = { 0, 0 };   // índices en StepSet::steps
+};
+
+// Línea de caudal de la zona (0 / 1) o -1 si no se puede medir por separado
+int flowLineOf(const StepSpec& sp);
+
+bool zonesCompatible(const StepSpec& a, const StepSpec& b, uint32_t capacityLph);
+
+// Devuelve los slots en orden de ejecución (cubre todos los pasos una vez)
+std::vector<ZoneSlot> packZones(const std::vector<StepSpec>& steps, uint32_t capacityLph);
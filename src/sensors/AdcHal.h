@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+
+// ===================== Costura HAL del ADC continuo =====================
+// SensorService sólo habla con esta interfaz. En el ESP32 la implementa
+// EspAdcHal (ADC1 en modo continuo con DMA); en host el simulador genera las
+// muestras a la tasa pedida contra el reloj virtual.
+class AdcHal {
+public:
+  static constexpr uint8_t MAX_CH = 2;
+
+  // Una conversión: canal lógico (posición en 'pins' de start()) y valor crudo
+  struct Sample {
+    uint8_t  ch  = 0;
+    uint16_t raw = 0;     // 12 bits
+  };
+
+  virtual ~AdcHal() {}
+
+  // Convierte en bucle los pines dados (pins[i] < 0 = canal apagado) a
+  // sampleHz conversiones/s en total, repartidas por igual entre los canales.
+  virtual bool start(const int* pins, uint8_t n, uint32_t sampleHz) = 0;
+  virtual void stop() = 0;
+
+  // Espera hasta timeoutMs un bloque de conversiones y copia hasta 'max'.
+  // 0 = nada en el plazo.
+  virtual size_t read(Sample* out, size_t max, uint32_t timeoutMs) = 0;
+
+  // Crudo -> mV en el pin (curva de calibración de la plataforma)
+  virtual uint32_t rawToMv(uint16_t raw) const = 0;
+
+  // Bloques perdidos porque nadie leyó a tiempo (desborde del DMA)
+  virtual uint32_t overruns() const = 0;
+};
+
+// Implementación por defecto de la plataforma (EspAdcHal en el ESP32)
+AdcHal& defaultAdcHal();
@@ -0,0 +1,88 @@
+#include "EspAdcHal.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+
+bool EspAdcHal::start(const int* pins, uint8_t n, uint32_t sampleHz) {
+  if (running_) stop();
+  for (int8_t& c : chOfAdc_) c = -1;
+
+  adc_digi_pattern_config_t pattern[AdcHal::MAX_CH] = {};
+  uint16_t mask = 0;
+  uint8_t  np   = 0;
+  for (uint8_t i = 0; i < n && i < AdcHal::MAX_CH; ++i) {
+    if (pins[i] < 0) continue;
+    const int8_t ch = digitalPinToAnalogChannel(pins[i]);
+    if (ch < 0 || ch >= 8) continue;             // sólo ADC1 (GPIO 32..39)
+    chOfAdc_[ch]          = (int8_t)i;
+    mask                 |= (uint16_t)(1u << ch);
+    pattern[np].atten     = ADC_ATTEN_DB_11;
+    pattern[np].channel   = (uint8_t)ch;
+    pattern[np].unit      = 0;                   // ADC1
+    pattern[np].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    np++;
+  }
+  if (np == 0) return false;
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = RING_BYTES;
+  init.conv_num_each_intr = FRAME_BYTES;
+  init.adc1_chan_mask     = mask;
+  init.adc2_chan_mask     = 0;
+  if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+  // El ESP32 no baja de 20 kHz en modo digital
+  if (sampleHz < SOC_ADC_SAMPLE_FREQ_THRES_LOW)  sampleHz = SOC_ADC_SAMPLE_FREQ_THRES_LOW;
+  if (sampleHz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH) sampleHz = SOC_ADC_SAMPLE_FREQ_THRES_HIGH;
+
+  adc_digi_configuration_t dig = {};
+  dig.conv_limit_en  = 1;                        // obligatorio en el ESP32
+  dig.conv_limit_num = 250;
+  dig.pattern_num    = np;
+  dig.adc_pattern    = pattern;
+  dig.sample_freq_hz = sampleHz;
+  dig.conv_mode      = ADC_CONV_SINGLE_UNIT_1;
+  dig.format         = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&dig) != ESP_OK) { adc_digi_deinitialize(); return false; }
+
+  esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, 1100, &cal_);
+  if (adc_digi_start() != ESP_OK) { adc_digi_deinitialize(); return false; }
+  running_ = true;
+  return true;
+}
+
+void EspAdcHal::stop() {
+  if (!running_) return;
+  adc_digi_stop();
+  adc_digi_deinitialize();
+  running_ = false;
+}
+
+size_t EspAdcHal::read(Sample* out, size_t max, uint32_t timeoutMs) {
+  if (!running_ || !out || max == 0) return 0;
+  uint32_t len = 0;
+  const uint32_t want = (max * SOC_ADC_DIGI_RESULT_BYTES < FRAME_BYTES) ? max * SOC_ADC_DIGI_RESULT_BYTES : FRAME_BYTES;
+  const esp_err_t r = adc_digi_read_bytes(buf_, want, &len, timeoutMs);
+  if (r == ESP_ERR_INVALID_STATE) overruns_++;   // el ring se llenó: igual trae datos
+  else if (r != ESP_OK) return 0;
+
+  size_t n = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len && n < max; i += SOC_ADC_DIGI_RESULT_BYTES) {
+    const adc_digi_output_data_t* d = reinterpret_cast<const adc_digi_output_data_t*>(&buf_[i]);
+    const uint8_t ch = d->type1.channel;
+    if (ch >= 8 || chOfAdc_[ch] < 0) continue;
+    out[n].ch  = (uint8_t)chOfAdc_[ch];
+    out[n].raw = d->type1.data;
+    n++;
+  }
+  return n;
+}
+
+uint32_t EspAdcHal::rawToMv(uint16_t raw) const {
+  return esp_adc_cal_raw_to_voltage(raw, &cal_);
+}
+
+AdcHal& defaultAdcHal() {
+  static EspAdcHal hal;
+  return hal;
+}
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#include "AdcHal.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+
+// ADC1 continuo del ESP32 (API adc_digi_* de IDF 4.4): patrón con los canales
+// pedidos, 11 dB (0..~3.1 V), 12 bits, salida TYPE1 por DMA. El driver junta
+// FRAME_BYTES por interrupción en su ring buffer; read() bloquea en él sin
+// gastar CPU. Sólo ADC1: ADC2 lo usa el Wi-Fi.
+class EspAdcHal : public AdcHal {
+public:
+  static constexpr uint32_t FRAME_BYTES = 256;          // conversiones * 2 bytes
+  static constexpr uint32_t RING_BYTES  = 4 * FRAME_BYTES;
+
+  bool start(const int* pins, uint8_t n, uint32_t sampleHz) override;
+  void stop() override;
+  size_t read(Sample* out, size_t max, uint32_t timeoutMs) override;
+  uint32_t rawToMv(uint16_t raw) const override;
+  uint32_t overruns() const override { return overruns_; }
+
+private:
+  bool                          running_  = false;
+  int8_t                        chOfAdc_[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };  // ADC1_CHx -> canal lógico
+  uint8_t                       buf_[FRAME_BYTES];
+  esp_adc_cal_characteristics_t cal_ {};
+  uint32_t                      overruns_ = 0;
+};
+#endif
@@ -0,0 +1,91 @@
+#include "SensorService.h"
+#include <math.h>
+
+const char* SensorService::name(Kind k) {
+  switch (k) {
+    case Kind::PRESSURE: return "pressure";
+    case Kind::LEVEL:    return "level";
+    default:             return "off";
+  }
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+// Tarea del servicio: bloquea en el ring del DMA, nunca en la tarea de riego
+static void sensorTask_(void* arg) {
+  SensorService* self = static_cast<SensorService*>(arg);
+  for (;;) {
+    if (self->pump(100) == 0) vTaskDelay(1);
+  }
+}
+#endif
+
+bool SensorService::begin(const Config& cfg) {
+  if (running_) return true;
+  cfg_ = cfg;
+  if (cfg_.decimation == 0) cfg_.decimation = 1;
+  if (!(cfg_.iirAlpha > 0.f) || cfg_.iirAlpha > 1.f) cfg_.iirAlpha = 1.f;
+
+  int pins[NUM_CH];
+  bool any = false;
+  for (int ch = 0; ch < NUM_CH; ++ch) {
+    pins[ch] = (cfg_.ch[ch].kind != Kind::OFF) ? pin_[ch] : -1;
+    work_.ch[ch].kind = cfg_.ch[ch].kind;
+    any |= pins[ch] >= 0;
+  }
+  snap_.publish(work_);
+  if (!any) return true;
+  if (!hal_.start(pins, NUM_CH, cfg_.sampleHz)) return false;
+  running_ = true;
+
+#if defined(ARDUINO_ARCH_ESP32)
+  xTaskCreatePinnedToCore(sensorTask_, "sensorTask", 3072, this, 1, nullptr, 1);
+#endif
+  return true;
+}
+
+size_t SensorService::pump(uint32_t timeoutMs) {
+  if (!running_) return 0;
+  const size_t n = hal_.read(buf_, BATCH, timeoutMs);
+
+  bool out = false;
+  for (size_t i = 0; i < n; ++i) {
+    const AdcHal::Sample& s = buf_[i];
+    if (s.ch >= NUM_CH) continue;
+    Acc& a = acc_[s.ch];
+    a.sum += s.raw;
+    if (++a.n < cfg_.decimation) continue;
+
+    // Salida diezmada -> mV -> IIR -> unidades
+    const uint16_t raw = (uint16_t)((a.sum + a.n / 2) / a.n);
+    a.sum = 0;
+    a.n   = 0;
+    const float mv = (float)hal_.rawToMv(raw);
+    a.iir    = a.primed ? a.iir + cfg_.iirAlpha * (mv - a.iir) : mv;
+    a.primed = true;
+
+    const Channel& c = cfg_.ch[s.ch];
+    const float span = (float)c.fullMv - (float)c.zeroMv;
+    Reading& r = work_.ch[s.ch];
+    r.valid = true;
+    r.mv    = (uint16_t)lroundf(a.iir);
+    r.value = (span != 0.f) ? (a.iir - (float)c.zeroMv) * c.fullScale / span : 0.f;
+    r.atMs  = millis();
+    work_.outputs++;
+    out = true;
+  }
+  if (out) {
+    work_.overruns = hal_.overruns();
+    snap_.publish(work_);
+  }
+  return n;
+}
+
+bool SensorService::latest(Kind kind, float& out, uint32_t nowMs) const {
+  const Snapshot s = snap_.read();
+  for (const Reading& r : s.ch) {
+    if (r.kind != kind || !r.valid || (uint32_t)(nowMs - r.atMs) > STALE_MS) continue;
+    out = r.value;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <Arduino.h>
+#include "AdcHal.h"
+#include "../core/SeqLock.h"
+
+// ===================== Sensores analógicos (presión / nivel) =====================
+// Muestrea PIN_FLOW_VP / PIN_FLOW_VN con el ADC continuo (DMA): el hardware
+// convierte solo y la tarea del servicio (core 1, baja prioridad) despierta una
+// vez por bloque DMA. Por canal:
+//   1) diezmado: promedio de 'decimation' conversiones (quita el ruido del ADC)
+//   2) IIR de 1er orden sobre cada salida diezmada (iirAlpha)
+//   3) mV -> kPa o % con la recta de dos puntos (zeroMv, fullMv -> fullScale)
+// Las lecturas se publican por SeqLock: AutoMode y la telemetría las copian sin
+// locks y la tarea de riego no filtra ni espera al ADC.
+class SensorService {
+public:
+  static constexpr int      NUM_CH   = AdcHal::MAX_CH;
+  static constexpr uint32_t STALE_MS = 2000;   // una lectura más vieja no vale
+
+  enum class Kind : uint8_t { OFF = 0, PRESSURE = 1, LEVEL = 2 };   // kPa / %
+  static const char* name(Kind k);
+
+  struct Channel {
+    Kind     kind      = Kind::OFF;
+    uint16_t zeroMv    = 330;      // mV en el pin a 0
+    uint16_t fullMv    = 3000;     // mV en el pin a fondo de escala
+    float    fullScale = 1000.f;   // kPa (PRESSURE) o % (LEVEL) en fullMv
+  };
+  struct Config {
+    uint32_t sampleHz   = 20000;   // conversiones/s totales (ESP32: mín. 20 kHz)
+    uint16_t decimation = 1000;    // conversiones promediadas por salida (por canal)
+    float    iirAlpha   = 0.2f;    // peso de cada salida diezmada
+    Channel  ch[NUM_CH];
+  };
+  struct Reading {
+    Kind     kind  = Kind::OFF;
+    bool     valid = false;
+    uint16_t mv    = 0;
+    float    value = 0.f;          // kPa o %
+    uint32_t atMs  = 0;            // millis() de la última salida
+  };
+  struct Snapshot {
+    Reading  ch[NUM_CH];
+    uint32_t outputs  = 0;         // salidas diezmadas (ambos canales)
+    uint32_t overruns = 0;         // bloques DMA perdidos
+  };
+
+  SensorService(AdcHal& hal, int pinVp, int pinVn) : hal_(hal), pin_{ pinVp, pinVn } {}
+
+  // Arranca el muestreo con 'cfg' (ESP32: y la tarea propia en core 1). Sin
+  // canales habilitados no toca el ADC. false = el HAL no arrancó.
+  bool begin(const Config& cfg);
+  bool running() const { return running_; }
+
+  // Procesa un bloque del DMA (espera hasta timeoutMs). La tarea lo llama en
+  // bucle; en host lo llama el simulador. Devuelve conversiones procesadas.
+  size_t pump(uint32_t timeoutMs);
+
+  // ---- Lectores (cualquier core, sin locks) ----
+  Snapshot snapshot() const { return snap_.read(); }
+  // Valor del primer canal de ese tipo con lectura fresca
+  bool latest(Kind kind, float& out, uint32_t nowMs) const;
+
+private:
+  static constexpr size_t BATCH = 128;   // = bloque DMA del ESP32
+
+  struct Acc {
+    uint32_t sum    = 0;
+    uint16_t n      = 0;
+    float    iir    = 0.f;
+    bool     primed = false;
+  };
+
+  AdcHal&          hal_;
+  const int        pin_[NUM_CH];
+  Config           cfg_;
+  bool             running_ = false;
+  Acc              acc_[NUM_CH];
+  AdcHal::Sample   buf_[BATCH];
+  Snapshot         work_;              // sólo el escritor (pump)
+  SeqLock<Snapshot> snap_;
+};
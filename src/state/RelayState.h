@@ -7,10 +7,12 @@
 // - mainsMask: bits de los relés "principales" (12 bits típicamente). Bit i=1 => MAIN i encendido
 // - secsMask:  bits de los relés "secundarios" (2 bits típicamente). Bit j=1 => SEC j encendido
 // - alwaysOn / alwaysOn12: si se deben activar las líneas de habilitación
+// - flowLph: caudal esperado de la zona en L/h (0 = desconocido; modo concurrente)
 struct RelayState {
   String   name;
   uint16_t mainsMask = 0;
   uint16_t secsMask  = 0;
   bool     alwaysOn  = false;
   bool     alwaysOn12= false;
+  uint16_t flowLph   = 0;
 };
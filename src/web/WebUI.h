@@ -8,8 +8,10 @@
 #include <vector>
 
 #include "../mqtt/MqttChat.h"
+#include "../mqtt/CommandChannel.h"
 #include "../config/MqttConfig.h"
 #include "../config/MqttConfigStore.h"
+#include "../config/ZoneTable.h"        // ZoneParams
 #include "../modes/AutoMode.h"          // StartSpec / StepSpec
 #include "../state/RelayState.h"        // RelayState
 
@@ -24,6 +26,8 @@ public:
   void begin();
   void loop();
   void attachMqttSink();
+  // Métricas del canal de comandos MQTT en /metrics (opcional)
+  void attachCommandChannel(const CommandChannel* cc) { cmdChannel_ = cc; }
 
   // ======== API de Schedule ========
   void attachScheduleAPI(
@@ -61,13 +65,29 @@ public:
     relayNameGetter_ = relayNameGetter;
   }
 
-  // ----------------- Estructuras públicas útiles -----------------
-  struct ZoneParams {
-    uint32_t volumeMl = 0;
-    uint32_t timeMs   = 0;
-    uint8_t  fert1Pct = 0;
-    uint8_t  fert2Pct = 0;
+  // ======== API de hidráulica (riego concurrente, /riego) ========
+  struct Hydraulics {
+    bool     concurrent      = false;
+    uint32_t pumpCapacityLph = 0;
+    uint32_t handoverMs      = 0;   // solape entre zonas (make-before-break)
   };
+  void attachHydraulicsAPI(
+    std::function<Hydraulics()>                  getter,
+    std::function<bool(const Hydraulics&)>       setter
+  ) {
+    getHydraulics_ = getter;
+    setHydraulics_ = setter;
+  }
+
+  // ======== Planificador en seco (/sched/plan y MQTT "plan") ========
+  // Devuelve el JSON de schedule/SchedulePlanner.h con a lo sumo maxEvents eventos.
+  void attachPlanAPI(std::function<String(size_t maxEvents)> planJson) {
+    planJson_ = planJson;
+  }
+
+  // ----------------- Estructuras públicas útiles -----------------
+  // Objetivos por zona (config/ZoneTable.h: NVS "zones" cargada en RAM)
+  using ZoneParams = ZoneTable::Zone;
 
   // ======== Franjas horarias ========
   struct TimeWindow {
@@ -76,6 +96,7 @@ public:
     uint8_t sm = 0;  // start minute [0..59]
     uint8_t eh = 0;  // end hour
     uint8_t em = 0;  // end minute
+    uint8_t dowMask = 0x7F;  // días activos: bit0=Lun..bit6=Dom (por defecto todos)
   };
 
 private:
@@ -88,7 +109,6 @@ private:
 
   // Namespaces de Preferences
   static constexpr const char* NS_WIFI    = "wifi_saved";
-  static constexpr const char* NS_ZONES   = "zones";
   static constexpr const char* NS_MODE    = "mode";
   static constexpr const char* NS_WINDOWS = "windows";
 
@@ -125,6 +145,13 @@ private:
 
   void pushMsg_(const String& t, const String& p);
 
+  // MQTT "order <zona> [mL] [ms] [urgente]" -> cola de AutoMode
+  void handleMqttOrder_(const String& args);
+
+  // Eventos del plan que caben en una respuesta MQTT
+  static constexpr size_t MQTT_PLAN_EVENTS = 6;
+  static constexpr size_t WEB_PLAN_EVENTS  = 192;
+
   // ---------- HTML helpers ----------
   String htmlHeader(const String& title) const;
   String htmlFooter() const;
@@ -142,10 +169,13 @@ private:
   void handleMqttSet();
   void handleMqttPublish();
   void handleMqttPoll();
+  void handleMetrics();                // GET /metrics (texto Prometheus)
 
-  // Riego / Telemetría (placeholder)
+  // Riego / Telemetría
   void handleIrrigation();
   void handleIrrigationJson();
+  void handleIrrigationHydraulics();   // POST /riego/hydraulics
+  void handleIrrigationOrder();        // POST /riego/order (riego a demanda)
 
   // ESTADOS (tabla)
   void handleStatesList();
@@ -167,6 +197,9 @@ private:
   void handleStepsPage();             // vista de pasos (StepSet 0)
   void handleStepsSave();             // guardar pasos
 
+  // Dry-run de 7 días (/sched/plan?max=N)
+  void handleSchedPlan();
+
   // ======= Modo (Manual/Auto + control manual por SW) =======
   void handleMode();
   void handleModeSet();
@@ -183,12 +216,15 @@ private:
   bool saveTimeWindows(const std::vector<TimeWindow>& v);
   bool windowsOverlap(const TimeWindow& a, const TimeWindow& b) const;
   bool validateNoOverlap(const std::vector<TimeWindow>& v, const TimeWindow& cand, int ignoreIndex) const;
+  // Publica las franjas en el índice por día (schedule/WindowIndex.h)
+  void rebuildWindowIndex_(const std::vector<TimeWindow>& v);
 
 private:
   WebServer&        server_;
   MqttChat&         chat_;
   MqttConfig&       cfg_;
   MqttConfigStore&  cfgStore_;
+  const CommandChannel* cmdChannel_ = nullptr;
 
   // Schedule API
   std::function<bool()>                              getProgramEnabled_;
@@ -198,6 +234,13 @@ private:
   std::function<bool(unsigned)>                      deleteStart_;
   std::function<std::vector<StepSpec>()>             getSteps_;
   std::function<bool(const std::vector<StepSpec>&)>  setSteps_;
+
+  // Hidráulica API
+  std::function<Hydraulics()>                        getHydraulics_;
+  std::function<bool(const Hydraulics&)>             setHydraulics_;
+
+  // Plan API
+  std::function<String(size_t)>                      planJson_;
   std::function<String()>                            nowStrProvider_;
   std::function<bool(const std::vector<StartSpec>&)> setStartsBulk_;
 
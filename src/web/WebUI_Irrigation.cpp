@@ -1,15 +1,152 @@
 // File: src/web/WebUI_Irrigation.cpp
 #include "web/WebUI.h"
+#include "modes/modes.h"   // órdenes a demanda + telemetría de AutoMode
 
 void WebUI::handleIrrigation() {
   String s = htmlHeader(F("Riego"));
   s += F("<h3>Estado (resumen)</h3>");
   s += F("<p>Ver <a href='/states'>Estados</a> para configurar combinaciones de relés.</p>");
+
+  // Hidráulica: riego concurrente (capacidad de la bomba) y relevo entre zonas
+  if (getHydraulics_) {
+    const Hydraulics h = getHydraulics_();
+    s += F("<div class='formcard'><h4>Hidráulica</h4>");
+    s += F("<form method='post' action='/riego/hydraulics'>");
+    s += F("<p><label><input type='checkbox' name='conc'");
+    if (h.concurrent) s += F(" checked");
+    s += F("> Regar zonas compatibles a la vez</label></p>");
+    s += F("<p>Capacidad bomba/línea: <input type='number' name='cap' min='0' step='1' value='");
+    s += String(h.pumpCapacityLph);
+    s += F("'> L/h</p>");
+    s += F("<p>Solape entre zonas: <input type='number' name='ovl' min='0' step='100' value='");
+    s += String(h.handoverMs);
+    s += F("'> ms <small>(abre la zona siguiente antes de cerrar la actual, sin pausa; 0 = corte clásico)</small></p>");
+    s += F("<p><small>Dos zonas van juntas si no comparten relés, miden por caudalímetros distintos "
+           "(S0/S1) y la suma de sus caudales esperados (ver cada zona en Estados) cabe en la capacidad.</small></p>");
+    s += F("<p><button class='btn'>Guardar</button></p></form></div>");
+  }
+
+  // Riego a demanda: la orden entra a la cola de AutoMode (sin cambiar de modo)
+  if (getStates_) {
+    const std::vector<RelayState> states = getStates_();
+    const AutoMode::Tele t = getAutoTelemetry();
+    s += F("<div class='formcard'><h4>Regar ahora</h4>");
+    s += F("<form method='post' action='/riego/order'>");
+    s += F("<p>Zona: <select name='zone'>");
+    for (size_t i = 0; i < states.size(); ++i) {
+      s += F("<option value='");
+      s += String((int)i);
+      s += F("'>");
+      if (states[i].name.length()) s += states[i].name;
+      else { s += F("Zona "); s += String((int)i); }
+      s += F("</option>");
+    }
+    s += F("</select></p>");
+    s += F("<p>Volumen: <input type='number' name='ml' min='0' step='1' value='0'> mL &nbsp; "
+           "Tiempo: <input type='number' name='ms' min='0' step='1000' value='0'> ms "
+           "<small>(0 = lo configurado en la zona)</small></p>");
+    s += F("<p><label><input type='checkbox' name='urgent'> Urgente (antes que las demás en cola)</label></p>");
+    s += F("<p><button class='btn'>Encolar</button></p></form>");
+    s += F("<p><small>En cola: ");
+    s += String(t.orderBacklog);
+    s += F(" &middot; hechas: ");
+    s += String(t.ordersDone);
+    s += F(" &middot; rechazadas: ");
+    s += String(t.ordersRejected);
+    s += F(" &middot; espera última/máx: ");
+    s += String(t.orderQueueMs);
+    s += F("/");
+    s += String(t.orderQueueMaxMs);
+    s += F(" ms</small></p></div>");
+  }
+
+  if (planJson_) {
+    s += F("<p><a href='/sched/plan'>Plan de los próximos 7 días (JSON)</a>: inicios y fines previstos, "
+           "cortes por cierre de franja y volumen total.</p>");
+  }
+
   s += htmlFooter();
   server_.send(200, F("text/html; charset=utf-8"), s);
 }
 
 void WebUI::handleIrrigationJson() {
-  String out = F("{\"ok\":true}");
+  const AutoMode::Tele t = getAutoTelemetry();
+  String out = F("{\"ok\":true,\"running\":");
+  out += t.running ? F("true") : F("false");
+  out += F(",\"step\":");            out += String(t.stepIndex);
+  out += F(",\"orders\":{\"zone\":"); out += String(t.orderZone);
+  out += F(",\"backlog\":");         out += String(t.orderBacklog);
+  out += F(",\"done\":");            out += String(t.ordersDone);
+  out += F(",\"rejected\":");        out += String(t.ordersRejected);
+  out += F(",\"dropped\":");         out += String(t.ordersDropped);
+  out += F(",\"queue_ms\":");        out += String(t.orderQueueMs);
+  out += F(",\"queue_max_ms\":");    out += String(t.orderQueueMaxMs);
+  out += F("}}");
   server_.send(200, F("application/json"), out);
 }
+
+void WebUI::handleIrrigationOrder() {
+  const int zone = server_.hasArg("zone") ? server_.arg("zone").toInt() : -1;
+  if (zone < 0) { server_.send(400, F("text/plain"), F("zona inválida")); return; }
+  const uint32_t ml = server_.hasArg("ml") ? (uint32_t)strtoul(server_.arg("ml").c_str(), nullptr, 10) : 0;
+  const uint32_t ms = server_.hasArg("ms") ? (uint32_t)strtoul(server_.arg("ms").c_str(), nullptr, 10) : 0;
+
+  OrderEnqueue why = OrderEnqueue::OK;
+  if (!modesEnqueueOrder(zone, ml, ms, server_.hasArg("urgent"), &why)) {
+    if (why == OrderEnqueue::BAD_ZONE) server_.send(400, F("text/plain"), F("zona inválida"));
+    else                               server_.send(503, F("text/plain"), F("cola de órdenes llena"));
+    return;
+  }
+  server_.sendHeader(F("Location"), "/riego");
+  server_.send(302, F("text/plain"), "ok");
+}
+
+// "order <zona> [mL] [ms] [urgente]": responde en el tópico de publicación
+void WebUI::handleMqttOrder_(const String& args) {
+  long v[3] = { -1, 0, 0 };
+  bool urgent = false;
+  int n = 0, from = 0;
+  while (from < (int)args.length()) {
+    int sp = args.indexOf(' ', from);
+    if (sp < 0) sp = args.length();
+    const String tok = args.substring(from, sp);
+    from = sp + 1;
+    if (!tok.length()) continue;
+    if (tok == "urgente" || tok == "urgent") urgent = true;
+    else if (n < 3) v[n++] = tok.toInt();
+  }
+
+  OrderEnqueue why = OrderEnqueue::BAD_ZONE;
+  const uint32_t id = (v[0] >= 0) ? modesEnqueueOrder((int)v[0], (uint32_t)max(v[1], 0L), (uint32_t)max(v[2], 0L), urgent, &why) : 0;
+  String out = F("{\"event\":\"order\",\"ok\":");
+  out += id ? F("true") : F("false");
+  if (!id) { out += F(",\"reason\":"); out += (why == OrderEnqueue::BAD_ZONE) ? F("\"bad_zone\"") : F("\"queue_full\""); }
+  out += F(",\"id\":");      out += String(id);
+  out += F(",\"zone\":");    out += String(v[0]);
+  out += F(",\"backlog\":"); out += String(modesOrderBacklog());
+  out += F("}");
+  (void)chat_.publish(out);
+}
+
+void WebUI::handleSchedPlan() {
+  if (!planJson_) { server_.send(500, F("text/plain"), F("Plan API no inicializada")); return; }
+  size_t maxEv = WEB_PLAN_EVENTS;
+  if (server_.hasArg("max")) {
+    const unsigned long n = strtoul(server_.arg("max").c_str(), nullptr, 10);
+    if (n < maxEv) maxEv = (size_t)n;
+  }
+  server_.send(200, F("application/json"), planJson_(maxEv));
+}
+
+void WebUI::handleIrrigationHydraulics() {
+  if (!setHydraulics_) { server_.send(500, F("text/plain"), F("Hydraulics API no inicializada")); return; }
+
+  Hydraulics h;
+  h.concurrent      = server_.hasArg("conc");
+  h.pumpCapacityLph = server_.hasArg("cap") ? (uint32_t)strtoul(server_.arg("cap").c_str(), nullptr, 10) : 0;
+  h.handoverMs      = server_.hasArg("ovl") ? (uint32_t)strtoul(server_.arg("ovl").c_str(), nullptr, 10) : 0;
+
+  bool ok = setHydraulics_(h);
+  server_.sendHeader(F("Location"), "/riego");
+  server_.send(302, F("text/plain"), ok ? "ok" : "fail");
+}
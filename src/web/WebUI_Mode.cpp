@@ -1,7 +1,8 @@
 // File: src/web/WebUI_Mode.cpp
 #include "web/WebUI.h"
 #include <Preferences.h>
-#include "modes/modes.h"         // manualWeb_* , resetFullMode, ManualTelemetry
+#include "modes/modes.h"         // manualWeb_* , ManualTelemetry
+#include "core/ControlSignals.h" // aviso inmediato a irrigationTask
 #include "../state/RelayState.h"
 
 // Namespace de persistencia para la página de Modo
@@ -150,6 +151,7 @@ void WebUI::handleModeSet() {
     p.putUChar("manual", manual ? 1 : 0);
     p.end();
   }
+  ctl::postModeOverride(ovr, manual);   // efecto inmediato (sin sondeo de NVS)
 
   server_.sendHeader(F("Location"), "/mode");
   server_.send(302, F("text/plain"), "");
@@ -180,8 +182,9 @@ void WebUI::handleModeManualStart() {
     }
   }
 
-  resetFullMode();
-  manualWeb_startState(rs);
+  // irrigationTask pasa a MANUAL y aplica el latch (reset + start) en su core
+  ctl::postModeOverride(true, true);
+  manualWeb_startState(rs, p1, p2);
 
   server_.sendHeader(F("Location"), "/mode");
   server_.send(302, F("text/plain"), "");
@@ -77,3 +77,55 @@ void WebUI::handleMqttPoll() {
   out += F("]}");
   server_.send(200, F("application/json"), out);
 }
+
+// Métricas de MQTT y del outbox de eventos en formato de exposición de Prometheus
+static void metric_(String& s, const char* name, const char* type, const char* help, double v) {
+  s += F("# HELP "); s += name; s += ' '; s += help; s += '\n';
+  s += F("# TYPE "); s += name; s += ' '; s += type; s += '\n';
+  s += name; s += ' '; s += String(v, (v == (double)(uint32_t)v) ? 0 : 4); s += '\n';
+}
+
+void WebUI::handleMetrics() {
+  const MqttChat::Stats m = chat_.stats();
+  String s;
+  s.reserve(2048);
+  metric_(s, "riego_mqtt_up",                 "gauge",   "Enlace MQTT arriba", chat_.connected() ? 1 : 0);
+  metric_(s, "riego_mqtt_connect_attempts_total", "counter", "Intentos de conexion", m.attempts);
+  metric_(s, "riego_mqtt_connect_failures_total", "counter", "Conexiones fallidas", m.failures);
+  metric_(s, "riego_mqtt_connect_last_ms",    "gauge",   "Duracion del ultimo connect exitoso", m.lastConnectMs);
+  metric_(s, "riego_mqtt_connect_max_ms",     "gauge",   "Duracion maxima de connect", m.maxConnectMs);
+  metric_(s, "riego_mqtt_outage_last_ms",     "gauge",   "Ultima caida hasta reconectar", m.lastOutageMs);
+  metric_(s, "riego_mqtt_sent_total",         "counter", "Publicaciones enviadas", m.sent);
+  metric_(s, "riego_mqtt_dropped_total",      "counter", "Publicaciones descartadas por cola llena", m.dropped);
+  metric_(s, "riego_mqtt_queue_depth",        "gauge",   "Publicaciones en cola RAM", m.outbox);
+
+  if (const EventOutbox* ob = chat_.outbox()) {
+    const EventOutbox::Stats o = ob->stats();
+    // Entregados sobre finalizados (entregados + perdidos por disco lleno)
+    const uint32_t done = o.delivered + o.evicted;
+    metric_(s, "riego_outbox_appended_total",  "counter", "Eventos anexados al outbox", o.appended);
+    metric_(s, "riego_outbox_delivered_total", "counter", "Eventos confirmados", o.delivered);
+    metric_(s, "riego_outbox_evicted_total",   "counter", "Eventos descartados sin entregar", o.evicted);
+    metric_(s, "riego_outbox_replayed_total",  "counter", "Reenvios", o.replayed);
+    metric_(s, "riego_outbox_direct_total",    "counter", "Eventos anexados por el productor (cola durable llena)", m.durableDirect);
+    metric_(s, "riego_outbox_bad_acks_total",  "counter", "Acks de seq nunca enviados (ignorados)", o.badAcks);
+    metric_(s, "riego_outbox_backlog",         "gauge",   "Eventos en flash sin confirmar", o.backlog);
+    metric_(s, "riego_outbox_delivery_ratio",  "gauge",   "Entregados / (entregados + descartados)",
+            done ? (double)o.delivered / (double)done : 1.0);
+    metric_(s, "riego_outbox_bytes",           "gauge",   "Bytes ocupados en flash", o.bytes);
+    metric_(s, "riego_outbox_ack_mode",        "gauge",   "El consumidor confirma con ack", o.ackMode ? 1 : 0);
+  }
+
+  if (cmdChannel_) {
+    const CommandChannel::Stats c = cmdChannel_->stats();
+    metric_(s, "riego_cmd_received_total",     "counter", "Comandos recibidos por MQTT", c.received);
+    metric_(s, "riego_cmd_errors_total",       "counter", "Comandos invalidos", c.errors);
+    metric_(s, "riego_cmd_dropped_total",      "counter", "Comandos descartados por cola llena", c.dropped);
+    metric_(s, "riego_cmd_executed_total",     "counter", "Comandos con respuesta final", c.executed);
+    metric_(s, "riego_cmd_timeouts_total",     "counter", "Comandos sin respuesta de AutoMode", c.timeouts);
+    metric_(s, "riego_cmd_latency_last_ms",    "gauge",   "Recepcion hasta reles comandados (ultimo)", c.lastLatencyMs);
+    metric_(s, "riego_cmd_latency_max_ms",     "gauge",   "Recepcion hasta reles comandados (maximo)", c.maxLatencyMs);
+    metric_(s, "riego_cmd_latency_avg_ms",     "gauge",   "Recepcion hasta reles comandados (media movil)", c.avgLatencyMs);
+  }
+  server_.send(200, F("text/plain; version=0.0.4"), s);
+}
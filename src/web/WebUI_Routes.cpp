@@ -2,6 +2,13 @@
 #include "web/WebUI.h"
 
 void WebUI::begin() {
+  // Índice de franjas en RAM (lo consultan AutoMode y la Home sin tocar NVS)
+  {
+    std::vector<TimeWindow> ws;
+    (void)loadTimeWindows(ws);
+    rebuildWindowIndex_(ws);
+  }
+
   // Home + Wi-Fi
   server_.on("/",               HTTP_GET,  [this]{ handleRoot(); });
   server_.on("/wifi/info",      HTTP_GET,  [this]{ handleWifiInfo(); });
@@ -15,6 +22,7 @@ void WebUI::begin() {
   server_.on("/mqtt/set",       HTTP_POST, [this]{ handleMqttSet(); });
   server_.on("/mqtt/publish",   HTTP_POST, [this]{ handleMqttPublish(); });
   server_.on("/mqtt/poll",      HTTP_GET,  [this]{ handleMqttPoll(); });
+  server_.on("/metrics",        HTTP_GET,  [this]{ handleMetrics(); });
 
   // Modo (Manual/Auto + control manual SW)
   server_.on("/mode",              HTTP_GET,  [this]{ handleMode(); });
@@ -25,6 +33,9 @@ void WebUI::begin() {
   // Riego (placeholder)
   server_.on("/riego",          HTTP_GET,  [this]{ handleIrrigation(); });
   server_.on("/riego.json",     HTTP_GET,  [this]{ handleIrrigationJson(); });
+  server_.on("/riego/hydraulics", HTTP_POST, [this]{ handleIrrigationHydraulics(); });
+  server_.on("/riego/order",    HTTP_POST, [this]{ handleIrrigationOrder(); });
+  server_.on("/sched/plan",     HTTP_GET,  [this]{ handleSchedPlan(); });
 
   // Estados
   server_.on("/states",         HTTP_GET,  [this]{ handleStatesList(); });
@@ -48,6 +59,11 @@ void WebUI::loop() {
 }
 
 void WebUI::attachMqttSink() {
-  chat_.onMessage([this](const String& t, const String& p){ pushMsg_(t, p); });
+  chat_.onMessage([this](const String& t, const String& p){
+    pushMsg_(t, p);
+    // Petición de plan: respuesta corta (buffer de PubSubClient) al tópico de publicación
+    if (p == "plan" && planJson_) (void)chat_.publish(planJson_(MQTT_PLAN_EVENTS));
+    else if (p.startsWith("order ")) handleMqttOrder_(p.substring(6));
+  });
   chat_.subscribe();
 }
@@ -1,86 +1,18 @@
 // File: src/web/WebUI_States.cpp
 #include "web/WebUI.h"
-#include <Preferences.h>
 
-/* ===== Persistencia de parámetros por zona ===== */
+/* ===== Parámetros por zona: los guarda config/ZoneTable (NVS + RAM) ===== */
 bool WebUI::loadZoneParams(int idx, ZoneParams& out) {
   if (idx < 0) return false;
-  Preferences p;
-  if (!p.begin(NS_ZONES, true)) return false;
-  String base = String("z") + String(idx) + "_";
-  out.volumeMl = p.getUInt((base + "vol").c_str(), 0);
-  out.timeMs   = p.getUInt((base + "time").c_str(), 0);
-  out.fert1Pct = p.getUChar((base + "f1").c_str(), 0);
-  out.fert2Pct = p.getUChar((base + "f2").c_str(), 0);
-  p.end();
+  out = zoneTable().get(idx);
   return true;
 }
-bool WebUI::saveZoneParams(int idx, const ZoneParams& z) {
-  if (idx < 0) return false;
-  Preferences p;
-  if (!p.begin(NS_ZONES, false)) return false;
-  String base = String("z") + String(idx) + "_";
-  p.putUInt ((base + "vol").c_str(),  z.volumeMl);
-  p.putUInt ((base + "time").c_str(), z.timeMs);
-  p.putUChar((base + "f1").c_str(),   z.fert1Pct);
-  p.putUChar((base + "f2").c_str(),   z.fert2Pct);
-  int count = p.getInt("count", 0);
-  if (idx + 1 > count) p.putInt("count", idx + 1);
-  p.end();
-  return true;
-}
-bool WebUI::deleteZoneParams(int idx) {
-  if (idx < 0) return false;
-  Preferences p;
-  if (!p.begin(NS_ZONES, false)) return false;
-  String base = String("z") + String(idx) + "_";
-  p.remove((base + "vol").c_str());
-  p.remove((base + "time").c_str());
-  p.remove((base + "f1").c_str());
-  p.remove((base + "f2").c_str());
-  p.end();
-  return true;
-}
-int WebUI::getZonesCount() {
-  Preferences p;
-  if (!p.begin(NS_ZONES, true)) return 0;
-  int c = p.getInt("count", 0);
-  p.end();
-  return c;
-}
-void WebUI::setZonesCount(int count) {
-  Preferences p;
-  if (!p.begin(NS_ZONES, false)) return;
-  p.putInt("count", count < 0 ? 0 : count);
-  p.end();
-}
+bool WebUI::saveZoneParams(int idx, const ZoneParams& z) { return zoneTable().save(idx, z); }
+bool WebUI::deleteZoneParams(int idx)                    { return zoneTable().erase(idx); }
+int  WebUI::getZonesCount()                              { return zoneTable().count(); }
+void WebUI::setZonesCount(int count)                     { zoneTable().setCount(count); }
 void WebUI::compactZonesAfterDelete(int deletedIdx, int newCount) {
-  if (deletedIdx < 0) return;
-  Preferences p;
-  if (!p.begin(NS_ZONES, false)) return;
-
-  for (int k = deletedIdx; k < newCount; ++k) {
-    String src = String("z") + String(k+1) + "_";
-    uint32_t vol  = p.getUInt ((src + "vol").c_str(),  0);
-    uint32_t time = p.getUInt ((src + "time").c_str(), 0);
-    uint8_t  f1   = p.getUChar((src + "f1").c_str(),   0);
-    uint8_t  f2   = p.getUChar((src + "f2").c_str(),   0);
-
-    String dst = String("z") + String(k) + "_";
-    p.putUInt ((dst + "vol").c_str(),  vol);
-    p.putUInt ((dst + "time").c_str(), time);
-    p.putUChar((dst + "f1").c_str(),   f1);
-    p.putUChar((dst + "f2").c_str(),   f2);
-  }
-
-  String last = String("z") + String(newCount) + "_";
-  p.remove((last + "vol").c_str());
-  p.remove((last + "time").c_str());
-  p.remove((last + "f1").c_str());
-  p.remove((last + "f2").c_str());
-
-  p.putInt("count", newCount);
-  p.end();
+  zoneTable().compactAfterDelete(deletedIdx, newCount);
 }
 
 /* ===================== ESTADOS (tabla) ===================== */
@@ -94,8 +26,6 @@ void WebUI::handleStatesList() {
   int numM = counts.first;
   int numS = counts.second;
 
-  setZonesCount((int)st.size());
-
   String s = htmlHeader(F("Estados"));
   s += F("<h3>Estados de relés</h3>");
   s += F("<p>Cada fila es un <b>estado</b>; cada columna un relé. Marca los que deben encenderse en ese estado.</p>");
@@ -149,17 +79,24 @@ void WebUI::handleStatesList() {
     s += F("</td></tr>");
   }
 
-  // fila para agregar
-  s += F("<tr><td>+</td><td>");
-  s += F("<form class='rowform' method='post' action='/states/save'>");
-  s += F("<input type='hidden' name='idx' value='-1'>");
-  s += F("<input name='name' placeholder='Nuevo estado' style='min-width:140px'>");
-  s += F("</td><td><input type='checkbox' name='always'>");
-  s += F("</td><td><input type='checkbox' name='a12'>");
-  for (int i=0;i<numM;i++){ s += F("</td><td><input type='checkbox' name='m"); s += String(i); s += F("'>"); }
-  for (int j=0;j<numS;j++){ s += F("</td><td><input type='checkbox' name='s"); s += String(j); s += F("'>"); }
-  s += F("</td><td><button class='btn'>Agregar</button></td></tr>");
-  s += F("</form>");
+  // fila para agregar (ZoneTable guarda objetivos de MAX_ZONES zonas como máximo)
+  const bool full = st.size() >= (size_t)ZoneTable::MAX_ZONES;
+  if (full) {
+    s += F("<tr><td colspan='99'><small>Máximo de ");
+    s += String(ZoneTable::MAX_ZONES);
+    s += F(" estados alcanzado: elimina uno para agregar otro.</small></td></tr>");
+  } else {
+    s += F("<tr><td>+</td><td>");
+    s += F("<form class='rowform' method='post' action='/states/save'>");
+    s += F("<input type='hidden' name='idx' value='-1'>");
+    s += F("<input name='name' placeholder='Nuevo estado' style='min-width:140px'>");
+    s += F("</td><td><input type='checkbox' name='always'>");
+    s += F("</td><td><input type='checkbox' name='a12'>");
+    for (int i=0;i<numM;i++){ s += F("</td><td><input type='checkbox' name='m"); s += String(i); s += F("'>"); }
+    for (int j=0;j<numS;j++){ s += F("</td><td><input type='checkbox' name='s"); s += String(j); s += F("'>"); }
+    s += F("</td><td><button class='btn'>Agregar</button></td></tr>");
+    s += F("</form>");
+  }
 
   s += F("</table>");
   s += htmlFooter();
@@ -188,7 +125,14 @@ void WebUI::handleStatesSave() {
   for (int j=0;j<numS;j++) if (server_.hasArg("s"+String(j))) sm |= (1u<<j);
   rs.mainsMask = mm; rs.secsMask = sm;
 
+  if (idx >= 0 && idx < (int)st.size()) rs.flowLph = st[idx].flowLph;   // se edita en /states/edit
   if (idx >= 0 && idx < (int)st.size()) st[idx] = rs;
+  else if (st.size() >= (size_t)ZoneTable::MAX_ZONES) {
+    // Un estado más no tendría objetivos en ZoneTable: se rechaza aquí
+    server_.send(400, F("text/plain; charset=utf-8"),
+                 String(F("Máximo de ")) + String(ZoneTable::MAX_ZONES) + F(" estados"));
+    return;
+  }
   else st.push_back(rs);
 
   bool ok = setStates_(st);
@@ -220,12 +164,14 @@ void WebUI::handleStatesDelete() {
 /* ===================== DETALLE DE ZONA ===================== */
 void WebUI::handleStateEdit() {
   int idx = server_.hasArg("idx") ? server_.arg("idx").toInt() : -1;
-  if (idx < 0) { server_.send(400, F("text/plain"), F("idx inválido")); return; }
+  if (idx < 0 || idx >= ZoneTable::MAX_ZONES) { server_.send(400, F("text/plain"), F("idx inválido")); return; }
 
   String zoneName = String("Zona ") + String(idx);
+  int flowLph = -1;   // -1 = zona sin RelayState (no se muestra)
   if (getStates_) {
     auto v = getStates_();
     if (idx >= 0 && idx < (int)v.size() && v[idx].name.length()) zoneName = v[idx].name;
+    if (idx >= 0 && idx < (int)v.size()) flowLph = v[idx].flowLph;
   }
 
   ZoneParams zp; loadZoneParams(idx, zp);
@@ -251,6 +197,12 @@ void WebUI::handleStateEdit() {
   s += String(zp.timeMs);
   s += F("'> ms</p>");
 
+  if (flowLph >= 0) {
+    s += F("<p>Caudal esperado: <input type='number' name='lph' min='0' max='65535' step='1' value='");
+    s += String(flowLph);
+    s += F("'> L/h <small>(riego concurrente; 0 = la zona corre sola)</small></p>");
+  }
+
   s += F("<p>p_fert_1 (0–100%): <input type='range' id='p1r' min='0' max='100' value='");
   s += String(zp.fert1Pct);
   s += F("' oninput='p1v.value=this.value'> ");
@@ -275,7 +227,11 @@ void WebUI::handleStateEdit() {
 
 void WebUI::handleStateEditSave() {
   int idx = server_.hasArg("idx") ? server_.arg("idx").toInt() : -1;
-  if (idx < 0) { server_.send(400, F("text/plain"), F("idx inválido")); return; }
+  if (idx < 0 || idx >= ZoneTable::MAX_ZONES) {
+    server_.send(400, F("text/plain; charset=utf-8"),
+                 String(F("idx inválido (zonas 0..")) + String(ZoneTable::MAX_ZONES - 1) + F(")"));
+    return;
+  }
 
   ZoneParams z;
   z.volumeMl = server_.hasArg("vol") ? (uint32_t)strtoul(server_.arg("vol").c_str(), nullptr, 10) : 0;
@@ -283,7 +239,20 @@ void WebUI::handleStateEditSave() {
   z.fert1Pct = server_.hasArg("p1")  ? (uint8_t)constrain(server_.arg("p1").toInt(), 0, 100) : 0;
   z.fert2Pct = server_.hasArg("p2")  ? (uint8_t)constrain(server_.arg("p2").toInt(), 0, 100) : 0;
 
-  (void)saveZoneParams(idx, z);
+  if (!saveZoneParams(idx, z)) {
+    server_.send(500, F("text/plain; charset=utf-8"), F("No se pudo guardar la zona (NVS)"));
+    return;
+  }
+
+  // Caudal esperado: vive en el RelayState (hidráulica del empaquetado concurrente)
+  if (server_.hasArg("lph") && getStates_ && setStates_) {
+    std::vector<RelayState> st = getStates_();
+    if (idx < (int)st.size()) {
+      st[idx].flowLph = (uint16_t)constrain(server_.arg("lph").toInt(), 0, 65535);
+      (void)setStates_(st);
+    }
+  }
+
   server_.sendHeader(F("Location"), "/states");
   server_.send(302, F("text/plain"), "");
 }
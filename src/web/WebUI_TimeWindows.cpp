@@ -1,6 +1,7 @@
 // File: src/web/WebUI_TimeWindows.cpp
 #include "web/WebUI.h"
 #include <Preferences.h>
+#include "schedule/WindowIndex.h"
 
 // ========== Persistencia ==========
 
@@ -16,6 +17,7 @@ bool WebUI::loadTimeWindows(std::vector<TimeWindow>& out) {
     w.sm   = p.getUChar ((String("w")+i+"_sm").c_str(), 0);
     w.eh   = p.getUChar ((String("w")+i+"_eh").c_str(), 0);
     w.em   = p.getUChar ((String("w")+i+"_em").c_str(), 0);
+    w.dowMask = p.getUChar((String("w")+i+"_dow").c_str(), 0x7F);   // franjas antiguas: todos los días
     out.push_back(w);
   }
   p.end();
@@ -35,17 +37,47 @@ bool WebUI::saveTimeWindows(const std::vector<TimeWindow>& v) {
     p.putUChar ((String("w")+i+"_sm").c_str(),   w.sm);
     p.putUChar ((String("w")+i+"_eh").c_str(),   w.eh);
     p.putUChar ((String("w")+i+"_em").c_str(),   w.em);
+    p.putUChar ((String("w")+i+"_dow").c_str(),  w.dowMask);
   }
   p.end();
+  rebuildWindowIndex_(v);
   return true;
 }
 
+void WebUI::rebuildWindowIndex_(const std::vector<TimeWindow>& v) {
+  static WindowIndex::Window tmp[WindowIndex::MAX_WINDOWS];   // sólo la WebUI construye
+  int n = 0;
+  for (const auto& w : v) {
+    if (n >= WindowIndex::MAX_WINDOWS) break;
+    WindowIndex::Window& d = tmp[n++];
+    d.startMin = (uint16_t)(w.sh * 60 + w.sm);
+    d.endMin   = (uint16_t)(w.eh * 60 + w.em);
+    d.dowMask  = w.dowMask;
+    strncpy(d.name, w.name.c_str(), sizeof(d.name) - 1);
+    d.name[sizeof(d.name) - 1] = '\0';
+  }
+  windowIndex().build(tmp, n);
+}
+
 // ---- helpers ----
 static inline int minutesOf(uint8_t h, uint8_t m) { return ((int)h)*60 + (int)m; }
 
+static const char* const DOW_SHORT[7] = { "L","M","X","J","V","S","D" };
+
+// Casillas d0..d6 (Lun..Dom)
+static void appendDowChecks_(String& s, uint8_t mask) {
+  for (int d = 0; d < 7; ++d) {
+    s += F("<label style='margin-right:4px'><input type='checkbox' name='d"); s += String(d); s += F("'");
+    if (mask & (1 << d)) s += F(" checked");
+    s += F(">"); s += DOW_SHORT[d]; s += F("</label>");
+  }
+}
+
 // Intervalo semi-abierto [start, end), sin wrap nocturno (no se permite cruzar medianoche).
-// NO hay solape si un intervalo termina exactamente cuando el otro empieza.
+// NO hay solape si un intervalo termina exactamente cuando el otro empieza,
+// ni si las franjas no comparten ningún día de la semana.
 bool WebUI::windowsOverlap(const TimeWindow& a, const TimeWindow& b) const {
+  if ((a.dowMask & b.dowMask & 0x7F) == 0) return false;
   int as = minutesOf(a.sh,a.sm), ae = minutesOf(a.eh,a.em);
   int bs = minutesOf(b.sh,b.sm), be = minutesOf(b.eh,b.em);
 
@@ -59,6 +91,7 @@ bool WebUI::windowsOverlap(const TimeWindow& a, const TimeWindow& b) const {
 bool WebUI::validateNoOverlap(const std::vector<TimeWindow>& v, const TimeWindow& cand, int ignoreIndex) const {
   int cs = minutesOf(cand.sh,cand.sm), ce = minutesOf(cand.eh,cand.em);
   if (cs >= ce) return false; // rango inválido
+  if ((cand.dowMask & 0x7F) == 0) return false; // sin días
 
   for (size_t i=0;i<v.size();++i) {
     if ((int)i == ignoreIndex) continue;
@@ -75,12 +108,12 @@ void WebUI::handleWindowsPage() {
 
   String s = htmlHeader(F("Franjas horarias"));
   s += F("<h3>Franjas horarias</h3>");
-  s += F("<p>Cada franja tiene <b>nombre</b>, <b>hora inicio</b> y <b>hora fin</b>. "
-         "No se permiten solapes ni rangos invertidos (no cruza medianoche).</p>");
+  s += F("<p>Cada franja tiene <b>nombre</b>, <b>hora inicio</b>, <b>hora fin</b> y <b>días</b>. "
+         "No se permiten solapes (en días comunes) ni rangos invertidos (no cruza medianoche).</p>");
 
   s += F("<table><tr>"
          "<th>#</th><th>Nombre</th>"
-         "<th>Inicio (HH:MM)</th><th>Fin (HH:MM)</th><th>Acciones</th>"
+         "<th>Inicio (HH:MM)</th><th>Fin (HH:MM)</th><th>Días</th><th>Acciones</th>"
          "</tr>");
 
   // Filas existentes (editables)
@@ -99,6 +132,8 @@ void WebUI::handleWindowsPage() {
     s += F("<input name='eh' type='number' min='0' max='23' value='"); s += String((int)w.eh); s += F("' style='width:60px'>:");
     s += F("<input name='em' type='number' min='0' max='59' value='"); s += String((int)w.em); s += F("' style='width:60px'>");
     s += F("</td><td>");
+    appendDowChecks_(s, w.dowMask);
+    s += F("</td><td>");
     s += F("<button class='btn'>Guardar</button> ");
     s += F("</form> ");
     s += F("<form class='rowform' method='post' action='/windows/delete' onsubmit='return confirm(\"¿Eliminar franja?\")'>");
@@ -118,6 +153,8 @@ void WebUI::handleWindowsPage() {
   s += F("</td><td>");
   s += F("<input name='eh' type='number' min='0' max='23' value='6' style='width:60px'>:");
   s += F("<input name='em' type='number' min='0' max='59' value='0' style='width:60px'>");
+  s += F("</td><td>");
+  appendDowChecks_(s, 0x7F);
   s += F("</td><td><button class='btn'>Agregar</button></td></tr>");
   s += F("</form>");
 
@@ -135,6 +172,8 @@ void WebUI::handleWindowsSave() {
   w.sm = (uint8_t)constrain(server_.hasArg("sm") ? server_.arg("sm").toInt() : 0, 0, 59);
   w.eh = (uint8_t)constrain(server_.hasArg("eh") ? server_.arg("eh").toInt() : 0, 0, 23);
   w.em = (uint8_t)constrain(server_.hasArg("em") ? server_.arg("em").toInt() : 0, 0, 59);
+  w.dowMask = 0;
+  for (int d = 0; d < 7; ++d) if (server_.hasArg(String("d") + d)) w.dowMask |= (uint8_t)(1 << d);
 
   if (w.name.length() == 0) {
     server_.send(400, F("text/plain"), F("Nombre vacío"));
@@ -146,7 +185,7 @@ void WebUI::handleWindowsSave() {
 
   // Validación anti-solape y rango válido
   if (!validateNoOverlap(ws, w, idx)) {
-    server_.send(400, F("text/plain"), F("Franja solapada o rango inválido (inicio < fin, sin cruzar medianoche)."));
+    server_.send(400, F("text/plain"), F("Franja solapada, sin días o rango inválido (inicio < fin, sin cruzar medianoche)."));
     return;
   }
 
@@ -6,48 +6,24 @@
 #include <time.h>              // hora local
 #include "../time/TimeSync.h"  // getTimeSyncInfo()
 #include "hw/RelayPins.h"      // mapa de pines del proyecto
+#include "schedule/WindowIndex.h" // franjas por día en RAM
+#include "modes/modes.h"           // estado filtrado del selector físico
 
 /* ======== Namespaces NVS usados localmente en este TU ======== */
 static const char* NS_MODE     = "mode";       // coincide con WebUI_Mode.cpp y main.cpp
-static const char* NS_WINDOWS  = "windows";    // coincide con WebUI_TimeWindows.cpp
 static const char* NS_WIFI     = "wifi_saved"; // coincide con main.cpp (autoconexión)
 
 /* ================= Helpers GPIO (solo para Home) ================= */
 
-static bool vecContains_(const std::vector<int>& v, int x){ for(int p: v) if(p==x) return true; return false; }
-
-static bool mainActiveLowOf_(int pin, bool& outAL, int& outIdx) {
-  for (int i=0;i<RP::NUM_MAINS;i++){
-    if (RP::MAIN_PINS[i]==pin){ outAL = RP::MAIN_ACTIVE_LOW[i]; outIdx = i; return true; }
-  }
-  return false;
-}
-static bool secActiveLowOf_(int pin, bool& outAL, int& outIdx) {
-  for (int j=0;j<RP::NUM_SECS;j++){
-    if (RP::SEC_PINS[j]==pin){ outAL = RP::SEC_ACTIVE_LOW[j]; outIdx = j; return true; }
-  }
-  return false;
-}
-
+// Rol/polaridad por pin: tabla generada en compilación desde Board.h (O(1))
 static String roleOf_(int pin, bool& hasAL, bool& al) {
-  hasAL=false; al=false;
-  int idx=-1;
-  if (mainActiveLowOf_(pin, al, idx)) { hasAL=true; return String(F("MAIN["))+String(idx)+F("]"); }
-  if (secActiveLowOf_(pin,  al, idx)) { hasAL=true; return String(F("SEC[" ))+String(idx)+F("]"); }
-  if (pin==RP::PIN_ALWAYS_ON)    { hasAL=false; return F("ALWAYS_ON"); }
-  if (pin==RP::PIN_ALWAYS_ON_12) { hasAL=false; return F("ALWAYS_ON_12"); }
-  if (pin==RP::PIN_TOGGLE_NEXT)  { hasAL=false; return F("TOGGLE_NEXT"); }
-  if (pin==RP::PIN_TOGGLE_PREV)  { hasAL=false; return F("TOGGLE_PREV"); }
-  if (pin==RP::PIN_FLOW_1)       { hasAL=false; return F("FLOW_1"); }
-  if (pin==RP::PIN_FLOW_2)       { hasAL=false; return F("FLOW_2"); }
-  if (pin==RP::PIN_SWITCH_MANUAL){ hasAL=false; return F("SWITCH_MANUAL"); }
-  if (pin==RP::PIN_NEXT)         { hasAL=false; return F("BTN_NEXT"); }
-  if (pin==RP::PIN_PREV)         { hasAL=false; return F("BTN_PREV"); }
-  return F("-");
+  const RP::PinRole& r = RP::roleOf(pin);
+  hasAL = r.hasAL; al = r.activeLow;
+  if (r.role == RP::Role::MAIN || r.role == RP::Role::SEC)
+    return String(RP::roleName(r.role)) + F("[") + String(r.idx) + F("]");
+  return String(RP::roleName(r.role));
 }
 
-static bool isFlashPin_(int pin) { return (pin>=6 && pin<=11); } // evitar pines del flash
-
 static String interpFromAL_(int level, bool hasAL, bool al) {
   if (!hasAL) return F("—");
   bool on = al ? (level==LOW) : (level==HIGH);
@@ -56,14 +32,9 @@ static String interpFromAL_(int level, bool hasAL, bool al) {
 
 // Dirección inferida por rol (sin driver IDF)
 static String dirOf_(int pin) {
-  bool dummyAL; int dummyIdx;
-  if (mainActiveLowOf_(pin, dummyAL, dummyIdx)) return F("OUT");
-  if (secActiveLowOf_(pin,  dummyAL, dummyIdx)) return F("OUT");
-  if (pin==RP::PIN_ALWAYS_ON || pin==RP::PIN_ALWAYS_ON_12 ||
-      pin==RP::PIN_TOGGLE_NEXT || pin==RP::PIN_TOGGLE_PREV) return F("OUT");
-  if (pin==RP::PIN_FLOW_1 || pin==RP::PIN_FLOW_2 ||
-      pin==RP::PIN_SWITCH_MANUAL || pin==RP::PIN_NEXT || pin==RP::PIN_PREV) return F("IN");
-  return F("—");
+  const RP::PinRole& r = RP::roleOf(pin);
+  if (r.role == RP::Role::NONE) return F("—");
+  return r.output ? F("OUT") : F("IN");
 }
 
 // Formatea “Xh Ym Zs” a partir de milisegundos
@@ -85,16 +56,6 @@ static int firstSetBit_(uint16_t mask) {
   return -1;
 }
 
-// Asegura que los pines ENTRADA tengan pulls correctos para LEER en Home
-static void ensureInputReadConfig_() {
-  if (RP::PIN_SWITCH_MANUAL >= 0) pinMode(RP::PIN_SWITCH_MANUAL, INPUT_PULLDOWN);
-  if (RP::PIN_NEXT          >= 0) pinMode(RP::PIN_NEXT,          INPUT_PULLUP);
-  if (RP::PIN_PREV          >= 0) pinMode(RP::PIN_PREV,          INPUT_PULLDOWN);
-  // Caudalímetros (pull-up externo): INPUT “flotante” sin PULL interno
-  if (RP::PIN_FLOW_1        >= 0) pinMode(RP::PIN_FLOW_1,        INPUT);
-  if (RP::PIN_FLOW_2        >= 0) pinMode(RP::PIN_FLOW_2,        INPUT);
-}
-
 /* ====================== HOME ====================== */
 void WebUI::handleRoot() {
   String s = htmlHeader(F("Home"));
@@ -106,9 +67,6 @@ void WebUI::handleRoot() {
   s += F("<li><a href='/wifi/saved'>Redes guardadas / autoconexión</a></li>");
   s += F("<li><a href='/mqtt'>MQTT (config, estado, chat)</a></li></ul>");
 
-  // Configura entradas antes de leer el switch físico
-  ensureInputReadConfig_();
-
   // ====== Bloque: Estado de modo + Hora local + Próxima ventana ======
   {
     // --- Modo desde NVS (override/software) ---
@@ -121,9 +79,8 @@ void WebUI::handleRoot() {
         p.end();
       }
     }
-    // --- Modo desde hardware (switch físico): HIGH=MANUAL, LOW=AUTO ---
-    bool hwManual = false;
-    if (RP::PIN_SWITCH_MANUAL >= 0) hwManual = (digitalRead(RP::PIN_SWITCH_MANUAL) == HIGH);
+    // --- Modo desde hardware (switch físico, ya filtrado por InputService) ---
+    const bool hwManual = modesSwitchManual();
 
     // --- Modo efectivo ---
     bool effManual = ovr ? manual : hwManual;
@@ -148,50 +105,23 @@ void WebUI::handleRoot() {
       lastSyncTxt = F("nunca");
     }
 
-    // --- Ventanas desde NVS (NS_WINDOWS="windows") ---
-    struct Win { uint8_t sh, sm, eh, em; };
-    std::vector<Win> wins;
-    {
-      Preferences p;
-      if (p.begin(NS_WINDOWS, /*ro*/ true)) {
-        uint8_t cnt = p.getUChar("count", 0);
-        for (uint8_t i = 0; i < cnt && i < 60; ++i) {
-          Win w;
-          w.sh = p.getUChar((String("w")+i+"_sh").c_str(), 0);
-          w.sm = p.getUChar((String("w")+i+"_sm").c_str(), 0);
-          w.eh = p.getUChar((String("w")+i+"_eh").c_str(), 0);
-          w.em = p.getUChar((String("w")+i+"_em").c_str(), 0);
-          int smin = (int)w.sh*60 + (int)w.sm;
-          int emin = (int)w.eh*60 + (int)w.em;
-          if (smin < emin) wins.push_back(w); // solo rangos válidos en el mismo día
-        }
-        p.end();
-      }
-    }
+    // --- Ventanas desde el índice en RAM (schedule/WindowIndex.h) ---
+    const WindowIndex::Snapshot& wins = windowIndex().snapshot();
 
     String nextText = F("Sin franjas configuradas");
+    int deltaMin = -1;
+    const WindowIndex::Window* nextW = nullptr;
     if (timeValid && !wins.empty()) {
+      nextW = wins.next(WindowIndex::dowOf(lt), lt.tm_hour * 60 + lt.tm_min, deltaMin);
+    }
+    if (nextW) {
       int md = lt.tm_hour * 60 + lt.tm_min;  // minuto del día
-      bool inside = false;
-      int  curEnd = 1e9;
-      int  nextStart = 1e9;
-      int  firstStart = 1e9;
-
-      for (const auto& w : wins) {
-        int smin = (int)w.sh*60 + (int)w.sm;
-        int emin = (int)w.eh*60 + (int)w.em;
-        if (smin < firstStart) firstStart = smin;
-        if (md >= smin && md < emin) { inside = true; if (emin < curEnd) curEnd = emin; }
-        if (smin > md && smin < nextStart) nextStart = smin;
-      }
-      // Si no hay otra ventana hoy, la próxima es mañana al primer inicio
-      if (nextStart == 1e9) nextStart = firstStart + 1440;
-
-      int deltaMin = nextStart - md;
-      if (deltaMin < 0) deltaMin += 1440; // seguridad
+      const WindowIndex::Window* cur = wins.current(WindowIndex::dowOf(lt), md);
+      bool inside = (cur != nullptr);
+      int  curEnd = inside ? (int)cur->endMin : md;
 
-      int nsH = (nextStart % 1440) / 60;
-      int nsM = (nextStart % 1440) % 60;
+      int nsH = nextW->startMin / 60;
+      int nsM = nextW->startMin % 60;
 
       char hhmm[6];
       snprintf(hhmm, sizeof(hhmm), "%02d:%02d", nsH, nsM);
@@ -277,28 +207,15 @@ void WebUI::handleRoot() {
   }
 
   // ================= Tabla GPIO =================
-  // Conjunto de pines relevantes del proyecto (evitamos 6..11 por flash)
-  std::vector<int> pins;
-  // MAIN/SEC
-  for (int i=0;i<RP::NUM_MAINS;i++) if (!vecContains_(pins, RP::MAIN_PINS[i]) && !isFlashPin_(RP::MAIN_PINS[i])) pins.push_back(RP::MAIN_PINS[i]);
-  for (int j=0;j<RP::NUM_SECS; j++) if (!vecContains_(pins, RP::SEC_PINS[j])   && !isFlashPin_(RP::SEC_PINS[j]))   pins.push_back(RP::SEC_PINS[j]);
-  // Control/aux
-  const int extras[] = {
-    RP::PIN_ALWAYS_ON, RP::PIN_ALWAYS_ON_12, RP::PIN_TOGGLE_NEXT, RP::PIN_TOGGLE_PREV,
-    RP::PIN_FLOW_1, RP::PIN_FLOW_2, RP::PIN_SWITCH_MANUAL, RP::PIN_NEXT, RP::PIN_PREV
-  };
-  for (size_t k=0;k<sizeof(extras)/sizeof(extras[0]);++k){
-    int p = extras[k];
-    if (p>=0 && !vecContains_(pins,p) && !isFlashPin_(p)) pins.push_back(p);
-  }
-
+  // Pines del proyecto (Board.h ya garantiza sin repetidos ni 6..11 del flash)
   s += F("<h3>GPIO (dirección y nivel)</h3>");
   s += F("<p><small>La <b>dirección</b> se infiere por el <i>rol</i> configurado en el proyecto (MAIN/SEC y salidas auxiliares = OUT; botones, switch y caudalímetros = IN). "
          "El <b>nivel</b> es lectura directa de <code>digitalRead()</code>. "
          "“Interpretación” usa ActiveLow para MAIN/SEC.</small></p>");
   s += F("<table><tr><th>GPIO</th><th>Rol</th><th>Dir</th><th>Nivel</th><th>AL</th><th>Interpretación</th></tr>");
 
-  for (int pin : pins) {
+  for (int k=0;k<RP::NUM_USED_PINS;k++) {
+    const int pin = RP::USED_PINS.pin[k];
     String dir = dirOf_(pin);
     int level = digitalRead(pin); // seguro para IN y OUT
 